@@ -0,0 +1,38 @@
+#!/bin/bash
+#
+# bench.sh - crawl a generated site served by siteserver on the loopback
+# interface, and report the crawler's throughput and fetch latency.
+#
+# Settings come from the environment:
+#   PORT       port to serve on (default 8099)
+#   PAGES      pages in the site (default 2000)
+#   FANOUT     links on each page (default 8)
+#   BYTES      size of each page (default 8192)
+#   LATENCY    milliseconds the server holds back each response (default 2)
+#   CRAWLARGS  options for the crawler (default "-a 32")
+#
+# Sajjad C Kareem - November 26, 2023
+
+PORT=${PORT:-8099}
+PAGES=${PAGES:-2000}
+FANOUT=${FANOUT:-8}
+BYTES=${BYTES:-8192}
+LATENCY=${LATENCY:-2}
+CRAWLARGS=${CRAWLARGS:--a 32}
+PREFIX=http://127.0.0.1:$PORT/
+
+./siteserver -p "$PORT" -n "$PAGES" -f "$FANOUT" -s "$BYTES" -l "$LATENCY" &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null' EXIT
+
+# Wait for the server to take connections
+for try in $(seq 50); do
+    (exec 3<>/dev/tcp/127.0.0.1/"$PORT") 2>/dev/null && break
+    sleep 0.1
+done
+
+rm -rf data && mkdir -p data
+echo "Crawling ${PREFIX}1.html with: $CRAWLARGS"
+../crawler/crawler -r 0 --report -p "$PREFIX" $CRAWLARGS "${PREFIX}1.html" data 100 2>&1 >/dev/null \
+    | grep -E "^(Throughput|Fetch latency)"
+echo "Pages saved: $(ls data | grep -c '^[0-9]') of $PAGES"
@@ -0,0 +1,393 @@
+/*
+ * siteserver.c    Sajjad C Kareem    November 26, 2023
+ *
+ * This file contains a small HTTP/1.1 server that stands in for the
+ * CS50 web site, so that the crawler can be run and timed offline.
+ * It serves either a generated site, of pages numbered 1 to n with a
+ * given number of links and size each, or the files of a directory,
+ * and may hold each response back for a given latency.
+ * Functions include:
+ *     - parseArgs: Validate and parse the command-line arguments.
+ *     - serveConnection: Answer the requests on one connection.
+ *     - generatePage: Build the HTML of one page of the generated site.
+ *     - readPage: Read a file of the served directory.
+ *     - asksToClose: Check a request for "Connection: close".
+ *     - sendAll: Write a whole buffer to a socket.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/*
+ * siteConfig_t: What the server serves, as given on the command line.
+ *
+ * Fields:
+ * - port: The port to listen on, on the loopback address (-p).
+ * - numPages: Pages in the generated site (-n).
+ * - fanout: Links on each generated page (-f).
+ * - pageBytes: Size of each generated page (-s).
+ * - latency: Seconds to hold back each response (-l, given in ms).
+ * - directory: The directory to serve instead of the generated site (-d), or NULL.
+ */
+typedef struct
+{
+    int port;
+    int numPages;
+    int fanout;
+    int pageBytes;
+    double latency;
+    const char* directory;
+} siteConfig_t;
+
+/*
+ * connection_t: A connection accepted, handed to the thread that serves it.
+ */
+typedef struct
+{
+    int sock;
+    const siteConfig_t* config;
+} connection_t;
+
+static const size_t MAX_REQUEST = 16384;    // longest request accepted
+static const char* WORDS[] = {
+    "search", "engine", "crawler", "index", "query", "page", "link", "word",
+    "tiny", "web", "server", "client", "socket", "thread", "buffer", "memory",
+    "hash", "table", "tree", "graph", "node", "edge", "depth", "breadth",
+    "alpha", "beta", "gamma", "delta", "epsilon", "zeta", "theta", "lambda",
+    "dartmouth", "college", "computer", "science", "systems", "program", "design", "test",
+    "apple", "banana", "cherry", "grape", "lemon", "mango", "orange", "peach",
+    "river", "mountain", "forest", "ocean", "desert", "valley", "island", "meadow",
+    "red", "green", "blue", "yellow", "purple", "silver", "golden", "violet"
+};
+static const int NUM_WORDS = sizeof(WORDS) / sizeof(WORDS[0]);
+
+/* Function declarations */
+static void parseArgs(int argc, char* argv[], siteConfig_t* config);
+static void* serveConnection(void* arg);
+static char* generatePage(const siteConfig_t* config, int pageNum, size_t* len);
+static char* readPage(const siteConfig_t* config, const char* path, size_t* len);
+static bool asksToClose(const char* request);
+static bool sendAll(int sock, const char* buf, size_t len);
+
+int main(int argc, char* argv[])
+{
+    siteConfig_t config;
+    parseArgs(argc, argv, &config);
+    signal(SIGPIPE, SIG_IGN);                       // a crawler that hangs up must not kill us
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listener < 0 || bind(listener, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(listener, 128) < 0)
+    {
+        perror("siteserver");
+        exit(2);
+    }
+    if (config.directory != NULL)
+    {
+        fprintf(stderr, "Serving %s on http://127.0.0.1:%d/\n", config.directory, config.port);
+    } else {
+        fprintf(stderr, "Serving %d pages of %d bytes with %d links each on http://127.0.0.1:%d/\n",
+                config.numPages, config.pageBytes, config.fanout, config.port);
+    }
+
+    /* One thread per connection; the crawler keeps few, and reuses them */
+    while (true)
+    {
+        int sock = accept(listener, NULL, NULL);
+        if (sock < 0)
+        {
+            continue;
+        }
+        // The headers and body go out in two writes, which Nagle's algorithm would hold apart
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        connection_t* conn = malloc(sizeof(connection_t));
+        pthread_t thread;
+        if (conn == NULL)
+        {
+            close(sock);
+            continue;
+        }
+        conn->sock = sock;
+        conn->config = &config;
+        if (pthread_create(&thread, NULL, serveConnection, conn) != 0)
+        {
+            close(sock);
+            free(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return 0;
+}
+
+/*
+ * parseArgs: Fills in config from the command line, or prints the usage
+ * and exits non-zero if any option is invalid.
+ */
+static void parseArgs(int argc, char* argv[], siteConfig_t* config)
+{
+    const char* usage = "Usage: ./siteserver [-p port] [-n pages] [-f fanout] [-s bytes] [-l ms] [-d directory]\n";
+    config->port = 8099;
+    config->numPages = 1000;
+    config->fanout = 8;
+    config->pageBytes = 8192;
+    config->latency = 0;
+    config->directory = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:n:f:s:l:d:")) != -1)
+    {
+        char* end = NULL;
+        long value = (opt != 'd' && optarg != NULL) ? strtol(optarg, &end, 10) : 0;
+        bool valid = (opt == 'd') || (end != NULL && end != optarg && *end == '\0');
+        if (opt == 'p' && valid && value > 0 && value < 65536)
+        {
+            config->port = value;
+        } else if (opt == 'n' && valid && value > 0 && value <= 100000000) {
+            config->numPages = value;
+        } else if (opt == 'f' && valid && value >= 0 && value <= 1000) {
+            config->fanout = value;
+        } else if (opt == 's' && valid && value > 0 && value <= 100000000) {
+            config->pageBytes = value;
+        } else if (opt == 'l' && valid && value >= 0 && value <= 60000) {
+            config->latency = value / 1000.0;
+        } else if (opt == 'd') {
+            config->directory = optarg;
+        } else {
+            fprintf(stderr, "%s", usage);
+            exit(1);
+        }
+    }
+    if (optind != argc)
+    {
+        fprintf(stderr, "%s", usage);
+        exit(1);
+    }
+}
+
+/*
+ * serveConnection: Answers the GET requests on one connection until the
+ * client closes it or asks to; each response is framed by Content-Length.
+ * Frees the connection_t it is given.
+ */
+static void* serveConnection(void* arg)
+{
+    connection_t* conn = arg;
+    const siteConfig_t* config = conn->config;
+    char* request = malloc(MAX_REQUEST + 1);
+    size_t len = 0;
+    bool keepOpen = (request != NULL);
+
+    while (keepOpen)
+    {
+        /* Read up to the blank line that ends the request's headers */
+        char* end;
+        request[len] = '\0';
+        while ((end = strstr(request, "\r\n\r\n")) == NULL)
+        {
+            ssize_t n = (len < MAX_REQUEST) ? recv(conn->sock, request + len, MAX_REQUEST - len, 0) : -1;
+            if (n <= 0)
+            {
+                break;
+            }
+            len += n;
+            request[len] = '\0';
+        }
+        if (end == NULL)
+        {
+            break;
+        }
+
+        char path[1024];
+        int minor = 0;
+        if (sscanf(request, "GET %1023s HTTP/1.%d", path, &minor) != 2)
+        {
+            break;
+        }
+        *end = '\0';
+        keepOpen = (minor >= 1) && !asksToClose(request);
+
+        if (config->latency > 0)
+        {
+            struct timespec delay = { (time_t) config->latency,
+                                      (long) ((config->latency - (time_t) config->latency) * 1e9) };
+            nanosleep(&delay, NULL);
+        }
+
+        size_t bodyLen = 0;
+        char* body = NULL;
+        if (config->directory != NULL)
+        {
+            body = readPage(config, path, &bodyLen);
+        } else {
+            int pageNum = 0;
+            char extra;
+            if (strcmp(path, "/") == 0)
+            {
+                pageNum = 1;
+            } else if (sscanf(path, "/%d.htm%c", &pageNum, &extra) != 2 || extra != 'l') {
+                pageNum = 0;
+            }
+            if (pageNum >= 1 && pageNum <= config->numPages)
+            {
+                body = generatePage(config, pageNum, &bodyLen);
+            }
+        }
+
+        char header[256];
+        int headerLen = sprintf(header, "HTTP/1.1 %s\r\nContent-Type: text/html\r\nContent-Length: %zu\r\n%s\r\n",
+                                body != NULL ? "200 OK" : "404 Not Found", bodyLen,
+                                keepOpen ? "" : "Connection: close\r\n");
+        if (!sendAll(conn->sock, header, headerLen) || !sendAll(conn->sock, body, bodyLen))
+        {
+            keepOpen = false;
+        }
+        free(body);
+
+        // Keep any bytes of the next request already read
+        size_t used = end + 4 - request;
+        memmove(request, request + used, len - used);
+        len -= used;
+    }
+
+    free(request);
+    close(conn->sock);
+    free(conn);
+    return NULL;
+}
+
+/*
+ * generatePage: Returns the HTML of page pageNum of the generated site,
+ * and sets *len to its length.  Page i links to pages i*f - f + 2
+ * through i*f + 1 (wrapping around past the last page), so every page
+ * is reachable from page 1 in about log_f(n) steps; the rest of the
+ * page is text drawn from WORDS, the same for the same page every time.
+ * Returns NULL if out of memory.
+ */
+static char* generatePage(const siteConfig_t* config, int pageNum, size_t* len)
+{
+    size_t cap = config->pageBytes + config->fanout * 48 + 256;
+    char* html = malloc(cap);
+    if (html == NULL)
+    {
+        return NULL;
+    }
+
+    size_t n = sprintf(html, "<html>\n<head><title>Page %d</title></head>\n<body>\n", pageNum);
+    for (int i = 0; i < config->fanout; i++)
+    {
+        long target = ((long) (pageNum - 1) * config->fanout + i + 1) % config->numPages + 1;
+        n += sprintf(html + n, "<a href=\"%ld.html\">page %ld</a>\n", target, target);
+    }
+
+    uint64_t seed = pageNum;
+    while (n + 32 < (size_t) config->pageBytes)
+    {
+        // splitmix64, so each page's text is the same every time it is served
+        seed += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        n += sprintf(html + n, "%s%s", WORDS[z % NUM_WORDS], (z >> 32) % 12 == 0 ? ".\n" : " ");
+    }
+    n += sprintf(html + n, "\n</body>\n</html>\n");
+    *len = n;
+    return html;
+}
+
+/*
+ * readPage: Returns the contents of the file at path under the served
+ * directory (its index.html, if path names a directory), and sets *len
+ * to its length; or NULL if there is no such file or path climbs out
+ * of the directory.
+ */
+static char* readPage(const siteConfig_t* config, const char* path, size_t* len)
+{
+    if (strstr(path, "..") != NULL)
+    {
+        return NULL;
+    }
+    char file[strlen(config->directory) + strlen(path) + 16];
+    sprintf(file, "%s%s", config->directory, path);
+    struct stat st;
+    if (stat(file, &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        strcat(file, "/index.html");
+    }
+
+    FILE* fp = fopen(file, "r");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+    char* html = NULL;
+    if (fstat(fileno(fp), &st) == 0 && (html = malloc(st.st_size + 1)) != NULL)
+    {
+        *len = fread(html, 1, st.st_size, fp);
+        html[*len] = '\0';
+    }
+    fclose(fp);
+    return html;
+}
+
+/*
+ * asksToClose: Returns true if the request's headers include a
+ * Connection header whose value is "close", ignoring case.
+ */
+static bool asksToClose(const char* request)
+{
+    for (const char* line = strstr(request, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n"))
+    {
+        if (strncasecmp(line + 2, "Connection:", strlen("Connection:")) == 0)
+        {
+            const char* value = line + 2 + strlen("Connection:");
+            while (*value == ' ')
+            {
+                value++;
+            }
+            return strncasecmp(value, "close", strlen("close")) == 0;
+        }
+    }
+    return false;
+}
+
+/*
+ * sendAll: Writes len bytes at buf to the socket.
+ * Returns false if the connection failed first.
+ */
+static bool sendAll(int sock, const char* buf, size_t len)
+{
+    for (size_t sent = 0; sent < len; )
+    {
+        ssize_t n = send(sock, buf + sent, len - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
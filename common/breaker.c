@@ -0,0 +1,179 @@
+/*
+ * breaker.c    Sajjad C Kareem    December 6, 2023
+ *
+ * This file contains the implementation of the per-host circuit breaker.
+ * Functions include:
+ *     - breaker_new: Create a breaker with the given threshold and cooldown.
+ *     - breaker_allow: Check whether a fetch from a host may go ahead.
+ *     - breaker_report: Record how a fetch from a host went.
+ *     - breaker_trips: Count the times a circuit has opened.
+ *     - breaker_delete: Free the breaker.
+ *
+ * Each host's circuit is kept in a hashtable keyed by host name, as the
+ * politeness scheduler keeps its buckets.  A circuit is open while
+ * openUntil lies in the future; once it has passed, the first fetch
+ * allowed marks the circuit as probing, which holds off all others until
+ * the probe is reported.
+ *
+ * See breaker.h for more information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "../libcs50/hashtable.h"
+#include "breaker.h"
+
+/**************** local constants ****************/
+static const int MAX_DOUBLINGS = 4;        // an open circuit waits at most 2^4 cooldowns
+
+/**************** local types ****************/
+typedef struct circuit
+{
+    int failures;               // fetches in a row with no answer
+    int opened;                 // times opened since the host last answered
+    double openUntil;           // when an open circuit may be probed, or 0 if closed
+    bool probing;               // whether a probe is under way
+} circuit_t;
+
+typedef struct breaker
+{
+    hashtable_t* circuits;      // host -> circuit_t
+    int threshold;
+    double cooldown;
+    long trips;
+    pthread_mutex_t lock;       // guards the circuits and trips
+} breaker_t;
+
+/**************** local functions ****************/
+static double now(void);
+
+/**************** breaker_new() ****************/
+/* see breaker.h for description */
+breaker_t* breaker_new(int threshold, double cooldown)
+{
+    if (threshold < 1 || cooldown <= 0)
+    {
+        return NULL;
+    }
+
+    breaker_t* breaker = malloc(sizeof(breaker_t));
+    if (breaker == NULL)
+    {
+        return NULL;
+    }
+    breaker->circuits = hashtable_new(16);
+    if (breaker->circuits == NULL)
+    {
+        free(breaker);
+        return NULL;
+    }
+    breaker->threshold = threshold;
+    breaker->cooldown = cooldown;
+    breaker->trips = 0;
+    pthread_mutex_init(&breaker->lock, NULL);
+    return breaker;
+}
+
+/**************** breaker_allow() ****************/
+/* see breaker.h for description */
+bool breaker_allow(breaker_t* breaker, const char* host)
+{
+    if (breaker == NULL || host == NULL)
+    {
+        return true;
+    }
+
+    bool allowed = true;
+    pthread_mutex_lock(&breaker->lock);
+    circuit_t* circuit = hashtable_find(breaker->circuits, host);
+    if (circuit != NULL && circuit->openUntil > 0)
+    {
+        allowed = !circuit->probing && now() >= circuit->openUntil;
+        if (allowed)
+        {
+            circuit->probing = true;
+        }
+    }
+    pthread_mutex_unlock(&breaker->lock);
+    return allowed;
+}
+
+/**************** breaker_report() ****************/
+/* see breaker.h for description */
+void breaker_report(breaker_t* breaker, const char* host, bool answered)
+{
+    if (breaker == NULL || host == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&breaker->lock);
+    circuit_t* circuit = hashtable_find(breaker->circuits, host);
+    if (circuit == NULL && !answered)
+    {
+        // A host is only tracked once it has failed; most never do
+        circuit = malloc(sizeof(circuit_t));
+        if (circuit != NULL)
+        {
+            *circuit = (circuit_t) { 0, 0, 0, false };
+            hashtable_insert(breaker->circuits, host, circuit);
+        }
+    }
+
+    if (circuit != NULL && answered)
+    {
+        *circuit = (circuit_t) { 0, 0, 0, false };
+    } else if (circuit != NULL) {
+        circuit->failures++;
+        // A failed probe opens the circuit again, as does the threshold reached
+        if (circuit->probing || (circuit->openUntil == 0 && circuit->failures >= breaker->threshold))
+        {
+            int doublings = (circuit->opened < MAX_DOUBLINGS) ? circuit->opened : MAX_DOUBLINGS;
+            circuit->openUntil = now() + breaker->cooldown * (1 << doublings);
+            circuit->opened++;
+            circuit->probing = false;
+            breaker->trips++;
+        }
+    }
+    pthread_mutex_unlock(&breaker->lock);
+}
+
+/**************** breaker_trips() ****************/
+/* see breaker.h for description */
+long breaker_trips(breaker_t* breaker)
+{
+    if (breaker == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&breaker->lock);
+    long trips = breaker->trips;
+    pthread_mutex_unlock(&breaker->lock);
+    return trips;
+}
+
+/**************** breaker_delete() ****************/
+/* see breaker.h for description */
+void breaker_delete(breaker_t* breaker)
+{
+    if (breaker != NULL)
+    {
+        hashtable_delete(breaker->circuits, free);
+        pthread_mutex_destroy(&breaker->lock);
+        free(breaker);
+    }
+}
+
+/*
+ * now: Returns the current monotonic time in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,56 @@
+#ifndef __BREAKER_H
+#define __BREAKER_H
+
+#include <stdbool.h>
+
+/*
+ * breaker - a per-host circuit breaker for crawler requests
+ *
+ * A host that is down costs every fetch from it a full set of connection
+ * attempts and timeouts, and a crawl may hold thousands of its pages.
+ * The breaker counts each host's fetches that failed in a row (with no
+ * answer at all); after `threshold` of them the host's circuit opens, and
+ * fetches from it fail at once, without touching the network, for
+ * `cooldown` seconds.  After that a single fetch is let through as a
+ * probe: if it is answered the circuit closes again, and if not it opens
+ * for twice as long as before, up to 16 times the cooldown.
+ *
+ * Any function may be given a NULL breaker, which lets every fetch through.
+ * The breaker is safe to share between threads.
+ */
+typedef struct breaker breaker_t;
+
+/*
+ * Create a new breaker.
+ * Takes threshold: failed fetches in a row that open a host's circuit (at least 1).
+ * Takes cooldown: seconds the circuit first stays open (positive).
+ * Returns pointer to the breaker, or NULL if any error.
+ * Caller is responsible for later calling breaker_delete.
+ */
+breaker_t* breaker_new(int threshold, double cooldown);
+
+/*
+ * Returns true if a fetch from host may go ahead: its circuit is closed,
+ * or has been open its full cooldown and no probe is yet under way, in
+ * which case this fetch is the probe.  Every fetch allowed must be
+ * followed by a breaker_report for the host.
+ */
+bool breaker_allow(breaker_t* breaker, const char* host);
+
+/*
+ * Report how a fetch from host that was allowed went: answered, whatever
+ * the status, or not answered at all.
+ */
+void breaker_report(breaker_t* breaker, const char* host, bool answered);
+
+/*
+ * Returns the number of times any host's circuit has opened.
+ */
+long breaker_trips(breaker_t* breaker);
+
+/*
+ * Delete the breaker.
+ */
+void breaker_delete(breaker_t* breaker);
+
+#endif //__BREAKER_H
@@ -0,0 +1,152 @@
+/*
+ * connpool.c    Sajjad C Kareem    November 9, 2023
+ *
+ * This file contains the implementation of the keep-alive connection pool.
+ * Functions include:
+ *     - connpool_new: Create an empty pool.
+ *     - connpool_get: Take an idle connection to a host.
+ *     - connpool_put: Give back an idle connection.
+ *     - connpool_delete: Close all idle connections and free the pool.
+ *
+ * The pool is a list of idle connections, most recently returned first.
+ * Crawls are restricted to one host, so the list is short and a linear
+ * search by host and port is all the lookup needs.
+ *
+ * See connpool.h for more information.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "connpool.h"
+
+/**************** local types ****************/
+typedef struct idleconn
+{
+    char* host;
+    int port;
+    int sock;
+    struct idleconn* next;
+} idleconn_t;
+
+typedef struct connpool
+{
+    idleconn_t* idle;           // idle connections, most recent first
+    int numIdle;
+    int maxIdle;
+    pthread_mutex_t lock;       // guards all of the above
+} connpool_t;
+
+/**************** connpool_new() ****************/
+/* see connpool.h for description */
+connpool_t* connpool_new(int maxIdle)
+{
+    if (maxIdle < 0)
+    {
+        return NULL;
+    }
+
+    connpool_t* pool = malloc(sizeof(connpool_t));
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+    pool->idle = NULL;
+    pool->numIdle = 0;
+    pool->maxIdle = maxIdle;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+/**************** connpool_get() ****************/
+/* see connpool.h for description */
+int connpool_get(connpool_t* pool, const char* host, const int port)
+{
+    if (pool == NULL || host == NULL)
+    {
+        return -1;
+    }
+
+    int sock = -1;
+    pthread_mutex_lock(&pool->lock);
+    for (idleconn_t** prev = &pool->idle; *prev != NULL; prev = &(*prev)->next)
+    {
+        idleconn_t* conn = *prev;
+        if (conn->port == port && strcmp(conn->host, host) == 0)
+        {
+            *prev = conn->next;
+            pool->numIdle--;
+            sock = conn->sock;
+            free(conn->host);
+            free(conn);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return sock;
+}
+
+/**************** connpool_put() ****************/
+/* see connpool.h for description */
+void connpool_put(connpool_t* pool, const char* host, const int port, int sock)
+{
+    if (sock < 0)
+    {
+        return;
+    }
+
+    bool kept = false;
+    idleconn_t* conn;
+    if (pool != NULL && host != NULL && (conn = malloc(sizeof(idleconn_t))) != NULL)
+    {
+        conn->host = malloc(strlen(host) + 1);
+        conn->port = port;
+        conn->sock = sock;
+
+        pthread_mutex_lock(&pool->lock);
+        if (conn->host != NULL && pool->numIdle < pool->maxIdle)
+        {
+            strcpy(conn->host, host);
+            conn->next = pool->idle;
+            pool->idle = conn;
+            pool->numIdle++;
+            kept = true;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        if (!kept)
+        {
+            free(conn->host);
+            free(conn);
+        }
+    }
+
+    // Either there was no room in the pool, or no pool at all
+    if (!kept)
+    {
+        close(sock);
+    }
+}
+
+/**************** connpool_delete() ****************/
+/* see connpool.h for description */
+void connpool_delete(connpool_t* pool)
+{
+    if (pool != NULL)
+    {
+        idleconn_t* conn = pool->idle;
+        while (conn != NULL)
+        {
+            idleconn_t* next = conn->next;
+            close(conn->sock);
+            free(conn->host);
+            free(conn);
+            conn = next;
+        }
+        pthread_mutex_destroy(&pool->lock);
+        free(pool);
+    }
+}
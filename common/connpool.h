@@ -0,0 +1,39 @@
+#ifndef __CONNPOOL_H
+#define __CONNPOOL_H
+
+/*
+ * connpool - a thread-safe pool of idle HTTP keep-alive connections
+ *
+ * Each connection is held as a connected socket, keyed by the host and
+ * port it is connected to.  A fetch takes a connection out of the pool,
+ * and puts it back only once the response has been read in full, so a
+ * pooled connection is always idle.
+ */
+typedef struct connpool connpool_t;
+
+/*
+ * Create a new, empty pool holding at most maxIdle idle connections.
+ * Returns pointer to the pool, or NULL if any error.
+ * Caller is responsible for later calling connpool_delete.
+ */
+connpool_t* connpool_new(int maxIdle);
+
+/*
+ * Take an idle connection to host:port out of the pool.
+ * Returns the connection's socket, which the caller now owns, or -1 if
+ * the pool has none (or pool is NULL).
+ */
+int connpool_get(connpool_t* pool, const char* host, const int port);
+
+/*
+ * Return an idle connection to host:port to the pool for reuse.
+ * If the pool is NULL or full, the connection is closed instead.
+ */
+void connpool_put(connpool_t* pool, const char* host, const int port, int sock);
+
+/*
+ * Close every idle connection and delete the pool.
+ */
+void connpool_delete(connpool_t* pool);
+
+#endif //__CONNPOOL_H
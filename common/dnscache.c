@@ -0,0 +1,471 @@
+/*
+ * dnscache.c    Sajjad C Kareem    November 14, 2023
+ *
+ * This file contains the implementation of the hostname lookup cache.
+ * Functions include:
+ *     - dnscache_new: Create a cache and start its resolver threads.
+ *     - dnscache_prefetch: Queue a background lookup of a host.
+ *     - dnscache_lookup: Look up a host, waiting for the answer if needed.
+ *     - dnscache_tryLookup: Look up a host without waiting.
+ *     - dnscache_stats: Report the hit and miss counts.
+ *     - dnscache_delete: Stop the resolver threads and free the cache.
+ *
+ * Each host has an entry in a hashtable, which is either RESOLVING (some
+ * thread is looking it up; others wait on the `done` condition) or
+ * RESOLVED (holding the answer until it expires).  Background lookups are
+ * queued in a FIFO list served by the resolver threads.
+ *
+ * See dnscache.h for more information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "../libcs50/hashtable.h"
+#include "dnscache.h"
+
+/**************** local constants ****************/
+#define MAX_ADDRS 8                         // addresses kept per host
+static const double NEGATIVE_TTL = 10;      // longest time a failed lookup is kept
+
+/**************** local types ****************/
+typedef enum { RESOLVING, RESOLVED } entryState_t;
+
+typedef struct entry
+{
+    entryState_t state;
+    struct sockaddr_in addrs[MAX_ADDRS];    // port is filled in per lookup
+    int numAddrs;                           // 0 if the host did not resolve
+    double expires;                         // when a RESOLVED entry goes stale
+} entry_t;
+
+typedef struct request
+{
+    char* host;
+    struct request* next;
+} request_t;
+
+typedef struct dnscache
+{
+    hashtable_t* entries;       // host -> entry_t
+    double ttl;
+    request_t* head;            // queue of background lookups
+    request_t* tail;
+    pthread_t* resolvers;
+    int numResolvers;
+    bool stopping;              // set by dnscache_delete
+    long hits;
+    long misses;
+    pthread_mutex_t lock;       // guards everything above
+    pthread_cond_t work;        // the queue is non-empty, or stopping
+    pthread_cond_t done;        // an entry has been resolved
+} dnscache_t;
+
+/**************** local functions ****************/
+static int doLookup(dnscache_t* cache, const char* host, int port,
+                    struct sockaddr_in* addrs, int maxAddrs, bool wait);
+static entry_t* claimEntry(dnscache_t* cache, const char* host);
+static void unclaimEntry(dnscache_t* cache, entry_t* entry);
+static bool enqueue(dnscache_t* cache, const char* host);
+static void* resolverThread(void* arg);
+static int resolve(const char* host, struct sockaddr_in* addrs);
+static void storeAnswer(dnscache_t* cache, entry_t* entry, struct sockaddr_in* addrs, int numAddrs);
+static int copyAnswer(const struct sockaddr_in* from, int numFrom, int port,
+                      struct sockaddr_in* addrs, int maxAddrs);
+static double now(void);
+
+/**************** dnscache_new() ****************/
+/* see dnscache.h for description */
+dnscache_t* dnscache_new(double ttl, int numResolvers)
+{
+    if (ttl <= 0 || numResolvers < 0)
+    {
+        return NULL;
+    }
+
+    dnscache_t* cache = malloc(sizeof(dnscache_t));
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+    cache->entries = hashtable_new(16);
+    cache->resolvers = calloc(numResolvers + 1, sizeof(pthread_t));
+    if (cache->entries == NULL || cache->resolvers == NULL)
+    {
+        hashtable_delete(cache->entries, NULL);
+        free(cache->resolvers);
+        free(cache);
+        return NULL;
+    }
+    cache->ttl = ttl;
+    cache->head = cache->tail = NULL;
+    cache->stopping = false;
+    cache->hits = cache->misses = 0;
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->work, NULL);
+    pthread_cond_init(&cache->done, NULL);
+
+    // Run with however many resolvers could be started
+    cache->numResolvers = 0;
+    while (cache->numResolvers < numResolvers
+           && pthread_create(&cache->resolvers[cache->numResolvers], NULL, resolverThread, cache) == 0)
+    {
+        cache->numResolvers++;
+    }
+    return cache;
+}
+
+/**************** dnscache_prefetch() ****************/
+/* see dnscache.h for description */
+void dnscache_prefetch(dnscache_t* cache, const char* host)
+{
+    if (cache == NULL || host == NULL || cache->numResolvers == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    entry_t* entry = hashtable_find(cache->entries, host);
+    if (entry == NULL || (entry->state == RESOLVED && entry->expires <= now()))
+    {
+        entry = claimEntry(cache, host);
+        if (entry != NULL && !enqueue(cache, host))
+        {
+            unclaimEntry(cache, entry);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**************** dnscache_lookup() ****************/
+/* see dnscache.h for description */
+int dnscache_lookup(dnscache_t* cache, const char* host, int port,
+                    struct sockaddr_in* addrs, int maxAddrs)
+{
+    return doLookup(cache, host, port, addrs, maxAddrs, true);
+}
+
+/**************** dnscache_tryLookup() ****************/
+/* see dnscache.h for description */
+int dnscache_tryLookup(dnscache_t* cache, const char* host, int port,
+                       struct sockaddr_in* addrs, int maxAddrs)
+{
+    return doLookup(cache, host, port, addrs, maxAddrs, false);
+}
+
+/**************** dnscache_stats() ****************/
+/* see dnscache.h for description */
+void dnscache_stats(dnscache_t* cache, long* hits, long* misses)
+{
+    long h = 0, m = 0;
+    if (cache != NULL)
+    {
+        pthread_mutex_lock(&cache->lock);
+        h = cache->hits;
+        m = cache->misses;
+        pthread_mutex_unlock(&cache->lock);
+    }
+    if (hits != NULL)
+    {
+        *hits = h;
+    }
+    if (misses != NULL)
+    {
+        *misses = m;
+    }
+}
+
+/**************** dnscache_delete() ****************/
+/* see dnscache.h for description */
+void dnscache_delete(dnscache_t* cache)
+{
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stopping = true;
+    pthread_cond_broadcast(&cache->work);
+    pthread_mutex_unlock(&cache->lock);
+    for (int i = 0; i < cache->numResolvers; i++)
+    {
+        pthread_join(cache->resolvers[i], NULL);
+    }
+
+    while (cache->head != NULL)
+    {
+        request_t* next = cache->head->next;
+        free(cache->head->host);
+        free(cache->head);
+        cache->head = next;
+    }
+    hashtable_delete(cache->entries, free);
+    free(cache->resolvers);
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->work);
+    pthread_cond_destroy(&cache->done);
+    free(cache);
+}
+
+/*
+ * doLookup: Look up host for dnscache_lookup (wait is true) or
+ * dnscache_tryLookup (wait is false).
+ *
+ * A fresh cached answer is a hit.  Otherwise, if nobody is resolving the
+ * host yet, a waiting caller resolves it itself, and a non-waiting one hands
+ * it to the resolver threads; if somebody already is, a waiting caller waits
+ * for them to finish.
+ */
+static int doLookup(dnscache_t* cache, const char* host, int port,
+                    struct sockaddr_in* addrs, int maxAddrs, bool wait)
+{
+    struct sockaddr_in found[MAX_ADDRS];
+    if (host == NULL || addrs == NULL || maxAddrs < 1)
+    {
+        return 0;
+    }
+    if (cache == NULL)
+    {
+        int numFound = resolve(host, found);
+        return copyAnswer(found, numFound, port, addrs, maxAddrs);
+    }
+    wait = wait || cache->numResolvers == 0;
+
+    pthread_mutex_lock(&cache->lock);
+    entry_t* entry = hashtable_find(cache->entries, host);
+    if (entry != NULL && entry->state == RESOLVED && entry->expires > now())
+    {
+        cache->hits++;
+        int n = copyAnswer(entry->addrs, entry->numAddrs, port, addrs, maxAddrs);
+        pthread_mutex_unlock(&cache->lock);
+        return n;
+    }
+
+    if (entry == NULL || entry->state == RESOLVED)
+    {
+        // Missing or stale: this caller starts the lookup
+        cache->misses++;
+        entry = claimEntry(cache, host);
+        if (!wait && entry != NULL && enqueue(cache, host))
+        {
+            pthread_mutex_unlock(&cache->lock);
+            return -1;
+        }
+        pthread_mutex_unlock(&cache->lock);
+
+        int numFound = resolve(host, found);
+        if (entry != NULL)
+        {
+            pthread_mutex_lock(&cache->lock);
+            storeAnswer(cache, entry, found, numFound);
+            pthread_mutex_unlock(&cache->lock);
+        }
+        return copyAnswer(found, numFound, port, addrs, maxAddrs);
+    }
+
+    // Being resolved by another thread
+    if (!wait)
+    {
+        pthread_mutex_unlock(&cache->lock);
+        return -1;
+    }
+    cache->misses++;
+    while (entry->state == RESOLVING)
+    {
+        pthread_cond_wait(&cache->done, &cache->lock);
+    }
+    int n = copyAnswer(entry->addrs, entry->numAddrs, port, addrs, maxAddrs);
+    pthread_mutex_unlock(&cache->lock);
+    return n;
+}
+
+/*
+ * claimEntry: Mark host's entry RESOLVING, creating it if need be.
+ * Caller holds the lock.  Returns the entry, or NULL if out of memory.
+ */
+static entry_t* claimEntry(dnscache_t* cache, const char* host)
+{
+    entry_t* entry = hashtable_find(cache->entries, host);
+    if (entry == NULL)
+    {
+        entry = malloc(sizeof(entry_t));
+        if (entry == NULL || !hashtable_insert(cache->entries, host, entry))
+        {
+            free(entry);
+            return NULL;
+        }
+        entry->numAddrs = 0;
+        entry->expires = 0;
+    }
+    entry->state = RESOLVING;
+    return entry;
+}
+
+/*
+ * unclaimEntry: Give up resolving a claimed entry, leaving it stale so
+ * the next lookup resolves it, and wake any threads waiting for it.
+ * Caller holds the lock.
+ */
+static void unclaimEntry(dnscache_t* cache, entry_t* entry)
+{
+    entry->expires = 0;
+    entry->state = RESOLVED;
+    pthread_cond_broadcast(&cache->done);
+}
+
+/*
+ * enqueue: Add host to the back of the queue of background lookups,
+ * and wake a resolver.  Caller holds the lock, and has claimed the entry.
+ * Returns false if out of memory, leaving the lookup to the caller.
+ */
+static bool enqueue(dnscache_t* cache, const char* host)
+{
+    request_t* request = malloc(sizeof(request_t));
+    char* copy = malloc(strlen(host) + 1);
+    if (request == NULL || copy == NULL)
+    {
+        free(request);
+        free(copy);
+        return false;
+    }
+    strcpy(copy, host);
+    request->host = copy;
+    request->next = NULL;
+    if (cache->tail == NULL)
+    {
+        cache->head = request;
+    } else {
+        cache->tail->next = request;
+    }
+    cache->tail = request;
+    pthread_cond_signal(&cache->work);
+    return true;
+}
+
+/*
+ * resolverThread: Serve the queue of background lookups until the
+ * cache is deleted.
+ */
+static void* resolverThread(void* arg)
+{
+    dnscache_t* cache = arg;
+    struct sockaddr_in found[MAX_ADDRS];
+
+    pthread_mutex_lock(&cache->lock);
+    while (true)
+    {
+        while (cache->head == NULL && !cache->stopping)
+        {
+            pthread_cond_wait(&cache->work, &cache->lock);
+        }
+        if (cache->stopping)
+        {
+            break;
+        }
+
+        request_t* request = cache->head;
+        cache->head = request->next;
+        if (cache->head == NULL)
+        {
+            cache->tail = NULL;
+        }
+
+        // Resolve without the lock, so other hosts are served meanwhile
+        pthread_mutex_unlock(&cache->lock);
+        int numFound = resolve(request->host, found);
+        pthread_mutex_lock(&cache->lock);
+
+        entry_t* entry = hashtable_find(cache->entries, request->host);
+        if (entry != NULL)
+        {
+            storeAnswer(cache, entry, found, numFound);
+        }
+        free(request->host);
+        free(request);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return NULL;
+}
+
+/*
+ * resolve: Look up the IPv4 addresses of host with getaddrinfo,
+ * which is safe to call from several threads.
+ * Fills in up to MAX_ADDRS addresses, and returns how many.
+ */
+static int resolve(const char* host, struct sockaddr_in* addrs)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* result;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0)
+    {
+        return 0;
+    }
+
+    int n = 0;
+    for (struct addrinfo* ai = result; ai != NULL && n < MAX_ADDRS; ai = ai->ai_next)
+    {
+        if (ai->ai_family == AF_INET && ai->ai_addrlen == sizeof(struct sockaddr_in))
+        {
+            memcpy(&addrs[n++], ai->ai_addr, sizeof(struct sockaddr_in));
+        }
+    }
+    freeaddrinfo(result);
+    return n;
+}
+
+/*
+ * storeAnswer: Record the result of resolving an entry, and wake any
+ * threads waiting for it.  Caller holds the lock.
+ */
+static void storeAnswer(dnscache_t* cache, entry_t* entry, struct sockaddr_in* addrs, int numAddrs)
+{
+    memcpy(entry->addrs, addrs, numAddrs * sizeof(struct sockaddr_in));
+    entry->numAddrs = numAddrs;
+    if (numAddrs > 0)
+    {
+        entry->expires = now() + cache->ttl;
+    } else {
+        entry->expires = now() + (cache->ttl < NEGATIVE_TTL ? cache->ttl : NEGATIVE_TTL);
+    }
+    entry->state = RESOLVED;
+    pthread_cond_broadcast(&cache->done);
+}
+
+/*
+ * copyAnswer: Copy up to maxAddrs of the numFrom addresses into addrs,
+ * setting their port.  Returns the number copied.
+ */
+static int copyAnswer(const struct sockaddr_in* from, int numFrom, int port,
+                      struct sockaddr_in* addrs, int maxAddrs)
+{
+    int n = (numFrom < maxAddrs) ? numFrom : maxAddrs;
+    for (int i = 0; i < n; i++)
+    {
+        addrs[i] = from[i];
+        addrs[i].sin_port = htons(port);
+    }
+    return n;
+}
+
+/*
+ * now: Returns the current monotonic time in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
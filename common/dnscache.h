@@ -0,0 +1,71 @@
+#ifndef __DNSCACHE_H
+#define __DNSCACHE_H
+
+#include <stdbool.h>
+#include <netinet/in.h>
+
+/*
+ * dnscache - a thread-safe cache of hostname lookups for the crawler
+ *
+ * Every fetch needs the address of its host, and a crawl fetches from the
+ * same few hosts over and over; the cache resolves each host once with
+ * getaddrinfo and keeps the answer for ttl seconds (a failed lookup is
+ * remembered for a shorter time, so a bad host is not looked up again on
+ * every retry).  getaddrinfo does not report the DNS record's own TTL, so
+ * the caller chooses one.
+ *
+ * Lookups may also be started ahead of time with dnscache_prefetch: a small
+ * pool of resolver threads performs them in the background, so that by the
+ * time a page is fetched its host is usually already in the cache.
+ *
+ * Any function may be given a NULL cache, in which case lookups go straight
+ * to getaddrinfo and nothing is cached.
+ */
+typedef struct dnscache dnscache_t;
+
+/*
+ * Create a new cache keeping answers for ttl seconds (ttl > 0), served by
+ * numResolvers background threads (0 for none, in which case prefetching
+ * does nothing and every miss is resolved by the caller).
+ * Returns pointer to the cache, or NULL if any error.
+ * Caller is responsible for later calling dnscache_delete.
+ */
+dnscache_t* dnscache_new(double ttl, int numResolvers);
+
+/*
+ * Start looking up host in the background, unless it is already cached
+ * or being looked up.  Never blocks on the network.
+ */
+void dnscache_prefetch(dnscache_t* cache, const char* host);
+
+/*
+ * Look up the IPv4 addresses of host, filling in up to maxAddrs entries
+ * of addrs with the given port already set.
+ * Waits for the answer if it is not yet cached.
+ * Returns the number of addresses filled in; 0 if host cannot be resolved.
+ */
+int dnscache_lookup(dnscache_t* cache, const char* host, int port,
+                    struct sockaddr_in* addrs, int maxAddrs);
+
+/*
+ * Like dnscache_lookup, but never waits: if the answer is not yet cached,
+ * a background lookup is started (as by dnscache_prefetch) and -1 is returned,
+ * so the caller can try again later.  With a NULL cache, or one without
+ * resolver threads, it behaves as dnscache_lookup.
+ */
+int dnscache_tryLookup(dnscache_t* cache, const char* host, int port,
+                       struct sockaddr_in* addrs, int maxAddrs);
+
+/*
+ * Report how many lookups were answered from the cache (hits), and how many
+ * had to wait for or start a lookup (misses).  Prefetches are not counted.
+ */
+void dnscache_stats(dnscache_t* cache, long* hits, long* misses);
+
+/*
+ * Delete the cache, stopping its resolver threads; lookups still queued
+ * are abandoned.
+ */
+void dnscache_delete(dnscache_t* cache);
+
+#endif //__DNSCACHE_H
@@ -0,0 +1,879 @@
+/*
+ * fetch.c    Sajjad C Kareem    November 2, 2023
+ *
+ * This file contains a reentrant replacement for webpage_fetch so the
+ * crawler can fetch pages from several threads at once.
+ * Functions include:
+ *     - fetch_html: Fetch the body of a page over HTTP/1.1, reusing
+ *                   keep-alive connections from a pool and pacing
+ *                   requests with a politeness scheduler and looking
+ *                   up hosts through a DNS cache.
+ *     - fetch_conditional: Fetch a page only if it has changed.
+ *     - fetch_backoff: Choose the wait before another attempt.
+ *     - fetch_freeValidators: Free a page's validators.
+ *     - fetch_headerValue: Find a header among a response's headers.
+ *     - fetch_decodeBody: Take the body out of a response wholly received.
+ *     - fetch_splitURL: Split a URL into host, port and path.
+ *
+ * Sockets connect without blocking, so that a connection attempt can be
+ * abandoned at its deadline, and are then waited on with poll before
+ * each recv, never for longer than the deadline of the phase at hand.
+ *
+ * See fetch.h for more information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE                    // memmem
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "fetch.h"
+
+/**************** local constants ****************/
+static const int MAX_TRY = 3;          // maximum attempts to connect
+static const int HTTP_PORT = 80;       // default web server port
+#define MAX_ADDRS 4                    // addresses of a host to try
+static const char HTTP_SCHEME[] = "http://";
+static const size_t INITIAL_RESPONSE = 16384;  // first size of the receive buffer
+static const size_t MIN_RECV = 4096;           // least room to offer each recv
+
+/**************** local types ****************/
+/*
+ * recvbuf_t: The bytes of a response received so far, kept
+ * null-terminated so that the headers can be searched as a string.
+ */
+typedef struct recvbuf
+{
+    int sock;
+    double deadline;            // when to give up waiting for more, or 0 for never
+    char* data;
+    size_t len;                 // bytes received
+    size_t cap;                 // bytes allocated, always more than len
+} recvbuf_t;
+
+/**************** local functions ****************/
+static int connectToHost(const char* host, const int port, dnscache_t* dns, double deadline,
+                         fetchtimes_t* times);
+static bool connectWithin(int sock, const struct sockaddr_in* addr, double deadline);
+static bool sendRequest(int sock, const char* host, const char* path, bool keepAlive,
+                        const fetchvalidators_t* have);
+static char* readResponse(int sock, double firstByteDeadline, double deadline, int* code, bool* reusable,
+                          fetchvalidators_t* got, fetchtimes_t* times);
+static bool awaitReadable(int sock, double deadline);
+static double deadlineOf(double timeout, double limit);
+static void sleepFor(double seconds);
+static double now(void);
+static bool recvMore(recvbuf_t* buf);
+static bool recvUntil(recvbuf_t* buf, size_t len);
+static char* readLength(recvbuf_t* buf, size_t start, size_t length, bool* exact);
+static long readChunked(recvbuf_t* buf, size_t start, bool* exact);
+static long recvLine(recvbuf_t* buf, size_t pos);
+static bool headerIs(const char* line, const char* name);
+static bool headerHas(const char* line, const char* name, const char* word);
+
+/**************** fetch_html() ****************/
+/* see fetch.h for description */
+char* fetch_html(const char* url, const fetchopts_t* opts)
+{
+    int status;
+    return fetch_conditional(url, opts, NULL, NULL, &status, NULL);
+}
+
+/**************** fetch_conditional() ****************/
+/* see fetch.h for description */
+char* fetch_conditional(const char* url, const fetchopts_t* opts, const fetchvalidators_t* have,
+                        fetchvalidators_t* got, int* status, fetchtimes_t* times)
+{
+    if (got != NULL)
+    {
+        got->etag = NULL;
+        got->lastModified = NULL;
+    }
+    *status = 0;
+    fetchtimes_t ignored;
+    if (times == NULL)
+    {
+        times = &ignored;
+    }
+    double start = now();
+    *times = (fetchtimes_t) { 0, -1, -1, -1, -1, -1 };
+    if (url == NULL)
+    {
+        return NULL;
+    }
+
+    char host[256];
+    int port;
+    const char* path;
+    if (!fetch_splitURL(url, host, sizeof(host), &port, &path))
+    {
+        return NULL;
+    }
+    connpool_t* pool = (opts != NULL) ? opts->connections : NULL;
+    politeness_t* polite = (opts != NULL) ? opts->politeness : NULL;
+    dnscache_t* dns = (opts != NULL) ? opts->dns : NULL;
+    breaker_t* breaker = (opts != NULL) ? opts->breaker : NULL;
+    const fetchlimits_t* limits = (opts != NULL) ? opts->limits : NULL;
+    fetchlimits_t none = { 0, 0, 0, MAX_TRY, 0 };
+    if (limits == NULL)
+    {
+        limits = &none;
+    }
+    if (!breaker_allow(breaker, host))
+    {
+        *status = FETCH_HOST_DOWN;
+        times->total = now() - start;
+        return NULL;
+    }
+
+    /* Reuse an idle connection if we have one; the server may have closed it
+     * while it sat in the pool, in which case we fall back to a new one.
+     * The fetch's deadline runs from when it is first allowed to go ahead */
+    int sock = connpool_get(pool, host, port);
+    int code = 0;
+    bool reusable = false;
+    char* html = NULL;
+    double deadline = 0;
+    if (sock >= 0)
+    {
+        double waitStart = now();
+        politeness_wait(polite, host);
+        times->wait += now() - waitStart;
+        deadline = deadlineOf(limits->totalTimeout, 0);
+        if (sendRequest(sock, host, path, true, have))
+        {
+            html = readResponse(sock, deadlineOf(limits->firstByteTimeout, deadline), deadline,
+                                &code, &reusable, got, times);
+        }
+        if (code == 0)
+        {
+            close(sock);
+            sock = -1;
+        }
+    }
+
+    /* Otherwise connect; each attempt that gets no answer is tried again, after
+     * a backoff and its turn with the politeness scheduler, while time remains */
+    int maxTries = (limits->maxTries > 0) ? limits->maxTries : MAX_TRY;
+    for (int try = 0; code == 0 && try < maxTries; try++)
+    {
+        if (try > 0)
+        {
+            double backoff = fetch_backoff(limits, try);
+            if (deadline > 0 && now() + backoff >= deadline)
+            {
+                break;
+            }
+            sleepFor(backoff);
+        }
+        double waitStart = now();
+        politeness_wait(polite, host);
+        times->wait += now() - waitStart;
+        if (deadline == 0)
+        {
+            deadline = deadlineOf(limits->totalTimeout, 0);
+        } else if (now() >= deadline) {
+            break;
+        }
+
+        sock = connectToHost(host, port, dns, deadlineOf(limits->connectTimeout, deadline), times);
+        if (sock >= 0 && sendRequest(sock, host, path, pool != NULL, have))
+        {
+            html = readResponse(sock, deadlineOf(limits->firstByteTimeout, deadline), deadline,
+                                &code, &reusable, got, times);
+        }
+        if (sock >= 0 && code == 0)
+        {
+            free(html);
+            html = NULL;
+            close(sock);
+            sock = -1;
+        }
+    }
+    breaker_report(breaker, host, code != 0);
+
+    if (reusable)
+    {
+        connpool_put(pool, host, port, sock);
+    } else if (sock >= 0) {
+        close(sock);
+    }
+
+    *status = code;
+    times->total = now() - start;
+    if (code != 200)
+    {
+        free(html);
+        return NULL;
+    }
+    return html;
+}
+
+/**************** fetch_backoff() ****************/
+/* see fetch.h for description */
+double fetch_backoff(const fetchlimits_t* limits, int tries)
+{
+    if (limits == NULL || limits->backoff <= 0 || tries < 1)
+    {
+        return 0;
+    }
+    double backoff = limits->backoff;
+    for (int i = 1; i < tries && i < 30; i++)
+    {
+        backoff *= 2;
+    }
+
+    // "Equal jitter": half the backoff, plus a random part of the other half;
+    // the clock's nanoseconds seed it, so each thread draws its own
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    unsigned int seed = (unsigned int) ts.tv_nsec ^ ((unsigned int) tries * 2654435761u);
+    return backoff / 2 + (backoff / 2) * (rand_r(&seed) / (RAND_MAX + 1.0));
+}
+
+/**************** fetch_freeValidators() ****************/
+/* see fetch.h for description */
+void fetch_freeValidators(fetchvalidators_t* validators)
+{
+    if (validators != NULL)
+    {
+        free(validators->etag);
+        free(validators->lastModified);
+        validators->etag = NULL;
+        validators->lastModified = NULL;
+    }
+}
+
+/**************** fetch_headerValue() ****************/
+/* see fetch.h for description */
+char* fetch_headerValue(const char* headers, const char* name)
+{
+    if (headers == NULL || name == NULL)
+    {
+        return NULL;
+    }
+
+    const char* line = headers;
+    while (*line != '\0' && *line != '\r' && *line != '\n')
+    {
+        const char* end = line + strcspn(line, "\r\n");
+        if (headerIs(line, name))
+        {
+            const char* start = line + strlen(name) + 1;
+            while (start < end && isspace((unsigned char) *start))
+            {
+                start++;
+            }
+            while (end > start && isspace((unsigned char) end[-1]))
+            {
+                end--;
+            }
+            char* value = malloc(end - start + 1);
+            if (value != NULL)
+            {
+                memcpy(value, start, end - start);
+                value[end - start] = '\0';
+            }
+            return value;
+        }
+
+        // On to the next line, past its CRLF
+        line = end;
+        if (*line == '\r')
+        {
+            line++;
+        }
+        if (*line == '\n')
+        {
+            line++;
+        }
+    }
+    return NULL;
+}
+
+/**************** fetch_decodeBody() ****************/
+/* see fetch.h for description */
+long fetch_decodeBody(char* response, size_t len)
+{
+    char* headersEnd = (response != NULL) ? strstr(response, "\r\n\r\n") : NULL;
+    if (headersEnd == NULL)
+    {
+        return -1;
+    }
+    const char* headers = strstr(response, "\r\n") + 2;
+    size_t start = headersEnd + 4 - response;
+
+    // Framed as readResponse frames a body from a socket: chunked, by
+    // Content-Length, or running to the end
+    if (headerHas(headers, "Transfer-Encoding", "chunked"))
+    {
+        recvbuf_t buf = { -1, 0, response, len, len + 1 };
+        bool exact;
+        return readChunked(&buf, start, &exact);
+    }
+    size_t bodyLen = len - start;
+    char* length = fetch_headerValue(headers, "Content-Length");
+    if (length != NULL)
+    {
+        char* end;
+        unsigned long value = strtoul(length, &end, 10);
+        bool valid = end != length && *end == '\0' && value <= bodyLen;
+        free(length);
+        if (!valid)
+        {
+            return -1;              // cut short, or no length at all
+        }
+        bodyLen = value;
+    }
+    memmove(response, response + start, bodyLen);
+    response[bodyLen] = '\0';
+    return bodyLen;
+}
+
+/**************** fetch_splitURL() ****************/
+/* see fetch.h for description */
+bool fetch_splitURL(const char* url, char* host, int hostSize, int* port, const char** path)
+{
+    if (url == NULL || host == NULL || port == NULL || path == NULL
+        || strncmp(url, HTTP_SCHEME, strlen(HTTP_SCHEME)) != 0)
+    {
+        return false;
+    }
+
+    const char* hostStart = url + strlen(HTTP_SCHEME);
+    const char* hostEnd = hostStart + strcspn(hostStart, ":/");
+    int hostLen = hostEnd - hostStart;
+    if (hostLen == 0 || hostLen >= hostSize)
+    {
+        return false;
+    }
+    memcpy(host, hostStart, hostLen);
+    host[hostLen] = '\0';
+
+    *port = HTTP_PORT;
+    if (*hostEnd == ':')
+    {
+        char* portEnd;
+        long p = strtol(hostEnd + 1, &portEnd, 10);
+        if (portEnd == hostEnd + 1 || p <= 0 || p > 65535)
+        {
+            return false;
+        }
+        *port = p;
+        hostEnd = portEnd;
+    }
+
+    *path = (*hostEnd == '/') ? hostEnd : "/";
+    return true;
+}
+
+/*
+ * connectToHost: Connect to the given host and port, trying each of
+ * its addresses in turn until the deadline (0 for none); returns the
+ * connected socket, or -1 on failure.  The host is looked up through the
+ * DNS cache.  Sets the dns and connect times.
+ */
+static int connectToHost(const char* host, const int port, dnscache_t* dns, double deadline,
+                         fetchtimes_t* times)
+{
+    double start = now();
+    struct sockaddr_in addrs[MAX_ADDRS];
+    int numAddrs = dnscache_lookup(dns, host, port, addrs, MAX_ADDRS);
+    double resolved = now();
+    times->dns = resolved - start;
+
+    int sock = -1;
+    for (int i = 0; i < numAddrs && sock < 0; i++)
+    {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock >= 0 && !connectWithin(sock, &addrs[i], deadline))
+        {
+            close(sock);
+            sock = -1;
+        }
+    }
+    times->connect = now() - resolved;
+    return sock;
+}
+
+/*
+ * connectWithin: Connect the socket to addr, giving up at the deadline
+ * (0 for none).  The connect is begun without blocking and waited on with
+ * poll; the socket is left blocking, as the rest of a fetch expects.
+ * Returns true if connected.
+ */
+static bool connectWithin(int sock, const struct sockaddr_in* addr, double deadline)
+{
+    int flags = fcntl(sock, F_GETFL);
+    if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        return false;
+    }
+    if (connect(sock, (const struct sockaddr*) addr, sizeof(*addr)) < 0)
+    {
+        if (errno != EINPROGRESS)
+        {
+            return false;
+        }
+        struct pollfd pfd = { sock, POLLOUT, 0 };
+        int ready;
+        do
+        {
+            double left = deadline - now();
+            if (deadline > 0 && left <= 0)
+            {
+                return false;
+            }
+            ready = poll(&pfd, 1, (deadline > 0) ? (int) (left * 1000) + 1 : -1);
+        } while (ready == 0 || (ready < 0 && errno == EINTR));
+
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (ready < 0 || getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+        {
+            return false;
+        }
+    }
+    return fcntl(sock, F_SETFL, flags) == 0;
+}
+
+/*
+ * sendRequest: Write a GET request for path to the socket, asking the
+ * server to keep the connection open or not, and, given the validators
+ * of a copy already held, to send the page only if it has changed since.
+ * Returns true if the whole request was sent.
+ */
+static bool sendRequest(int sock, const char* host, const char* path, bool keepAlive,
+                        const fetchvalidators_t* have)
+{
+    const char* etag = (have != NULL && have->etag != NULL) ? have->etag : NULL;
+    const char* lastModified = (have != NULL && have->lastModified != NULL) ? have->lastModified : NULL;
+    char request[strlen(path) + strlen(host) + (etag ? strlen(etag) : 0)
+                 + (lastModified ? strlen(lastModified) : 0) + 128];
+    int len = sprintf(request, "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n",
+                      path, host, keepAlive ? "keep-alive" : "close");
+    if (etag != NULL)
+    {
+        len += sprintf(request + len, "If-None-Match: %s\r\n", etag);
+    }
+    if (lastModified != NULL)
+    {
+        len += sprintf(request + len, "If-Modified-Since: %s\r\n", lastModified);
+    }
+    len += sprintf(request + len, "\r\n");
+
+    for (int sent = 0; sent < len; )
+    {
+        // MSG_NOSIGNAL: a server that closed an idle connection must not kill us
+        ssize_t n = send(sock, request + sent, len - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+/*
+ * readResponse: Read one complete response from the socket.
+ *
+ * The response is received in large pieces into a buffer that doubles
+ * as it fills, and the headers are parsed where they lie.  A body of
+ * known length goes straight into a buffer of that size; a chunked body
+ * is decoded in place, over the headers, and so is an unframed body,
+ * read until the server closes the socket.
+ *
+ * Sets *code to the HTTP status (0 if no status line could be read), and
+ * *reusable to whether the response was framed by Content-Length or chunked
+ * encoding, ended exactly where the server stopped sending, and the server
+ * did not ask to close, so that the connection is idle and may be kept.
+ * If got is not NULL, fills it in with any ETag and Last-Modified headers.
+ * Sets the firstByte and download times, counting from the call.
+ * Gives up, as on error, if the first byte has not come by firstByteDeadline
+ * or the last by deadline (either 0 for none).
+ *
+ * Returns the body, which the caller must free, or NULL on error; a
+ * "304" or "204" response has an empty body, whatever its headers say.
+ */
+static char* readResponse(int sock, double firstByteDeadline, double deadline, int* code, bool* reusable,
+                          fetchvalidators_t* got, fetchtimes_t* times)
+{
+    *code = 0;
+    *reusable = false;
+
+    double sent = now();
+    double firstByte = 0;
+    recvbuf_t buf = { sock, firstByteDeadline, NULL, 0, 0 };
+    char* headersEnd = NULL;
+    size_t searched = 0;
+    while (headersEnd == NULL)
+    {
+        if (!recvMore(&buf))
+        {
+            free(buf.data);
+            return NULL;
+        }
+        if (firstByte == 0)
+        {
+            firstByte = now();
+            times->firstByte = firstByte - sent;
+            buf.deadline = deadline;
+        }
+        // The blank line may straddle two pieces
+        headersEnd = strstr(buf.data + (searched > 3 ? searched - 3 : 0), "\r\n\r\n");
+        searched = buf.len;
+    }
+
+    int minor;
+    if (sscanf(buf.data, "HTTP/1.%d %d", &minor, code) != 2)
+    {
+        free(buf.data);
+        *code = 0;
+        return NULL;
+    }
+
+    /* Headers run from after the status line to the blank line; HTTP/1.1 keeps the connection by default */
+    bool keepAlive = (minor >= 1);
+    bool chunked = false;
+    long length = -1;
+    headersEnd[2] = '\0';
+    for (char* line = strstr(buf.data, "\r\n") + 2; *line != '\0'; line = strstr(line, "\r\n") + 2)
+    {
+        if (headerIs(line, "Content-Length"))
+        {
+            length = strtol(line + strlen("Content-Length:"), NULL, 10);
+            if (length > FETCH_MAX_BODY)
+            {
+                free(buf.data);
+                return NULL;
+            }
+        } else if (headerIs(line, "Transfer-Encoding")) {
+            chunked = headerHas(line, "Transfer-Encoding", "chunked");
+        } else if (headerIs(line, "Connection")) {
+            keepAlive = !headerHas(line, "Connection", "close");
+        } else if (got != NULL && got->etag == NULL && headerIs(line, "ETag")) {
+            got->etag = fetch_headerValue(line, "ETag");
+        } else if (got != NULL && got->lastModified == NULL && headerIs(line, "Last-Modified")) {
+            got->lastModified = fetch_headerValue(line, "Last-Modified");
+        }
+    }
+    size_t start = headersEnd + 4 - buf.data;
+
+    char* body = NULL;
+    bool exact = true;
+    if (*code == 304 || *code == 204)
+    {
+        exact = (buf.len == start);
+        body = calloc(1, 1);
+    } else if (chunked) {
+        if (readChunked(&buf, start, &exact) >= 0)
+        {
+            body = buf.data;
+            buf.data = NULL;
+        }
+    } else if (length >= 0) {
+        body = readLength(&buf, start, length, &exact);
+    } else {
+        // No framing: the body is everything up to the server closing the socket
+        keepAlive = false;
+        bool tooLong = false;
+        while (!tooLong && recvMore(&buf))
+        {
+            tooLong = buf.len - start > FETCH_MAX_BODY;
+        }
+        if (!tooLong && (buf.deadline == 0 || now() < buf.deadline))     // not cut short by the deadline
+        {
+            memmove(buf.data, buf.data + start, buf.len - start + 1);
+            body = buf.data;
+            buf.data = NULL;
+        }
+    }
+    free(buf.data);
+    times->download = now() - firstByte;
+
+    *reusable = keepAlive && exact && body != NULL;
+    return body;
+}
+
+/*
+ * recvMore: Receive whatever the socket has next onto the end of the
+ * buffer, first doubling the buffer if it has little room left.
+ * Returns false if the server closed the socket, on error, if nothing
+ * came by the buffer's deadline, or if the buffer has no socket.
+ */
+static bool recvMore(recvbuf_t* buf)
+{
+    if (buf->sock < 0)
+    {
+        return false;               // a response received before, with no socket to read more from
+    }
+    if (buf->cap - buf->len < MIN_RECV)
+    {
+        size_t cap = (buf->cap == 0) ? INITIAL_RESPONSE : buf->cap * 2;
+        char* grown = realloc(buf->data, cap);
+        if (grown == NULL)
+        {
+            return false;
+        }
+        buf->data = grown;
+        buf->cap = cap;
+    }
+
+    if (!awaitReadable(buf->sock, buf->deadline))
+    {
+        return false;
+    }
+    ssize_t n = recv(buf->sock, buf->data + buf->len, buf->cap - buf->len - 1, 0);
+    if (n <= 0)
+    {
+        return false;
+    }
+    buf->len += n;
+    buf->data[buf->len] = '\0';
+    return true;
+}
+
+/*
+ * recvUntil: Receive until the buffer holds at least len bytes.
+ * Returns false if the socket ends or fails first.
+ */
+static bool recvUntil(recvbuf_t* buf, size_t len)
+{
+    while (buf->len < len)
+    {
+        if (!recvMore(buf))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * readLength: Read a body of exactly length bytes, of which any received
+ * beyond start are in the buffer; the rest is received straight into
+ * the body.  Sets *exact to false if the server sent more than that.
+ * Returns the body, null-terminated, or NULL on error or at the buffer's deadline.
+ */
+static char* readLength(recvbuf_t* buf, size_t start, size_t length, bool* exact)
+{
+    char* body = malloc(length + 1);
+    if (body == NULL)
+    {
+        return NULL;
+    }
+
+    size_t have = buf->len - start;
+    *exact = (have <= length);
+    if (have > length)
+    {
+        have = length;
+    }
+    memcpy(body, buf->data + start, have);
+    while (have < length)
+    {
+        ssize_t n = awaitReadable(buf->sock, buf->deadline) ? recv(buf->sock, body + have, length - have, 0) : -1;
+        if (n <= 0)
+        {
+            free(body);
+            return NULL;
+        }
+        have += n;
+    }
+    body[length] = '\0';
+    return body;
+}
+
+/*
+ * readChunked: Read a body sent with chunked transfer coding: a series
+ * of hexadecimal chunk sizes, each on its own line and followed by that
+ * many bytes and a CRLF, ending with a zero size and optional trailer
+ * headers.  The body starts at start in the buffer; the chunks are
+ * moved down to the front of the buffer as they arrive, so that it
+ * ends up holding just the body, null-terminated.  Sets *exact to false
+ * if the server sent more than the body.
+ * Returns the length of the body, or -1 on error, on a malformed chunk
+ * size, or if the body would be longer than FETCH_MAX_BODY.
+ */
+static long readChunked(recvbuf_t* buf, size_t start, bool* exact)
+{
+    size_t out = 0;                 // end of the body so far
+    size_t pos = start;             // start of the next chunk-size line
+    size_t chunkLen;
+    do
+    {
+        long lineEnd = recvLine(buf, pos);
+        if (lineEnd < 0)
+        {
+            return -1;
+        }
+        // A size with no hex digits, or one that would take the body past
+        // FETCH_MAX_BODY (or the offsets past SIZE_MAX), fails the fetch
+        char* end;
+        chunkLen = isxdigit((unsigned char) buf->data[pos]) ? strtoul(buf->data + pos, &end, 16) : 0;
+        if (!isxdigit((unsigned char) buf->data[pos]) || end > buf->data + lineEnd
+            || chunkLen > FETCH_MAX_BODY - out || chunkLen > SIZE_MAX - lineEnd - 4)
+        {
+            return -1;
+        }
+        pos = lineEnd + 2;
+
+        if (chunkLen > 0)
+        {
+            if (!recvUntil(buf, pos + chunkLen + 2))
+            {
+                return -1;
+            }
+            memmove(buf->data + out, buf->data + pos, chunkLen);
+            out += chunkLen;
+            pos += chunkLen + 2;        // past the CRLF that ends each chunk
+        }
+    } while (chunkLen > 0);
+
+    // skip any trailer headers through the final blank line
+    long lineEnd;
+    while ((lineEnd = recvLine(buf, pos)) != (long) pos)
+    {
+        if (lineEnd < 0)
+        {
+            return -1;
+        }
+        pos = lineEnd + 2;
+    }
+    *exact = (buf->len == pos + 2);
+    buf->data[out] = '\0';
+    return out;
+}
+
+/*
+ * recvLine: Receive until the buffer holds a CRLF at or after pos,
+ * searching all the bytes received, so a NUL byte in a body is passed over.
+ * Returns the offset of the CRLF, or -1 if the socket ends or fails first.
+ */
+static long recvLine(recvbuf_t* buf, size_t pos)
+{
+    char* end;
+    while (pos >= buf->len || (end = memmem(buf->data + pos, buf->len - pos, "\r\n", 2)) == NULL)
+    {
+        if (!recvMore(buf))
+        {
+            return -1;
+        }
+    }
+    return end - buf->data;
+}
+
+/*
+ * awaitReadable: Wait until the socket has something to receive (or has
+ * been closed), but not past the deadline (0 for none).
+ * Returns false if the deadline passed first, or on error.
+ */
+static bool awaitReadable(int sock, double deadline)
+{
+    if (deadline == 0)
+    {
+        return true;                    // recv itself waits
+    }
+    struct pollfd pfd = { sock, POLLIN, 0 };
+    while (true)
+    {
+        double left = deadline - now();
+        if (left <= 0)
+        {
+            return false;
+        }
+        int ready = poll(&pfd, 1, (int) (left * 1000) + 1);
+        if (ready > 0)
+        {
+            return true;
+        }
+        if (ready < 0 && errno != EINTR)
+        {
+            return false;
+        }
+    }
+}
+
+/*
+ * deadlineOf: Returns the deadline timeout seconds from now, or limit if
+ * that is sooner; a timeout or limit of 0 is none, and a result of 0 is
+ * no deadline.
+ */
+static double deadlineOf(double timeout, double limit)
+{
+    double deadline = (timeout > 0) ? now() + timeout : 0;
+    if (limit > 0 && (deadline == 0 || limit < deadline))
+    {
+        deadline = limit;
+    }
+    return deadline;
+}
+
+/*
+ * sleepFor: Sleep the given seconds, resuming after any signal.
+ */
+static void sleepFor(double seconds)
+{
+    if (seconds > 0)
+    {
+        struct timespec ts;
+        ts.tv_sec = (time_t) seconds;
+        ts.tv_nsec = (long) ((seconds - ts.tv_sec) * 1e9);
+        while (nanosleep(&ts, &ts) != 0)
+        {
+            ;   // interrupted by a signal; sleep for the remainder
+        }
+    }
+}
+
+/*
+ * now: Returns the current monotonic time in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * headerIs: Returns true if the header line names the given header,
+ * ignoring case as HTTP requires.
+ */
+static bool headerIs(const char* line, const char* name)
+{
+    size_t len = strlen(name);
+    return strncasecmp(line, name, len) == 0 && line[len] == ':';
+}
+
+/*
+ * headerHas: Returns true if the value of the named header, on the given
+ * header line, contains word, ignoring case.
+ */
+static bool headerHas(const char* line, const char* name, const char* word)
+{
+    char* value = fetch_headerValue(line, name);
+    bool has = false;
+    if (value != NULL)
+    {
+        for (char* c = value; *c != '\0'; c++)
+        {
+            *c = tolower((unsigned char) *c);
+        }
+        has = strstr(value, word) != NULL;
+        free(value);
+    }
+    return has;
+}
@@ -0,0 +1,214 @@
+#ifndef __FETCH_H
+#define __FETCH_H
+
+#include <stdbool.h>
+#include "connpool.h"
+#include "politeness.h"
+#include "dnscache.h"
+#include "breaker.h"
+
+/*
+ * fetch - thread-safe retrieval of web pages for the crawler
+ *
+ * The libcs50 webpage_fetch resolves hostnames with gethostbyname, which
+ * keeps its result in static storage and so cannot be called from more
+ * than one thread at a time.  This module offers the same behavior (an
+ * HTTP/1.1 GET of a http://host[:port][/path] URL and at most MAX_TRY
+ * connection attempts) using only reentrant calls, so that several crawler
+ * threads may fetch at once.  Rather than sleeping a second before every
+ * request, it waits as long as a politeness scheduler says.
+ *
+ * Given limits, no fetch waits on a server for longer than they allow: a
+ * connection attempt, the wait for the first byte of the response, and
+ * the whole fetch each have a deadline, and an attempt that gets no
+ * answer is tried again after a backoff that doubles each time, with
+ * jitter so that fetches failing together do not retry together.  Given
+ * a circuit breaker, a host that has stopped answering is not contacted
+ * at all for a while.
+ *
+ * Given a connection pool, fetches ask the server to keep the connection
+ * open, and reuse it for the next fetch from the same host and port; the
+ * response body is framed by Content-Length or chunked transfer coding so
+ * the connection is left ready for the next request.
+ *
+ * A fetch may be conditional: given the validators (ETag and Last-Modified)
+ * of a copy of the page already held, it asks the server to answer "304 Not
+ * Modified", with no body, if that copy is still current.
+ */
+
+/*
+ * fetchlimits_t: How long a fetch may take, and how it retries.
+ *
+ * Fields:
+ * - connectTimeout: Seconds for each connection attempt, or 0 for no limit.
+ * - firstByteTimeout: Seconds from sending a request to the first byte of
+ *   the response, or 0 for no limit.
+ * - totalTimeout: Seconds for the whole fetch, from its first attempt
+ *   (once the politeness scheduler first allows it) through any retries
+ *   to the last byte, or 0 for no limit.
+ * - maxTries: Attempts to make at most, or 0 for MAX_TRY.  An attempt
+ *   that gets no answer is tried again; one answered, however, is not.
+ * - backoff: Seconds to wait before the second attempt, doubling before
+ *   each one after; the wait is drawn at random from the upper half of
+ *   that.  0 for no wait beyond the politeness scheduler's.
+ */
+typedef struct
+{
+    double connectTimeout;
+    double firstByteTimeout;
+    double totalTimeout;
+    int maxTries;
+    double backoff;
+} fetchlimits_t;
+
+/*
+ * fetchopts_t: The shared services a fetch draws on; any may be NULL.
+ *
+ * Fields:
+ * - connections: Keep-alive connections to draw from and return to;
+ *   if NULL, each fetch uses a fresh connection and closes it afterwards.
+ * - politeness: Decides how long to wait before each request to a host;
+ *   if NULL, requests are sent at once.
+ * - dns: Cache of host addresses; if NULL, each connection looks up its host.
+ * - breaker: Stops fetches from hosts that have stopped answering; if
+ *   NULL, every host is always tried.
+ * - limits: Deadlines and retries; if NULL, MAX_TRY attempts with no
+ *   deadline and no backoff.
+ */
+typedef struct
+{
+    connpool_t* connections;
+    politeness_t* politeness;
+    dnscache_t* dns;
+    breaker_t* breaker;
+    const fetchlimits_t* limits;
+} fetchopts_t;
+
+/*
+ * The longest body a fetch accepts, in bytes; a response that says its
+ * body is longer, whose chunks add up to more, or whose unframed body runs
+ * on past it, fails like one cut short.  The fetch engine fails a response
+ * longer than it too.
+ */
+#define FETCH_MAX_BODY (64L * 1024 * 1024)
+
+/*
+ * The status of a fetch that was not tried because its host's circuit
+ * breaker was open.
+ */
+#define FETCH_HOST_DOWN -1
+
+/*
+ * fetchvalidators_t: The validators of one copy of a page: the values of
+ * the ETag and Last-Modified headers it was served with, either NULL if
+ * the server sent none.
+ */
+typedef struct
+{
+    char* etag;
+    char* lastModified;
+} fetchvalidators_t;
+
+/*
+ * fetchtimes_t: Where the time of one fetch went, in seconds.  A phase
+ * that did not happen (such as connecting, on a connection reused from
+ * the pool, or the first byte, when the server never answered) is -1.
+ *
+ * Fields:
+ * - wait: Waiting for the politeness scheduler to allow the request.
+ * - dns: Looking up the host.
+ * - connect: Connecting to it.
+ * - firstByte: From sending the request to receiving the first byte of
+ *   the response.
+ * - download: From the first byte to the last.
+ * - total: The whole fetch, including all of the above and any retries.
+ */
+typedef struct
+{
+    double wait;
+    double dns;
+    double connect;
+    double firstByte;
+    double download;
+    double total;
+} fetchtimes_t;
+
+/*
+ * Fetch the page at the given URL.
+ *
+ * Takes url: a normalized absolute URL of form http://host[:port][/path].
+ * Takes opts: the services to use, or NULL for none.
+ *
+ * Returns a newly allocated, null-terminated buffer holding the body of
+ * the response if the server answered "200", otherwise NULL.
+ * The caller is responsible for freeing the returned buffer; it is
+ * suitable for handing to webpage_new as the page html.
+ */
+char* fetch_html(const char* url, const fetchopts_t* opts);
+
+/*
+ * Fetch the page at the given URL unless the copy already held is current.
+ *
+ * Takes url and opts: as for fetch_html.
+ * Takes have: the validators of the copy held, sent as If-None-Match and
+ *   If-Modified-Since; or NULL, to fetch the page unconditionally.
+ * Takes got: filled in with the validators the server sent, as strings
+ *   the caller must free with fetch_freeValidators; may be NULL.
+ * Takes status: set to the HTTP status, 0 if there was no answer, or
+ *   FETCH_HOST_DOWN if the breaker kept the fetch from being tried.
+ * Takes times: filled in with where the time of the fetch went; may be NULL.
+ *   Only the last attempt's phases are given, when a connection from the
+ *   pool turns out to be closed or an attempt goes unanswered and the
+ *   fetch tries again; the wait is that of all the attempts.
+ *
+ * Returns the body, as for fetch_html, if the server answered "200";
+ * otherwise NULL, with *status 304 if the copy held is current.
+ */
+char* fetch_conditional(const char* url, const fetchopts_t* opts, const fetchvalidators_t* have,
+                        fetchvalidators_t* got, int* status, fetchtimes_t* times);
+
+/*
+ * Returns the seconds to wait before attempt number tries (from 1 for
+ * the second attempt) under limits, as described for fetchlimits_t;
+ * 0 if limits is NULL.  Safe to call from several threads.
+ */
+double fetch_backoff(const fetchlimits_t* limits, int tries);
+
+/*
+ * Free the strings of a set of validators, leaving both NULL.
+ */
+void fetch_freeValidators(fetchvalidators_t* validators);
+
+/*
+ * Returns a copy of the value of the named header, found among the header
+ * lines of an HTTP response (which end at a blank line or the end of the
+ * string), with surrounding whitespace removed; or NULL if there is no
+ * such header.  Names are matched ignoring case.  The caller must free it.
+ */
+char* fetch_headerValue(const char* headers, const char* name);
+
+/*
+ * Take the body out of an HTTP response wholly received into response,
+ * len bytes and null-terminated, by the same rules as a fetch reads it
+ * from a socket: decoding chunked transfer coding, or taking as many
+ * bytes as Content-Length gives, or else all that follows the headers.
+ * The body is moved down to the front of response and null-terminated.
+ *
+ * Returns the body's length, or -1 if the response has no end to its
+ * headers, or its body is malformed or shorter than its headers say.
+ */
+long fetch_decodeBody(char* response, size_t len);
+
+/*
+ * Split a URL of form http://host[:port][/path] into its pieces.
+ *
+ * Fills in the caller's host buffer (of hostSize bytes), the port
+ * (80 if none is given), and a pointer to the path within url
+ * ("/" if the URL has no path).
+ *
+ * Returns true if successful, false if the URL is not of that form
+ * or the host does not fit in the buffer.
+ */
+bool fetch_splitURL(const char* url, char* host, int hostSize, int* port, const char** path);
+
+#endif //__FETCH_H
@@ -0,0 +1,768 @@
+/*
+ * fetchengine.c    Sajjad C Kareem    November 6, 2023
+ *
+ * This file contains the implementation of the event-driven fetch engine.
+ * Functions include:
+ *     - fetchengine_new: Create an engine with a fixed number of slots.
+ *     - fetchengine_hasRoom: Check whether a slot is free.
+ *     - fetchengine_submit: Start fetching a page.
+ *     - fetchengine_next: Wait for and return a finished page.
+ *     - fetchengine_delete: Free the engine.
+ *
+ * Each slot holds one request and moves through the states
+ * WAITING (to be started) -> CONNECTING -> SENDING -> READING,
+ * after which the page, with the status and validators of its response,
+ * is parked in a bag of finished pages.
+ *
+ * A slot's deadlines are checked each time round the event loop, which
+ * sleeps no longer than the nearest of them: a connection attempt or a
+ * wait for the first byte that runs out is tried again, and a fetch that
+ * runs out of time altogether finishes without a page.
+ *
+ * See fetchengine.h for more information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "../libcs50/bag.h"
+#include "fetch.h"
+#include "fetchengine.h"
+
+/**************** local types ****************/
+typedef enum { FREE, WAITING, CONNECTING, SENDING, READING } slotState_t;
+
+typedef struct finished
+{
+    webpage_t* page;
+    int status;                 // HTTP status, or 0 for no answer
+    fetchvalidators_t got;      // validators the server sent
+    fetchtimes_t times;         // where the time went
+} finished_t;
+
+typedef struct slot
+{
+    slotState_t state;
+    webpage_t* page;            // the page being fetched
+    char host[256];             // its host, or "" if its URL could not be split
+    finished_t* result;         // where it goes when finished, allocated on submit
+    int fd;                     // socket, or -1
+    int tries;                  // connection attempts so far
+    double submittedAt;         // when the page was submitted
+    double phaseAt;             // when the slot's current phase began
+    double firstByteAt;         // when the response began to arrive, or 0
+    double startAt;             // when a WAITING slot may connect
+    double deadline;            // when the whole fetch must end, or 0 for never
+    double phaseDeadline;       // when a connect, or the wait for a first byte, must end, or 0
+    bool allowed;               // whether the breaker let the fetch go ahead
+    bool refused;               // whether it did not
+    char* request;              // the HTTP request text
+    size_t requestLen;
+    size_t sent;                // bytes of request sent so far
+    char* response;             // the response received so far
+    size_t responseLen;
+    size_t responseCap;
+    bool headersRead;           // whether the response's headers are all in
+} slot_t;
+
+typedef struct fetchengine
+{
+    int epfd;                   // epoll instance
+    slot_t* slots;              // maxInFlight request slots
+    int maxInFlight;
+    int inFlight;               // slots not FREE
+    bag_t* finished;            // finished_t's ready for fetchengine_next
+    int numFinished;            // pages in the finished bag
+    politeness_t* politeness;   // paces connections to each host
+    dnscache_t* dns;            // host addresses
+    breaker_t* breaker;         // hosts not to contact for now
+    fetchlimits_t limits;       // deadlines and retries
+} fetchengine_t;
+
+/**************** local constants ****************/
+static const int MAX_TRY = 3;              // maximum attempts to connect
+static const size_t INITIAL_RESPONSE = 16384;
+static const size_t MIN_RECV = 4096;        // least room to offer each recv
+static const double DNS_POLL = 0.005;      // seconds between checks on a pending lookup
+
+/**************** local functions ****************/
+static double now(void);
+static double deadlineOf(double timeout, double limit);
+static void waitSlot(fetchengine_t* engine, slot_t* slot, double backoff);
+static void startSlot(fetchengine_t* engine, slot_t* slot);
+static void expireSlot(fetchengine_t* engine, slot_t* slot);
+static double slotDue(const slot_t* slot);
+static void handleEvent(fetchengine_t* engine, slot_t* slot, unsigned int events);
+static bool readResponse(slot_t* slot);
+static void retrySlot(fetchengine_t* engine, slot_t* slot);
+static void finishSlot(fetchengine_t* engine, slot_t* slot, bool success);
+static void closeSlot(fetchengine_t* engine, slot_t* slot);
+static bool sizeResponse(slot_t* slot);
+static char* responseBody(slot_t* slot);
+static void finishedDelete(void* item);
+
+/**************** fetchengine_new() ****************/
+/* see fetchengine.h for description */
+fetchengine_t* fetchengine_new(int maxInFlight, const fetchopts_t* opts)
+{
+    if (maxInFlight < 1)
+    {
+        return NULL;
+    }
+
+    fetchengine_t* engine = malloc(sizeof(fetchengine_t));
+    if (engine == NULL)
+    {
+        return NULL;
+    }
+    engine->slots = calloc(maxInFlight, sizeof(slot_t));
+    engine->finished = bag_new();
+    engine->epfd = epoll_create1(0);
+    if (engine->slots == NULL || engine->finished == NULL || engine->epfd < 0)
+    {
+        free(engine->slots);
+        bag_delete(engine->finished, NULL);
+        if (engine->epfd >= 0)
+        {
+            close(engine->epfd);
+        }
+        free(engine);
+        return NULL;
+    }
+
+    for (int i = 0; i < maxInFlight; i++)
+    {
+        engine->slots[i].state = FREE;
+        engine->slots[i].fd = -1;
+    }
+    engine->maxInFlight = maxInFlight;
+    engine->inFlight = 0;
+    engine->numFinished = 0;
+    engine->politeness = (opts != NULL) ? opts->politeness : NULL;
+    engine->dns = (opts != NULL) ? opts->dns : NULL;
+    engine->breaker = (opts != NULL) ? opts->breaker : NULL;
+    engine->limits = (fetchlimits_t) { 0, 0, 0, MAX_TRY, 0 };
+    if (opts != NULL && opts->limits != NULL)
+    {
+        engine->limits = *opts->limits;
+    }
+    if (engine->limits.maxTries < 1)
+    {
+        engine->limits.maxTries = MAX_TRY;
+    }
+    return engine;
+}
+
+/**************** fetchengine_hasRoom() ****************/
+/* see fetchengine.h for description */
+bool fetchengine_hasRoom(fetchengine_t* engine)
+{
+    return engine != NULL && engine->inFlight < engine->maxInFlight;
+}
+
+/**************** fetchengine_submit() ****************/
+/* see fetchengine.h for description */
+bool fetchengine_submit(fetchengine_t* engine, webpage_t* page, const fetchvalidators_t* have)
+{
+    if (!fetchengine_hasRoom(engine) || page == NULL || webpage_getHTML(page) != NULL)
+    {
+        return false;
+    }
+    finished_t* result = malloc(sizeof(finished_t));
+    if (result == NULL)
+    {
+        return false;
+    }
+
+    slot_t* slot = engine->slots;
+    while (slot->state != FREE)
+    {
+        slot++;
+    }
+
+    /* Build the request now; a URL we cannot split fails straight away */
+    char host[256];
+    int port;
+    const char* path;
+    const char* etag = (have != NULL) ? have->etag : NULL;
+    const char* lastModified = (have != NULL) ? have->lastModified : NULL;
+    slot->page = page;
+    slot->result = result;
+    slot->tries = 0;
+    slot->submittedAt = now();
+    slot->phaseAt = 0;
+    slot->firstByteAt = 0;
+    slot->deadline = 0;
+    slot->phaseDeadline = 0;
+    slot->allowed = false;
+    slot->refused = false;
+    slot->host[0] = '\0';
+    result->times = (fetchtimes_t) { -1, -1, -1, -1, -1, -1 };
+    slot->request = NULL;
+    slot->response = NULL;
+    engine->inFlight++;
+
+    if (!fetch_splitURL(webpage_getURL(page), host, sizeof(host), &port, &path))
+    {
+        finishSlot(engine, slot, false);
+        return true;
+    }
+    strcpy(slot->host, host);
+    slot->requestLen = strlen(path) + strlen(host) + (etag ? strlen(etag) : 0)
+                       + (lastModified ? strlen(lastModified) : 0) + 128;
+    slot->request = malloc(slot->requestLen + 1);
+    if (slot->request == NULL)
+    {
+        finishSlot(engine, slot, false);
+        return true;
+    }
+    int len = sprintf(slot->request, "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n", path, host);
+    if (etag != NULL)
+    {
+        len += sprintf(slot->request + len, "If-None-Match: %s\r\n", etag);
+    }
+    if (lastModified != NULL)
+    {
+        len += sprintf(slot->request + len, "If-Modified-Since: %s\r\n", lastModified);
+    }
+    slot->requestLen = len + sprintf(slot->request + len, "\r\n");
+    waitSlot(engine, slot, 0);
+    dnscache_prefetch(engine->dns, host);          // look up the host while the slot waits its turn
+    return true;
+}
+
+/**************** fetchengine_next() ****************/
+/* see fetchengine.h for description */
+webpage_t* fetchengine_next(fetchengine_t* engine, int* status, fetchvalidators_t* got, fetchtimes_t* times)
+{
+    if (engine == NULL)
+    {
+        return NULL;
+    }
+
+    struct epoll_event events[64];
+    while (engine->numFinished == 0 && engine->inFlight > 0)
+    {
+        /* Give up on or retry the requests past a deadline, and start the waiting
+         * requests whose turn has come; sleep no longer than the next turn or deadline */
+        int timeout = -1;
+        for (int i = 0; i < engine->maxInFlight; i++)
+        {
+            slot_t* slot = &engine->slots[i];
+            if (slot->state != FREE)
+            {
+                expireSlot(engine, slot);
+            }
+            if (slot->state == WAITING && slot->startAt <= now())
+            {
+                startSlot(engine, slot);
+            }
+            // A slot may still be waiting, even after startSlot, if its host is being looked up
+            double due = (slot->state != FREE) ? slotDue(slot) : 0;
+            if (due > 0)
+            {
+                double wait = due - now();
+                int ms = (wait > 0) ? wait * 1000 + 1 : 0;
+                if (timeout < 0 || ms < timeout)
+                {
+                    timeout = ms;
+                }
+            }
+        }
+        if (engine->numFinished > 0 || engine->inFlight == 0)
+        {
+            continue;
+        }
+
+        int n = epoll_wait(engine->epfd, events, 64, timeout);
+        for (int i = 0; i < n; i++)
+        {
+            handleEvent(engine, events[i].data.ptr, events[i].events);
+        }
+    }
+
+    if (engine->numFinished == 0)
+    {
+        return NULL;
+    }
+    engine->numFinished--;
+    finished_t* result = bag_extract(engine->finished);
+    webpage_t* page = result->page;
+    if (status != NULL)
+    {
+        *status = result->status;
+    }
+    if (got != NULL)
+    {
+        *got = result->got;
+    } else {
+        fetch_freeValidators(&result->got);
+    }
+    if (times != NULL)
+    {
+        *times = result->times;
+    }
+    free(result);
+    return page;
+}
+
+/**************** fetchengine_delete() ****************/
+/* see fetchengine.h for description */
+void fetchengine_delete(fetchengine_t* engine)
+{
+    if (engine != NULL)
+    {
+        for (int i = 0; i < engine->maxInFlight; i++)
+        {
+            slot_t* slot = &engine->slots[i];
+            if (slot->state != FREE)
+            {
+                webpage_delete(slot->page);
+                free(slot->result);
+                closeSlot(engine, slot);
+            }
+        }
+        bag_delete(engine->finished, finishedDelete);
+        close(engine->epfd);
+        free(engine->slots);
+        free(engine);
+    }
+}
+
+/*
+ * now: Returns the current monotonic time in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * deadlineOf: Returns the deadline timeout seconds from now, or limit if
+ * that is sooner; a timeout or limit of 0 is none, and a result of 0 is
+ * no deadline.
+ */
+static double deadlineOf(double timeout, double limit)
+{
+    double deadline = (timeout > 0) ? now() + timeout : 0;
+    if (limit > 0 && (deadline == 0 || limit < deadline))
+    {
+        deadline = limit;
+    }
+    return deadline;
+}
+
+/*
+ * waitSlot: Put the slot in the WAITING state, and reserve its turn
+ * to connect from the politeness scheduler; it waits at least backoff
+ * seconds, even if its turn comes sooner.
+ */
+static void waitSlot(fetchengine_t* engine, slot_t* slot, double backoff)
+{
+    double delay = politeness_reserve(engine->politeness, slot->host);
+    slot->state = WAITING;
+    slot->startAt = now() + ((delay > backoff) ? delay : backoff);
+}
+
+/*
+ * startSlot: Look up the host in the DNS cache and begin a non-blocking
+ * connect, registering the socket with epoll to learn when it completes.
+ * If the host is still being looked up, the slot stays WAITING a while longer.
+ */
+static void startSlot(fetchengine_t* engine, slot_t* slot)
+{
+    char host[256];
+    int port;
+    const char* path;
+    fetch_splitURL(webpage_getURL(slot->page), host, sizeof(host), &port, &path);
+
+    // The first start ends the wait for politeness, begins the lookup and
+    // the fetch's deadline, unless the breaker says the host is down
+    fetchtimes_t* times = &slot->result->times;
+    if (slot->phaseAt == 0)
+    {
+        slot->phaseAt = now();
+        times->wait = slot->phaseAt - slot->submittedAt;
+        slot->deadline = deadlineOf(engine->limits.totalTimeout, 0);
+        slot->allowed = breaker_allow(engine->breaker, host);
+        if (!slot->allowed)
+        {
+            slot->refused = true;
+            finishSlot(engine, slot, false);
+            return;
+        }
+    }
+
+    // Keep waiting, without spending a try, while the host is being looked up
+    struct sockaddr_in addr;
+    int numAddrs = dnscache_tryLookup(engine->dns, host, port, &addr, 1);
+    if (numAddrs < 0)
+    {
+        slot->startAt = now() + DNS_POLL;
+        return;
+    }
+    if (times->dns < 0)
+    {
+        times->dns = now() - slot->phaseAt;
+    }
+
+    slot->tries++;
+    slot->sent = 0;
+    slot->responseLen = 0;
+    slot->headersRead = false;
+    slot->firstByteAt = 0;
+    slot->phaseAt = now();
+    if (numAddrs == 0)
+    {
+        retrySlot(engine, slot);
+        return;
+    }
+
+    slot->fd = socket(AF_INET, SOCK_STREAM, 0);
+    int result = -1;
+    if (slot->fd >= 0 && fcntl(slot->fd, F_SETFL, O_NONBLOCK) == 0)
+    {
+        result = connect(slot->fd, (struct sockaddr*) &addr, sizeof(addr));
+    }
+
+    if (result < 0 && errno != EINPROGRESS)
+    {
+        retrySlot(engine, slot);
+        return;
+    }
+
+    // An immediate connect (likely on loopback) can go straight to sending
+    slot->state = (result == 0) ? SENDING : CONNECTING;
+    slot->phaseDeadline = (result == 0) ? 0 : deadlineOf(engine->limits.connectTimeout, slot->deadline);
+    if (result == 0)
+    {
+        slot->result->times.connect = now() - slot->phaseAt;
+    }
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = slot };
+    if (epoll_ctl(engine->epfd, EPOLL_CTL_ADD, slot->fd, &ev) < 0)
+    {
+        retrySlot(engine, slot);
+    }
+}
+
+/*
+ * handleEvent: Advance one slot's state machine after epoll
+ * reports activity on its socket.
+ */
+static void handleEvent(fetchengine_t* engine, slot_t* slot, unsigned int events)
+{
+    if (slot->state == CONNECTING)
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(slot->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+        {
+            retrySlot(engine, slot);
+            return;
+        }
+        slot->state = SENDING;
+        slot->phaseDeadline = 0;
+        slot->result->times.connect = now() - slot->phaseAt;
+    }
+
+    if (slot->state == SENDING)
+    {
+        ssize_t n = send(slot->fd, slot->request + slot->sent, slot->requestLen - slot->sent, 0);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            finishSlot(engine, slot, false);
+            return;
+        }
+        if (n > 0)
+        {
+            slot->sent += n;
+        }
+        if (slot->sent == slot->requestLen)
+        {
+            slot->state = READING;
+            slot->phaseAt = now();
+            slot->phaseDeadline = deadlineOf(engine->limits.firstByteTimeout, slot->deadline);
+            struct epoll_event ev = { .events = EPOLLIN, .data.ptr = slot };
+            epoll_ctl(engine->epfd, EPOLL_CTL_MOD, slot->fd, &ev);
+        }
+        return;
+    }
+
+    if (slot->state == READING && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+    {
+        if (!readResponse(slot))
+        {
+            finishSlot(engine, slot, false);
+        } else if (slot->fd < 0) {
+            finishSlot(engine, slot, true);
+        }
+    }
+}
+
+/*
+ * readResponse: Read whatever the socket has available into the slot's
+ * response buffer, growing it geometrically, or once the headers are in,
+ * to the size they give.  On end of file the socket is closed (leaving
+ * fd at -1) to mark the response complete.
+ * Returns false on any error, or once the response is longer than
+ * FETCH_MAX_BODY, as a blocking fetch fails a body that long.
+ */
+static bool readResponse(slot_t* slot)
+{
+    while (true)
+    {
+        if (slot->responseCap - slot->responseLen < MIN_RECV || slot->response == NULL)
+        {
+            size_t cap = slot->response == NULL ? INITIAL_RESPONSE : slot->responseCap * 2;
+            char* grown = realloc(slot->response, cap);
+            if (grown == NULL)
+            {
+                return false;
+            }
+            slot->response = grown;
+            slot->responseCap = cap;
+        }
+
+        ssize_t n = recv(slot->fd, slot->response + slot->responseLen, slot->responseCap - slot->responseLen - 1, 0);
+        if (n > 0)
+        {
+            if (slot->firstByteAt == 0)
+            {
+                slot->firstByteAt = now();
+                slot->result->times.firstByte = slot->firstByteAt - slot->phaseAt;
+            }
+            slot->responseLen += n;
+            slot->response[slot->responseLen] = '\0';
+            if (slot->responseLen > FETCH_MAX_BODY || (!slot->headersRead && !sizeResponse(slot)))
+            {
+                return false;
+            }
+        } else if (n == 0) {
+            close(slot->fd);            // also removes it from the epoll set
+            slot->fd = -1;
+            return true;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+}
+
+/*
+ * sizeResponse: Once the headers of the response are all in, grow the
+ * buffer in one step to hold the whole response, if they give the
+ * body's Content-Length.  Returns false if that is more than
+ * FETCH_MAX_BODY.
+ */
+static bool sizeResponse(slot_t* slot)
+{
+    char* headersEnd = strstr(slot->response, "\r\n\r\n");
+    if (headersEnd == NULL)
+    {
+        return true;
+    }
+    slot->headersRead = true;
+
+    char* length = fetch_headerValue(strstr(slot->response, "\r\n") + 2, "Content-Length");
+    bool ok = true;
+    if (length != NULL)
+    {
+        unsigned long bodyLen = strtoul(length, NULL, 10);
+        size_t total = (headersEnd + 4 - slot->response) + bodyLen;
+        ok = bodyLen <= FETCH_MAX_BODY;
+        if (ok && total + MIN_RECV > slot->responseCap)
+        {
+            // room past the end for the recv that finds the server has closed
+            char* grown = realloc(slot->response, total + MIN_RECV);
+            if (grown != NULL)
+            {
+                slot->response = grown;
+                slot->responseCap = total + MIN_RECV;
+            }
+        }
+        free(length);
+    }
+    return ok;
+}
+
+/*
+ * expireSlot: Give up on the slot if its fetch is past its deadline; or,
+ * if it is connecting or waiting for a first byte past that phase's
+ * deadline, try again.
+ */
+static void expireSlot(fetchengine_t* engine, slot_t* slot)
+{
+    double t = now();
+    bool unanswered = slot->state == CONNECTING || (slot->state == READING && slot->firstByteAt == 0);
+    if (slot->deadline > 0 && t >= slot->deadline)
+    {
+        finishSlot(engine, slot, false);
+    } else if (unanswered && slot->phaseDeadline > 0 && t >= slot->phaseDeadline) {
+        retrySlot(engine, slot);
+    }
+}
+
+/*
+ * slotDue: Returns when the slot next needs attention other than for
+ * activity on its socket: its turn to start, if it is WAITING, or its
+ * nearest deadline; or 0 if only its socket can move it on.
+ */
+static double slotDue(const slot_t* slot)
+{
+    double due = slot->deadline;
+    double other = 0;
+    if (slot->state == WAITING)
+    {
+        other = slot->startAt;
+    } else if (slot->state == CONNECTING || (slot->state == READING && slot->firstByteAt == 0)) {
+        other = slot->phaseDeadline;
+    }
+    if (other > 0 && (due == 0 || other < due))
+    {
+        due = other;
+    }
+    return due;
+}
+
+/*
+ * retrySlot: After an attempt that got no answer, close the socket and
+ * either queue the request to start again, after a backoff, or give up
+ * on it once it has used its tries or the backoff would outlast its
+ * deadline.
+ */
+static void retrySlot(fetchengine_t* engine, slot_t* slot)
+{
+    if (slot->fd >= 0)
+    {
+        close(slot->fd);
+        slot->fd = -1;
+    }
+    slot->phaseDeadline = 0;
+    double backoff = fetch_backoff(&engine->limits, slot->tries);
+    if (slot->tries < engine->limits.maxTries && (slot->deadline == 0 || now() + backoff < slot->deadline))
+    {
+        waitSlot(engine, slot, backoff);
+    } else {
+        finishSlot(engine, slot, false);
+    }
+}
+
+/*
+ * finishSlot: Move the slot's page to the finished bag, with the status
+ * and validators of the response and, if the server answered "200", its
+ * body as the page's html; report to the breaker whether the host
+ * answered; and free the slot.
+ */
+static void finishSlot(fetchengine_t* engine, slot_t* slot, bool success)
+{
+    webpage_t* page = slot->page;
+    finished_t* result = slot->result;
+    result->status = 0;
+    result->got.etag = NULL;
+    result->got.lastModified = NULL;
+    result->times.total = now() - slot->submittedAt;
+    if (slot->firstByteAt > 0)
+    {
+        result->times.download = now() - slot->firstByteAt;
+    }
+    if (success && slot->response != NULL)
+    {
+        slot->response[slot->responseLen] = '\0';
+        const char* headers = strstr(slot->response, "\r\n");
+        if (sscanf(slot->response, "HTTP/1.%*d %d", &result->status) == 1 && headers != NULL)
+        {
+            result->got.etag = fetch_headerValue(headers + 2, "ETag");
+            result->got.lastModified = fetch_headerValue(headers + 2, "Last-Modified");
+        }
+        char* html = responseBody(slot);
+        char* url = malloc(strlen(webpage_getURL(page)) + 1);
+        if (html != NULL && url != NULL)
+        {
+            strcpy(url, webpage_getURL(page));
+            webpage_t* fetched = webpage_new(url, webpage_getDepth(page), html);
+            webpage_delete(page);
+            page = fetched;
+        } else {
+            free(html);
+            free(url);
+        }
+    }
+
+    if (slot->refused)
+    {
+        result->status = FETCH_HOST_DOWN;
+    } else if (slot->allowed) {
+        breaker_report(engine->breaker, slot->host, result->status != 0 || slot->firstByteAt > 0);
+    }
+
+    result->page = page;
+    bag_insert(engine->finished, result);
+    engine->numFinished++;
+    closeSlot(engine, slot);
+}
+
+/*
+ * closeSlot: Release everything the slot holds except its page.
+ */
+static void closeSlot(fetchengine_t* engine, slot_t* slot)
+{
+    if (slot->fd >= 0)
+    {
+        close(slot->fd);
+        slot->fd = -1;
+    }
+    free(slot->request);
+    free(slot->response);
+    slot->request = NULL;
+    slot->response = NULL;
+    slot->responseCap = 0;
+    slot->page = NULL;
+    slot->result = NULL;
+    slot->state = FREE;
+    engine->inFlight--;
+}
+
+/*
+ * responseBody: Returns the body of a "200" response, decoded as fetch
+ * decodes it (fetch_decodeBody) and moved down to the front of the
+ * slot's response buffer, which it takes over; or NULL if the response
+ * is anything else, or its body is malformed or cut short.
+ */
+static char* responseBody(slot_t* slot)
+{
+    int code = 0;
+    if (sscanf(slot->response, "HTTP/1.%*d %d", &code) != 1 || code != 200)
+    {
+        return NULL;
+    }
+    if (fetch_decodeBody(slot->response, slot->responseLen) < 0)
+    {
+        return NULL;
+    }
+
+    char* html = slot->response;
+    slot->response = NULL;
+    return html;
+}
+
+/*
+ * finishedDelete: Delete a finished page along with its validators,
+ * for bag_delete.
+ */
+static void finishedDelete(void* item)
+{
+    finished_t* result = item;
+    webpage_delete(result->page);
+    fetch_freeValidators(&result->got);
+    free(result);
+}
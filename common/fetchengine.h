@@ -0,0 +1,79 @@
+#ifndef __FETCHENGINE_H
+#define __FETCHENGINE_H
+
+#include <stdbool.h>
+#include "../libcs50/webpage.h"
+#include "fetch.h"
+
+/*
+ * fetchengine - event-driven fetching of many pages from a single thread
+ *
+ * A fetch engine keeps up to maxInFlight HTTP requests in progress at once
+ * on non-blocking sockets, driven by one epoll instance.  The caller submits
+ * pages (with no html) while the engine has room, and collects finished
+ * pages from fetchengine_next, which waits for network activity as needed.
+ *
+ * Like fetch_html, the engine tries to connect at most MAX_TRY times (or
+ * as many as the limits in opts allow), and each attempt is delayed as long
+ * as the politeness scheduler says, and any backoff; while one request waits
+ * its turn, requests to other hosts proceed.  A request is held to the
+ * deadlines in the limits, and one to a host whose circuit breaker is open
+ * finishes at once with status FETCH_HOST_DOWN.  Hosts are
+ * looked up in the background while their requests wait, so the engine's
+ * thread never blocks on name resolution.
+ *
+ * A page may be submitted with the validators of a copy already held, to
+ * be fetched only if it has changed (see fetch_conditional).
+ */
+typedef struct fetchengine fetchengine_t;
+
+/*
+ * Create a new fetch engine able to hold maxInFlight requests at once,
+ * using the politeness scheduler, DNS cache, circuit breaker and limits in
+ * opts (which may be NULL); the limits are copied.
+ * Returns pointer to the engine, or NULL if any error.
+ * Caller is responsible for later calling fetchengine_delete.
+ */
+fetchengine_t* fetchengine_new(int maxInFlight, const fetchopts_t* opts);
+
+/*
+ * Returns true if the engine can take another page.
+ */
+bool fetchengine_hasRoom(fetchengine_t* engine);
+
+/*
+ * Submit a page to be fetched; the page must not yet have html.
+ * Given have, the validators of a copy already held, the page is fetched
+ * only if it has changed; have may be NULL, and is copied.
+ * The engine takes ownership of the page until it is handed back by
+ * fetchengine_next.
+ * Returns false, leaving the page with the caller, if the engine is full
+ * or out of memory.
+ */
+bool fetchengine_submit(fetchengine_t* engine, webpage_t* page, const fetchvalidators_t* have);
+
+/*
+ * Return the next finished page, waiting for one if needed.
+ *
+ * If the fetch succeeded, the returned page carries the html; if it
+ * failed, or the copy held is current, the page is returned as submitted,
+ * without html.  Either way, the caller owns the returned page.
+ * If status is not NULL, it is set to the HTTP status (304 if the copy
+ * held is current, 0 if there was no answer, FETCH_HOST_DOWN if the host
+ * was not tried); if got is not NULL, it is
+ * filled in with the validators the server sent, which the caller must
+ * free with fetch_freeValidators; if times is not NULL, it is filled in
+ * with where the time went, from the page's submission until it finished
+ * (the wait being for the politeness scheduler, and the DNS time for the
+ * lookup that began once the wait was over).
+ * Returns NULL once no pages remain in the engine.
+ */
+webpage_t* fetchengine_next(fetchengine_t* engine, int* status, fetchvalidators_t* got, fetchtimes_t* times);
+
+/*
+ * Delete the engine, closing any connections and deleting any pages
+ * still inside it.
+ */
+void fetchengine_delete(fetchengine_t* engine);
+
+#endif //__FETCHENGINE_H
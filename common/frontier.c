@@ -0,0 +1,803 @@
+/*
+ * frontier.c    Sajjad C Kareem    November 2, 2023
+ *
+ * This file contains the implementation of the thread-safe crawl frontier.
+ * Functions include:
+ *     - frontier_new: Create an empty frontier.
+ *     - frontier_insert: Add a page to crawl.
+ *     - frontier_addScore: Raise the score of a waiting page.
+ *     - frontier_extract: Take the next page to crawl, waiting if needed.
+ *     - frontier_tryExtract: Take the next page to crawl, if any, without waiting.
+ *     - frontier_done: Mark an extracted page as fully processed.
+ *     - frontier_pause: Stop handing out pages and wait for those out to be done.
+ *     - frontier_resume: Start handing out pages again.
+ *     - frontier_hold, frontier_release: Keep the crawl open for pages from elsewhere.
+ *     - frontier_idle: Check that no page is waiting or in progress.
+ *     - frontier_wait: Wait for a page, or for the crawl to be over.
+ *     - frontier_size: Count the waiting pages.
+ *     - frontier_save: Write the waiting pages to a file.
+ *     - frontier_delete: Free the frontier.
+ *
+ * Up to maxInMemory pages are kept in a binary heap, ordered by the
+ * frontier's policy with ties going to the page inserted first (or last,
+ * for FRONTIER_LIFO); pages inserted beyond that are written as "depth URL"
+ * lines to numbered segment files (.frontier1, .frontier2, ...) in the
+ * spill directory.  Segments are appended to in turn and read back oldest
+ * first, a batch at a time, whenever the heap runs dry; each is removed
+ * once it has been read.
+ *
+ * For FRONTIER_SCORE, each entry in the heap is also chained into a small
+ * hashtable by URL, so that frontier_addScore can find it and sift it up.
+ *
+ * See frontier.h for more information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../libcs50/file.h"
+#include "frontier.h"
+
+/**************** local types ****************/
+typedef struct entry
+{
+    webpage_t* page;
+    long seq;                   // when the page was inserted
+    long score;                 // FRONTIER_SCORE: total of frontier_addScore
+    int pos;                    // index in the heap
+    struct entry* next;         // FRONTIER_SCORE: next in the same URL bucket
+} entry_t;
+
+typedef struct frontier
+{
+    frontierorder_t order;
+    entry_t** heap;             // pages waiting to be crawled, best first
+    int heapSize;               // slots allocated in the heap
+    entry_t** buckets;          // FRONTIER_SCORE: heap entries by URL, or NULL
+    int numBuckets;             // a power of two
+    long nextSeq;               // seq of the next page inserted
+    long size;                  // number of pages waiting, in the heap or on disk
+    int inMemory;               // number of pages in the heap
+    int maxInMemory;            // heap size beyond which pages spill, or 0
+    char* spillDir;             // where segments go, or NULL for no spilling
+    FILE* writer;               // segment being appended to, or NULL
+    int writeSeg;               // its number
+    long writeCount;            // records in it so far
+    FILE* reader;               // segment being read back, or NULL
+    int readSeg;                // its number
+    int inProgress;             // pages extracted but not yet done
+    int holds;                  // frontier_hold calls not yet released
+    bool paused;                // set by frontier_pause
+    pthread_mutex_t lock;       // guards all of the above
+    pthread_cond_t changed;     // signalled on insert, on resume, and when nothing is in progress
+} frontier_t;
+
+/**************** local constants ****************/
+static const long SEGMENT_RECORDS = 65536;     // records per segment file
+static const int MIN_HEAP = 64;                 // starting heap and bucket sizes
+
+/**************** local functions ****************/
+static webpage_t* takePage(frontier_t* frontier);
+static bool heapPush(frontier_t* frontier, webpage_t* page);
+static bool before(const frontier_t* frontier, const entry_t* a, const entry_t* b);
+static void siftUp(frontier_t* frontier, int pos);
+static void siftDown(frontier_t* frontier, int pos);
+static unsigned long hashURL(const char* url);
+static entry_t** findEntry(frontier_t* frontier, const char* url);
+static bool growBuckets(frontier_t* frontier);
+static void spill(frontier_t* frontier, webpage_t* page);
+static void unspill(frontier_t* frontier);
+static char* segmentPath(frontier_t* frontier, int seg);
+static bool copyRest(FILE* from, FILE* to);
+
+/**************** frontier_new() ****************/
+/* see frontier.h for description */
+frontier_t* frontier_new(frontierorder_t order, int maxInMemory, const char* spillDir)
+{
+    if (order != FRONTIER_LIFO && order != FRONTIER_DEPTH && order != FRONTIER_SCORE)
+    {
+        return NULL;
+    }
+    frontier_t* frontier = malloc(sizeof(frontier_t));
+    if (frontier == NULL)
+    {
+        return NULL;
+    }
+
+    frontier->order = order;
+    frontier->heapSize = MIN_HEAP;
+    frontier->heap = malloc(MIN_HEAP * sizeof(entry_t*));
+    frontier->numBuckets = MIN_HEAP;
+    frontier->buckets = (order == FRONTIER_SCORE) ? calloc(MIN_HEAP, sizeof(entry_t*)) : NULL;
+    frontier->spillDir = NULL;
+    if (maxInMemory > 0 && spillDir != NULL)
+    {
+        frontier->spillDir = malloc(strlen(spillDir) + 1);
+        if (frontier->spillDir != NULL)
+        {
+            strcpy(frontier->spillDir, spillDir);
+        }
+    }
+    if (frontier->heap == NULL || (order == FRONTIER_SCORE && frontier->buckets == NULL)
+        || (maxInMemory > 0 && spillDir != NULL && frontier->spillDir == NULL))
+    {
+        free(frontier->heap);
+        free(frontier->buckets);
+        free(frontier->spillDir);
+        free(frontier);
+        return NULL;
+    }
+    frontier->nextSeq = 0;
+    frontier->size = 0;
+    frontier->inMemory = 0;
+    frontier->maxInMemory = maxInMemory;
+    frontier->writer = frontier->reader = NULL;
+    frontier->writeSeg = frontier->readSeg = 1;
+    frontier->writeCount = 0;
+    frontier->inProgress = 0;
+    frontier->holds = 0;
+    frontier->paused = false;
+    pthread_mutex_init(&frontier->lock, NULL);
+    pthread_cond_init(&frontier->changed, NULL);
+    return frontier;
+}
+
+/**************** frontier_insert() ****************/
+/* see frontier.h for description */
+void frontier_insert(frontier_t* frontier, webpage_t* page)
+{
+    if (frontier == NULL || page == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+    // Once pages are on disk, an ordered frontier sends later pages after them,
+    // so that pages inserted in order (as breadth-first links are) leave in order
+    if (frontier->spillDir != NULL && (frontier->inMemory >= frontier->maxInMemory
+        || (frontier->order != FRONTIER_LIFO && frontier->size > frontier->inMemory)))
+    {
+        spill(frontier, page);
+    } else if (!heapPush(frontier, page)) {
+        fprintf(stderr, "frontier: out of memory; dropped %s\n", webpage_getURL(page));
+        webpage_delete(page);
+        pthread_mutex_unlock(&frontier->lock);
+        return;
+    }
+    frontier->size++;
+    pthread_cond_signal(&frontier->changed);
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**************** frontier_addScore() ****************/
+/* see frontier.h for description */
+void frontier_addScore(frontier_t* frontier, const char* url, long delta)
+{
+    if (frontier == NULL || url == NULL || frontier->order != FRONTIER_SCORE)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+    entry_t* entry = *findEntry(frontier, url);
+    if (entry != NULL)
+    {
+        entry->score += delta;
+        if (delta > 0)
+        {
+            siftUp(frontier, entry->pos);
+        } else {
+            siftDown(frontier, entry->pos);
+        }
+    }
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**************** frontier_extract() ****************/
+/* see frontier.h for description */
+webpage_t* frontier_extract(frontier_t* frontier)
+{
+    if (frontier == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+
+    // An empty frontier only means the crawl is over when nobody can refill it
+    while (frontier->paused || (frontier->size == 0 && (frontier->inProgress > 0 || frontier->holds > 0)))
+    {
+        pthread_cond_wait(&frontier->changed, &frontier->lock);
+    }
+
+    webpage_t* page = takePage(frontier);
+
+    pthread_mutex_unlock(&frontier->lock);
+    return page;
+}
+
+/**************** frontier_tryExtract() ****************/
+/* see frontier.h for description */
+webpage_t* frontier_tryExtract(frontier_t* frontier)
+{
+    if (frontier == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+    webpage_t* page = frontier->paused ? NULL : takePage(frontier);
+    pthread_mutex_unlock(&frontier->lock);
+    return page;
+}
+
+/**************** frontier_done() ****************/
+/* see frontier.h for description */
+void frontier_done(frontier_t* frontier)
+{
+    if (frontier == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+    frontier->inProgress--;
+    if ((frontier->size == 0 || frontier->paused) && frontier->inProgress == 0)
+    {
+        // Wake every waiting thread so they can all see the crawl is over,
+        // or so that frontier_pause can return
+        pthread_cond_broadcast(&frontier->changed);
+    }
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**************** frontier_pause() ****************/
+/* see frontier.h for description */
+void frontier_pause(frontier_t* frontier)
+{
+    if (frontier == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+    frontier->paused = true;
+    while (frontier->inProgress > 0)
+    {
+        pthread_cond_wait(&frontier->changed, &frontier->lock);
+    }
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**************** frontier_resume() ****************/
+/* see frontier.h for description */
+void frontier_resume(frontier_t* frontier)
+{
+    if (frontier == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+    frontier->paused = false;
+    pthread_cond_broadcast(&frontier->changed);
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**************** frontier_hold() ****************/
+/* see frontier.h for description */
+void frontier_hold(frontier_t* frontier)
+{
+    if (frontier == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+    frontier->holds++;
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**************** frontier_release() ****************/
+/* see frontier.h for description */
+void frontier_release(frontier_t* frontier)
+{
+    if (frontier == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+    if (frontier->holds > 0 && --frontier->holds == 0)
+    {
+        pthread_cond_broadcast(&frontier->changed);     // the crawl may now be over
+    }
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**************** frontier_idle() ****************/
+/* see frontier.h for description */
+bool frontier_idle(frontier_t* frontier)
+{
+    if (frontier == NULL)
+    {
+        return true;
+    }
+    pthread_mutex_lock(&frontier->lock);
+    bool idle = frontier->size == 0 && frontier->inProgress == 0;
+    pthread_mutex_unlock(&frontier->lock);
+    return idle;
+}
+
+/**************** frontier_wait() ****************/
+/* see frontier.h for description */
+bool frontier_wait(frontier_t* frontier)
+{
+    if (frontier == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+    while (frontier->size == 0 && (frontier->inProgress > 0 || frontier->holds > 0))
+    {
+        pthread_cond_wait(&frontier->changed, &frontier->lock);
+    }
+    bool waiting = frontier->size > 0;
+    pthread_mutex_unlock(&frontier->lock);
+    return waiting;
+}
+
+/**************** frontier_size() ****************/
+/* see frontier.h for description */
+long frontier_size(frontier_t* frontier)
+{
+    if (frontier == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&frontier->lock);
+    long size = frontier->size;
+    pthread_mutex_unlock(&frontier->lock);
+    return size;
+}
+
+/**************** frontier_save() ****************/
+/* see frontier.h for description */
+long frontier_save(frontier_t* frontier, FILE* fp)
+{
+    if (frontier == NULL || fp == NULL)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&frontier->lock);
+    bool ok = true;
+    for (int i = 0; i < frontier->inMemory; i++)
+    {
+        webpage_t* page = frontier->heap[i]->page;
+        fprintf(fp, "%d %s\n", webpage_getDepth(page), webpage_getURL(page));
+    }
+
+    // Then the rest of the segment being read, and every later segment
+    if (frontier->reader != NULL)
+    {
+        long pos = ftell(frontier->reader);
+        ok = pos >= 0 && copyRest(frontier->reader, fp) && fseek(frontier->reader, pos, SEEK_SET) == 0;
+    }
+    if (frontier->writer != NULL)
+    {
+        ok = ok && fflush(frontier->writer) == 0;
+    }
+    int seg = (frontier->reader != NULL) ? frontier->readSeg + 1 : frontier->readSeg;
+    for (; ok && frontier->spillDir != NULL && seg <= frontier->writeSeg; seg++)
+    {
+        char* path = segmentPath(frontier, seg);
+        FILE* segment = (path != NULL) ? fopen(path, "r") : NULL;
+        if (segment != NULL)
+        {
+            ok = copyRest(segment, fp);
+            fclose(segment);
+        } else if (seg < frontier->writeSeg || frontier->writer != NULL) {
+            ok = false;             // only an unstarted last segment may be missing
+        }
+        free(path);
+    }
+    long size = frontier->size;
+    pthread_mutex_unlock(&frontier->lock);
+
+    return (ok && !ferror(fp)) ? size : -1;
+}
+
+/**************** frontier_delete() ****************/
+/* see frontier.h for description */
+void frontier_delete(frontier_t* frontier)
+{
+    if (frontier != NULL)
+    {
+        for (int i = 0; i < frontier->inMemory; i++)
+        {
+            webpage_delete(frontier->heap[i]->page);
+            free(frontier->heap[i]);
+        }
+        free(frontier->heap);
+        free(frontier->buckets);
+
+        // Remove any segments not yet read back
+        if (frontier->writer != NULL)
+        {
+            fclose(frontier->writer);
+        }
+        if (frontier->reader != NULL)
+        {
+            fclose(frontier->reader);
+        }
+        for (int seg = frontier->readSeg; frontier->spillDir != NULL && seg <= frontier->writeSeg; seg++)
+        {
+            char* path = segmentPath(frontier, seg);
+            if (path != NULL)
+            {
+                unlink(path);
+                free(path);
+            }
+        }
+        free(frontier->spillDir);
+        pthread_mutex_destroy(&frontier->lock);
+        pthread_cond_destroy(&frontier->changed);
+        free(frontier);
+    }
+}
+
+/*
+ * takePage: Take the best page from the heap, first refilling it from disk if it
+ * is empty, and count it as in progress.  Returns NULL if no pages are
+ * waiting.  Caller holds the lock.
+ */
+static webpage_t* takePage(frontier_t* frontier)
+{
+    if (frontier->size > 0 && frontier->inMemory == 0)
+    {
+        unspill(frontier);
+        if (frontier->inMemory == 0)
+        {
+            fprintf(stderr, "frontier: lost %ld pages that could not be read back from %s\n",
+                    frontier->size, frontier->spillDir);
+            frontier->size = 0;
+        }
+    }
+    if (frontier->size == 0)
+    {
+        return NULL;
+    }
+
+    // Move the last entry to the root in place of the best, and let it sink
+    entry_t* best = frontier->heap[0];
+    frontier->inMemory--;
+    if (frontier->inMemory > 0)
+    {
+        frontier->heap[0] = frontier->heap[frontier->inMemory];
+        frontier->heap[0]->pos = 0;
+        siftDown(frontier, 0);
+    }
+    if (frontier->buckets != NULL)
+    {
+        // Unlink this very entry, as a URL can be in the frontier twice after a resume
+        entry_t** link = &frontier->buckets[hashURL(webpage_getURL(best->page)) & (frontier->numBuckets - 1)];
+        while (*link != best)
+        {
+            link = &(*link)->next;
+        }
+        *link = best->next;
+    }
+    webpage_t* page = best->page;
+    free(best);
+    frontier->size--;
+    frontier->inProgress++;
+    return page;
+}
+
+/*
+ * spill: Append a page to the current segment as a "depth URL" line,
+ * and delete the page; start a new segment if the current one is full.
+ * If the segment cannot be written, the page stays in memory instead.
+ * Caller holds the lock.
+ */
+static void spill(frontier_t* frontier, webpage_t* page)
+{
+    if (frontier->writer == NULL)
+    {
+        char* path = segmentPath(frontier, frontier->writeSeg);
+        frontier->writer = (path != NULL) ? fopen(path, "w") : NULL;
+        free(path);
+    }
+    if (frontier->writer == NULL
+        || fprintf(frontier->writer, "%d %s\n", webpage_getDepth(page), webpage_getURL(page)) < 0)
+    {
+        if (!heapPush(frontier, page))
+        {
+            fprintf(stderr, "frontier: out of memory; dropped %s\n", webpage_getURL(page));
+            webpage_delete(page);
+            frontier->size--;
+        }
+        return;
+    }
+    webpage_delete(page);
+
+    if (++frontier->writeCount == SEGMENT_RECORDS)
+    {
+        fclose(frontier->writer);
+        frontier->writer = NULL;
+        frontier->writeSeg++;
+        frontier->writeCount = 0;
+    }
+}
+
+/*
+ * unspill: Refill the empty heap with up to half its capacity of pages
+ * from the oldest segment, removing segments as they are used up; the
+ * segment being appended to is closed first if it is the only one left.
+ * Caller holds the lock, and knows some pages are on disk.
+ */
+static void unspill(frontier_t* frontier)
+{
+    int batch = (frontier->maxInMemory > 1) ? frontier->maxInMemory / 2 : 1;
+    while (frontier->inMemory < batch && frontier->inMemory < frontier->size)
+    {
+        if (frontier->reader == NULL)
+        {
+            if (frontier->readSeg == frontier->writeSeg)
+            {
+                if (frontier->writer == NULL)
+                {
+                    return;             // nothing on disk after all
+                }
+                fclose(frontier->writer);
+                frontier->writer = NULL;
+                frontier->writeSeg++;
+                frontier->writeCount = 0;
+            }
+            char* path = segmentPath(frontier, frontier->readSeg);
+            frontier->reader = (path != NULL) ? fopen(path, "r") : NULL;
+            free(path);
+            if (frontier->reader == NULL)
+            {
+                return;
+            }
+        }
+
+        int depth;
+        char* url = NULL;
+        if (fscanf(frontier->reader, "%d ", &depth) == 1 && (url = file_readLine(frontier->reader)) != NULL)
+        {
+            webpage_t* page = webpage_new(url, depth, NULL);
+            if (page == NULL)
+            {
+                free(url);
+                return;
+            }
+            if (!heapPush(frontier, page))
+            {
+                webpage_delete(page);
+                frontier->size--;
+                return;
+            }
+        } else {
+            // This segment is used up
+            fclose(frontier->reader);
+            frontier->reader = NULL;
+            char* path = segmentPath(frontier, frontier->readSeg++);
+            if (path != NULL)
+            {
+                unlink(path);
+                free(path);
+            }
+        }
+    }
+}
+
+/*
+ * heapPush: Add a page to the heap (and, for FRONTIER_SCORE, to the
+ * buckets), with a score of 0.  Returns false if out of memory.
+ * Caller holds the lock.
+ */
+static bool heapPush(frontier_t* frontier, webpage_t* page)
+{
+    if (frontier->inMemory == frontier->heapSize)
+    {
+        entry_t** heap = realloc(frontier->heap, 2 * frontier->heapSize * sizeof(entry_t*));
+        if (heap == NULL)
+        {
+            return false;
+        }
+        frontier->heap = heap;
+        frontier->heapSize *= 2;
+    }
+    if (frontier->buckets != NULL && frontier->inMemory >= frontier->numBuckets && !growBuckets(frontier))
+    {
+        return false;
+    }
+    entry_t* entry = malloc(sizeof(entry_t));
+    if (entry == NULL)
+    {
+        return false;
+    }
+
+    entry->page = page;
+    entry->seq = frontier->nextSeq++;
+    entry->score = 0;
+    entry->next = NULL;
+    if (frontier->buckets != NULL)
+    {
+        entry_t** bucket = &frontier->buckets[hashURL(webpage_getURL(page)) & (frontier->numBuckets - 1)];
+        entry->next = *bucket;
+        *bucket = entry;
+    }
+    entry->pos = frontier->inMemory++;
+    frontier->heap[entry->pos] = entry;
+    siftUp(frontier, entry->pos);
+    return true;
+}
+
+/*
+ * before: Returns true if entry a should be crawled before entry b.
+ */
+static bool before(const frontier_t* frontier, const entry_t* a, const entry_t* b)
+{
+    if (frontier->order == FRONTIER_LIFO)
+    {
+        return a->seq > b->seq;
+    }
+    if (frontier->order == FRONTIER_SCORE && a->score != b->score)
+    {
+        return a->score > b->score;
+    }
+    int depthA = webpage_getDepth(a->page);
+    int depthB = webpage_getDepth(b->page);
+    if (depthA != depthB)
+    {
+        return depthA < depthB;
+    }
+    return a->seq < b->seq;
+}
+
+/*
+ * siftUp: Move the entry at pos towards the root past any entries it
+ * should come before.  Caller holds the lock.
+ */
+static void siftUp(frontier_t* frontier, int pos)
+{
+    entry_t* entry = frontier->heap[pos];
+    while (pos > 0)
+    {
+        int parent = (pos - 1) / 2;
+        if (!before(frontier, entry, frontier->heap[parent]))
+        {
+            break;
+        }
+        frontier->heap[pos] = frontier->heap[parent];
+        frontier->heap[pos]->pos = pos;
+        pos = parent;
+    }
+    frontier->heap[pos] = entry;
+    entry->pos = pos;
+}
+
+/*
+ * siftDown: Move the entry at pos away from the root past any entries
+ * that should come before it.  Caller holds the lock.
+ */
+static void siftDown(frontier_t* frontier, int pos)
+{
+    entry_t* entry = frontier->heap[pos];
+    while (true)
+    {
+        int child = 2 * pos + 1;
+        if (child >= frontier->inMemory)
+        {
+            break;
+        }
+        if (child + 1 < frontier->inMemory && before(frontier, frontier->heap[child + 1], frontier->heap[child]))
+        {
+            child++;
+        }
+        if (!before(frontier, frontier->heap[child], entry))
+        {
+            break;
+        }
+        frontier->heap[pos] = frontier->heap[child];
+        frontier->heap[pos]->pos = pos;
+        pos = child;
+    }
+    frontier->heap[pos] = entry;
+    entry->pos = pos;
+}
+
+/*
+ * hashURL: Returns a hash of url (FNV-1a) for the buckets.
+ */
+static unsigned long hashURL(const char* url)
+{
+    unsigned long h = 2166136261UL;
+    for (const unsigned char* p = (const unsigned char*) url; *p != '\0'; p++)
+    {
+        h ^= *p;
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+/*
+ * findEntry: Returns the link in the buckets that points to an entry
+ * for url, or to NULL at the end of its chain if url is not in memory.
+ * Caller holds the lock.
+ */
+static entry_t** findEntry(frontier_t* frontier, const char* url)
+{
+    entry_t** link = &frontier->buckets[hashURL(url) & (frontier->numBuckets - 1)];
+    while (*link != NULL && strcmp(webpage_getURL((*link)->page), url) != 0)
+    {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/*
+ * growBuckets: Double the number of buckets, rechaining every entry.
+ * Returns false, leaving the buckets as they were, if out of memory.
+ */
+static bool growBuckets(frontier_t* frontier)
+{
+    int numBuckets = frontier->numBuckets * 2;
+    entry_t** buckets = calloc(numBuckets, sizeof(entry_t*));
+    if (buckets == NULL)
+    {
+        return false;
+    }
+    for (int i = 0; i < frontier->inMemory; i++)
+    {
+        entry_t* entry = frontier->heap[i];
+        entry_t** bucket = &buckets[hashURL(webpage_getURL(entry->page)) & (numBuckets - 1)];
+        entry->next = *bucket;
+        *bucket = entry;
+    }
+    free(frontier->buckets);
+    frontier->buckets = buckets;
+    frontier->numBuckets = numBuckets;
+    return true;
+}
+
+/*
+ * segmentPath: Returns the newly allocated pathname of a segment file,
+ * or NULL if out of memory.
+ */
+static char* segmentPath(frontier_t* frontier, int seg)
+{
+    char* path = malloc(strlen(frontier->spillDir) + 32);
+    if (path != NULL)
+    {
+        sprintf(path, "%s/.frontier%d", frontier->spillDir, seg);
+    }
+    return path;
+}
+
+/*
+ * copyRest: Copy everything from the current position of one file
+ * to the end of another.  Returns false on any error.
+ */
+static bool copyRest(FILE* from, FILE* to)
+{
+    char buf[8192];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), from)) > 0)
+    {
+        if (fwrite(buf, 1, n, to) != n)
+        {
+            return false;
+        }
+    }
+    return !ferror(from);
+}
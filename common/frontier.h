@@ -0,0 +1,149 @@
+#ifndef __FRONTIER_H
+#define __FRONTIER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "../libcs50/webpage.h"
+
+/*
+ * frontier - the thread-safe set of pages waiting to be crawled
+ *
+ * A frontier is a priority queue of webpages that several crawler threads
+ * can share.  Besides the pages themselves it tracks how many extracted
+ * pages are still being worked on, because a thread that finds the frontier
+ * empty must wait while another thread may yet add links from the page
+ * it is scanning.  The crawl is over once the frontier is empty and no
+ * pages are in progress.
+ *
+ * Pages come out in the order chosen when the frontier is created:
+ *
+ * FRONTIER_LIFO hands out the page inserted last, as the libcs50 bag did,
+ * so the crawl dives deep before finishing shallow pages.
+ *
+ * FRONTIER_DEPTH hands out the shallowest page, oldest first: a breadth-first
+ * crawl, so a crawl stopped early has the pages nearest the seed.
+ *
+ * FRONTIER_SCORE hands out the page with the highest score, added with
+ * frontier_addScore (e.g., one per link found to the page), breaking ties
+ * as FRONTIER_DEPTH does.
+ *
+ * Inserting and extracting take O(log n) time in the pages held in memory.
+ *
+ * So that a large crawl does not hold its whole frontier in memory, the
+ * frontier may keep just a bounded number of pages in memory, spilling
+ * the rest to disk as compact "depth URL" records in segment files and
+ * reading them back, oldest first, as memory empties.  The order then
+ * holds only among the pages in memory; pages come back from disk with
+ * a score of 0, and only pages in memory can have their scores raised.
+ */
+typedef struct frontier frontier_t;
+
+typedef enum { FRONTIER_LIFO, FRONTIER_DEPTH, FRONTIER_SCORE } frontierorder_t;
+
+/*
+ * Create a new, empty frontier.
+ * Takes order: FRONTIER_LIFO, FRONTIER_DEPTH or FRONTIER_SCORE.
+ * Takes maxInMemory: the most pages to hold in memory, or 0 for no limit.
+ * Takes spillDir: an existing directory for the segment files (named
+ *   .frontier1, .frontier2, ...), or NULL for no limit.
+ * Returns pointer to the frontier, or NULL if any error.
+ * Caller is responsible for later calling frontier_delete.
+ */
+frontier_t* frontier_new(frontierorder_t order, int maxInMemory, const char* spillDir);
+
+/*
+ * Add a page to the frontier and wake one waiting thread.
+ * The frontier takes ownership of the page until it is extracted.
+ */
+void frontier_insert(frontier_t* frontier, webpage_t* page);
+
+/*
+ * Add delta to the score of the page for url, if it is waiting in memory
+ * in a FRONTIER_SCORE frontier; otherwise do nothing.  A page's score
+ * starts at 0 when it is inserted.
+ */
+void frontier_addScore(frontier_t* frontier, const char* url, long delta);
+
+/*
+ * Remove a page from the frontier, waiting while the frontier is empty
+ * but other pages are still in progress.
+ *
+ * Returns a page, which the caller now owns and must report with
+ * frontier_done once it has finished adding that page's links;
+ * or NULL once the crawl is over.
+ */
+webpage_t* frontier_extract(frontier_t* frontier);
+
+/*
+ * Like frontier_extract, but never waits: returns NULL at once if the
+ * frontier is empty, even if other pages are still in progress.
+ * Meant for a single thread that is itself processing every page.
+ */
+webpage_t* frontier_tryExtract(frontier_t* frontier);
+
+/*
+ * Report that a page returned by frontier_extract or frontier_tryExtract
+ * has been fully processed, i.e., all the links it yields have been inserted.
+ */
+void frontier_done(frontier_t* frontier);
+
+/*
+ * Stop handing out pages, and wait until every page already handed out
+ * has been reported done; the caller must not itself hold such a page.
+ * While paused, frontier_extract waits and frontier_tryExtract returns
+ * NULL; pages may still be inserted.  The frontier then holds every page
+ * not yet crawled, as is needed for a consistent checkpoint.
+ */
+void frontier_pause(frontier_t* frontier);
+
+/*
+ * Start handing out pages again after frontier_pause.
+ */
+void frontier_resume(frontier_t* frontier);
+
+/*
+ * Keep the crawl open, as if a page were in progress, until a matching
+ * frontier_release: while held, an empty frontier makes frontier_extract
+ * wait rather than return NULL.  For a source of pages other than the
+ * pages being crawled, such as another process's links.
+ */
+void frontier_hold(frontier_t* frontier);
+
+/*
+ * Release a frontier_hold; once none is left, an empty frontier with no
+ * page in progress means the crawl is over.
+ */
+void frontier_release(frontier_t* frontier);
+
+/*
+ * Returns true if no page is waiting and none is in progress, whether
+ * or not the frontier is held.
+ */
+bool frontier_idle(frontier_t* frontier);
+
+/*
+ * Wait, without taking a page, while the frontier is empty but pages are
+ * in progress or it is held.  Returns true if a page is then waiting, or
+ * false once the crawl is over.  Meant for a thread that otherwise only
+ * uses frontier_tryExtract.
+ */
+bool frontier_wait(frontier_t* frontier);
+
+/*
+ * Returns the number of pages waiting in the frontier, in memory or on disk.
+ */
+long frontier_size(frontier_t* frontier);
+
+/*
+ * Write every page waiting in the frontier (in memory or on disk) to fp,
+ * one "depth URL" line per page; the frontier is unchanged.
+ * Returns the number of pages written, or -1 on any error.
+ */
+long frontier_save(frontier_t* frontier, FILE* fp);
+
+/*
+ * Delete the frontier and any pages still in it, removing its segment files.
+ */
+void frontier_delete(frontier_t* frontier);
+
+#endif //__FRONTIER_H
@@ -0,0 +1,217 @@
+/*
+ * histogram.c    Sajjad C Kareem    November 28, 2023
+ *
+ * This file contains the implementation of the duration histogram.
+ * Functions include:
+ *     - histogram_new: Create an empty histogram.
+ *     - histogram_record: Count one duration.
+ *     - histogram_count: Count the durations recorded.
+ *     - histogram_percentile: Find a percentile of the durations.
+ *     - histogram_mean: Average the durations.
+ *     - histogram_max: Find the longest duration.
+ *     - histogram_print: Write a summary as JSON.
+ *     - histogram_delete: Free the histogram.
+ *
+ * A value v (in microseconds) below 2^LINEAR_BITS has a bucket of its
+ * own.  Above that, with v's highest bit at position b, v is shifted
+ * right by b - SUB_BITS so that SUB_BITS + 1 bits remain; the top one is
+ * always set, and the SUB_BITS below it pick one of 2^SUB_BITS buckets
+ * within that power of two.
+ *
+ * See histogram.h for more information.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "histogram.h"
+
+/**************** local constants ****************/
+#define SUB_BITS 5                                  // 32 buckets to each power of two
+#define LINEAR_BITS (SUB_BITS + 1)                  // one bucket per value below 64
+#define MAX_BITS 40                                 // values up to 2^40us, about 12 days
+#define NUM_BUCKETS ((1 << LINEAR_BITS) + (MAX_BITS - LINEAR_BITS) * (1 << SUB_BITS))
+
+/**************** local types ****************/
+typedef struct histogram
+{
+    long counts[NUM_BUCKETS];
+    long total;                 // values recorded
+    double sum;                 // their sum, in microseconds
+    uint64_t max;               // the largest, in microseconds
+    pthread_mutex_t lock;       // guards all of the above
+} histogram_t;
+
+/**************** local functions ****************/
+static int bucketOf(uint64_t micros);
+static uint64_t bucketValue(int bucket);
+
+/**************** histogram_new() ****************/
+/* see histogram.h for description */
+histogram_t* histogram_new(void)
+{
+    histogram_t* histogram = calloc(1, sizeof(histogram_t));
+    if (histogram != NULL)
+    {
+        pthread_mutex_init(&histogram->lock, NULL);
+    }
+    return histogram;
+}
+
+/**************** histogram_record() ****************/
+/* see histogram.h for description */
+void histogram_record(histogram_t* histogram, double seconds)
+{
+    if (histogram == NULL || !(seconds >= 0))
+    {
+        return;
+    }
+
+    double micros = seconds * 1e6 + 0.5;
+    uint64_t value = (micros < (double) ((uint64_t) 1 << MAX_BITS)) ? (uint64_t) micros : ((uint64_t) 1 << MAX_BITS) - 1;
+    int bucket = bucketOf(value);
+
+    pthread_mutex_lock(&histogram->lock);
+    histogram->counts[bucket]++;
+    histogram->total++;
+    histogram->sum += value;
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+    pthread_mutex_unlock(&histogram->lock);
+}
+
+/**************** histogram_count() ****************/
+/* see histogram.h for description */
+long histogram_count(histogram_t* histogram)
+{
+    if (histogram == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&histogram->lock);
+    long total = histogram->total;
+    pthread_mutex_unlock(&histogram->lock);
+    return total;
+}
+
+/**************** histogram_percentile() ****************/
+/* see histogram.h for description */
+double histogram_percentile(histogram_t* histogram, double fraction)
+{
+    if (histogram == NULL)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&histogram->lock);
+    // The smallest value with at least that fraction of the values at or below it
+    long rank = fraction * histogram->total + 0.999999;
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    uint64_t value = 0;
+    long seen = 0;
+    for (int bucket = 0; histogram->total > 0 && bucket < NUM_BUCKETS; bucket++)
+    {
+        seen += histogram->counts[bucket];
+        if (seen >= rank)
+        {
+            value = bucketValue(bucket);
+            break;
+        }
+    }
+    if (value > histogram->max)
+    {
+        value = histogram->max;             // the top bucket's middle may be past the largest value
+    }
+    pthread_mutex_unlock(&histogram->lock);
+    return value / 1e6;
+}
+
+/**************** histogram_mean() ****************/
+/* see histogram.h for description */
+double histogram_mean(histogram_t* histogram)
+{
+    if (histogram == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&histogram->lock);
+    double mean = (histogram->total > 0) ? histogram->sum / histogram->total / 1e6 : 0;
+    pthread_mutex_unlock(&histogram->lock);
+    return mean;
+}
+
+/**************** histogram_max() ****************/
+/* see histogram.h for description */
+double histogram_max(histogram_t* histogram)
+{
+    if (histogram == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&histogram->lock);
+    uint64_t max = histogram->max;
+    pthread_mutex_unlock(&histogram->lock);
+    return max / 1e6;
+}
+
+/**************** histogram_print() ****************/
+/* see histogram.h for description */
+void histogram_print(histogram_t* histogram, FILE* fp)
+{
+    fprintf(fp, "{\"n\":%ld,\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"p999\":%.3f,\"max\":%.3f}",
+            histogram_count(histogram), histogram_mean(histogram) * 1e3,
+            histogram_percentile(histogram, 0.5) * 1e3, histogram_percentile(histogram, 0.9) * 1e3,
+            histogram_percentile(histogram, 0.99) * 1e3, histogram_percentile(histogram, 0.999) * 1e3,
+            histogram_max(histogram) * 1e3);
+}
+
+/**************** histogram_delete() ****************/
+/* see histogram.h for description */
+void histogram_delete(histogram_t* histogram)
+{
+    if (histogram != NULL)
+    {
+        pthread_mutex_destroy(&histogram->lock);
+        free(histogram);
+    }
+}
+
+/*
+ * bucketOf: Returns the bucket holding the given number of microseconds,
+ * which is below 2^MAX_BITS.
+ */
+static int bucketOf(uint64_t micros)
+{
+    if (micros < (1 << LINEAR_BITS))
+    {
+        return micros;
+    }
+    int top = LINEAR_BITS;                  // position of the highest bit
+    while ((micros >> (top + 1)) != 0)
+    {
+        top++;
+    }
+    int shift = top - SUB_BITS;
+    int sub = (micros >> shift) - (1 << SUB_BITS);
+    return (1 << LINEAR_BITS) + (shift - 1) * (1 << SUB_BITS) + sub;
+}
+
+/*
+ * bucketValue: Returns the middle of the values the bucket holds.
+ */
+static uint64_t bucketValue(int bucket)
+{
+    if (bucket < (1 << LINEAR_BITS))
+    {
+        return bucket;
+    }
+    int shift = (bucket - (1 << LINEAR_BITS)) / (1 << SUB_BITS) + 1;
+    uint64_t sub = (bucket - (1 << LINEAR_BITS)) % (1 << SUB_BITS) + (1 << SUB_BITS);
+    return (sub << shift) + ((uint64_t) 1 << (shift - 1));
+}
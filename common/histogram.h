@@ -0,0 +1,66 @@
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <stdio.h>
+
+/*
+ * histogram - a thread-safe histogram of durations, in the style of HDR
+ * Histogram
+ *
+ * Durations are recorded in whole microseconds into log-linear buckets:
+ * one per microsecond below 64us, and above that, 32 buckets to each
+ * power of two, so every bucket is within 1/32 (about 3%) of the values
+ * it holds.  Recording is a few shifts and an increment whatever the
+ * value, the whole histogram takes about 15KB, and percentiles of any
+ * number of values come from one pass over the buckets.  Durations from
+ * 0 to about 12 days are kept; longer ones count as the longest.
+ */
+typedef struct histogram histogram_t;
+
+/*
+ * Create a new, empty histogram.
+ * Returns pointer to the histogram, or NULL if out of memory.
+ * Caller is responsible for later calling histogram_delete.
+ */
+histogram_t* histogram_new(void);
+
+/*
+ * Record one duration, in seconds; negative durations are ignored.
+ */
+void histogram_record(histogram_t* histogram, double seconds);
+
+/*
+ * Returns the number of durations recorded.
+ */
+long histogram_count(histogram_t* histogram);
+
+/*
+ * Returns the duration, in seconds, that the given fraction (0 to 1)
+ * of those recorded are no longer than, to within 3%; or 0 if none
+ * have been recorded.
+ */
+double histogram_percentile(histogram_t* histogram, double fraction);
+
+/*
+ * Returns the mean of the durations recorded, in seconds, or 0 if none.
+ */
+double histogram_mean(histogram_t* histogram);
+
+/*
+ * Returns the longest duration recorded, in seconds, or 0 if none.
+ */
+double histogram_max(histogram_t* histogram);
+
+/*
+ * Write the histogram to fp as a JSON object giving the count, the mean,
+ * the 50th, 90th, 99th and 99.9th percentiles and the maximum, in
+ * milliseconds: {"n":..,"mean":..,"p50":..,"p90":..,"p99":..,"p999":..,"max":..}
+ */
+void histogram_print(histogram_t* histogram, FILE* fp);
+
+/*
+ * Delete the histogram.
+ */
+void histogram_delete(histogram_t* histogram);
+
+#endif //__HISTOGRAM_H
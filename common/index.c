@@ -6,10 +6,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <limits.h>
 #include "word.h"
 #include "../libcs50/file.h"
 #include "index.h"
+#include "indexmap.h"
+
+/**************** local constants ****************/
+static const int NUM_SECTIONS = 4;
 
 /**************** local types ****************/
 typedef struct index 
@@ -17,6 +23,60 @@ typedef struct index
     hashtable_t* ht;
 } index_t;
 
+/* A growing array of bytes */
+typedef struct buffer
+{
+    unsigned char* data;
+    size_t length;
+    size_t max;
+    bool ok;                    // false once out of memory
+} buffer_t;
+
+/* A word of the index and its counters, as gathered to be sorted */
+typedef struct wordctrs
+{
+    const char* word;
+    counters_t* ctrs;
+} wordctrs_t;
+
+/* A growing array of words, or of (docID, count) pairs */
+typedef struct gather
+{
+    wordctrs_t* words;
+    int* pairs;
+    int num;
+    int max;
+    bool ok;
+} gather_t;
+
+/* An index being written in the binary format, a word at a time */
+typedef struct indexwriter
+{
+    FILE* fp;
+    buffer_t terms;             // INDEX_TERMS, written on closing
+    buffer_t words;             // INDEX_WORDS, likewise
+    buffer_t postings;          // the postings of the word being added
+    gather_t pairs;
+    uint64_t postingsLength;    // bytes of INDEX_POSTINGS written so far
+    uint64_t lastDoc;
+    size_t lastWord;            // offset of the last word added in words
+    bool ok;                    // false once anything could not be written
+} indexwriter_t;
+
+/**************** local functions ****************/
+static index_t* loadBinary(FILE* fp);
+static int scanLastDoc(FILE* fp);
+static void gatherWord(void* arg, const char* key, void* item);
+static void gatherPair(void* arg, int key, int count);
+static void mergeWord(void* arg, const char* key, void* item);
+static void setCount(void* arg, const int key, const int count);
+static void lastOfWord(void* arg, const char* key, void* item);
+static void lastOfCounters(void* arg, const int key, const int count);
+static int compareWords(const void* a, const void* b);
+static int comparePairs(const void* a, const void* b);
+static void append(buffer_t* buffer, const void* data, size_t length);
+static void appendVarint(buffer_t* buffer, uint64_t value);
+
 /**************** index_new() ****************/
 /* see index.h for description */
 index_t* index_new(int num_slots)
@@ -99,6 +159,20 @@ void index_save(index_t* index, const char* filename)
 /* see index.h for description */
 index_t* index_load(FILE* fp)
 {
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+    int c = fgetc(fp);
+    if (c == '\0')
+    {
+        return loadBinary(fp);
+    }
+    if (c != EOF)
+    {
+        ungetc(c, fp);
+    }
+
     index_t* index = index_new(500);
     char* word;
     int docID;
@@ -149,4 +223,511 @@ void ctr_print(void* arg, int key, int count)
 {
     FILE *fp = arg;
     fprintf(fp, " %d %d", key, count);
-}
\ No newline at end of file
+}
+
+/**************** index_saveBinary() ****************/
+/* see index.h for description */
+bool index_saveBinary(index_t* index, const char* filename)
+{
+    if (index == NULL || filename == NULL)
+    {
+        return false;
+    }
+
+    // Gather the words, to write them in order
+    gather_t words = { NULL, NULL, 0, 0, true };
+    hashtable_iterate(index->ht, &words, gatherWord);
+    if (!words.ok)
+    {
+        free(words.words);
+        return false;
+    }
+    qsort(words.words, words.num, sizeof(wordctrs_t), compareWords);
+
+    indexwriter_t* writer = indexwriter_new(filename);
+    for (int i = 0; writer != NULL && i < words.num; i++)
+    {
+        if (!indexwriter_add(writer, words.words[i].word, words.words[i].ctrs))
+        {
+            break;
+        }
+    }
+    free(words.words);
+    return indexwriter_close(writer);
+}
+
+/**************** indexwriter_new() ****************/
+/* see index.h for description */
+indexwriter_t* indexwriter_new(const char* filename)
+{
+    indexwriter_t* writer = (filename != NULL) ? calloc(1, sizeof(indexwriter_t)) : NULL;
+    if (writer == NULL)
+    {
+        return NULL;
+    }
+    writer->fp = fopen(filename, "wb");
+    writer->terms.ok = writer->words.ok = writer->postings.ok = writer->pairs.ok = true;
+    writer->ok = writer->fp != NULL;
+
+    // The header and section table are written last, over these zeros, and
+    // the postings follow them as each word is added
+    uint32_t header[4] = { 0 };
+    indexsection_t sections[4] = { { 0 } };
+    if (!writer->ok || fwrite(header, sizeof(header), 1, writer->fp) != 1
+        || fwrite(sections, sizeof(sections), 1, writer->fp) != 1)
+    {
+        if (writer->fp != NULL)
+        {
+            fclose(writer->fp);
+        }
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/**************** indexwriter_add() ****************/
+/* see index.h for description */
+bool indexwriter_add(indexwriter_t* writer, const char* word, counters_t* ctrs)
+{
+    if (writer == NULL || word == NULL || ctrs == NULL || !writer->ok)
+    {
+        return false;
+    }
+    if (writer->terms.length > 0 && strcmp((char*) writer->words.data + writer->lastWord, word) >= 0)
+    {
+        writer->ok = false;
+        return false;
+    }
+
+    writer->pairs.num = 0;
+    counters_iterate(ctrs, &writer->pairs, gatherPair);
+    qsort(writer->pairs.pairs, writer->pairs.num, 2 * sizeof(int), comparePairs);
+
+    indexterm_t entry = { writer->postingsLength, (uint32_t) writer->words.length, writer->pairs.num };
+    writer->lastWord = writer->words.length;
+    append(&writer->terms, &entry, sizeof(entry));
+    append(&writer->words, word, strlen(word) + 1);
+    writer->postings.length = 0;
+    int last = 0;
+    for (int p = 0; p < writer->pairs.num; p++)
+    {
+        appendVarint(&writer->postings, (uint64_t) (writer->pairs.pairs[2 * p] - last));
+        appendVarint(&writer->postings, (uint64_t) writer->pairs.pairs[2 * p + 1]);
+        last = writer->pairs.pairs[2 * p];
+    }
+    writer->lastDoc = ((uint64_t) last > writer->lastDoc) ? (uint64_t) last : writer->lastDoc;
+
+    writer->ok = writer->pairs.ok && writer->terms.ok && writer->words.ok && writer->postings.ok
+                 && writer->words.length <= UINT32_MAX
+                 && fwrite(writer->postings.data, 1, writer->postings.length, writer->fp) == writer->postings.length;
+    writer->postingsLength += writer->postings.length;
+    return writer->ok;
+}
+
+/**************** indexwriter_close() ****************/
+/* see index.h for description */
+bool indexwriter_close(indexwriter_t* writer)
+{
+    if (writer == NULL)
+    {
+        return false;
+    }
+
+    // The postings, then each other section on an 8-byte boundary
+    uint64_t postingsOffset = INDEX_HEADER_BYTES + NUM_SECTIONS * sizeof(indexsection_t);
+    uint64_t termsOffset = (postingsOffset + writer->postingsLength + 7) / 8 * 8;
+    uint64_t textOffset = termsOffset + writer->terms.length;
+    uint64_t lastDocOffset = (textOffset + writer->words.length + 7) / 8 * 8;
+    uint32_t header[4] = { 0, INDEX_VERSION, NUM_SECTIONS, 0 };
+    memcpy(header, INDEX_MAGIC, 4);
+    indexsection_t sections[4] = {
+        { INDEX_TERMS, 0, termsOffset, writer->terms.length },
+        { INDEX_WORDS, 0, textOffset, writer->words.length },
+        { INDEX_POSTINGS, 0, postingsOffset, writer->postingsLength },
+        { INDEX_LASTDOC, 0, lastDocOffset, sizeof(writer->lastDoc) },
+    };
+    static const char padding[8] = { 0 };
+
+    FILE* fp = writer->fp;
+    size_t postingsPad = termsOffset - postingsOffset - writer->postingsLength;
+    size_t textPad = lastDocOffset - textOffset - writer->words.length;
+    bool ok = writer->ok
+              && fwrite(padding, 1, postingsPad, fp) == postingsPad
+              && fwrite(writer->terms.data, 1, writer->terms.length, fp) == writer->terms.length
+              && fwrite(writer->words.data, 1, writer->words.length, fp) == writer->words.length
+              && fwrite(padding, 1, textPad, fp) == textPad
+              && fwrite(&writer->lastDoc, sizeof(writer->lastDoc), 1, fp) == 1
+              && fseek(fp, 0, SEEK_SET) == 0
+              && fwrite(header, sizeof(header), 1, fp) == 1
+              && fwrite(sections, sizeof(sections), 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+    free(writer->terms.data);
+    free(writer->words.data);
+    free(writer->postings.data);
+    free(writer->pairs.pairs);
+    free(writer);
+    return ok;
+}
+
+/**************** index_deltaPath() ****************/
+/* see index.h for description */
+char* index_deltaPath(const char* filename, int n)
+{
+    if (filename == NULL)
+    {
+        return NULL;
+    }
+    int length = snprintf(NULL, 0, "%s.delta%d", filename, n);
+    char* path = malloc(length + 1);
+    if (path != NULL)
+    {
+        sprintf(path, "%s.delta%d", filename, n);
+    }
+    return path;
+}
+
+/**************** index_loadDeltas() ****************/
+/* see index.h for description */
+int index_loadDeltas(index_t* index, const char* filename)
+{
+    if (index == NULL || filename == NULL)
+    {
+        return -1;
+    }
+    int n = 0;
+    while (true)
+    {
+        char* path = index_deltaPath(filename, n + 1);
+        if (path == NULL)
+        {
+            return -1;
+        }
+        FILE* fp = fopen(path, "r");
+        free(path);
+        if (fp == NULL)
+        {
+            return n;
+        }
+        index_t* delta = index_load(fp);
+        fclose(fp);
+        if (delta == NULL)
+        {
+            return -1;
+        }
+        hashtable_iterate(delta->ht, index, mergeWord);
+        index_delete(delta);
+        n++;
+    }
+}
+
+/**************** index_lastDoc() ****************/
+/* see index.h for description */
+int index_lastDoc(index_t* index)
+{
+    int last = 0;
+    if (index != NULL)
+    {
+        hashtable_iterate(index->ht, &last, lastOfWord);
+    }
+    return last;
+}
+
+/**************** index_fileLastDoc() ****************/
+/* see index.h for description */
+int index_fileLastDoc(const char* filename)
+{
+    FILE* fp = (filename != NULL) ? fopen(filename, "r") : NULL;
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    int c = fgetc(fp);
+    if (c != '\0')
+    {
+        if (c != EOF)
+        {
+            ungetc(c, fp);
+        }
+        int last = scanLastDoc(fp);
+        fclose(fp);
+        return last;
+    }
+    fclose(fp);
+
+    // Only the header of a binary index is read, unless it lacks INDEX_LASTDOC
+    indexmap_t* map = indexmap_open(filename);
+    int last = indexmap_lastDoc(map);
+    for (int i = 0; map != NULL && last < 0 && i < indexmap_size(map); i++)
+    {
+        if (!indexmap_iterate(map, i, &last, lastOfCounters))
+        {
+            indexmap_close(map);
+            return -1;
+        }
+    }
+    if (map != NULL && last < 0)
+    {
+        last = 0;
+    }
+    indexmap_close(map);
+    return last;
+}
+
+/*
+ * scanLastDoc: Returns the highest docID in the text index at fp, or 0 if
+ * it is empty, reading each line's fields in turn (the word, then docID
+ * and count by turns) without keeping any.  Returns -1 if a docID is not
+ * a number.
+ */
+static int scanLastDoc(FILE* fp)
+{
+    int last = 0;
+    int field = 0;                      // fields before this one on its line
+    bool inField = false;
+    bool number = true;
+    long value = 0;
+    unsigned char chunk[65536];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    {
+        for (size_t i = 0; i < got; i++)
+        {
+            int c = chunk[i];
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            {
+                if (!inField)
+                {
+                    inField = true;
+                    number = true;
+                    value = 0;
+                }
+                if (field % 2 == 1)
+                {
+                    number = number && c >= '0' && c <= '9' && value <= (INT_MAX - (c - '0')) / 10;
+                    value = number ? value * 10 + (c - '0') : value;
+                }
+                continue;
+            }
+            if (inField && field % 2 == 1)
+            {
+                if (!number)
+                {
+                    return -1;
+                }
+                last = (value > last) ? (int) value : last;
+            }
+            field = (c == '\n') ? 0 : (inField ? field + 1 : field);
+            inField = false;
+        }
+    }
+    if (inField && field % 2 == 1)
+    {
+        if (!number)
+        {
+            return -1;
+        }
+        last = (value > last) ? (int) value : last;
+    }
+    return ferror(fp) ? -1 : last;
+}
+
+/*
+ * loadBinary: Loads an index in the binary format from fp, whose first
+ * byte has been read.  Returns NULL if any error, including a file that
+ * is not whole.
+ */
+static index_t* loadBinary(FILE* fp)
+{
+    // Read the whole file, putting back the byte already read
+    buffer_t file = { NULL, 0, 0, true };
+    append(&file, INDEX_MAGIC, 1);
+    unsigned char chunk[65536];
+    size_t got;
+    while (file.ok && (got = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    {
+        append(&file, chunk, got);
+    }
+    indexmap_t* map = file.ok ? indexmap_wrap(file.data, file.length) : NULL;
+
+    // Every word goes straight into a hashtable big enough for them all
+    int numTerms = indexmap_size(map);
+    index_t* index = (map != NULL) ? index_new(numTerms > 0 ? numTerms : 1) : NULL;
+    bool ok = index != NULL;
+    for (int i = 0; ok && i < numTerms; i++)
+    {
+        const char* word = indexmap_word(map, i);
+        counters_t* ctrs = (word != NULL) ? indexmap_counters(map, i) : NULL;
+        ok = ctrs != NULL && hashtable_insert(index->ht, word, ctrs);
+        if (!ok && ctrs != NULL)
+        {
+            counters_delete(ctrs);
+        }
+    }
+    indexmap_close(map);
+    free(file.data);
+    if (!ok && index != NULL)
+    {
+        index_delete(index);
+        index = NULL;
+    }
+    return index;
+}
+
+/*
+ * gatherWord: Adds a word of the index and its counters to a gather_t.
+ */
+static void gatherWord(void* arg, const char* key, void* item)
+{
+    gather_t* gather = arg;
+    if (gather->num == gather->max)
+    {
+        int max = (gather->max > 0) ? 2 * gather->max : 1024;
+        wordctrs_t* words = realloc(gather->words, max * sizeof(wordctrs_t));
+        if (words == NULL)
+        {
+            gather->ok = false;
+            return;
+        }
+        gather->words = words;
+        gather->max = max;
+    }
+    gather->words[gather->num++] = (wordctrs_t) { key, item };
+}
+
+/*
+ * gatherPair: Adds a (docID, count) pair to a gather_t.
+ */
+static void gatherPair(void* arg, int key, int count)
+{
+    gather_t* gather = arg;
+    if (gather->num == gather->max)
+    {
+        int max = (gather->max > 0) ? 2 * gather->max : 64;
+        int* pairs = realloc(gather->pairs, 2 * max * sizeof(int));
+        if (pairs == NULL)
+        {
+            gather->ok = false;
+            return;
+        }
+        gather->pairs = pairs;
+        gather->max = max;
+    }
+    gather->pairs[2 * gather->num] = key;
+    gather->pairs[2 * gather->num + 1] = count;
+    gather->num++;
+}
+
+/*
+ * mergeWord: Sets the counts of a delta segment's word in the index.
+ */
+static void mergeWord(void* arg, const char* key, void* item)
+{
+    index_t* index = arg;
+    counters_t* ctrs = hashtable_find(index->ht, key);
+    if (ctrs == NULL)
+    {
+        ctrs = counters_new();
+        if (ctrs != NULL && !hashtable_insert(index->ht, key, ctrs))
+        {
+            counters_delete(ctrs);
+            ctrs = NULL;
+        }
+        if (ctrs == NULL)
+        {
+            return;
+        }
+    }
+    counters_iterate(item, ctrs, setCount);
+}
+
+/*
+ * setCount: Sets a document's count in a counters set.
+ */
+static void setCount(void* arg, const int key, const int count)
+{
+    counters_set(arg, key, count);
+}
+
+/*
+ * lastOfWord: Raises *arg to the highest docID of a word.
+ */
+static void lastOfWord(void* arg, const char* key, void* item)
+{
+    counters_iterate(item, arg, lastOfCounters);
+}
+
+/*
+ * lastOfCounters: Raises *arg to a docID, if higher.
+ */
+static void lastOfCounters(void* arg, const int key, const int count)
+{
+    int* last = arg;
+    if (key > *last)
+    {
+        *last = key;
+    }
+}
+
+/*
+ * compareWords: Orders gathered words by strcmp.
+ */
+static int compareWords(const void* a, const void* b)
+{
+    return strcmp(((const wordctrs_t*) a)->word, ((const wordctrs_t*) b)->word);
+}
+
+/*
+ * comparePairs: Orders (docID, count) pairs by docID.
+ */
+static int comparePairs(const void* a, const void* b)
+{
+    int x = *(const int*) a;
+    int y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * append: Appends length bytes of data to a buffer, doubling it as need be.
+ */
+static void append(buffer_t* buffer, const void* data, size_t length)
+{
+    if (!buffer->ok)
+    {
+        return;
+    }
+    if (buffer->length + length > buffer->max)
+    {
+        size_t max = (buffer->max > 0) ? buffer->max : 4096;
+        while (max < buffer->length + length)
+        {
+            max *= 2;
+        }
+        unsigned char* grown = realloc(buffer->data, max);
+        if (grown == NULL)
+        {
+            buffer->ok = false;
+            return;
+        }
+        buffer->data = grown;
+        buffer->max = max;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+/*
+ * appendVarint: Appends value to a buffer as a varint.
+ */
+static void appendVarint(buffer_t* buffer, uint64_t value)
+{
+    unsigned char bytes[10];
+    int n = 0;
+    while (value >= 0x80)
+    {
+        bytes[n++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    bytes[n++] = (unsigned char) value;
+    append(buffer, bytes, n);
+}
@@ -2,10 +2,38 @@
 #define __INDEX_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "../libcs50/hashtable.h"
 #include "../libcs50/counters.h"
 
 typedef struct index index_t;
+typedef struct indexwriter indexwriter_t;
+
+/* The binary format's magic, version, header size and sections */
+#define INDEX_MAGIC "\0TSI"
+#define INDEX_VERSION 1
+#define INDEX_HEADER_BYTES 16
+#define INDEX_TERMS 1
+#define INDEX_WORDS 2
+#define INDEX_POSTINGS 3
+#define INDEX_LASTDOC 4
+
+/* An entry of the binary format's section table */
+typedef struct indexsection
+{
+    uint32_t id;
+    uint32_t zero;
+    uint64_t offset;
+    uint64_t length;
+} indexsection_t;
+
+/* A word's entry in the binary format's INDEX_TERMS section */
+typedef struct indexterm
+{
+    uint64_t postings;
+    uint32_t word;
+    uint32_t count;
+} indexterm_t;
 
 /* Create a new index data structure with a given number of slots for the hashtable */
 index_t* index_new(int num_slots);
@@ -19,12 +47,105 @@ void index_delete(index_t* index);
 /* Save the index to the specified file. */
 void index_save(index_t* index, const char* filename);
 
+/*
+ * Save the index to the specified file in the binary format:
+ *
+ *     4 bytes  "\0TSI"
+ *     4 bytes  version (INDEX_VERSION)
+ *     4 bytes  number of sections
+ *     4 bytes  zero
+ *     a table giving, for each section, its id (4 bytes), four zero
+ *     bytes, and its offset and length in the file (8 bytes each)
+ *
+ * followed by the sections, each starting on an 8-byte boundary, in any
+ * order (INDEX_POSTINGS is written first, so it can be written as it is
+ * encoded):
+ *
+ *     INDEX_TERMS     for each word, in strcmp order: the offset of its
+ *                     postings in INDEX_POSTINGS (8 bytes), the offset
+ *                     of the word in INDEX_WORDS (4 bytes) and its number
+ *                     of documents (4 bytes)
+ *     INDEX_WORDS     the words, each ending in '\0', in the same order
+ *     INDEX_POSTINGS  for each word, a varint of each docID less the one
+ *                     before it (the first less 0), then a varint of its
+ *                     count, in increasing docID
+ *     INDEX_LASTDOC   the highest docID in the index, or 0 if it is
+ *                     empty (8 bytes)
+ *
+ * A varint holds 7 bits in each byte, the lowest first, with the top bit
+ * set in every byte but the last.  The integers are written in native
+ * byte order, as page segments are, so the file is read back on the
+ * same kind of machine.  A loader skips sections it does not know.
+ * Returns false if the file could not be written.
+ */
+bool index_saveBinary(index_t* index, const char* filename);
+
+/*
+ * Start writing an index in the binary format to filename a word at a
+ * time, for an index too large to hold: each word's postings are written
+ * as it is added, and only the words and their INDEX_TERMS entries are
+ * kept until indexwriter_close.
+ * Returns NULL if the file could not be created or out of memory.
+ */
+indexwriter_t* indexwriter_new(const char* filename);
+
+/*
+ * Add a word and its documents' counts to the index being written; the
+ * words are to be added in strcmp order.
+ * Returns false, failing the whole file, if the word is out of order or
+ * could not be written.
+ */
+bool indexwriter_add(indexwriter_t* writer, const char* word, counters_t* ctrs);
+
+/*
+ * Finish writing the index, and free the writer.
+ * Returns false if any of the file could not be written, or writer is NULL.
+ */
+bool indexwriter_close(indexwriter_t* writer);
+
 /* 
- * Load the index from the specified file.
+ * Load the index from the specified file, in either the text format
+ * index_save writes or the binary format index_saveBinary writes; a
+ * binary file begins with a '\0', which no text index does.  A binary
+ * index may instead be queried in place; see indexmap.h.
  * Returns pointer to the loaded index, or NULL if any error.
  */
 index_t* index_load(FILE* fp);
 
+/*
+ * Returns the path of delta segment number n (from 1) of the index file
+ * filename, as a string the caller must free; or NULL if out of memory.
+ *
+ * An index file may be followed by delta segments, each an index file
+ * in either format of the pages added to the pageDirectory since: see
+ * indexer --update.  Every loader of an index is to load its delta
+ * segments too, setting each document's count from them, so a document
+ * in both the index and a delta segment, as while they are merged, is
+ * counted once.
+ */
+char* index_deltaPath(const char* filename, int n);
+
+/*
+ * Load each delta segment of the index file filename, from number 1
+ * until one is missing, into index, setting the counts of its documents.
+ * Returns the number of delta segments loaded, or -1 if any error.
+ */
+int index_loadDeltas(index_t* index, const char* filename);
+
+/*
+ * Returns the highest docID in the index, or 0 if it is empty.
+ */
+int index_lastDoc(index_t* index);
+
+/*
+ * Returns the highest docID in the index file filename, or 0 if it is
+ * empty, without loading the index: a binary index gives it in its
+ * INDEX_LASTDOC section (or, if written without one, its postings are
+ * decoded in place), and a text index, which has no header, is scanned.
+ * Returns -1 if the file cannot be read or is not an index.
+ */
+int index_fileLastDoc(const char* filename);
+
 /* 
  * Find the counters associated with the specified word in the index.
  * Returns pointer to the counters if found, otherwise NULL.
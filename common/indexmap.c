@@ -0,0 +1,304 @@
+/*
+ * indexmap.c    Sajjad C Kareem    December 10, 2023
+ *
+ * This file contains the implementation of an index in the binary
+ * format, queried in place.
+ * Functions include:
+ *     - indexmap_open: Map an index file.
+ *     - indexmap_wrap: Read an index from memory.
+ *     - indexmap_size: Count the words in the index.
+ *     - indexmap_lastDoc: Find the highest docID in the index.
+ *     - indexmap_word: Find a word by its number.
+ *     - indexmap_find: Find the number of a word.
+ *     - indexmap_iterate: Decode the postings of a word.
+ *     - indexmap_counters: Decode the postings of a word into counters.
+ *     - indexmap_close: Unmap the index.
+ *
+ * Only the header and section table are checked when the index is
+ * opened; a term entry is checked each time it is read, and its
+ * postings as they are decoded.
+ *
+ * See indexmap.h for more information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "index.h"
+#include "indexmap.h"
+
+/**************** local types ****************/
+typedef struct indexmap
+{
+    const unsigned char* data;
+    size_t length;
+    bool mapped;                        // whether data is to be unmapped on close
+    const unsigned char* terms;
+    int numTerms;
+    const char* words;
+    uint64_t wordsLength;
+    const unsigned char* postings;
+    uint64_t postingsLength;
+    int lastDoc;                        // -1 if the index does not give it
+} indexmap_t;
+
+/**************** local functions ****************/
+static bool readTerm(indexmap_t* map, int i, indexterm_t* term);
+static bool readVarint(const unsigned char** p, const unsigned char* end, uint64_t* value);
+static void setCounter(void* arg, const int key, const int count);
+
+/**************** indexmap_open() ****************/
+/* see indexmap.h for description */
+indexmap_t* indexmap_open(const char* filename)
+{
+    int fd = (filename != NULL) ? open(filename, O_RDONLY) : -1;
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < INDEX_HEADER_BYTES)
+    {
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    indexmap_t* map = indexmap_wrap(data, info.st_size);
+    if (map == NULL)
+    {
+        munmap(data, info.st_size);
+        return NULL;
+    }
+    map->mapped = true;
+    return map;
+}
+
+/**************** indexmap_wrap() ****************/
+/* see indexmap.h for description */
+indexmap_t* indexmap_wrap(const void* data, size_t length)
+{
+    const unsigned char* bytes = data;
+    uint32_t header[4];
+    if (data == NULL || length < INDEX_HEADER_BYTES || memcmp(bytes, INDEX_MAGIC, 4) != 0)
+    {
+        return NULL;
+    }
+    memcpy(header, bytes, sizeof(header));
+    if (header[1] != INDEX_VERSION || header[2] > (length - INDEX_HEADER_BYTES) / sizeof(indexsection_t))
+    {
+        return NULL;
+    }
+
+    // Find each section; any unknown are skipped
+    const unsigned char* found[INDEX_LASTDOC + 1] = { NULL };
+    uint64_t lengths[INDEX_LASTDOC + 1] = { 0 };
+    for (uint32_t i = 0; i < header[2]; i++)
+    {
+        indexsection_t section;
+        memcpy(&section, bytes + INDEX_HEADER_BYTES + i * sizeof(indexsection_t), sizeof(section));
+        if (section.offset > length || section.length > length - section.offset)
+        {
+            return NULL;
+        }
+        if (section.id >= INDEX_TERMS && section.id <= INDEX_LASTDOC)
+        {
+            found[section.id] = bytes + section.offset;
+            lengths[section.id] = section.length;
+        }
+    }
+    if (found[INDEX_TERMS] == NULL || found[INDEX_WORDS] == NULL || found[INDEX_POSTINGS] == NULL
+        || lengths[INDEX_TERMS] % sizeof(indexterm_t) != 0 || lengths[INDEX_TERMS] / sizeof(indexterm_t) >= INT_MAX)
+    {
+        return NULL;
+    }
+
+    indexmap_t* map = malloc(sizeof(indexmap_t));
+    if (map == NULL)
+    {
+        return NULL;
+    }
+    map->data = bytes;
+    map->length = length;
+    map->mapped = false;
+    map->terms = found[INDEX_TERMS];
+    map->numTerms = lengths[INDEX_TERMS] / sizeof(indexterm_t);
+    map->words = (const char*) found[INDEX_WORDS];
+    map->wordsLength = lengths[INDEX_WORDS];
+    map->postings = found[INDEX_POSTINGS];
+    map->postingsLength = lengths[INDEX_POSTINGS];
+    map->lastDoc = -1;
+    if (found[INDEX_LASTDOC] != NULL && lengths[INDEX_LASTDOC] == sizeof(uint64_t))
+    {
+        uint64_t lastDoc;
+        memcpy(&lastDoc, found[INDEX_LASTDOC], sizeof(lastDoc));
+        map->lastDoc = (lastDoc <= INT_MAX) ? (int) lastDoc : -1;
+    }
+    return map;
+}
+
+/**************** indexmap_size() ****************/
+/* see indexmap.h for description */
+int indexmap_size(indexmap_t* map)
+{
+    return (map != NULL) ? map->numTerms : 0;
+}
+
+/**************** indexmap_lastDoc() ****************/
+/* see indexmap.h for description */
+int indexmap_lastDoc(indexmap_t* map)
+{
+    return (map != NULL) ? map->lastDoc : -1;
+}
+
+/**************** indexmap_word() ****************/
+/* see indexmap.h for description */
+const char* indexmap_word(indexmap_t* map, int i)
+{
+    indexterm_t term;
+    return readTerm(map, i, &term) ? map->words + term.word : NULL;
+}
+
+/**************** indexmap_find() ****************/
+/* see indexmap.h for description */
+int indexmap_find(indexmap_t* map, const char* word)
+{
+    if (map == NULL || word == NULL)
+    {
+        return -1;
+    }
+    int low = 0;
+    int high = map->numTerms - 1;
+    while (low <= high)
+    {
+        int middle = low + (high - low) / 2;
+        const char* found = indexmap_word(map, middle);
+        if (found == NULL)
+        {
+            return -1;
+        }
+        int cmp = strcmp(word, found);
+        if (cmp == 0)
+        {
+            return middle;
+        } else if (cmp < 0) {
+            high = middle - 1;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return -1;
+}
+
+/**************** indexmap_iterate() ****************/
+/* see indexmap.h for description */
+bool indexmap_iterate(indexmap_t* map, int i, void* arg,
+                      void (*itemfunc)(void* arg, const int key, const int count))
+{
+    indexterm_t term;
+    // Each posting takes two bytes at least
+    if (itemfunc == NULL || !readTerm(map, i, &term) || term.postings > map->postingsLength
+        || term.count > (map->postingsLength - term.postings) / 2)
+    {
+        return false;
+    }
+
+    const unsigned char* p = map->postings + term.postings;
+    const unsigned char* end = map->postings + map->postingsLength;
+    uint64_t docID = 0;
+    for (uint32_t n = 0; n < term.count; n++)
+    {
+        uint64_t delta, count;
+        if (!readVarint(&p, end, &delta) || !readVarint(&p, end, &count)
+            || delta == 0 || docID + delta > INT_MAX || count > INT_MAX)
+        {
+            return false;
+        }
+        docID += delta;
+        (*itemfunc)(arg, (int) docID, (int) count);
+    }
+    return true;
+}
+
+/**************** indexmap_counters() ****************/
+/* see indexmap.h for description */
+counters_t* indexmap_counters(indexmap_t* map, int i)
+{
+    counters_t* ctrs = counters_new();
+    if (ctrs != NULL && !indexmap_iterate(map, i, ctrs, setCounter))
+    {
+        counters_delete(ctrs);
+        ctrs = NULL;
+    }
+    return ctrs;
+}
+
+/**************** indexmap_close() ****************/
+/* see indexmap.h for description */
+void indexmap_close(indexmap_t* map)
+{
+    if (map != NULL)
+    {
+        if (map->mapped)
+        {
+            munmap((void*) map->data, map->length);
+        }
+        free(map);
+    }
+}
+
+/*
+ * readTerm: Reads the entry of word number i into *term, checking that
+ * its word lies whole in the words section.  Returns false if there is
+ * no such word or it is corrupt.
+ */
+static bool readTerm(indexmap_t* map, int i, indexterm_t* term)
+{
+    if (map == NULL || i < 0 || i >= map->numTerms)
+    {
+        return false;
+    }
+    memcpy(term, map->terms + (size_t) i * sizeof(indexterm_t), sizeof(indexterm_t));
+    return term->word < map->wordsLength
+           && memchr(map->words + term->word, '\0', map->wordsLength - term->word) != NULL;
+}
+
+/*
+ * readVarint: Reads a varint at *p, no further than end, into *value, and
+ * moves *p past it.  Returns false if it runs past end or is too long.
+ */
+static bool readVarint(const unsigned char** p, const unsigned char* end, uint64_t* value)
+{
+    *value = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7)
+    {
+        unsigned char byte = *(*p)++;
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * setCounter: Sets a document's count in a counters set.
+ */
+static void setCounter(void* arg, const int key, const int count)
+{
+    counters_set(arg, key, count);
+}
@@ -0,0 +1,82 @@
+#ifndef __INDEXMAP_H
+#define __INDEXMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "../libcs50/counters.h"
+
+/*
+ * indexmap - an index in the binary format, queried where it lies
+ *
+ * An index saved by index_saveBinary (see index.h) needs no parsing to be
+ * queried: its words are sorted, so a word is found by binary search of
+ * the fixed-size entries of its INDEX_TERMS section, and only then are
+ * the word's postings decoded.  indexmap_open maps the file read-only and
+ * shared, so opening an index of any size takes a check of its header,
+ * and every process with the same index open shares one copy of it in
+ * the page cache.
+ *
+ * Words are numbered from 0, in strcmp order.  Each entry and posting is
+ * checked as it is read, so a corrupt file gives errors rather than
+ * crashes.
+ */
+typedef struct indexmap indexmap_t;
+
+/*
+ * Map the index file filename.
+ * Returns NULL if it is not an index in the binary format, or any error.
+ * Caller is responsible for later calling indexmap_close.
+ */
+indexmap_t* indexmap_open(const char* filename);
+
+/*
+ * Read an index in the binary format from length bytes of memory at
+ * data, which the caller keeps until indexmap_close.
+ * Returns NULL if it is not an index in the binary format, or any error.
+ */
+indexmap_t* indexmap_wrap(const void* data, size_t length);
+
+/*
+ * Returns the number of words in the index, or 0 if map is NULL.
+ */
+int indexmap_size(indexmap_t* map);
+
+/*
+ * Returns the highest docID in the index, as its INDEX_LASTDOC section
+ * gives it, or -1 if it has none or map is NULL.
+ */
+int indexmap_lastDoc(indexmap_t* map);
+
+/*
+ * Returns word number i, or NULL if there is none or it is corrupt.
+ * The word lies in the index, and is valid until indexmap_close.
+ */
+const char* indexmap_word(indexmap_t* map, int i);
+
+/*
+ * Returns the number of word, or -1 if it is not in the index.
+ */
+int indexmap_find(indexmap_t* map, const char* word);
+
+/*
+ * Decode the postings of word number i, calling itemfunc on each
+ * document's docID and count, in increasing docID.
+ * Returns false if there is no such word or its postings are corrupt,
+ * in which case itemfunc may have been called on some of them.
+ */
+bool indexmap_iterate(indexmap_t* map, int i, void* arg,
+                      void (*itemfunc)(void* arg, const int key, const int count));
+
+/*
+ * Returns the postings of word number i as a new counters set, or NULL
+ * if there is no such word, its postings are corrupt, or out of memory.
+ * Caller is responsible for later calling counters_delete.
+ */
+counters_t* indexmap_counters(indexmap_t* map, int i);
+
+/*
+ * Unmap the index, and free the indexmap.
+ */
+void indexmap_close(indexmap_t* map);
+
+#endif //__INDEXMAP_H
@@ -0,0 +1,282 @@
+/*
+ * logger.c    Sajjad C Kareem    November 30, 2023
+ *
+ * This file contains the implementation of the background log writer.
+ * Functions include:
+ *     - logger_new: Create a logger and start its writer.
+ *     - logger_enabled: Check whether a level is logged.
+ *     - logger_printf: Queue a line.
+ *     - logger_dropped: Count the lines dropped.
+ *     - logger_delete: Drain the ring, stop the writer and free the logger.
+ *
+ * The ring is the bounded queue of Dmitry Vyukov: each slot has a sequence
+ * number that says whose turn it is.  A slot at position pos is free for
+ * the thread that claims pos when its sequence is pos, and holds a line
+ * for the writer when it is pos + 1; the writer hands it back for the
+ * next lap by setting it to pos + capacity.  Loggers claim positions by
+ * advancing head with compare-and-swap; only the writer moves tail.
+ *
+ * See logger.h for more information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "logger.h"
+
+/**************** local constants ****************/
+#define SLOT_BYTES 240                      // lines this long or longer are kept in the heap
+#define BATCH_BYTES 65536                   // the writer's buffer
+static const long IDLE_NANOS = 1000000;     // the writer's nap when the ring is empty
+
+/**************** local types ****************/
+typedef struct slot
+{
+    atomic_size_t sequence;
+    char* longText;                         // the line, if it did not fit in text; otherwise NULL
+    int length;
+    char text[SLOT_BYTES];
+} slot_t;
+
+typedef struct logger
+{
+    loglevel_t level;
+    FILE* out;
+    slot_t* slots;
+    size_t mask;                            // capacity - 1, capacity being a power of two
+    atomic_size_t head;                     // the next position to claim
+    size_t tail;                            // the next position to write; the writer's alone
+    atomic_long dropped;
+    atomic_bool stopping;
+    pthread_t writer;
+    char batch[BATCH_BYTES];
+    size_t batchLength;
+} logger_t;
+
+/**************** local functions ****************/
+static void* writeLines(void* arg);
+static void batchAdd(logger_t* logger, const char* text, int length);
+static void batchFlush(logger_t* logger);
+
+/**************** logger_new() ****************/
+/* see logger.h for description */
+logger_t* logger_new(loglevel_t level, FILE* out, int capacity)
+{
+    if (out == NULL || capacity < 2)
+    {
+        return NULL;
+    }
+    logger_t* logger = malloc(sizeof(logger_t));
+    if (logger == NULL)
+    {
+        return NULL;
+    }
+
+    size_t slots = 2;
+    while (slots < (size_t) capacity)
+    {
+        slots *= 2;
+    }
+    logger->slots = malloc(slots * sizeof(slot_t));
+    if (logger->slots == NULL)
+    {
+        free(logger);
+        return NULL;
+    }
+    for (size_t i = 0; i < slots; i++)
+    {
+        atomic_init(&logger->slots[i].sequence, i);
+        logger->slots[i].longText = NULL;
+    }
+    logger->level = level;
+    logger->out = out;
+    logger->mask = slots - 1;
+    atomic_init(&logger->head, 0);
+    logger->tail = 0;
+    atomic_init(&logger->dropped, 0);
+    atomic_init(&logger->stopping, false);
+    logger->batchLength = 0;
+
+    if (pthread_create(&logger->writer, NULL, writeLines, logger) != 0)
+    {
+        free(logger->slots);
+        free(logger);
+        return NULL;
+    }
+    return logger;
+}
+
+/**************** logger_enabled() ****************/
+/* see logger.h for description */
+bool logger_enabled(logger_t* logger, loglevel_t level)
+{
+    return logger != NULL && level <= logger->level;
+}
+
+/**************** logger_printf() ****************/
+/* see logger.h for description */
+void logger_printf(logger_t* logger, loglevel_t level, const char* format, ...)
+{
+    if (!logger_enabled(logger, level))
+    {
+        return;
+    }
+
+    // Format the line before claiming a slot, so the slot is held as briefly as can be
+    char text[SLOT_BYTES];
+    char* longText = NULL;
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0)
+    {
+        return;
+    }
+    if (length >= SLOT_BYTES)
+    {
+        longText = malloc(length + 1);
+        if (longText == NULL)
+        {
+            atomic_fetch_add(&logger->dropped, 1);
+            return;
+        }
+        va_start(args, format);
+        vsnprintf(longText, length + 1, format, args);
+        va_end(args);
+    }
+
+    size_t pos = atomic_load_explicit(&logger->head, memory_order_relaxed);
+    slot_t* slot;
+    while (true)
+    {
+        slot = &logger->slots[pos & logger->mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t lap = (intptr_t) sequence - (intptr_t) pos;
+        if (lap == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&logger->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                break;                      // pos is ours
+            }
+        } else if (lap < 0) {
+            // The writer has not yet emptied this slot from the last lap: the ring is full
+            atomic_fetch_add(&logger->dropped, 1);
+            free(longText);
+            return;
+        } else {
+            pos = atomic_load_explicit(&logger->head, memory_order_relaxed);   // another thread claimed pos
+        }
+    }
+
+    slot->length = length;
+    slot->longText = longText;
+    if (longText == NULL)
+    {
+        memcpy(slot->text, text, length);
+    }
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+}
+
+/**************** logger_dropped() ****************/
+/* see logger.h for description */
+long logger_dropped(logger_t* logger)
+{
+    return (logger != NULL) ? atomic_load(&logger->dropped) : 0;
+}
+
+/**************** logger_delete() ****************/
+/* see logger.h for description */
+void logger_delete(logger_t* logger)
+{
+    if (logger != NULL)
+    {
+        atomic_store(&logger->stopping, true);
+        pthread_join(logger->writer, NULL);
+        fflush(logger->out);
+        free(logger->slots);
+        free(logger);
+    }
+}
+
+/*
+ * writeLines: The writer thread's loop.  Copies each line, as it becomes
+ * ready, into the batch, and writes the batch out whenever it fills or the
+ * ring runs dry; naps while the ring is empty, and returns once it is
+ * empty after logger_delete has asked it to stop.
+ */
+static void* writeLines(void* arg)
+{
+    logger_t* logger = arg;
+    while (true)
+    {
+        // Read stopping first: once it is set, no more lines are coming, so empty means done
+        bool stopping = atomic_load(&logger->stopping);
+        slot_t* slot = &logger->slots[logger->tail & logger->mask];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) == logger->tail + 1)
+        {
+            if (slot->longText != NULL)
+            {
+                batchAdd(logger, slot->longText, slot->length);
+                free(slot->longText);
+                slot->longText = NULL;
+            } else {
+                batchAdd(logger, slot->text, slot->length);
+            }
+            atomic_store_explicit(&slot->sequence, logger->tail + logger->mask + 1, memory_order_release);
+            logger->tail++;
+            continue;
+        }
+
+        batchFlush(logger);
+        if (stopping)
+        {
+            return NULL;
+        }
+        struct timespec nap = { 0, IDLE_NANOS };
+        nanosleep(&nap, NULL);
+    }
+}
+
+/*
+ * batchAdd: Appends a line to the writer's batch, first writing the batch
+ * out if the line would not fit; a line longer than the batch is written
+ * straight out.
+ */
+static void batchAdd(logger_t* logger, const char* text, int length)
+{
+    if (logger->batchLength + length > BATCH_BYTES)
+    {
+        batchFlush(logger);
+    }
+    if (length > BATCH_BYTES)
+    {
+        fwrite(text, 1, length, logger->out);
+        fflush(logger->out);
+        return;
+    }
+    memcpy(logger->batch + logger->batchLength, text, length);
+    logger->batchLength += length;
+}
+
+/*
+ * batchFlush: Writes out the writer's batch, and flushes the stream so the
+ * lines are seen promptly.
+ */
+static void batchFlush(logger_t* logger)
+{
+    if (logger->batchLength > 0)
+    {
+        fwrite(logger->batch, 1, logger->batchLength, logger->out);
+        fflush(logger->out);
+        logger->batchLength = 0;
+    }
+}
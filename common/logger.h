@@ -0,0 +1,66 @@
+#ifndef __LOGGER_H
+#define __LOGGER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/*
+ * logger - a levelled log whose lines are written by a background thread
+ *
+ * Lines are formatted by the threads that log them and queued in a ring
+ * of fixed-size slots, claimed with an atomic compare-and-swap, so no
+ * thread logging ever takes a lock or waits on the output stream; one
+ * writer thread copies the lines out in order and writes them in large
+ * batches.  Lines logged by one thread are written in the order logged.
+ * If the ring is full, because the output cannot keep up, the line is
+ * dropped and counted rather than waiting for room.
+ *
+ * A line above the logger's level is discarded before it is formatted,
+ * so logging that is switched off costs one comparison.
+ */
+typedef struct logger logger_t;
+
+typedef enum
+{
+    LOG_QUIET,          // nothing
+    LOG_SUMMARY,        // a line per page
+    LOG_VERBOSE         // a line per page and per link found
+} loglevel_t;
+
+/*
+ * Create a logger and start its writer thread.
+ * Takes level: the most detailed level of line to write.
+ * Takes out: the stream to write to, which the writer thread alone
+ *   should write to until logger_delete.
+ * Takes capacity: the number of lines the ring holds; at least 2.
+ * Returns pointer to the logger, or NULL if any error.
+ * Caller is responsible for later calling logger_delete.
+ */
+logger_t* logger_new(loglevel_t level, FILE* out, int capacity);
+
+/*
+ * Returns true if lines at the given level are written; a caller may
+ * use it to skip work done only to log.
+ */
+bool logger_enabled(logger_t* logger, loglevel_t level);
+
+/*
+ * Queue a line, formatted as by printf, if level is at or below the
+ * logger's level; the format should end the line with "\n".
+ * Never blocks.  A NULL logger discards the line.
+ */
+void logger_printf(logger_t* logger, loglevel_t level, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/*
+ * Returns the number of lines dropped because the ring was full.
+ */
+long logger_dropped(logger_t* logger);
+
+/*
+ * Write every line queued, stop the writer thread, flush the stream
+ * (without closing it) and free the logger.
+ */
+void logger_delete(logger_t* logger);
+
+#endif //__LOGGER_H
@@ -0,0 +1,230 @@
+/*
+ * lz.c    Sajjad C Kareem    November 20, 2023
+ *
+ * This file contains the implementation of the LZ77 block codec.
+ * Functions include:
+ *     - lz_bound: The largest a compressed block can be.
+ *     - lz_compress: Compress a block.
+ *     - lz_decompress: Decompress a block, checking it as it goes.
+ *
+ * See lz.h for the block layout.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lz.h"
+
+/**************** local constants ****************/
+static const size_t MIN_MATCH = 4;              // shortest match, and bytes hashed
+static const size_t MAX_OFFSET = 65535;         // furthest back a match may be
+static const int HASH_BITS = 14;                // hash table of 16384 positions
+
+/**************** local functions ****************/
+static uint32_t read32(const unsigned char* p);
+static bool emit(unsigned char* out, size_t* op, size_t cap, const unsigned char* literals,
+                 size_t numLiterals, size_t offset, size_t matchLen);
+static bool readLength(const unsigned char* in, size_t* ip, size_t n, size_t* length);
+
+/**************** lz_bound() ****************/
+/* see lz.h for description */
+size_t lz_bound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+/**************** lz_compress() ****************/
+/* see lz.h for description */
+size_t lz_compress(const char* src, size_t n, char* dst, size_t cap)
+{
+    if (src == NULL || dst == NULL)
+    {
+        return 0;
+    }
+
+    // Each slot holds 1 + the last position with that hash, or 0 for none
+    uint32_t* table = calloc(1 << HASH_BITS, sizeof(uint32_t));
+    if (table == NULL)
+    {
+        return 0;
+    }
+
+    const unsigned char* in = (const unsigned char*) src;
+    unsigned char* out = (unsigned char*) dst;
+    size_t op = 0;
+    size_t anchor = 0;              // start of the literals not yet written
+    size_t ip = 0;
+    bool ok = true;
+    while (ok && ip + MIN_MATCH <= n)
+    {
+        uint32_t seq = read32(in + ip);
+        uint32_t hash = (seq * 2654435761u) >> (32 - HASH_BITS);
+        size_t candidate = table[hash];
+        table[hash] = ip + 1;
+
+        if (candidate > 0 && ip - (candidate - 1) <= MAX_OFFSET && read32(in + candidate - 1) == seq)
+        {
+            candidate--;
+            size_t len = MIN_MATCH;
+            while (ip + len < n && in[candidate + len] == in[ip + len])
+            {
+                len++;
+            }
+            ok = emit(out, &op, cap, in + anchor, ip - anchor, ip - candidate, len);
+            ip += len;
+            anchor = ip;
+
+            // Remember a position near the match's end too, as text often repeats in runs
+            if (ip + MIN_MATCH <= n)
+            {
+                table[(read32(in + ip - 2) * 2654435761u) >> (32 - HASH_BITS)] = ip - 2 + 1;
+            }
+        } else {
+            ip++;
+        }
+    }
+    ok = ok && emit(out, &op, cap, in + anchor, n - anchor, 0, 0);
+
+    free(table);
+    return ok ? op : 0;
+}
+
+/**************** lz_decompress() ****************/
+/* see lz.h for description */
+long lz_decompress(const char* src, size_t n, char* dst, size_t cap)
+{
+    if (src == NULL || dst == NULL)
+    {
+        return -1;
+    }
+
+    const unsigned char* in = (const unsigned char*) src;
+    unsigned char* out = (unsigned char*) dst;
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < n)
+    {
+        unsigned int token = in[ip++];
+
+        /* Literals */
+        size_t numLiterals = token >> 4;
+        if (!readLength(in, &ip, n, &numLiterals) || numLiterals > n - ip || numLiterals > cap - op)
+        {
+            return -1;
+        }
+        memcpy(out + op, in + ip, numLiterals);
+        ip += numLiterals;
+        op += numLiterals;
+        if (ip == n)
+        {
+            break;                  // the last sequence has no match
+        }
+
+        /* Match */
+        if (n - ip < 2)
+        {
+            return -1;
+        }
+        size_t offset = in[ip] | (size_t) in[ip + 1] << 8;
+        ip += 2;
+        size_t len = token & 15;
+        if (offset == 0 || offset > op || !readLength(in, &ip, n, &len) || len + MIN_MATCH > cap - op)
+        {
+            return -1;
+        }
+        len += MIN_MATCH;
+        if (offset >= len)
+        {
+            memcpy(out + op, out + op - offset, len);
+        } else {
+            // The match overlaps its own output, repeating the last offset bytes
+            for (size_t i = 0; i < len; i++)
+            {
+                out[op + i] = out[op + i - offset];
+            }
+        }
+        op += len;
+    }
+    return op;
+}
+
+/*
+ * read32: Returns the four bytes at p as an integer, whatever their alignment.
+ */
+static uint32_t read32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/*
+ * emit: Append a sequence of numLiterals literals and then, if matchLen
+ * is not 0, a match of matchLen bytes at offset back.
+ * Returns false, leaving *op unchanged, if the sequence would not fit in cap.
+ */
+static bool emit(unsigned char* out, size_t* op, size_t cap, const unsigned char* literals,
+                 size_t numLiterals, size_t offset, size_t matchLen)
+{
+    size_t extra = (matchLen > 0) ? matchLen - MIN_MATCH : 0;
+    size_t need = 1 + numLiterals / 255 + 1 + numLiterals + ((matchLen > 0) ? 2 + extra / 255 + 1 : 0);
+    if (need > cap - *op)
+    {
+        return false;
+    }
+
+    size_t pos = *op;
+    out[pos++] = (numLiterals >= 15 ? 15 : numLiterals) << 4 | (extra >= 15 ? 15 : extra);
+    if (numLiterals >= 15)
+    {
+        size_t rest = numLiterals - 15;
+        for (; rest >= 255; rest -= 255)
+        {
+            out[pos++] = 255;
+        }
+        out[pos++] = rest;
+    }
+    memcpy(out + pos, literals, numLiterals);
+    pos += numLiterals;
+
+    if (matchLen > 0)
+    {
+        out[pos++] = offset & 255;
+        out[pos++] = offset >> 8;
+        if (extra >= 15)
+        {
+            size_t rest = extra - 15;
+            for (; rest >= 255; rest -= 255)
+            {
+                out[pos++] = 255;
+            }
+            out[pos++] = rest;
+        }
+    }
+    *op = pos;
+    return true;
+}
+
+/*
+ * readLength: If *length is 15, add on the continuation bytes at *ip,
+ * moving *ip past them.  Returns false if the block ends first.
+ */
+static bool readLength(const unsigned char* in, size_t* ip, size_t n, size_t* length)
+{
+    if (*length != 15)
+    {
+        return true;
+    }
+    unsigned int byte;
+    do
+    {
+        if (*ip >= n)
+        {
+            return false;
+        }
+        byte = in[(*ip)++];
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef __LZ_H
+#define __LZ_H
+
+#include <stddef.h>
+
+/*
+ * lz - a small LZ77 block codec for page HTML
+ *
+ * A block is a series of sequences, each a run of literal bytes followed
+ * by a match: a copy of earlier output, up to 65535 bytes back, of at
+ * least 4 bytes.  A sequence starts with a token byte whose high four bits
+ * are the literal count and low four bits the match length minus 4; a
+ * value of 15 in either is continued in following bytes, each added on,
+ * until one is less than 255.  Then come the literals, the match offset
+ * in two bytes (low byte first), and any match-length bytes.  The last
+ * sequence has literals only.  This is the layout LZ4 uses, which keeps
+ * decoding to little more than memcpy.
+ *
+ * Compression finds matches with a hash table of 4-byte sequences, taking
+ * the first match it finds; HTML, with its repeated tags and attributes,
+ * typically shrinks to 40% or less of its size.
+ */
+
+/*
+ * Returns the most bytes lz_compress can produce from n bytes.
+ */
+size_t lz_bound(size_t n);
+
+/*
+ * Compress n bytes at src into dst, which has room for cap bytes.
+ * Returns the compressed size, or 0 if it would exceed cap or on error.
+ */
+size_t lz_compress(const char* src, size_t n, char* dst, size_t cap);
+
+/*
+ * Decompress n bytes at src into dst, which has room for cap bytes.
+ * Returns the decompressed size, or -1 if the block is damaged or
+ * would exceed cap.
+ */
+long lz_decompress(const char* src, size_t n, char* dst, size_t cap);
+
+#endif //__LZ_H
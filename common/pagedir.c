@@ -4,14 +4,98 @@
  * This file contains the implementations for page directory handling. Functions include:
  *     - pagedir_init: Initializes a page directory.
  *     - pagedir_save: Saves a webpage into the page directory.
+ *     - pagedir_validate: Checks for a crawler-produced directory.
+ *     - pagedir_setPartitions, pagedir_partitions: Record and read how many
+ *       crawler processes numbered the pages.
+ *     - pagedir_load: Reads a page from a page file or a segment.
+ *     - pagedir_open, pagedir_create: Open a page directory of either form.
+ *     - pagedir_put, pagedir_get, pagedir_getURL, pagedir_remove: Save,
+ *       load and remove pages by docID.
+ *     - pagedir_lastDocID: Find the highest docID a page is saved under.
+ *     - pagedir_setCompressed, pagedir_stats, pagedir_isPacked, pagedir_close.
+ *
+ * In a packed page directory, pages are appended to the last segment,
+ * and each index entry is two native 64-bit integers, the segment number
+ * (0 if there is no such page) and the record's offset, at position
+ * (docID - 1) * 16 in the index.  Segments are opened for reading as they
+ * are first needed and kept open.  When a packed directory is first
+ * written to, the last segment is cut back to its last complete record,
+ * in case a crash left part of one.
+ *
+ * A compressed record has the magic "\0TSZ" and one more field after the
+ * HTML length: the length of the compressed HTML that follows the URL.
+ * A page whose HTML does not shrink is saved as a plain record.  With
+ * compression on, page files hold a single record rather than text;
+ * pagedir_load tells the two apart by the record's leading NUL.
  */
 
+#define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
 #include "pagedir.h"
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "../libcs50/file.h"
+#include "lz.h"
+
+/**************** local types ****************/
+typedef struct pagedir
+{
+    char* dirname;
+    bool packed;
+    FILE* index;                // packed: the offset index
+    bool writable;              // whether the index is open for update
+    FILE** readers;             // packed: segments open for reading, by number - 1, or NULL
+    int numReaders;             // length of readers
+    int numSegments;            // segments that exist
+    FILE* writer;               // the last segment, open for appending, or NULL
+    long writeSize;             // its size
+    bool compress;              // whether to compress the HTML of pages saved
+    pagedirstats_t stats;
+    pthread_mutex_t lock;       // guards stats, and all of the above for a packed directory
+} pagedir_t;
+
+typedef struct record
+{
+    uint32_t docID;
+    uint32_t depth;
+    uint32_t urlLen;
+    uint32_t htmlLen;
+    uint32_t storedLen;         // bytes of HTML in the record, compressed or not
+    bool compressed;
+} record_t;
+
+/**************** local constants ****************/
+static const char RECORD_MAGIC[4] = { '\0', 'T', 'S', 'E' };
+static const char COMPRESSED_MAGIC[4] = { '\0', 'T', 'S', 'Z' };
+static const long HEADER_BYTES = 4 + 4 * sizeof(uint32_t);
+static const long COMPRESSED_HEADER_BYTES = 4 + 5 * sizeof(uint32_t);
+static const long SEGMENT_BYTES = 1L << 30;        // start a new segment beyond this size
+
+/**************** local functions ****************/
+static char* dirPath(const char* dirname, const char* name, int n);
+static pagedir_t* newPagedir(const char* dirname, bool packed);
+static bool readHeader(FILE* fp, record_t* rec);
+static long recordBytes(const record_t* rec);
+static webpage_t* loadRecord(FILE* fp, record_t* rec, bool withHTML, double* decodeSeconds);
+static char* buildRecord(const webpage_t* page, int docID, bool compress, record_t* rec);
+static bool saveRecordFile(pagedir_t* dir, const char* record, long length, int docID);
+static webpage_t* loadFile(pagedir_t* dir, int docID, bool withHTML);
+static webpage_t* loadPacked(pagedir_t* dir, int docID, bool withHTML);
+static double now(void);
+static bool readEntry(pagedir_t* dir, int docID, uint64_t entry[2]);
+static bool writeEntry(pagedir_t* dir, int docID, uint64_t seg, uint64_t offset);
+static bool openWritable(pagedir_t* dir);
+static bool openWriter(pagedir_t* dir);
+static FILE* segmentReader(pagedir_t* dir, int seg);
 
 /*
  * Initialize a page directory.
@@ -46,19 +130,24 @@ bool pagedir_init(const char* pageDirectory)
  */
 void pagedir_save(const webpage_t* page, const char* pageDirectory, const int docID)
 {
-    /* Allocate space for filename */
+    /* Allocate space for filename, and the temporary name it is written under */
     char* filename = malloc(strlen(pageDirectory) + 20);
-    if (filename == NULL)
+    char* tempname = malloc(strlen(pageDirectory) + 24);
+    if (filename == NULL || tempname == NULL)
     {
+        free(filename);
+        free(tempname);
         return;
     }
 
     sprintf(filename, "%s/%d", pageDirectory, docID);                        // Create a page with the docID in the directory
+    sprintf(tempname, "%s/.%d.tmp", pageDirectory, docID);
 
-    FILE* fp = fopen(filename, "w");
+    FILE* fp = fopen(tempname, "w");
     if (fp == NULL)
     {
         free(filename);
+        free(tempname);
         return;
     }
     
@@ -67,8 +156,15 @@ void pagedir_save(const webpage_t* page, const char* pageDirectory, const int do
     fprintf(fp, "%d\n", webpage_getDepth(page));
     fprintf(fp, "%s\n", webpage_getHTML(page));
 
-    fclose(fp);
+    /* Only a complete page takes the docID's name, so a crash never leaves half a page */
+    if (fclose(fp) == 0)
+    {
+        rename(tempname, filename);
+    } else {
+        remove(tempname);
+    }
     free(filename);
+    free(tempname);
 }
 
 /*
@@ -101,6 +197,47 @@ bool pagedir_validate(const char* pageDirectory)
     return true;
 }
 
+/*
+ * See pagedir.h for more detail
+ */
+bool pagedir_setPartitions(const char* pageDirectory, int partitions)
+{
+    char filename[strlen(pageDirectory) + strlen("/.partitions") + 1];
+    sprintf(filename, "%s/.partitions", pageDirectory);
+    if (partitions <= 1)
+    {
+        return unlink(filename) == 0 || errno == ENOENT;
+    }
+
+    FILE* fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    fprintf(fp, "%d\n", partitions);
+    return fclose(fp) == 0;
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+int pagedir_partitions(const char* pageDirectory)
+{
+    char filename[strlen(pageDirectory) + strlen("/.partitions") + 1];
+    sprintf(filename, "%s/.partitions", pageDirectory);
+    FILE* fp = fopen(filename, "r");
+    int partitions = 1;
+    if (fp != NULL)
+    {
+        if (fscanf(fp, "%d", &partitions) != 1 || partitions < 1)
+        {
+            partitions = 1;
+        }
+        fclose(fp);
+    }
+    return partitions;
+}
+
 /*
  * See pagedir.h for more detail
  *
@@ -117,6 +254,20 @@ webpage_t* pagedir_load(FILE* fp)
         return NULL;
     }
 
+    /* A segment's records start with a NUL, which no page file does */
+    int c = getc(fp);
+    if (c == EOF)
+    {
+        return NULL;
+    }
+    ungetc(c, fp);
+    if (c == RECORD_MAGIC[0])
+    {
+        record_t rec;
+        double decodeSeconds;
+        return loadRecord(fp, &rec, true, &decodeSeconds);
+    }
+
     char* url = file_readLine(fp);  // Retrieve the URL from the file
 
     int depth;
@@ -129,4 +280,737 @@ webpage_t* pagedir_load(FILE* fp)
     webpage_t* webpage = webpage_new(url, depth, html);
 
     return webpage;
-}
\ No newline at end of file
+}
+/*
+ * See pagedir.h for more detail
+ */
+pagedir_t* pagedir_open(const char* pageDirectory)
+{
+    if (pageDirectory == NULL)
+    {
+        return NULL;
+    }
+    char* path = dirPath(pageDirectory, "segment.idx", 0);
+    if (path == NULL)
+    {
+        return NULL;
+    }
+    FILE* index = fopen(path, "rb");
+    free(path);
+
+    pagedir_t* dir = newPagedir(pageDirectory, index != NULL);
+    if (dir == NULL)
+    {
+        if (index != NULL)
+        {
+            fclose(index);
+        }
+        return NULL;
+    }
+    dir->index = index;
+
+    /* Count the segments there are */
+    while (dir->packed && (path = dirPath(pageDirectory, "segment", dir->numSegments + 1)) != NULL)
+    {
+        bool exists = access(path, F_OK) == 0;
+        free(path);
+        if (!exists)
+        {
+            break;
+        }
+        dir->numSegments++;
+    }
+    return dir;
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+pagedir_t* pagedir_create(const char* pageDirectory, bool packed)
+{
+    if (pageDirectory == NULL)
+    {
+        return NULL;
+    }
+
+    /* Remove whatever an earlier packed crawl left */
+    char* path;
+    for (int seg = 1; (path = dirPath(pageDirectory, "segment", seg)) != NULL; seg++)
+    {
+        bool removed = unlink(path) == 0;
+        free(path);
+        if (!removed)
+        {
+            break;
+        }
+    }
+    if ((path = dirPath(pageDirectory, "segment.idx", 0)) == NULL)
+    {
+        return NULL;
+    }
+    unlink(path);
+
+    pagedir_t* dir = newPagedir(pageDirectory, packed);
+    if (dir != NULL && packed)
+    {
+        dir->index = fopen(path, "w+b");
+        dir->writable = true;
+        if (dir->index == NULL)
+        {
+            pagedir_close(dir);
+            dir = NULL;
+        }
+    }
+    free(path);
+    return dir;
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+bool pagedir_put(pagedir_t* dir, const webpage_t* page, int docID)
+{
+    if (dir == NULL || page == NULL || docID < 1)
+    {
+        return false;
+    }
+    const char* html = webpage_getHTML(page);
+    long htmlLen = (html != NULL) ? strlen(html) : 0;
+    if (!dir->packed && !dir->compress)
+    {
+        pagedir_save(page, dir->dirname, docID);
+        pthread_mutex_lock(&dir->lock);
+        dir->stats.pagesSaved++;
+        dir->stats.savedBytes += htmlLen;
+        dir->stats.storedBytes += htmlLen;
+        pthread_mutex_unlock(&dir->lock);
+        return true;
+    }
+
+    /* Build the record first, so that threads compress pages at the same time */
+    record_t rec;
+    char* record = buildRecord(page, docID, dir->compress, &rec);
+    if (record == NULL)
+    {
+        return false;
+    }
+    long length = recordBytes(&rec);
+    bool ok = true;
+    if (!dir->packed)
+    {
+        ok = saveRecordFile(dir, record, length, docID);
+        pthread_mutex_lock(&dir->lock);
+    } else {
+        pthread_mutex_lock(&dir->lock);
+        ok = openWriter(dir);
+        if (ok && dir->writeSize >= SEGMENT_BYTES)
+        {
+            fclose(dir->writer);
+            dir->writer = NULL;
+            dir->numSegments++;
+            ok = openWriter(dir);
+        }
+
+        /* The whole record reaches the file before the index points at it */
+        long offset = dir->writeSize;
+        if (ok)
+        {
+            ok = fwrite(record, 1, length, dir->writer) == length && fflush(dir->writer) == 0;
+            if (ok)
+            {
+                dir->writeSize += length;
+                ok = writeEntry(dir, docID, dir->numSegments, offset);
+            } else {
+                clearerr(dir->writer);
+                ftruncate(fileno(dir->writer), offset);         // drop whatever part was written
+            }
+        }
+    }
+    if (ok)
+    {
+        dir->stats.pagesSaved++;
+        dir->stats.savedBytes += rec.htmlLen;
+        dir->stats.storedBytes += rec.storedLen;
+    }
+    pthread_mutex_unlock(&dir->lock);
+    free(record);
+    return ok;
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+webpage_t* pagedir_get(pagedir_t* dir, int docID)
+{
+    if (dir == NULL || docID < 1)
+    {
+        return NULL;
+    }
+    return dir->packed ? loadPacked(dir, docID, true) : loadFile(dir, docID, true);
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+char* pagedir_getURL(pagedir_t* dir, int docID)
+{
+    if (dir == NULL || docID < 1)
+    {
+        return NULL;
+    }
+    webpage_t* page = dir->packed ? loadPacked(dir, docID, false) : loadFile(dir, docID, false);
+
+    char* url = NULL;
+    if (page != NULL && (url = malloc(strlen(webpage_getURL(page)) + 1)) != NULL)
+    {
+        strcpy(url, webpage_getURL(page));
+    }
+    webpage_delete(page);
+    return url;
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+void pagedir_remove(pagedir_t* dir, int docID)
+{
+    if (dir == NULL || docID < 1)
+    {
+        return;
+    }
+    if (!dir->packed)
+    {
+        char filename[strlen(dir->dirname) + 20];
+        sprintf(filename, "%s/%d", dir->dirname, docID);
+        unlink(filename);
+        return;
+    }
+
+    // The record stays in its segment, but nothing points to it
+    pthread_mutex_lock(&dir->lock);
+    uint64_t entry[2];
+    if (readEntry(dir, docID, entry) && openWritable(dir))
+    {
+        writeEntry(dir, docID, 0, 0);
+    }
+    pthread_mutex_unlock(&dir->lock);
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+int pagedir_lastDocID(pagedir_t* dir)
+{
+    if (dir == NULL)
+    {
+        return 0;
+    }
+    int last = 0;
+    if (dir->packed)
+    {
+        // The index has an entry for every docID up to the highest ever saved
+        struct stat st;
+        pthread_mutex_lock(&dir->lock);
+        if (fstat(fileno(dir->index), &st) == 0)
+        {
+            last = st.st_size / (sizeof(uint64_t) * 2);
+        }
+        pthread_mutex_unlock(&dir->lock);
+        return last;
+    }
+
+    DIR* dp = opendir(dir->dirname);
+    struct dirent* entry;
+    while (dp != NULL && (entry = readdir(dp)) != NULL)
+    {
+        const char* name = entry->d_name;
+        int i = 0;
+        while (isdigit((unsigned char) name[i]))
+        {
+            i++;
+        }
+        if (i > 0 && name[i] == '\0' && atoi(name) > last)
+        {
+            last = atoi(name);
+        }
+    }
+    if (dp != NULL)
+    {
+        closedir(dp);
+    }
+    return last;
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+void pagedir_setCompressed(pagedir_t* dir, bool compress)
+{
+    if (dir != NULL)
+    {
+        dir->compress = compress;
+    }
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+void pagedir_stats(pagedir_t* dir, pagedirstats_t* stats)
+{
+    if (dir == NULL || stats == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&dir->lock);
+    *stats = dir->stats;
+    pthread_mutex_unlock(&dir->lock);
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+bool pagedir_isPacked(pagedir_t* dir)
+{
+    return dir != NULL && dir->packed;
+}
+
+/*
+ * See pagedir.h for more detail
+ */
+void pagedir_close(pagedir_t* dir)
+{
+    if (dir != NULL)
+    {
+        if (dir->index != NULL)
+        {
+            fclose(dir->index);
+        }
+        if (dir->writer != NULL)
+        {
+            fclose(dir->writer);
+        }
+        for (int i = 0; i < dir->numReaders; i++)
+        {
+            if (dir->readers[i] != NULL)
+            {
+                fclose(dir->readers[i]);
+            }
+        }
+        free(dir->readers);
+        free(dir->dirname);
+        pthread_mutex_destroy(&dir->lock);
+        free(dir);
+    }
+}
+
+/*
+ * dirPath: Returns the newly allocated pathname of name in dirname, with
+ * n appended if it is positive; or NULL if out of memory.
+ */
+static char* dirPath(const char* dirname, const char* name, int n)
+{
+    char* path = malloc(strlen(dirname) + strlen(name) + 16);
+    if (path != NULL)
+    {
+        if (n > 0)
+        {
+            sprintf(path, "%s/%s%d", dirname, name, n);
+        } else {
+            sprintf(path, "%s/%s", dirname, name);
+        }
+    }
+    return path;
+}
+
+/*
+ * newPagedir: Returns a pagedir_t for dirname with no files open yet,
+ * or NULL if out of memory.
+ */
+static pagedir_t* newPagedir(const char* dirname, bool packed)
+{
+    pagedir_t* dir = calloc(1, sizeof(pagedir_t));
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+    dir->dirname = malloc(strlen(dirname) + 1);
+    if (dir->dirname == NULL)
+    {
+        free(dir);
+        return NULL;
+    }
+    strcpy(dir->dirname, dirname);
+    dir->packed = packed;
+    pthread_mutex_init(&dir->lock, NULL);
+    return dir;
+}
+
+/*
+ * readHeader: Reads a record's header from fp.
+ * Returns false if there is no record there.
+ */
+static bool readHeader(FILE* fp, record_t* rec)
+{
+    char magic[4];
+    uint32_t header[5];
+    if (fread(magic, 1, 4, fp) != 4)
+    {
+        return false;
+    }
+    rec->compressed = memcmp(magic, COMPRESSED_MAGIC, 4) == 0;
+    if (!rec->compressed && memcmp(magic, RECORD_MAGIC, 4) != 0)
+    {
+        return false;
+    }
+    int fields = rec->compressed ? 5 : 4;
+    if (fread(header, sizeof(uint32_t), fields, fp) != fields)
+    {
+        return false;
+    }
+    rec->docID = header[0];
+    rec->depth = header[1];
+    rec->urlLen = header[2];
+    rec->htmlLen = header[3];
+    rec->storedLen = rec->compressed ? header[4] : header[3];
+    return true;
+}
+
+/*
+ * recordBytes: Returns the size of a whole record, header and all.
+ */
+static long recordBytes(const record_t* rec)
+{
+    return (rec->compressed ? COMPRESSED_HEADER_BYTES : HEADER_BYTES) + (long) rec->urlLen + rec->storedLen;
+}
+
+/*
+ * loadRecord: Reads the record at fp's position into a new webpage, with
+ * its HTML (decompressed if need be) only if withHTML is true.  Fills in
+ * *rec, and *decodeSeconds with the time spent decompressing.
+ * Returns NULL if the record is incomplete or damaged, or out of memory.
+ */
+static webpage_t* loadRecord(FILE* fp, record_t* rec, bool withHTML, double* decodeSeconds)
+{
+    *decodeSeconds = 0;
+    if (!readHeader(fp, rec))
+    {
+        return NULL;
+    }
+
+    char* url = malloc(rec->urlLen + 1);
+    char* html = withHTML ? malloc(rec->htmlLen + 1) : NULL;
+    char* stored = (withHTML && rec->compressed) ? malloc(rec->storedLen + 1) : html;
+    bool ok = url != NULL && (!withHTML || (html != NULL && stored != NULL))
+              && fread(url, 1, rec->urlLen, fp) == rec->urlLen
+              && (!withHTML || fread(stored, 1, rec->storedLen, fp) == rec->storedLen);
+    if (ok && withHTML && rec->compressed)
+    {
+        double start = now();
+        ok = lz_decompress(stored, rec->storedLen, html, rec->htmlLen) == (long) rec->htmlLen;
+        *decodeSeconds = now() - start;
+    }
+    if (stored != html)
+    {
+        free(stored);
+    }
+    if (!ok)
+    {
+        free(url);
+        free(html);
+        return NULL;
+    }
+    url[rec->urlLen] = '\0';
+    if (html != NULL)
+    {
+        html[rec->htmlLen] = '\0';
+    }
+
+    webpage_t* page = webpage_new(url, rec->depth, html);
+    if (page == NULL)
+    {
+        free(url);
+        free(html);
+    }
+    return page;
+}
+
+/*
+ * buildRecord: Returns a newly allocated record for the page, compressed
+ * if compress is true and that makes it smaller, and fills in *rec to
+ * describe it; or NULL if out of memory.
+ */
+static char* buildRecord(const webpage_t* page, int docID, bool compress, record_t* rec)
+{
+    const char* url = webpage_getURL(page);
+    const char* html = (webpage_getHTML(page) != NULL) ? webpage_getHTML(page) : "";
+    rec->docID = docID;
+    rec->depth = webpage_getDepth(page);
+    rec->urlLen = strlen(url);
+    rec->htmlLen = strlen(html);
+
+    char* record = malloc(COMPRESSED_HEADER_BYTES + rec->urlLen + rec->htmlLen);
+    if (record == NULL)
+    {
+        return NULL;
+    }
+
+    // Compress straight into place, keeping the result only if it is smaller
+    size_t storedLen = 0;
+    if (compress && rec->htmlLen > 0)
+    {
+        storedLen = lz_compress(html, rec->htmlLen, record + COMPRESSED_HEADER_BYTES + rec->urlLen, rec->htmlLen - 1);
+    }
+    rec->compressed = storedLen > 0;
+    rec->storedLen = rec->compressed ? storedLen : rec->htmlLen;
+
+    uint32_t header[5] = { rec->docID, rec->depth, rec->urlLen, rec->htmlLen, rec->storedLen };
+    memcpy(record, rec->compressed ? COMPRESSED_MAGIC : RECORD_MAGIC, 4);
+    memcpy(record + 4, header, (rec->compressed ? 5 : 4) * sizeof(uint32_t));
+    long headerBytes = rec->compressed ? COMPRESSED_HEADER_BYTES : HEADER_BYTES;
+    memcpy(record + headerBytes, url, rec->urlLen);
+    if (!rec->compressed)
+    {
+        memcpy(record + headerBytes + rec->urlLen, html, rec->htmlLen);
+    }
+    return record;
+}
+
+/*
+ * saveRecordFile: Writes a record as the page file for docID, under a
+ * temporary name renamed once complete, as pagedir_save does.
+ * Returns false on any error.
+ */
+static bool saveRecordFile(pagedir_t* dir, const char* record, long length, int docID)
+{
+    char filename[strlen(dir->dirname) + 20];
+    char tempname[strlen(dir->dirname) + 24];
+    sprintf(filename, "%s/%d", dir->dirname, docID);
+    sprintf(tempname, "%s/.%d.tmp", dir->dirname, docID);
+
+    FILE* fp = fopen(tempname, "wb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    bool ok = fwrite(record, 1, length, fp) == length;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tempname, filename) != 0)
+    {
+        remove(tempname);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * loadFile: Loads the page file for docID, whether text or a record,
+ * with its HTML only if withHTML is true.  Returns NULL if there is none.
+ */
+static webpage_t* loadFile(pagedir_t* dir, int docID, bool withHTML)
+{
+    char filename[strlen(dir->dirname) + 20];
+    sprintf(filename, "%s/%d", dir->dirname, docID);
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+
+    webpage_t* page = NULL;
+    int c = getc(fp);
+    ungetc(c, fp);
+    if (c == RECORD_MAGIC[0])
+    {
+        record_t rec;
+        double decodeSeconds;
+        page = loadRecord(fp, &rec, withHTML, &decodeSeconds);
+        if (page != NULL && rec.compressed && withHTML)
+        {
+            pthread_mutex_lock(&dir->lock);
+            dir->stats.loadedBytes += rec.htmlLen;
+            dir->stats.decodeSeconds += decodeSeconds;
+            pthread_mutex_unlock(&dir->lock);
+        }
+    } else if (withHTML) {
+        page = pagedir_load(fp);
+    } else {
+        char* url = file_readLine(fp);
+        page = (url != NULL) ? webpage_new(url, 0, NULL) : NULL;
+        if (page == NULL)
+        {
+            free(url);
+        }
+    }
+    fclose(fp);
+    return page;
+}
+
+/*
+ * loadPacked: Loads the record the index gives for docID, with its HTML
+ * only if withHTML is true.  Returns NULL if there is none.
+ */
+static webpage_t* loadPacked(pagedir_t* dir, int docID, bool withHTML)
+{
+    pthread_mutex_lock(&dir->lock);
+    uint64_t entry[2];
+    FILE* fp = readEntry(dir, docID, entry) ? segmentReader(dir, entry[0]) : NULL;
+    record_t rec;
+    double decodeSeconds;
+    webpage_t* page = NULL;
+    if (fp != NULL && fseek(fp, entry[1], SEEK_SET) == 0)
+    {
+        page = loadRecord(fp, &rec, withHTML, &decodeSeconds);
+    }
+    if (page != NULL && rec.compressed && withHTML)
+    {
+        dir->stats.loadedBytes += rec.htmlLen;
+        dir->stats.decodeSeconds += decodeSeconds;
+    }
+    pthread_mutex_unlock(&dir->lock);
+
+    if (page != NULL && rec.docID != docID)
+    {
+        webpage_delete(page);
+        page = NULL;
+    }
+    return page;
+}
+
+/*
+ * now: Returns the time in seconds, from a clock that only goes forward.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * readEntry: Reads docID's index entry (segment, offset).
+ * Returns false if there is no page saved under docID.  Caller holds the lock.
+ */
+static bool readEntry(pagedir_t* dir, int docID, uint64_t entry[2])
+{
+    return fseek(dir->index, (long) (docID - 1) * sizeof(uint64_t) * 2, SEEK_SET) == 0
+           && fread(entry, sizeof(uint64_t), 2, dir->index) == 2 && entry[0] != 0;
+}
+
+/*
+ * writeEntry: Writes docID's index entry, and flushes it to the file.
+ * Returns false on any error.  Caller holds the lock, with the index writable.
+ */
+static bool writeEntry(pagedir_t* dir, int docID, uint64_t seg, uint64_t offset)
+{
+    uint64_t entry[2] = { seg, offset };
+    return fseek(dir->index, (long) (docID - 1) * sizeof(uint64_t) * 2, SEEK_SET) == 0
+           && fwrite(entry, sizeof(uint64_t), 2, dir->index) == 2 && fflush(dir->index) == 0;
+}
+
+/*
+ * openWritable: Reopens the index for update, if it was opened only for
+ * reading.  Returns false on any error.  Caller holds the lock.
+ */
+static bool openWritable(pagedir_t* dir)
+{
+    if (dir->writable)
+    {
+        return true;
+    }
+    char* path = dirPath(dir->dirname, "segment.idx", 0);
+    FILE* index = (path != NULL) ? fopen(path, "r+b") : NULL;
+    free(path);
+    if (index == NULL)
+    {
+        return false;
+    }
+    fclose(dir->index);
+    dir->index = index;
+    dir->writable = true;
+    return true;
+}
+
+/*
+ * openWriter: Opens the last segment for appending, creating the first
+ * if there are none, after cutting it back to its last complete record.
+ * Returns false on any error.  Caller holds the lock.
+ */
+static bool openWriter(pagedir_t* dir)
+{
+    if (dir->writer != NULL)
+    {
+        return true;
+    }
+    if (!openWritable(dir))
+    {
+        return false;
+    }
+    if (dir->numSegments == 0)
+    {
+        dir->numSegments = 1;
+    }
+    char* path = dirPath(dir->dirname, "segment", dir->numSegments);
+    if (path == NULL)
+    {
+        return false;
+    }
+
+    /* Walk the records, stopping at the first that is not all there */
+    long size = 0;
+    struct stat st;
+    FILE* fp = fopen(path, "rb");
+    if (fp != NULL && fstat(fileno(fp), &st) == 0)
+    {
+        record_t rec;
+        while (fseek(fp, size, SEEK_SET) == 0 && readHeader(fp, &rec) && size + recordBytes(&rec) <= st.st_size)
+        {
+            size += recordBytes(&rec);
+        }
+        if (size < st.st_size)
+        {
+            truncate(path, size);
+        }
+    }
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+
+    dir->writer = fopen(path, "ab");
+    dir->writeSize = size;
+    free(path);
+    return dir->writer != NULL;
+}
+
+/*
+ * segmentReader: Returns segment seg, opened for reading, or NULL if
+ * there is no such segment.  Caller holds the lock.
+ */
+static FILE* segmentReader(pagedir_t* dir, int seg)
+{
+    if (seg < 1 || seg > dir->numSegments)
+    {
+        return NULL;
+    }
+    if (seg > dir->numReaders)
+    {
+        FILE** readers = realloc(dir->readers, dir->numSegments * sizeof(FILE*));
+        if (readers == NULL)
+        {
+            return NULL;
+        }
+        for (int i = dir->numReaders; i < dir->numSegments; i++)
+        {
+            readers[i] = NULL;
+        }
+        dir->readers = readers;
+        dir->numReaders = dir->numSegments;
+    }
+    if (dir->readers[seg - 1] == NULL)
+    {
+        char* path = dirPath(dir->dirname, "segment", seg);
+        dir->readers[seg - 1] = (path != NULL) ? fopen(path, "rb") : NULL;
+        free(path);
+    }
+    return dir->readers[seg - 1];
+}
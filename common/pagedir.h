@@ -15,6 +15,8 @@ bool pagedir_init(const char* pageDirectory);
 /*
  * Save a fetched page to the pageDirectory.
  * Writes the URL, depth, and HTML of the page to a unique file.
+ * The file is written under a temporary name and renamed once complete,
+ * so the file named for docID is either absent or whole.
  */
 void pagedir_save(const webpage_t* page, const char* pageDirectory, const int docID);
 
@@ -29,16 +31,142 @@ void pagedir_save(const webpage_t* page, const char* pageDirectory, const int do
  */
 bool pagedir_validate(const char* pageDirectory);
 
+/*
+ * Record, in a .partitions file, that the pages in pageDirectory were
+ * saved by the given number of crawler processes, each numbering its
+ * pages from its own first docID in steps of that number; so the
+ * docIDs in use may have gaps, but never as many as that in a row
+ * before the last.  One partition removes the file.
+ * Returns true if successful.
+ */
+bool pagedir_setPartitions(const char* pageDirectory, int partitions);
+
+/*
+ * Returns the number of crawler processes recorded by
+ * pagedir_setPartitions, or 1 if none is.
+ */
+int pagedir_partitions(const char* pageDirectory);
+
 /*
  * Reads a file and extracts webpage data 
  * from it, returning the constructed webpage_t object. This is typically used 
  * to load webpages that were saved by the crawler into files.
  * 
- * Takes a file pointer to the file that contains the serialized webpage.
+ * Takes a file pointer to the file that contains the serialized webpage:
+ *   either a whole page file, or a segment positioned at one of its records,
+ *   which is left positioned at the next, so that a segment can be read
+ *   through in one pass.
  * 
  * Returns a pointer to the loaded webpage_t structure, or NULL if there 
  *          was an error during loading.
  */
 webpage_t* pagedir_load(FILE* fp);
 
+/*
+ * A page directory holds its pages in one of two forms.  By default each
+ * page is a file named for its docID, as written by pagedir_save.  A packed
+ * page directory instead appends every page as a length-prefixed record
+ * to segment files (segment1, segment2, ..., each up to 1GB), and keeps
+ * an index (segment.idx) giving, for each docID, the segment and offset
+ * of its record; reading any page then takes a seek in a file already
+ * open rather than an fopen.  A record holds:
+ *
+ *     4 bytes  "\0TSE"
+ *     4 bytes  docID       (these four fields are native unsigned
+ *     4 bytes  depth        32-bit integers, so segments are read back
+ *     4 bytes  URL length   on the same kind of machine)
+ *     4 bytes  HTML length
+ *     the URL, then the HTML, with no terminators
+ *
+ * A pagedir_t is an open page directory of either form, through which
+ * pages are read, saved and removed by docID.  It is thread-safe.
+ */
+typedef struct pagedir pagedir_t;
+
+/*
+ * Open the pages already in pageDirectory, packed if it has a segment
+ * index and as files otherwise; pages may also be saved and removed.
+ * Returns NULL if out of memory.
+ * Caller is responsible for later calling pagedir_close.
+ */
+pagedir_t* pagedir_open(const char* pageDirectory);
+
+/*
+ * Open pageDirectory to save a fresh set of pages, packed or as files,
+ * first removing any segments and index left from an earlier crawl.
+ * Returns NULL on any error.
+ * Caller is responsible for later calling pagedir_close.
+ */
+pagedir_t* pagedir_create(const char* pageDirectory, bool packed);
+
+/*
+ * Save a page under docID, replacing any page already saved under it.
+ * A packed record is complete on disk before the index points to it,
+ * so a crash never leaves half a page.
+ * Returns false if a packed record could not be written; a page file's
+ * errors are not reported, as with pagedir_save.
+ */
+bool pagedir_put(pagedir_t* dir, const webpage_t* page, int docID);
+
+/*
+ * Load the page saved under docID.
+ * Returns the page, which the caller must webpage_delete, or NULL if
+ * there is no such page or it cannot be read.
+ */
+webpage_t* pagedir_get(pagedir_t* dir, int docID);
+
+/*
+ * Returns the URL of the page saved under docID, without loading its
+ * HTML, as a string the caller must free; or NULL if there is no such page.
+ */
+char* pagedir_getURL(pagedir_t* dir, int docID);
+
+/*
+ * Remove the page saved under docID, if any.
+ */
+void pagedir_remove(pagedir_t* dir, int docID);
+
+/*
+ * Returns the highest docID under which a page is saved, or 0 if there
+ * is none; a packed directory may give a higher one, of a page since
+ * removed, but never a lower.
+ */
+int pagedir_lastDocID(pagedir_t* dir);
+
+/*
+ * Compress the HTML of the pages saved from now on, or stop doing so.
+ * Compressed pages (see lz.h) are saved as records with the magic
+ * "\0TSZ", which also give the compressed HTML's length after the HTML
+ * length; in a directory of page files, each such file holds one record.
+ * Pages are read back the same whether compressed or not.
+ */
+void pagedir_setCompressed(pagedir_t* dir, bool compress);
+
+/*
+ * pagedirstats_t: What the page directory has done since it was opened.
+ */
+typedef struct pagedirstats
+{
+    long pagesSaved;
+    long savedBytes;            // HTML bytes in the pages saved
+    long storedBytes;           // bytes that HTML took on disk, compressed or not
+    long loadedBytes;           // HTML bytes decompressed by pagedir_get
+    double decodeSeconds;       // time spent decompressing them
+} pagedirstats_t;
+
+/*
+ * Copy the page directory's statistics into *stats.
+ */
+void pagedir_stats(pagedir_t* dir, pagedirstats_t* stats);
+
+/*
+ * Returns true if the page directory is packed.
+ */
+bool pagedir_isPacked(pagedir_t* dir);
+
+/*
+ * Close the page directory, flushing any pages saved.
+ */
+void pagedir_close(pagedir_t* dir);
+
 #endif //__PAGEDIR_H
\ No newline at end of file
@@ -0,0 +1,175 @@
+/*
+ * politeness.c    Sajjad C Kareem    November 13, 2023
+ *
+ * This file contains the implementation of the per-host politeness scheduler.
+ * Functions include:
+ *     - politeness_new: Create a scheduler with the given limits.
+ *     - politeness_reserve: Reserve a request slot for a host.
+ *     - politeness_wait: Reserve a slot and sleep until it arrives.
+ *     - politeness_delete: Free the scheduler.
+ *
+ * Each host's bucket is kept in a hashtable keyed by host name.  A bucket
+ * remembers its token count as of the last reservation, so refilling is
+ * done lazily from the elapsed time whenever the host is next reserved.
+ *
+ * See politeness.h for more information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "../libcs50/hashtable.h"
+#include "politeness.h"
+
+/**************** local types ****************/
+typedef struct bucket
+{
+    double tokens;              // tokens as of time `last`
+    double last;                // time of the latest reservation
+} bucket_t;
+
+typedef struct politeness
+{
+    hashtable_t* buckets;       // host -> bucket_t
+    double rate;
+    int burst;
+    double minDelay;
+    pthread_mutex_t lock;       // guards the buckets
+} politeness_t;
+
+/**************** local functions ****************/
+static double now(void);
+
+/**************** politeness_new() ****************/
+/* see politeness.h for description */
+politeness_t* politeness_new(double rate, int burst, double minDelay)
+{
+    if (rate < 0 || burst < 1 || minDelay < 0)
+    {
+        return NULL;
+    }
+
+    politeness_t* polite = malloc(sizeof(politeness_t));
+    if (polite == NULL)
+    {
+        return NULL;
+    }
+    polite->buckets = hashtable_new(16);
+    if (polite->buckets == NULL)
+    {
+        free(polite);
+        return NULL;
+    }
+    polite->rate = rate;
+    polite->burst = burst;
+    polite->minDelay = minDelay;
+    pthread_mutex_init(&polite->lock, NULL);
+    return polite;
+}
+
+/**************** politeness_reserve() ****************/
+/* see politeness.h for description */
+double politeness_reserve(politeness_t* polite, const char* host)
+{
+    if (polite == NULL || host == NULL)
+    {
+        return 0;
+    }
+
+    double t = now();
+    double start = t;
+
+    pthread_mutex_lock(&polite->lock);
+    bucket_t* bucket = hashtable_find(polite->buckets, host);
+    if (bucket == NULL)
+    {
+        // A host we have never contacted starts with a full bucket
+        bucket = malloc(sizeof(bucket_t));
+        if (bucket != NULL)
+        {
+            bucket->tokens = polite->burst;
+            bucket->last = t - polite->minDelay;
+            hashtable_insert(polite->buckets, host, bucket);
+        }
+    }
+
+    if (bucket != NULL)
+    {
+        // Reservations may lie in the future, so `last` can be later than now
+        double from = (bucket->last > t) ? bucket->last : t;
+        double tokens = bucket->tokens;
+        if (polite->rate > 0)
+        {
+            tokens += (from - bucket->last) * polite->rate;
+            if (tokens > polite->burst)
+            {
+                tokens = polite->burst;
+            }
+        } else {
+            tokens = polite->burst;
+        }
+
+        // Wait for a whole token, then for the minimum gap after the last request
+        start = (tokens >= 1) ? from : from + (1 - tokens) / polite->rate;
+        if (start < bucket->last + polite->minDelay)
+        {
+            start = bucket->last + polite->minDelay;
+        }
+        if (polite->rate > 0)
+        {
+            tokens += (start - from) * polite->rate;
+            if (tokens > polite->burst)
+            {
+                tokens = polite->burst;
+            }
+        }
+
+        bucket->tokens = tokens - 1;
+        bucket->last = start;
+    }
+    pthread_mutex_unlock(&polite->lock);
+
+    return (start > t) ? start - t : 0;
+}
+
+/**************** politeness_wait() ****************/
+/* see politeness.h for description */
+void politeness_wait(politeness_t* polite, const char* host)
+{
+    double delay = politeness_reserve(polite, host);
+    if (delay > 0)
+    {
+        struct timespec ts;
+        ts.tv_sec = (time_t) delay;
+        ts.tv_nsec = (long) ((delay - ts.tv_sec) * 1e9);
+        while (nanosleep(&ts, &ts) != 0)
+        {
+            ;   // interrupted by a signal; sleep for the remainder
+        }
+    }
+}
+
+/**************** politeness_delete() ****************/
+/* see politeness.h for description */
+void politeness_delete(politeness_t* polite)
+{
+    if (polite != NULL)
+    {
+        hashtable_delete(polite->buckets, free);
+        pthread_mutex_destroy(&polite->lock);
+        free(polite);
+    }
+}
+
+/*
+ * now: Returns the current monotonic time in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
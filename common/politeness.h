@@ -0,0 +1,46 @@
+#ifndef __POLITENESS_H
+#define __POLITENESS_H
+
+/*
+ * politeness - a per-host token-bucket scheduler for crawler requests
+ *
+ * Each host gets a bucket holding up to `burst` tokens, refilled at `rate`
+ * tokens per second; a request to the host spends one token, and must
+ * also start at least `minDelay` seconds after the previous request to
+ * that host.  Hosts are independent, so waiting on a busy host never
+ * holds up a request to an idle one.
+ *
+ * A rate of 0 means the bucket never runs dry, leaving only minDelay.
+ * The scheduler is safe to share between threads.
+ */
+typedef struct politeness politeness_t;
+
+/*
+ * Create a new scheduler with the given per-host limits.
+ * Takes rate: requests per second, or 0 for no rate limit.
+ * Takes burst: requests that may be sent back to back (at least 1).
+ * Takes minDelay: minimum seconds between requests to one host.
+ * Returns pointer to the scheduler, or NULL if any error.
+ * Caller is responsible for later calling politeness_delete.
+ */
+politeness_t* politeness_new(double rate, int burst, double minDelay);
+
+/*
+ * Reserve the next request slot for host.
+ * Returns the number of seconds from now at which the request may be
+ * sent (0 if it may be sent at once).  The slot is taken whether or not
+ * the caller waits for it; pass a NULL scheduler to always get 0.
+ */
+double politeness_reserve(politeness_t* polite, const char* host);
+
+/*
+ * Reserve the next request slot for host, and sleep until it arrives.
+ */
+void politeness_wait(politeness_t* polite, const char* host);
+
+/*
+ * Delete the scheduler.
+ */
+void politeness_delete(politeness_t* polite);
+
+#endif //__POLITENESS_H
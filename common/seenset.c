@@ -0,0 +1,480 @@
+/*
+ * seenset.c    Sajjad C Kareem    November 16, 2023
+ *
+ * This file contains the implementation of the compact seen-URL set.
+ * Functions include:
+ *     - seenset_new: Create an empty set in either mode.
+ *     - seenset_insert: Add a URL, reporting whether it was new.
+ *     - seenset_contains: Check for a URL.
+ *     - seenset_size: Count the URLs added.
+ *     - seenset_memory: Measure the set's footprint.
+ *     - seenset_save: Write the set to a file.
+ *     - seenset_load: Read a set back from a file.
+ *     - seenset_delete: Free the set.
+ *
+ * Both modes start from one 64-bit hash of the URL (FNV-1a, followed by
+ * a mixing step so that every bit depends on every input byte).  The Bloom
+ * mode derives its k bit positions from it by double hashing.
+ *
+ * The exact mode takes the top FP_BITS bits of the hash as the URL's
+ * fingerprint, and stores it by quotienting: with 2^q slots, the top q
+ * bits of the fingerprint choose its home slot, and only the other
+ * FP_BITS - q bits (the remainder) are stored, along with how far the
+ * entry lies past its home (DISP_BITS bits, stored plus one so that 0
+ * marks an empty slot).  Slots are bit-packed, each remainder and
+ * displacement together, and placed by Robin Hood linear probing, which
+ * keeps displacements short: an entry never lies further from its home
+ * than one it passes over.  Growing re-forms each fingerprint from its
+ * home and remainder and places it in a table twice the size, where one
+ * more of its bits goes to the home and one fewer is stored.
+ *
+ * See seenset.h for more information.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "seenset.h"
+
+/**************** local types ****************/
+typedef struct seenset
+{
+    seenmode_t mode;
+    size_t size;                // URLs added
+    uint64_t* table;            // SEEN_EXACT: the slots, bit-packed
+    size_t numSlots;            // 2^q
+    int remBits;                // bits of remainder stored: FP_BITS - q
+    int entryBits;              // bits per slot: remBits + DISP_BITS
+    uint8_t* bits;              // SEEN_BLOOM: the filter
+    uint64_t numBits;
+    int numHashes;              // bit positions per URL
+} seenset_t;
+
+/**************** local constants ****************/
+static const size_t MIN_SLOTS = 64;
+static const int FP_BITS = 51;              // fingerprint bits of each URL in SEEN_EXACT
+#define DISP_BITS 7                         // bits of each slot's displacement (plus one)
+static const uint64_t DISP_MASK = (1 << DISP_BITS) - 1;
+static const uint64_t MAX_DISP = (1 << DISP_BITS) - 2;   // the furthest an entry may lie from its home
+static const uint64_t SAVE_MAGIC = 0x7365656e73657432ULL;   // "seenset2"
+
+/**************** local functions ****************/
+static uint64_t hashURL(const char* url);
+static bool exactAlloc(seenset_t* set, size_t numSlots);
+static bool exactInsert(seenset_t* set, uint64_t fp, bool add);
+static bool exactGrow(seenset_t* set);
+static uint64_t dispOf(uint64_t entry);
+static uint64_t slotGet(const seenset_t* set, size_t i);
+static void slotSet(seenset_t* set, size_t i, uint64_t entry);
+static size_t tableWords(size_t numSlots, int entryBits);
+static bool bloomInsert(seenset_t* set, uint64_t hash, bool add);
+
+/**************** seenset_new() ****************/
+/* see seenset.h for description */
+seenset_t* seenset_new(seenmode_t mode, size_t expected, double fpRate)
+{
+    if ((mode != SEEN_EXACT && mode != SEEN_BLOOM)
+        || (mode == SEEN_BLOOM && (expected < 1 || fpRate <= 0 || fpRate >= 1)))
+    {
+        return NULL;
+    }
+
+    seenset_t* set = calloc(1, sizeof(seenset_t));
+    if (set == NULL)
+    {
+        return NULL;
+    }
+    set->mode = mode;
+
+    if (mode == SEEN_EXACT)
+    {
+        // Room for `expected` URLs before the first doubling
+        size_t numSlots = MIN_SLOTS;
+        while (numSlots / 8 * 7 < expected)
+        {
+            numSlots *= 2;
+        }
+        if (!exactAlloc(set, numSlots))
+        {
+            free(set);
+            return NULL;
+        }
+    } else {
+        // The standard optimal sizes: m = -n ln(p) / ln(2)^2 bits, k = (m/n) ln(2) hashes
+        double bitsPerURL = -log(fpRate) / (log(2) * log(2));
+        set->numBits = (uint64_t) ceil(expected * bitsPerURL);
+        set->numBits = (set->numBits + 7) / 8 * 8;
+        set->numHashes = (int) round(bitsPerURL * log(2));
+        if (set->numHashes < 1)
+        {
+            set->numHashes = 1;
+        }
+        set->bits = calloc(set->numBits / 8, 1);
+        if (set->bits == NULL)
+        {
+            free(set);
+            return NULL;
+        }
+    }
+    return set;
+}
+
+/**************** seenset_insert() ****************/
+/* see seenset.h for description */
+bool seenset_insert(seenset_t* set, const char* url)
+{
+    if (set == NULL || url == NULL)
+    {
+        return false;
+    }
+
+    bool added;
+    if (set->mode == SEEN_EXACT)
+    {
+        if ((set->size + 1) > set->numSlots / 8 * 7 && !exactGrow(set))
+        {
+            return false;
+        }
+        added = exactInsert(set, hashURL(url) >> (64 - FP_BITS), true);
+    } else {
+        added = bloomInsert(set, hashURL(url), true);
+    }
+    if (added)
+    {
+        set->size++;
+    }
+    return added;
+}
+
+/**************** seenset_contains() ****************/
+/* see seenset.h for description */
+bool seenset_contains(seenset_t* set, const char* url)
+{
+    if (set == NULL || url == NULL)
+    {
+        return false;
+    }
+    if (set->mode == SEEN_EXACT)
+    {
+        return !exactInsert(set, hashURL(url) >> (64 - FP_BITS), false);
+    } else {
+        return !bloomInsert(set, hashURL(url), false);
+    }
+}
+
+/**************** seenset_size() ****************/
+/* see seenset.h for description */
+size_t seenset_size(seenset_t* set)
+{
+    return (set != NULL) ? set->size : 0;
+}
+
+/**************** seenset_memory() ****************/
+/* see seenset.h for description */
+size_t seenset_memory(seenset_t* set)
+{
+    if (set == NULL)
+    {
+        return 0;
+    }
+    size_t words = (set->mode == SEEN_EXACT) ? tableWords(set->numSlots, set->entryBits) : 0;
+    return sizeof(seenset_t) + words * sizeof(uint64_t) + set->numBits / 8;
+}
+
+/**************** seenset_save() ****************/
+/* see seenset.h for description */
+bool seenset_save(seenset_t* set, FILE* fp)
+{
+    if (set == NULL || fp == NULL)
+    {
+        return false;
+    }
+
+    // A small header, then the table or the filter as it is in memory
+    uint64_t header[5] = { SAVE_MAGIC, set->mode, set->size, set->numSlots, set->numBits };
+    header[4] |= (uint64_t) set->numHashes << 56;
+    if (fwrite(header, sizeof(header), 1, fp) != 1)
+    {
+        return false;
+    }
+    if (set->mode == SEEN_EXACT)
+    {
+        size_t words = tableWords(set->numSlots, set->entryBits);
+        return fwrite(set->table, sizeof(uint64_t), words, fp) == words;
+    } else {
+        return fwrite(set->bits, 1, set->numBits / 8, fp) == set->numBits / 8;
+    }
+}
+
+/**************** seenset_load() ****************/
+/* see seenset.h for description */
+seenset_t* seenset_load(FILE* fp)
+{
+    uint64_t header[5];
+    if (fp == NULL || fread(header, sizeof(header), 1, fp) != 1 || header[0] != SAVE_MAGIC
+        || (header[1] != SEEN_EXACT && header[1] != SEEN_BLOOM))
+    {
+        return NULL;
+    }
+
+    seenset_t* set = calloc(1, sizeof(seenset_t));
+    if (set == NULL)
+    {
+        return NULL;
+    }
+    set->mode = header[1];
+    set->size = header[2];
+    set->numBits = header[4] & ((1ULL << 56) - 1);
+    set->numHashes = header[4] >> 56;
+
+    bool ok;
+    if (set->mode == SEEN_EXACT)
+    {
+        // The table must be a power of two with room to spare, as seenset_insert keeps it
+        size_t numSlots = header[3];
+        ok = numSlots >= MIN_SLOTS && (numSlots & (numSlots - 1)) == 0
+             && set->size <= numSlots / 8 * 7 && exactAlloc(set, numSlots)
+             && fread(set->table, sizeof(uint64_t), tableWords(numSlots, set->entryBits), fp)
+                == tableWords(numSlots, set->entryBits);
+    } else {
+        ok = set->numBits > 0 && set->numBits % 8 == 0 && set->numHashes > 0
+             && (set->bits = malloc(set->numBits / 8)) != NULL
+             && fread(set->bits, 1, set->numBits / 8, fp) == set->numBits / 8;
+    }
+    if (!ok)
+    {
+        seenset_delete(set);
+        return NULL;
+    }
+    return set;
+}
+
+/**************** seenset_delete() ****************/
+/* see seenset.h for description */
+void seenset_delete(seenset_t* set)
+{
+    if (set != NULL)
+    {
+        free(set->table);
+        free(set->bits);
+        free(set);
+    }
+}
+
+/*
+ * hashURL: Returns a well-mixed 64-bit hash of url, never 0.
+ */
+static uint64_t hashURL(const char* url)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;             // FNV-1a
+    for (const unsigned char* p = (const unsigned char*) url; *p != '\0'; p++)
+    {
+        h ^= *p;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;                                   // final mix, as in MurmurHash3
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (h != 0) ? h : 1;
+}
+
+/*
+ * exactAlloc: Give the set an empty table of numSlots slots, a power of
+ * two, sized for the remainders at that size; the old table is the
+ * caller's.  Returns false if out of memory, or numSlots is too large
+ * to leave any remainder.
+ */
+static bool exactAlloc(seenset_t* set, size_t numSlots)
+{
+    int q = 0;
+    while (((size_t) 1 << q) < numSlots)
+    {
+        q++;
+    }
+    if (q >= FP_BITS)
+    {
+        return false;
+    }
+    uint64_t* table = calloc(tableWords(numSlots, FP_BITS - q + DISP_BITS), sizeof(uint64_t));
+    if (table == NULL)
+    {
+        return false;
+    }
+    set->table = table;
+    set->numSlots = numSlots;
+    set->remBits = FP_BITS - q;
+    set->entryBits = set->remBits + DISP_BITS;
+    return true;
+}
+
+/*
+ * exactInsert: Look for fingerprint fp (FP_BITS bits) in the table,
+ * adding it if add is true.  Returns true if fp was absent; false if it
+ * was present, or if it could not be added for want of memory.
+ * The table must have a free slot.
+ */
+static bool exactInsert(seenset_t* set, uint64_t fp, bool add)
+{
+    size_t mask = set->numSlots - 1;
+    uint64_t rem = fp & (((uint64_t) 1 << set->remBits) - 1);
+    size_t i = fp >> set->remBits;
+    uint64_t disp = 0;
+
+    // An entry lies no further from its home than any it has passed over,
+    // so the search ends at an empty slot or one nearer its own home
+    uint64_t entry;
+    while ((entry = slotGet(set, i)) != 0 && dispOf(entry) >= disp)
+    {
+        if (dispOf(entry) == disp && entry >> DISP_BITS == rem)
+        {
+            return false;
+        }
+        i = (i + 1) & mask;
+        disp++;
+    }
+    if (!add)
+    {
+        return true;
+    }
+
+    // Place it there, and carry on with whatever it displaces
+    uint64_t carried = rem << DISP_BITS;
+    while (true)
+    {
+        if (disp > MAX_DISP)
+        {
+            // Too far from home to record: grow, and place the entry carried afresh
+            uint64_t carriedFp = (((i - disp) & mask) << set->remBits) | (carried >> DISP_BITS);
+            return exactGrow(set) && exactInsert(set, carriedFp, true);
+        }
+        entry = slotGet(set, i);
+        if (entry == 0)
+        {
+            slotSet(set, i, carried | (disp + 1));
+            return true;
+        }
+        uint64_t entryDisp = dispOf(entry);
+        if (entryDisp < disp)
+        {
+            slotSet(set, i, carried | (disp + 1));
+            carried = entry & ~DISP_MASK;
+            disp = entryDisp;
+        }
+        i = (i + 1) & mask;
+        disp++;
+    }
+}
+
+/*
+ * exactGrow: Double the table, re-placing every fingerprint.
+ * Returns false, leaving the table as it was, if out of memory.
+ */
+static bool exactGrow(seenset_t* set)
+{
+    uint64_t* old = set->table;
+    size_t oldSlots = set->numSlots;
+    int oldRemBits = set->remBits;
+    int oldEntryBits = set->entryBits;
+    if (!exactAlloc(set, oldSlots * 2))
+    {
+        return false;
+    }
+
+    // Read the old slots through a set that describes them
+    seenset_t from = *set;
+    from.table = old;
+    from.numSlots = oldSlots;
+    from.remBits = oldRemBits;
+    from.entryBits = oldEntryBits;
+    for (size_t i = 0; i < oldSlots; i++)
+    {
+        uint64_t entry = slotGet(&from, i);
+        if (entry != 0)
+        {
+            size_t home = (i - (dispOf(entry))) & (oldSlots - 1);
+            exactInsert(set, ((uint64_t) home << oldRemBits) | (entry >> DISP_BITS), true);
+        }
+    }
+    free(old);
+    return true;
+}
+
+/*
+ * dispOf: Returns how far past its home the entry of a full slot lies.
+ */
+static uint64_t dispOf(uint64_t entry)
+{
+    return (entry & DISP_MASK) - 1;
+}
+
+/*
+ * slotGet: Returns the entry in slot i of the table: its remainder,
+ * shifted up past DISP_BITS, and its displacement plus one; 0 if empty.
+ */
+static uint64_t slotGet(const seenset_t* set, size_t i)
+{
+    uint64_t bit = (uint64_t) i * set->entryBits;
+    size_t word = bit / 64;
+    int offset = bit % 64;
+    uint64_t entry = set->table[word] >> offset;
+    if (offset + set->entryBits > 64)
+    {
+        entry |= set->table[word + 1] << (64 - offset);
+    }
+    return entry & (((uint64_t) 1 << set->entryBits) - 1);
+}
+
+/*
+ * slotSet: Write entry, as slotGet returns it, into slot i of the table.
+ */
+static void slotSet(seenset_t* set, size_t i, uint64_t entry)
+{
+    uint64_t bit = (uint64_t) i * set->entryBits;
+    size_t word = bit / 64;
+    int offset = bit % 64;
+    uint64_t mask = ((uint64_t) 1 << set->entryBits) - 1;
+    set->table[word] = (set->table[word] & ~(mask << offset)) | (entry << offset);
+    if (offset + set->entryBits > 64)
+    {
+        int low = 64 - offset;                  // bits of the entry in the first word
+        set->table[word + 1] = (set->table[word + 1] & ~(mask >> low)) | (entry >> low);
+    }
+}
+
+/*
+ * tableWords: Returns the 64-bit words that hold numSlots slots of
+ * entryBits bits each.
+ */
+static size_t tableWords(size_t numSlots, int entryBits)
+{
+    return (numSlots * (uint64_t) entryBits + 63) / 64;
+}
+
+/*
+ * bloomInsert: Test the URL's bits in the filter, setting them if add is true.
+ * Returns true if any bit was clear, i.e., the URL is certainly new.
+ */
+static bool bloomInsert(seenset_t* set, uint64_t hash, bool add)
+{
+    // Double hashing: position i is h1 + i*h2, with h2 odd so the positions differ
+    uint64_t h1 = hash;
+    uint64_t h2 = ((hash >> 32) | (hash << 32)) * 0x9e3779b97f4a7c15ULL | 1;
+    bool absent = false;
+    for (int i = 0; i < set->numHashes; i++)
+    {
+        uint64_t bit = (h1 + i * h2) % set->numBits;
+        uint8_t mask = 1 << (bit % 8);
+        if ((set->bits[bit / 8] & mask) == 0)
+        {
+            absent = true;
+            if (add)
+            {
+                set->bits[bit / 8] |= mask;
+            }
+        }
+    }
+    return absent;
+}
@@ -0,0 +1,88 @@
+#ifndef __SEENSET_H
+#define __SEENSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * seenset - a compact set of the URLs a crawl has already seen
+ *
+ * The crawler only ever asks "have I seen this URL before?", so the set
+ * need not keep the URLs themselves.  It comes in two modes:
+ *
+ * SEEN_EXACT keeps a 51-bit fingerprint of each URL in a compact
+ * open-addressed table (at most 7/8 full, doubling as needed), where the
+ * slot a fingerprint belongs in stands for its leading bits, so only the
+ * rest need be stored: with 2^q slots, each takes 58 - q bits, however
+ * long the URL.  100 million URLs take 2^27 slots of 31 bits, about
+ * 520MB or 5 bytes per URL (up to twice that per URL just after the
+ * table doubles).  Two different URLs are taken for the same only if
+ * their fingerprints collide: about 2 URLs in a crawl of 100 million.
+ *
+ * SEEN_BLOOM keeps a Bloom filter sized up front for `expected` URLs at
+ * false-positive rate `fpRate`: about 1.2 bytes per URL at 1%, so 100
+ * million URLs fit in 120MB.  It never grows; a URL may now and then be
+ * reported as seen when it was not (and so not be crawled), more often
+ * if more than `expected` URLs are added.
+ *
+ * Like the libcs50 hashtable it replaces, a seenset is not thread-safe.
+ */
+typedef struct seenset seenset_t;
+
+typedef enum { SEEN_EXACT, SEEN_BLOOM } seenmode_t;
+
+/*
+ * Create a new, empty set.
+ * Takes mode: SEEN_EXACT or SEEN_BLOOM.
+ * Takes expected: the number of URLs expected (a starting size for
+ *   SEEN_EXACT; the fixed capacity of SEEN_BLOOM).
+ * Takes fpRate: the false-positive rate for SEEN_BLOOM, between 0 and 1
+ *   exclusive; ignored for SEEN_EXACT.
+ * Returns pointer to the set, or NULL if any error.
+ * Caller is responsible for later calling seenset_delete.
+ */
+seenset_t* seenset_new(seenmode_t mode, size_t expected, double fpRate);
+
+/*
+ * Add url to the set.
+ * Returns true if url was not already in the set (and so was added);
+ * false if it was (or, for SEEN_BLOOM, may have been), or on error.
+ */
+bool seenset_insert(seenset_t* set, const char* url);
+
+/*
+ * Returns true if url is (or, for SEEN_BLOOM, may be) in the set.
+ */
+bool seenset_contains(seenset_t* set, const char* url);
+
+/*
+ * Returns the number of URLs added to the set.
+ */
+size_t seenset_size(seenset_t* set);
+
+/*
+ * Returns the number of bytes the set occupies.
+ */
+size_t seenset_memory(seenset_t* set);
+
+/*
+ * Write the set to fp, in a binary form that seenset_load reads back
+ * on the same kind of machine.
+ * Returns true if successful, false on any error.
+ */
+bool seenset_save(seenset_t* set, FILE* fp);
+
+/*
+ * Read a set written by seenset_save from fp, in whatever mode it was saved.
+ * Returns pointer to the set, or NULL if any error.
+ * Caller is responsible for later calling seenset_delete.
+ */
+seenset_t* seenset_load(FILE* fp);
+
+/*
+ * Delete the set.
+ */
+void seenset_delete(seenset_t* set);
+
+#endif //__SEENSET_H
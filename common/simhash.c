@@ -0,0 +1,310 @@
+/*
+ * simhash.c    Sajjad C Kareem    November 24, 2023
+ *
+ * This file contains the implementation of page fingerprints and the
+ * index for finding near-duplicate pages.
+ * Functions include:
+ *     - simhash_fingerprint: Compute a page's SimHash.
+ *     - simhash_new: Create an empty index.
+ *     - simhash_find: Find a fingerprint within the index's distance.
+ *     - simhash_insert: Store a fingerprint.
+ *     - simhash_size: Count the fingerprints stored.
+ *     - simhash_delete: Free the index.
+ *
+ * Fingerprints are kept in one array; each block's hash table is an array
+ * of bucket heads, chained through the entries' next indexes for that block.
+ * The tables double, and are rebuilt from the array, as entries are added.
+ *
+ * See simhash.h for more information.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "simhash.h"
+
+/**************** local types ****************/
+typedef struct entry
+{
+    uint64_t fingerprint;
+    int docID;
+    int next[SIMHASH_MAX_DISTANCE + 1];     // next entry in the same bucket of each block, or -1
+} entry_t;
+
+typedef struct simhash
+{
+    int maxDistance;
+    int numBlocks;                          // maxDistance + 1
+    int shift[SIMHASH_MAX_DISTANCE + 1];    // where each block starts
+    uint64_t mask[SIMHASH_MAX_DISTANCE + 1];    // its bits, once shifted down
+    entry_t* entries;
+    size_t numEntries;
+    size_t capacity;
+    int* heads[SIMHASH_MAX_DISTANCE + 1];   // each block's bucket heads, or -1
+    size_t numBuckets;                      // a power of two
+} simhash_t;
+
+/**************** local constants ****************/
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+static const size_t INITIAL_BUCKETS = 1024;
+
+/**************** local functions ****************/
+static uint64_t mix(uint64_t x);
+static uint64_t rotate(uint64_t x, int bits);
+static int bitsSet(uint64_t x);
+static size_t bucketOf(const simhash_t* index, int block, uint64_t fingerprint);
+static bool rebuild(simhash_t* index, size_t numBuckets);
+
+/**************** simhash_fingerprint() ****************/
+/* see simhash.h for description */
+uint64_t simhash_fingerprint(const char* html, int* numFeatures)
+{
+    *numFeatures = 0;
+    if (html == NULL)
+    {
+        return 0;
+    }
+
+    int weights[64] = { 0 };
+    uint64_t prev1 = 0, prev2 = 0;          // hashes of the two words before
+    bool inTag = false;
+    for (const char* p = html; *p != '\0'; )
+    {
+        if (*p == '<' || *p == '>')
+        {
+            inTag = (*p == '<');
+            p++;
+            continue;
+        }
+        if (inTag || !isalnum((unsigned char) *p))
+        {
+            p++;
+            continue;
+        }
+
+        uint64_t word = FNV_OFFSET;
+        for (; *p != '\0' && isalnum((unsigned char) *p); p++)
+        {
+            word = (word ^ (unsigned char) tolower((unsigned char) *p)) * FNV_PRIME;
+        }
+        uint64_t feature = mix(word ^ rotate(prev1, 21) ^ rotate(prev2, 42));
+        prev2 = prev1;
+        prev1 = word;
+        (*numFeatures)++;
+
+        for (int bit = 0; bit < 64; bit++)
+        {
+            weights[bit] += ((feature >> bit) & 1) ? 1 : -1;
+        }
+    }
+
+    uint64_t fingerprint = 0;
+    for (int bit = 0; bit < 64; bit++)
+    {
+        if (weights[bit] > 0)
+        {
+            fingerprint |= (uint64_t) 1 << bit;
+        }
+    }
+    return fingerprint;
+}
+
+/**************** simhash_new() ****************/
+/* see simhash.h for description */
+simhash_t* simhash_new(int maxDistance)
+{
+    if (maxDistance < 0 || maxDistance > SIMHASH_MAX_DISTANCE)
+    {
+        return NULL;
+    }
+    simhash_t* index = calloc(1, sizeof(simhash_t));
+    if (index == NULL)
+    {
+        return NULL;
+    }
+
+    /* Blocks as even as can be: the first 64 % numBlocks get one bit more */
+    index->maxDistance = maxDistance;
+    index->numBlocks = maxDistance + 1;
+    int start = 0;
+    for (int block = 0; block < index->numBlocks; block++)
+    {
+        int bits = 64 / index->numBlocks + (block < 64 % index->numBlocks ? 1 : 0);
+        index->shift[block] = start;
+        index->mask[block] = (bits == 64) ? ~(uint64_t) 0 : ((uint64_t) 1 << bits) - 1;
+        start += bits;
+    }
+
+    if (!rebuild(index, INITIAL_BUCKETS))
+    {
+        simhash_delete(index);
+        return NULL;
+    }
+    return index;
+}
+
+/**************** simhash_find() ****************/
+/* see simhash.h for description */
+int simhash_find(simhash_t* index, uint64_t fingerprint)
+{
+    if (index == NULL)
+    {
+        return 0;
+    }
+    for (int block = 0; block < index->numBlocks; block++)
+    {
+        uint64_t key = (fingerprint >> index->shift[block]) & index->mask[block];
+        for (int e = index->heads[block][bucketOf(index, block, fingerprint)]; e >= 0; e = index->entries[e].next[block])
+        {
+            const entry_t* entry = &index->entries[e];
+            if (((entry->fingerprint >> index->shift[block]) & index->mask[block]) == key
+                && bitsSet(entry->fingerprint ^ fingerprint) <= index->maxDistance)
+            {
+                return entry->docID;
+            }
+        }
+    }
+    return 0;
+}
+
+/**************** simhash_insert() ****************/
+/* see simhash.h for description */
+bool simhash_insert(simhash_t* index, uint64_t fingerprint, int docID)
+{
+    if (index == NULL)
+    {
+        return false;
+    }
+    if (index->numEntries == index->capacity)
+    {
+        size_t capacity = (index->capacity > 0) ? index->capacity * 2 : INITIAL_BUCKETS;
+        entry_t* grown = realloc(index->entries, capacity * sizeof(entry_t));
+        if (grown == NULL)
+        {
+            return false;
+        }
+        index->entries = grown;
+        index->capacity = capacity;
+    }
+
+    int e = index->numEntries++;
+    index->entries[e].fingerprint = fingerprint;
+    index->entries[e].docID = docID;
+    for (int block = 0; block < index->numBlocks; block++)
+    {
+        size_t bucket = bucketOf(index, block, fingerprint);
+        index->entries[e].next[block] = index->heads[block][bucket];
+        index->heads[block][bucket] = e;
+    }
+
+    // Keep chains short; if the tables cannot grow, the old ones still hold every entry
+    if (index->numEntries > index->numBuckets)
+    {
+        rebuild(index, index->numBuckets * 2);
+    }
+    return true;
+}
+
+/**************** simhash_size() ****************/
+/* see simhash.h for description */
+size_t simhash_size(simhash_t* index)
+{
+    return (index != NULL) ? index->numEntries : 0;
+}
+
+/**************** simhash_delete() ****************/
+/* see simhash.h for description */
+void simhash_delete(simhash_t* index)
+{
+    if (index != NULL)
+    {
+        for (int block = 0; block < index->numBlocks; block++)
+        {
+            free(index->heads[block]);
+        }
+        free(index->entries);
+        free(index);
+    }
+}
+
+/*
+ * mix: Scrambles a 64-bit value so every bit depends on every input bit
+ * (the finalizer of splitmix64).
+ */
+static uint64_t mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*
+ * rotate: Rotates x left by bits, from 1 to 63.
+ */
+static uint64_t rotate(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+/*
+ * bitsSet: Returns the number of bits set in x.
+ */
+static int bitsSet(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
+/*
+ * bucketOf: Returns the bucket of the given block's table that holds
+ * fingerprints with the same value in that block.
+ */
+static size_t bucketOf(const simhash_t* index, int block, uint64_t fingerprint)
+{
+    uint64_t key = (fingerprint >> index->shift[block]) & index->mask[block];
+    return mix(key + block) & (index->numBuckets - 1);
+}
+
+/*
+ * rebuild: Replaces each block's table with one of numBuckets buckets,
+ * and chains every entry into them.  Returns false, leaving the tables
+ * as they were, if out of memory.
+ */
+static bool rebuild(simhash_t* index, size_t numBuckets)
+{
+    int* heads[SIMHASH_MAX_DISTANCE + 1];
+    for (int block = 0; block < index->numBlocks; block++)
+    {
+        heads[block] = malloc(numBuckets * sizeof(int));
+        if (heads[block] == NULL)
+        {
+            while (--block >= 0)
+            {
+                free(heads[block]);
+            }
+            return false;
+        }
+        memset(heads[block], -1, numBuckets * sizeof(int));
+    }
+
+    for (int block = 0; block < index->numBlocks; block++)
+    {
+        free(index->heads[block]);
+        index->heads[block] = heads[block];
+    }
+    index->numBuckets = numBuckets;
+    for (size_t e = 0; e < index->numEntries; e++)
+    {
+        for (int block = 0; block < index->numBlocks; block++)
+        {
+            size_t bucket = bucketOf(index, block, index->entries[e].fingerprint);
+            index->entries[e].next[block] = index->heads[block][bucket];
+            index->heads[block][bucket] = e;
+        }
+    }
+    return true;
+}
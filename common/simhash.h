@@ -0,0 +1,72 @@
+#ifndef __SIMHASH_H
+#define __SIMHASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * simhash - fingerprints of page text, and an index of them for finding
+ * near-duplicate pages
+ *
+ * A page's SimHash is a 64-bit fingerprint of its text such that pages
+ * with mostly the same text get fingerprints that differ in few bits.  The
+ * text outside HTML tags is split into words, ignoring case; each run of
+ * three words is hashed, and bit b of the fingerprint is set if more of
+ * those hashes have bit b set than not.  Templated or mirrored pages, which
+ * differ in a few words, then lie within a small Hamming distance.
+ *
+ * The index finds a stored fingerprint within Hamming distance k of a
+ * given one.  It splits the 64 bits into k+1 blocks; two fingerprints at
+ * most k bits apart agree exactly on at least one block, so the index
+ * keeps a hash table per block and compares only fingerprints that agree
+ * on some block, about n/2^(64/(k+1)) per block for n fingerprints.
+ *
+ * Like the seenset, the index is not thread-safe.
+ */
+typedef struct simhash simhash_t;
+
+/*
+ * The largest Hamming distance the index supports; beyond it, blocks
+ * would be so short that a lookup compares most of the index.
+ */
+#define SIMHASH_MAX_DISTANCE 7
+
+/*
+ * Compute the fingerprint of a page's html.  Sets *numFeatures to the
+ * number of three-word runs it was built from; a page with few words has
+ * a fingerprint too weak to judge it by.
+ */
+uint64_t simhash_fingerprint(const char* html, int* numFeatures);
+
+/*
+ * Create a new, empty index for finding fingerprints at most maxDistance
+ * bits apart, from 0 to SIMHASH_MAX_DISTANCE.
+ * Returns pointer to the index, or NULL if any error.
+ * Caller is responsible for later calling simhash_delete.
+ */
+simhash_t* simhash_new(int maxDistance);
+
+/*
+ * Returns the docID stored with a fingerprint within maxDistance bits of
+ * the given one (the first found, if several are), or 0 if there is none.
+ */
+int simhash_find(simhash_t* index, uint64_t fingerprint);
+
+/*
+ * Store a fingerprint with the docID of its page.
+ * Returns false if out of memory.
+ */
+bool simhash_insert(simhash_t* index, uint64_t fingerprint, int docID);
+
+/*
+ * Returns the number of fingerprints stored.
+ */
+size_t simhash_size(simhash_t* index);
+
+/*
+ * Delete the index.
+ */
+void simhash_delete(simhash_t* index);
+
+#endif //__SIMHASH_H
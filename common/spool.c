@@ -0,0 +1,347 @@
+/*
+ * spool.c    Sajjad C Kareem    December 4, 2023
+ *
+ * This file contains the implementation of the spool through which
+ * crawler processes pass each other links.
+ * Functions include:
+ *     - spool_prepare: Set up the spool directory for a crawl.
+ *     - spool_open: Open the spool as one partition.
+ *     - spool_partition: Find the partition of a URL.
+ *     - spool_send: Send a link to another partition.
+ *     - spool_receive: Read the links sent to this partition.
+ *     - spool_publish: Publish whether this partition is idle.
+ *     - spool_finished: Check whether the crawl is over.
+ *     - spool_close: Close the spool.
+ *
+ * Files sent to this partition are opened as they first appear, and read
+ * with pread from the offset up to which they have been read, a buffer
+ * at a time; the offset moves past complete lines only.  A state file
+ * holds an "idle 0|1" line and a "read" line giving that offset for each
+ * partition's file in turn (0 for the partition's own).
+ *
+ * See spool.h for more information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "spool.h"
+
+/**************** local constants ****************/
+#define LINE_BYTES 8192                     // the longest line sent; a URL of up to URL_MAX fits
+#define READ_BYTES 65536                    // read from a file at a time
+
+/**************** local types ****************/
+typedef struct spool
+{
+    char* dir;
+    int part;
+    int parts;
+    int* outbox;                            // fd of to-K.from-part for each K, or -1 for part
+    int* inbox;                             // fd of to-part.from-J for each J, or -1 until it appears
+    long* offset;                           // how far each inbox has been read
+    char buffer[READ_BYTES];
+} spool_t;
+
+/**************** local functions ****************/
+static char* spoolPath(const char* dir, const char* format, int a, int b);
+
+/**************** spool_prepare() ****************/
+/* see spool.h for description */
+bool spool_prepare(const char* dir, int parts, bool fresh)
+{
+    if (dir == NULL || parts < 1 || (mkdir(dir, 0755) != 0 && errno != EEXIST))
+    {
+        return false;
+    }
+
+    for (int k = 0; k < parts; k++)
+    {
+        char* path = spoolPath(dir, "state-%d", k, 0);
+        if (path != NULL)
+        {
+            unlink(path);
+            free(path);
+        }
+        for (int j = 0; fresh && j < parts; j++)
+        {
+            path = spoolPath(dir, "to-%d.from-%d", k, j);
+            if (path != NULL)
+            {
+                unlink(path);
+                free(path);
+            }
+        }
+    }
+    return true;
+}
+
+/**************** spool_open() ****************/
+/* see spool.h for description */
+spool_t* spool_open(const char* dir, int part, int parts)
+{
+    if (dir == NULL || parts < 1 || part < 0 || part >= parts)
+    {
+        return NULL;
+    }
+    spool_t* spool = malloc(sizeof(spool_t));
+    if (spool == NULL)
+    {
+        return NULL;
+    }
+    spool->dir = malloc(strlen(dir) + 1);
+    spool->outbox = malloc(parts * sizeof(int));
+    spool->inbox = malloc(parts * sizeof(int));
+    spool->offset = calloc(parts, sizeof(long));
+    spool->part = part;
+    spool->parts = parts;
+    if (spool->dir == NULL || spool->outbox == NULL || spool->inbox == NULL || spool->offset == NULL)
+    {
+        free(spool->dir);
+        free(spool->outbox);
+        free(spool->inbox);
+        free(spool->offset);
+        free(spool);
+        return NULL;
+    }
+    strcpy(spool->dir, dir);
+
+    bool ok = true;
+    for (int k = 0; k < parts; k++)
+    {
+        spool->inbox[k] = -1;
+        spool->outbox[k] = -1;
+        if (k != part)
+        {
+            char* path = spoolPath(dir, "to-%d.from-%d", k, part);
+            spool->outbox[k] = (path != NULL) ? open(path, O_WRONLY | O_CREAT | O_APPEND, 0644) : -1;
+            ok = ok && spool->outbox[k] >= 0;
+            free(path);
+        }
+    }
+    if (!ok)
+    {
+        spool_close(spool);
+        return NULL;
+    }
+    return spool;
+}
+
+/**************** spool_partition() ****************/
+/* see spool.h for description */
+int spool_partition(const char* url, int parts)
+{
+    // FNV-1a, which spreads even URLs that differ in a character or two
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char* p = (const unsigned char*) url; *p != '\0'; p++)
+    {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return (parts > 1) ? (int) (hash % parts) : 0;
+}
+
+/**************** spool_send() ****************/
+/* see spool.h for description */
+bool spool_send(spool_t* spool, int part, int depth, const char* url)
+{
+    if (spool == NULL || part < 0 || part >= spool->parts || part == spool->part || url == NULL)
+    {
+        return false;
+    }
+    char line[LINE_BYTES];
+    int length = snprintf(line, sizeof(line), "%d %s\n", depth, url);
+    if (length < 0 || length >= (int) sizeof(line))
+    {
+        return false;
+    }
+    return write(spool->outbox[part], line, length) == length;
+}
+
+/**************** spool_receive() ****************/
+/* see spool.h for description */
+long spool_receive(spool_t* spool, void* arg,
+                   void (*itemfunc)(void* arg, int depth, const char* url))
+{
+    if (spool == NULL || itemfunc == NULL)
+    {
+        return 0;
+    }
+
+    long received = 0;
+    for (int j = 0; j < spool->parts; j++)
+    {
+        if (j == spool->part)
+        {
+            continue;
+        }
+        if (spool->inbox[j] < 0)
+        {
+            char* path = spoolPath(spool->dir, "to-%d.from-%d", spool->part, j);
+            spool->inbox[j] = (path != NULL) ? open(path, O_RDONLY) : -1;
+            free(path);
+            if (spool->inbox[j] < 0)
+            {
+                continue;                   // nothing sent from j yet
+            }
+        }
+
+        ssize_t length;
+        while ((length = pread(spool->inbox[j], spool->buffer, sizeof(spool->buffer), spool->offset[j])) > 0)
+        {
+            // Take each complete line; a partial one at the end waits for the next read
+            char* line = spool->buffer;
+            char* end = spool->buffer + length;
+            char* newline;
+            while (line < end && (newline = memchr(line, '\n', end - line)) != NULL)
+            {
+                *newline = '\0';
+                int depth, start;
+                if (sscanf(line, "%d %n", &depth, &start) == 1 && line[start] != '\0')
+                {
+                    (*itemfunc)(arg, depth, line + start);
+                    received++;
+                }
+                line = newline + 1;
+            }
+            if (line == spool->buffer)
+            {
+                if (length < (ssize_t) sizeof(spool->buffer))
+                {
+                    break;                  // a line still being written
+                }
+                line = end;                 // a line longer than any sent; skip it
+            }
+            spool->offset[j] += line - spool->buffer;
+        }
+    }
+    return received;
+}
+
+/**************** spool_publish() ****************/
+/* see spool.h for description */
+bool spool_publish(spool_t* spool, bool idle)
+{
+    if (spool == NULL)
+    {
+        return false;
+    }
+    char* path = spoolPath(spool->dir, "state-%d", spool->part, 0);
+    char* tempPath = spoolPath(spool->dir, "state-%d.tmp", spool->part, 0);
+    FILE* fp = (path != NULL && tempPath != NULL) ? fopen(tempPath, "w") : NULL;
+    bool ok = fp != NULL;
+    if (ok)
+    {
+        fprintf(fp, "idle %d\nread", idle ? 1 : 0);
+        for (int j = 0; j < spool->parts; j++)
+        {
+            fprintf(fp, " %ld", spool->offset[j]);
+        }
+        fprintf(fp, "\n");
+        ok = fclose(fp) == 0 && rename(tempPath, path) == 0;
+    }
+    free(path);
+    free(tempPath);
+    return ok;
+}
+
+/**************** spool_finished() ****************/
+/* see spool.h for description */
+bool spool_finished(spool_t* spool)
+{
+    if (spool == NULL)
+    {
+        return false;
+    }
+    int parts = spool->parts;
+    long* read = malloc(parts * parts * sizeof(long));
+    if (read == NULL)
+    {
+        return false;
+    }
+
+    // First every state, then every file's length, so that anything sent
+    // after a state was published is seen
+    bool finished = true;
+    for (int k = 0; finished && k < parts; k++)
+    {
+        char* path = spoolPath(spool->dir, "state-%d", k, 0);
+        FILE* fp = (path != NULL) ? fopen(path, "r") : NULL;
+        free(path);
+        int idle = 0;
+        finished = fp != NULL && fscanf(fp, "idle %d read", &idle) == 1 && idle == 1;
+        for (int j = 0; finished && j < parts; j++)
+        {
+            finished = fscanf(fp, "%ld", &read[k * parts + j]) == 1;
+        }
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+    }
+    for (int k = 0; finished && k < parts; k++)
+    {
+        for (int j = 0; finished && j < parts; j++)
+        {
+            if (j == k)
+            {
+                continue;
+            }
+            char* path = spoolPath(spool->dir, "to-%d.from-%d", k, j);
+            struct stat info;
+            long length = (path != NULL && stat(path, &info) == 0) ? (long) info.st_size : 0;
+            finished = path != NULL && length == read[k * parts + j];
+            free(path);
+        }
+    }
+    free(read);
+    return finished;
+}
+
+/**************** spool_close() ****************/
+/* see spool.h for description */
+void spool_close(spool_t* spool)
+{
+    if (spool != NULL)
+    {
+        for (int k = 0; k < spool->parts; k++)
+        {
+            if (spool->outbox[k] >= 0)
+            {
+                close(spool->outbox[k]);
+            }
+            if (spool->inbox[k] >= 0)
+            {
+                close(spool->inbox[k]);
+            }
+        }
+        free(spool->dir);
+        free(spool->outbox);
+        free(spool->inbox);
+        free(spool->offset);
+        free(spool);
+    }
+}
+
+/*
+ * spoolPath: Returns the path of a file in the spool directory dir, its
+ * name given by format and up to two partitions, as a string the caller
+ * must free; or NULL if out of memory.
+ */
+static char* spoolPath(const char* dir, const char* format, int a, int b)
+{
+    int length = snprintf(NULL, 0, format, a, b);
+    char* path = malloc(strlen(dir) + 1 + length + 1);
+    if (path != NULL)
+    {
+        sprintf(path, "%s/", dir);
+        sprintf(path + strlen(dir) + 1, format, a, b);
+    }
+    return path;
+}
@@ -0,0 +1,84 @@
+#ifndef __SPOOL_H
+#define __SPOOL_H
+
+#include <stdbool.h>
+
+/*
+ * spool - passing links between crawler processes through a shared directory
+ *
+ * A crawl split over several processes gives each a partition of the
+ * URLs, by a hash of the normalized URL; a process crawls only the URLs
+ * in its own partition, and sends every other link it finds to the
+ * process whose partition it is in.  A link is sent by appending a
+ * "depth URL" line to the file to-K.from-J in the spool directory, where
+ * J is the sender and K the receiver, so each file has one writer and
+ * one reader; the receiver reads each of its files from where it left
+ * off, a complete line at a time.
+ *
+ * The crawl is over once every process is idle and has read all that
+ * was sent to it.  Each process publishes, in its file state-K, whether
+ * it is idle and how far it has read each file sent to it; a process
+ * that is idle can only become busy by reading more, and files only
+ * grow, so if every state published says idle, and each file is then
+ * no longer than its reader says it has read, nothing is left to do.
+ */
+typedef struct spool spool_t;
+
+/*
+ * Set up the spool directory dir, creating it if need be, for a crawl
+ * over parts processes, before any of them opens it: every state file
+ * is removed, so none is taken for that of a process not yet started;
+ * and, if fresh, so are all the links sent in an earlier crawl.
+ * Returns true if successful.
+ */
+bool spool_prepare(const char* dir, int parts, bool fresh);
+
+/*
+ * Open the spool directory dir as partition part (from 0) of parts.
+ * Returns NULL on any error.
+ * Caller is responsible for later calling spool_close.
+ */
+spool_t* spool_open(const char* dir, int part, int parts);
+
+/*
+ * Returns the partition, from 0 to parts - 1, of a normalized URL.
+ */
+int spool_partition(const char* url, int parts);
+
+/*
+ * Send a link, found at the given depth, to partition part, with a
+ * single write so that the receiver never sees half a line from a
+ * whole one.  May be called from several threads at once.
+ * Returns false if it could not be written.
+ */
+bool spool_send(spool_t* spool, int part, int depth, const char* url);
+
+/*
+ * Read every complete line sent to this partition since the last call,
+ * passing each link to itemfunc along with arg; the url is valid only
+ * during the call.
+ * Returns the number of links read.
+ */
+long spool_receive(spool_t* spool, void* arg,
+                   void (*itemfunc)(void* arg, int depth, const char* url));
+
+/*
+ * Publish whether this partition is idle, along with how far it has
+ * read what was sent to it; the state file is replaced by a rename, so
+ * others read either the old state or the new.
+ * Returns true if successful.
+ */
+bool spool_publish(spool_t* spool, bool idle);
+
+/*
+ * Returns true if every partition has published that it is idle, and
+ * has read all that was sent to it; the crawl is then over.
+ */
+bool spool_finished(spool_t* spool);
+
+/*
+ * Close the spool, leaving its files in place.
+ */
+void spool_close(spool_t* spool);
+
+#endif //__SPOOL_H
@@ -0,0 +1,418 @@
+/*
+ * url.c    Sajjad C Kareem    December 2, 2023
+ *
+ * This file contains the implementation of link scanning and URL
+ * normalization in caller-provided buffers.
+ * Functions include:
+ *     - url_nextLink: Find a page's next link and resolve it.
+ *     - url_normalize: Normalize a URL in place.
+ *
+ * A URL is parsed into parts_t, a pair of pointers into the string for
+ * each part, on the same boundaries as libcs50's parseURL.  Normalizing
+ * only ever shortens a URL, and its parts appear in it in order, so the
+ * normalized URL is written over the original from left to right, never
+ * overtaking what is still to be read.
+ *
+ * See url.h for more information.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "url.h"
+
+/**************** local types ****************/
+/*
+ * parts_t: The parts of an absolute URL, each from a start pointer up to,
+ * not including, an end pointer.  The scheme includes its ":" and any
+ * "//", and the user its "@"; user, query and fragment are NULL if absent.
+ */
+typedef struct
+{
+    char* scheme;
+    char* schemeEnd;
+    char* user;
+    char* userEnd;
+    char* host;
+    char* hostEnd;
+    char* path;
+    char* pathEnd;
+    char* query;
+    char* queryEnd;
+    char* fragment;
+    char* fragmentEnd;
+} parts_t;
+
+/**************** local functions ****************/
+static bool parseParts(char* str, parts_t* parts);
+static bool isHTML(const parts_t* parts);
+static char* removeDotSegments(char* path, char* pathEnd);
+static bool startsWith(const char* s, const char* end, const char* prefix);
+static bool equals(const char* s, const char* end, const char* word);
+static char* findNoCase(char* s, const char* end, const char* needle);
+static void removeWhitespace(char* str);
+
+/**************** url_nextLink() ****************/
+/* see url.h for description */
+bool url_nextLink(char* html, int* pos, const char* base, char* url, size_t size)
+{
+    if (html == NULL || pos == NULL || base == NULL || url == NULL || size < URL_MAX)
+    {
+        return false;
+    }
+    if (*pos == 0)
+    {
+        removeWhitespace(html);             // as webpage_getNextURL does, so links are found alike
+    }
+
+    while (true)
+    {
+        char* link = findNoCase(html + *pos, NULL, "<a");
+        if (link == NULL)
+        {
+            return false;
+        }
+
+        // A link with no href in its tag is skipped; webpage_getNextURL moves on
+        // two characters at a time until it is past the tag's "<a", which comes to the same
+        char* end = strchr(link, '>');
+        char* href = findNoCase(link, end, "href=");
+        if (href == NULL && end == NULL)
+        {
+            return false;                   // no tag ends, so no tag after this has an href
+        }
+        if (href == NULL)
+        {
+            *pos = link + 2 - html;
+            continue;
+        }
+
+        href += strlen("href=");
+        if (*href == '\'' || *href == '"')
+        {
+            char delimiter = *href++;
+            end = strchr(href, delimiter);
+        } else {
+            end = strchr(href, '>');        // <a ... href=url>, since whitespace is gone
+        }
+        if (end == NULL || *href == '#')
+        {
+            *pos = link + 2 - html;
+            continue;
+        }
+        char* hash = memchr(href, '#', end - href);
+        if (hash != NULL)
+        {
+            end = hash;                     // the fragment is dropped
+        }
+
+        // Absolute if a ':' comes before any '/', '?' or '#', looking past the end of
+        // the link if need be, as webpage_getNextURL does; then it must be http(s)
+        char* colon = strpbrk(href, ":/?#");
+        bool relative = (colon == NULL || *colon != ':');
+        if (!relative && strncasecmp(href, "http", 4) != 0)
+        {
+            *pos = link + 2 - html;
+            continue;
+        }
+        *pos = end - html;
+
+        size_t length = end - href;
+        if (!relative)
+        {
+            if (length + 1 > size)
+            {
+                continue;                   // too long to keep
+            }
+            memcpy(url, href, length);
+            url[length] = '\0';
+            return true;
+        }
+
+        // Resolve the link against the base URL, as libcs50's fixRelativeURL does
+        char baseCopy[URL_MAX];
+        parts_t parts;
+        size_t baseLength = strlen(base);
+        if (baseLength + 1 > sizeof(baseCopy))
+        {
+            return false;
+        }
+        memcpy(baseCopy, base, baseLength + 1);
+        if (!parseParts(baseCopy, &parts))
+        {
+            return false;
+        }
+        char* slash = NULL;
+        if (href[0] != '/')
+        {
+            // The base path up to its last '/', unless that is its first character
+            for (char* p = parts.pathEnd; p > parts.path; p--)
+            {
+                if (p[-1] == '/')
+                {
+                    slash = p - 1;
+                    break;
+                }
+            }
+            if (slash == parts.path)
+            {
+                slash = NULL;
+            }
+        }
+        size_t prefix = (parts.userEnd != NULL ? parts.userEnd : parts.schemeEnd) - parts.scheme;
+        size_t hostLength = parts.hostEnd - parts.host;
+        size_t dirLength = (slash != NULL) ? (size_t) (slash - parts.path) : 0;
+        size_t total = prefix + hostLength + dirLength + (href[0] != '/' ? 1 : 0) + length;
+        if (total + 1 > size)
+        {
+            continue;
+        }
+
+        char* out = url;
+        for (char* p = parts.scheme; p < parts.schemeEnd; p++)
+        {
+            *out++ = tolower((unsigned char) *p);
+        }
+        if (parts.user != NULL)
+        {
+            memcpy(out, parts.user, parts.userEnd - parts.user);
+            out += parts.userEnd - parts.user;
+        }
+        for (char* p = parts.host; p < parts.hostEnd; p++)
+        {
+            *out++ = tolower((unsigned char) *p);
+        }
+        if (href[0] != '/')
+        {
+            memcpy(out, parts.path, dirLength);
+            out += dirLength;
+            *out++ = '/';
+        }
+        memcpy(out, href, length);
+        out[length] = '\0';
+        return true;
+    }
+}
+
+/**************** url_normalize() ****************/
+/* see url.h for description */
+bool url_normalize(char* url)
+{
+    parts_t parts;
+    if (url == NULL || !parseParts(url, &parts) || parts.path == parts.pathEnd || !isHTML(&parts))
+    {
+        return false;
+    }
+
+    // Scheme and host are lowercased where they are; the user sits between them, as it was
+    for (char* p = parts.scheme; p < parts.schemeEnd; p++)
+    {
+        *p = tolower((unsigned char) *p);
+    }
+    for (char* p = parts.host; p < parts.hostEnd; p++)
+    {
+        *p = tolower((unsigned char) *p);
+    }
+
+    // The path shrinks as dot segments go, and the query and fragment, which
+    // are all that follow it, move up behind it
+    char* out = removeDotSegments(parts.path, parts.pathEnd);
+    memmove(out, parts.pathEnd, strlen(parts.pathEnd) + 1);
+    return true;
+}
+
+/*
+ * parseParts: Splits the absolute URL str into its parts, on the same
+ * boundaries as libcs50's parseURL.  Returns false if str has no scheme,
+ * or if a '?' or '#' comes before the end of the host, where parseURL
+ * fails.
+ */
+static bool parseParts(char* str, parts_t* parts)
+{
+    char* end = str + strlen(str);
+
+    // Absolute: a ':' must come before any '/', '?' or '#'
+    char* schemeEnd = strpbrk(str, ":/?#");
+    if (schemeEnd == NULL || *schemeEnd != ':')
+    {
+        return false;
+    }
+    schemeEnd++;
+    if (strncmp(schemeEnd, "//", 2) == 0)
+    {
+        schemeEnd += 2;
+    }
+    parts->scheme = str;
+    parts->schemeEnd = schemeEnd;
+
+    // User information is anything before an '@' that comes before any '/'
+    char* at = strpbrk(schemeEnd, "@/");
+    if (at != NULL && *at == '@')
+    {
+        parts->user = schemeEnd;
+        parts->userEnd = at + 1;
+    } else {
+        parts->user = parts->userEnd = NULL;
+    }
+
+    // The host runs to the first '/', or the end
+    char* slash = strchr(schemeEnd, '/');
+    parts->host = (parts->user != NULL) ? parts->userEnd : schemeEnd;
+    parts->hostEnd = (slash != NULL) ? slash : end;
+
+    // The path runs from there to the first '?' or '#', or the end
+    char* pathEnd = strpbrk(schemeEnd, "?#");
+    if (pathEnd != NULL && pathEnd < parts->hostEnd)
+    {
+        return false;
+    }
+    parts->path = parts->hostEnd;
+    parts->pathEnd = (pathEnd != NULL) ? pathEnd : end;
+
+    // The fragment is anything from the first '#'; the query anything from a '?' before it
+    char* hash = strchr(schemeEnd, '#');
+    char* question = strchr(schemeEnd, '?');
+    parts->fragment = hash;
+    parts->fragmentEnd = (hash != NULL) ? end : NULL;
+    if (question != NULL && (hash == NULL || question < hash))
+    {
+        parts->query = question;
+        parts->queryEnd = (hash != NULL) ? hash : end;
+    } else {
+        parts->query = parts->queryEnd = NULL;
+    }
+    return true;
+}
+
+/*
+ * isHTML: Returns true unless the last segment of the URL's path has an
+ * extension that does not begin "htm", as normalizeURL requires.
+ */
+static bool isHTML(const parts_t* parts)
+{
+    const char* dot = NULL;
+    const char* slash = NULL;
+    for (const char* p = parts->path; p < parts->pathEnd; p++)
+    {
+        if (*p == '.')
+        {
+            dot = p;
+        } else if (*p == '/') {
+            slash = p;
+        }
+    }
+    if (dot == NULL || slash == NULL || dot < slash || dot + 1 == parts->pathEnd)
+    {
+        return true;
+    }
+    return parts->pathEnd - (dot + 1) >= 3 && strncasecmp(dot + 1, "htm", 3) == 0;
+}
+
+/*
+ * removeDotSegments: Removes the "." and ".." segments from the path
+ * between path and pathEnd, which is not empty, by the algorithm of
+ * RFC 3986 section 5.2.4, as libcs50's removeDotSegments does; the
+ * result is written over the path, and a pointer to its end returned.
+ */
+static char* removeDotSegments(char* path, char* pathEnd)
+{
+    char* in = path;
+    char* out = path;
+    do
+    {
+        if (startsWith(in, pathEnd, "./"))
+        {
+            in += 2;
+        } else if (startsWith(in, pathEnd, "../")) {
+            in += 3;
+        } else if (startsWith(in, pathEnd, "/./")) {
+            in += 2;
+        } else if (equals(in, pathEnd, "/.")) {
+            in[1] = '/';                    // what is left becomes "/"
+            in++;
+        } else if (startsWith(in, pathEnd, "/../") || equals(in, pathEnd, "/..")) {
+            if (startsWith(in, pathEnd, "/../"))
+            {
+                in += 3;
+            } else {
+                in[2] = '/';                // what is left becomes "/"
+                in += 2;
+            }
+            while (out > path)              // and the last segment written goes
+            {
+                out--;
+                if (*out == '/')
+                {
+                    break;
+                }
+            }
+        } else if (equals(in, pathEnd, ".") || equals(in, pathEnd, "..")) {
+            in = pathEnd;
+        } else {
+            do
+            {
+                *out++ = *in++;
+            } while (in < pathEnd && *in != '/');
+        }
+    } while (in < pathEnd);
+    return out;
+}
+
+/*
+ * startsWith: Returns true if the characters from s up to end begin with prefix.
+ */
+static bool startsWith(const char* s, const char* end, const char* prefix)
+{
+    size_t length = strlen(prefix);
+    return (size_t) (end - s) >= length && strncmp(s, prefix, length) == 0;
+}
+
+/*
+ * equals: Returns true if the characters from s up to end are word.
+ */
+static bool equals(const char* s, const char* end, const char* word)
+{
+    size_t length = strlen(word);
+    return (size_t) (end - s) == length && strncmp(s, word, length) == 0;
+}
+
+/*
+ * findNoCase: Returns the first place from s, wholly before end (or the
+ * end of the string, if end is NULL), where needle, given in lowercase,
+ * appears in any case; or NULL if there is none.
+ */
+static char* findNoCase(char* s, const char* end, const char* needle)
+{
+    size_t length = strlen(needle);
+    for (char* p = s; *p != '\0' && (end == NULL || p + length <= end); p++)
+    {
+        size_t i = 0;
+        while (i < length && p[i] != '\0' && tolower((unsigned char) p[i]) == needle[i])
+        {
+            i++;
+        }
+        if (i == length)
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * removeWhitespace: Removes all whitespace from str, in place.
+ */
+static void removeWhitespace(char* str)
+{
+    char* out = str;
+    for (char* in = str; *in != '\0'; in++)
+    {
+        if (!isspace((unsigned char) *in))
+        {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
@@ -0,0 +1,46 @@
+#ifndef __URL_H
+#define __URL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * url - finding and normalizing the links in a page without allocating
+ *
+ * libcs50's webpage_getNextURL and normalizeURL allocate a string for
+ * the link, another for the normalized URL, and one for each part of the
+ * URL on the way; with a few hundred links a page, that was most of the
+ * crawler's time scanning pages.  These functions do the same work, by
+ * the same rules (including their quirks), in a buffer the caller
+ * provides, so a link costs an allocation only if it is kept.
+ */
+
+/*
+ * The size of buffer that holds any URL these functions accept; longer
+ * links are skipped.
+ */
+#define URL_MAX 4096
+
+/*
+ * Find the next link in a page's html, as webpage_getNextURL does, and
+ * write it to url as an absolute URL, resolved against base, the page's
+ * URL if the link is relative.
+ * Takes html: the page's html, from which the first call (with *pos 0)
+ *   removes all whitespace, as webpage_getNextURL does.
+ * Takes pos: where to search from; 0 on the first call, then left as
+ *   this call sets it.
+ * Takes url: a buffer of size bytes, at least URL_MAX.
+ * Returns false once the page has no more links (or a relative link
+ * cannot be resolved, as webpage_getNextURL gives up then too).
+ */
+bool url_nextLink(char* html, int* pos, const char* base, char* url, size_t size);
+
+/*
+ * Normalize an absolute URL in place, as normalizeURL does: lowercase the
+ * scheme and host, and remove "." and ".." segments from the path.
+ * Returns false, leaving url as it was, if it cannot be parsed, has no
+ * path, or names a file other than HTML (by its extension).
+ */
+bool url_normalize(char* url);
+
+#endif //__URL_H
@@ -0,0 +1,237 @@
+/*
+ * validators.c    Sajjad C Kareem    November 22, 2023
+ *
+ * This file contains the implementation of the validators file kept
+ * beside a page directory.
+ * Functions include:
+ *     - validators_open: Open the file, loading and compacting it or not.
+ *     - validators_get: Look up the validators loaded for a docID.
+ *     - validators_put: Append the validators of a page just saved.
+ *     - validators_close: Close the file.
+ *
+ * See validators.h for the file's layout.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../libcs50/file.h"
+#include "validators.h"
+
+/**************** local types ****************/
+typedef struct validators
+{
+    FILE* log;                  // open for appending
+    fetchvalidators_t* table;   // loaded validators, indexed by docID
+    int tableSize;
+    pthread_mutex_t lock;       // guards log
+} validators_t;
+
+/**************** local functions ****************/
+static bool loadFile(validators_t* validators, const char* path);
+static bool setEntry(validators_t* validators, int docID, char* etag, char* lastModified);
+static bool writeLine(FILE* fp, int docID, const fetchvalidators_t* entry);
+static const char* recordable(const char* value);
+static char* field(char* start, char** next);
+
+/**************** validators_open() ****************/
+/* see validators.h for description */
+validators_t* validators_open(const char* pageDirectory, bool load)
+{
+    if (pageDirectory == NULL)
+    {
+        return NULL;
+    }
+    validators_t* validators = malloc(sizeof(validators_t));
+    if (validators == NULL)
+    {
+        return NULL;
+    }
+    validators->log = NULL;
+    validators->table = NULL;
+    validators->tableSize = 0;
+    pthread_mutex_init(&validators->lock, NULL);
+
+    char path[strlen(pageDirectory) + 20];
+    char tempPath[strlen(pageDirectory) + 24];
+    sprintf(path, "%s/.validators", pageDirectory);
+    sprintf(tempPath, "%s/.validators.tmp", pageDirectory);
+
+    /* Rewrite what is loaded with one line per page, then append to that */
+    bool ok = true;
+    if (load && loadFile(validators, path))
+    {
+        FILE* fp = fopen(tempPath, "w");
+        ok = fp != NULL;
+        for (int docID = 1; ok && docID < validators->tableSize; docID++)
+        {
+            const fetchvalidators_t* entry = validators_get(validators, docID);
+            ok = entry == NULL || writeLine(fp, docID, entry);
+        }
+        ok = fp != NULL && (fclose(fp) == 0) && ok;
+        ok = ok && rename(tempPath, path) == 0;
+        if (!ok)
+        {
+            unlink(tempPath);
+        }
+    }
+    validators->log = ok ? fopen(path, load ? "a" : "w") : NULL;
+    if (validators->log == NULL)
+    {
+        validators_close(validators);
+        return NULL;
+    }
+    return validators;
+}
+
+/**************** validators_get() ****************/
+/* see validators.h for description */
+const fetchvalidators_t* validators_get(validators_t* validators, int docID)
+{
+    if (validators == NULL || docID < 1 || docID >= validators->tableSize)
+    {
+        return NULL;
+    }
+    const fetchvalidators_t* entry = &validators->table[docID];
+    return (entry->etag != NULL || entry->lastModified != NULL) ? entry : NULL;
+}
+
+/**************** validators_put() ****************/
+/* see validators.h for description */
+bool validators_put(validators_t* validators, int docID, const fetchvalidators_t* got)
+{
+    if (validators == NULL || docID < 1 || got == NULL)
+    {
+        return false;
+    }
+    pthread_mutex_lock(&validators->lock);
+    bool ok = writeLine(validators->log, docID, got) && fflush(validators->log) == 0;
+    pthread_mutex_unlock(&validators->lock);
+    return ok;
+}
+
+/**************** validators_close() ****************/
+/* see validators.h for description */
+void validators_close(validators_t* validators)
+{
+    if (validators != NULL)
+    {
+        if (validators->log != NULL)
+        {
+            fclose(validators->log);
+        }
+        for (int docID = 0; docID < validators->tableSize; docID++)
+        {
+            fetch_freeValidators(&validators->table[docID]);
+        }
+        free(validators->table);
+        pthread_mutex_destroy(&validators->lock);
+        free(validators);
+    }
+}
+
+/*
+ * loadFile: Loads every line of the file at path into the table, later
+ * lines for a docID replacing earlier ones; lines that cannot be read
+ * are skipped.  Returns false if there is no such file.
+ */
+static bool loadFile(validators_t* validators, const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    char* line;
+    while ((line = file_readLine(fp)) != NULL)
+    {
+        char* rest;
+        int docID = atoi(field(line, &rest));
+        char* etag = field(rest, &rest);
+        char* lastModified = field(rest, &rest);
+        if (docID >= 1 && lastModified != NULL)
+        {
+            setEntry(validators, docID, (*etag != '\0') ? strdup(etag) : NULL,
+                     (*lastModified != '\0') ? strdup(lastModified) : NULL);
+        }
+        free(line);
+    }
+    fclose(fp);
+    return true;
+}
+
+/*
+ * setEntry: Gives docID the validators etag and lastModified (either NULL),
+ * which the table takes over, growing the table as needed.
+ * Returns false, freeing them, if out of memory.
+ */
+static bool setEntry(validators_t* validators, int docID, char* etag, char* lastModified)
+{
+    if (docID >= validators->tableSize)
+    {
+        int size = (validators->tableSize > 0) ? validators->tableSize : 1024;
+        while (size <= docID)
+        {
+            size *= 2;
+        }
+        fetchvalidators_t* grown = realloc(validators->table, size * sizeof(fetchvalidators_t));
+        if (grown == NULL)
+        {
+            free(etag);
+            free(lastModified);
+            return false;
+        }
+        memset(grown + validators->tableSize, 0, (size - validators->tableSize) * sizeof(fetchvalidators_t));
+        validators->table = grown;
+        validators->tableSize = size;
+    }
+    fetch_freeValidators(&validators->table[docID]);
+    validators->table[docID].etag = etag;
+    validators->table[docID].lastModified = lastModified;
+    return true;
+}
+
+/*
+ * writeLine: Writes the line for docID's validators to fp.
+ * Returns false on any error.
+ */
+static bool writeLine(FILE* fp, int docID, const fetchvalidators_t* entry)
+{
+    return fprintf(fp, "%d\t%s\t%s\n", docID, recordable(entry->etag), recordable(entry->lastModified)) > 0;
+}
+
+/*
+ * recordable: Returns value if it can go in a field of the file,
+ * and otherwise the empty string that stands for no value.
+ */
+static const char* recordable(const char* value)
+{
+    return (value != NULL && strpbrk(value, "\t\r\n") == NULL) ? value : "";
+}
+
+/*
+ * field: Returns the tab-separated field starting at start, cutting it off
+ * there, and sets *next to the field after it (or NULL if it was the last).
+ * Returns NULL if start is NULL, when the line has run out of fields.
+ */
+static char* field(char* start, char** next)
+{
+    if (start == NULL)
+    {
+        *next = NULL;
+        return NULL;
+    }
+    char* tab = strchr(start, '\t');
+    if (tab != NULL)
+    {
+        *tab = '\0';
+        tab++;
+    }
+    *next = tab;
+    return start;
+}
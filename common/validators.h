@@ -0,0 +1,55 @@
+#ifndef __VALIDATORS_H
+#define __VALIDATORS_H
+
+#include <stdbool.h>
+#include "fetch.h"
+
+/*
+ * validators - the HTTP validators of the pages in a page directory
+ *
+ * To recrawl a page only if it has changed, the crawler must remember the
+ * ETag and Last-Modified headers it was last served with.  They are kept
+ * beside the pages, in pageDirectory/.validators, one line per page saved:
+ *
+ *     docID<TAB>ETag<TAB>Last-Modified
+ *
+ * with either field empty if the server sent no such header.  Lines are
+ * appended as pages are saved, a later line for a docID replacing any
+ * earlier one, so a crash loses at most the page being saved.  When the
+ * file is opened to carry on from an earlier crawl, it is loaded and
+ * rewritten with one line per page, so that it does not grow without end.
+ *
+ * Recording validators is thread-safe; looking them up reads only those
+ * loaded when the file was opened.
+ */
+typedef struct validators validators_t;
+
+/*
+ * Open the validators of the pages in pageDirectory.  If load is true,
+ * those already recorded there are loaded, for validators_get, and kept;
+ * otherwise any there are discarded, for a fresh crawl.
+ * Returns NULL on any error.
+ * Caller is responsible for later calling validators_close.
+ */
+validators_t* validators_open(const char* pageDirectory, bool load);
+
+/*
+ * Returns the validators loaded for the page saved under docID, whose
+ * strings belong to the table; or NULL if it had none.
+ */
+const fetchvalidators_t* validators_get(validators_t* validators, int docID);
+
+/*
+ * Record the validators a page was saved with under docID (either string
+ * may be NULL), replacing those recorded for it before.  Values holding
+ * a tab or line break cannot be recorded and are left out.
+ * Returns false if they could not be written.
+ */
+bool validators_put(validators_t* validators, int docID, const fetchvalidators_t* got);
+
+/*
+ * Close the file and free the table.
+ */
+void validators_close(validators_t* validators);
+
+#endif //__VALIDATORS_H
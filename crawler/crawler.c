@@ -4,56 +4,612 @@
  * This file contains the definitions for a web crawler. 
  * Functions include:
  *     - parseArgs: To validate and parse the command-line arguments.
+ *     - parseNumber: Convert an option's argument to a number.
  *     - crawl: Crawling websites up to a specified depth.
+ *     - crawlPartitions: Split the crawl between processes, one per partition of the URLs.
+ *     - crawlWorker: The loop each crawler thread runs over the frontier.
+ *     - crawlAsync: The loop that feeds the frontier through a fetch engine.
+ *     - budgetSpent: Check whether the page limit has been reached.
+ *     - takeDocID: Number a new page, unless it is a near-duplicate.
+ *     - pageFetched: Save and scan a page once its html has arrived.
+ *     - pageUnchanged: Scan the saved copy of a page that has not changed.
  *     - pageScan: Scan a page for URLs and handle them.
- *     - strdup: Duplicate a string.
+ *     - prefetchHost: Start looking up the host of a newly added URL.
+ *     - spoolReceiver: The loop of the thread taking links from other partitions.
+ *     - spoolLink: Add a link sent by another partition.
+ *     - checkpointDue: Check whether it is time for a checkpoint.
+ *     - checkpointTake: Pause the crawl and write a checkpoint.
+ *     - checkpointSave: Write the crawl's state to the checkpoint file.
+ *     - checkpointLoad: Restore the crawl's state from the checkpoint file.
+ *     - resumeSaved: Account for pages saved after the last checkpoint.
+ *     - recrawlLoad: Note the docIDs of the pages an earlier crawl saved.
+ *     - recrawlDocID: Look up the docID a page was saved under before.
+ *     - sameValue: Compare two header values, either of which may be missing.
+ *     - dupLoad: Fingerprint the pages saved before, for near-duplicate detection.
+ *     - isInternal: Check whether a URL is within the crawl.
+ *     - fetchDone: Count a fetch and record where its time went.
+ *     - statsReporter: The loop of the thread writing periodic stats.
+ *     - statsWrite: Write one line of stats, as JSON.
+ *     - reportStats: Print the crawl's fetch rate, latency percentiles and the state of its structures.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "webpage.h"
 #include "set.h"
-#include "hashtable.h"
 #include "bag.h"
+#include "hashtable.h"
+#include "file.h"
+#include "seenset.h"
+#include "frontier.h"
+#include "fetch.h"
+#include "fetchengine.h"
+#include "connpool.h"
+#include "politeness.h"
+#include "dnscache.h"
 #include "pagedir.h"
+#include "validators.h"
+#include "simhash.h"
+#include "histogram.h"
+#include "logger.h"
+#include "url.h"
+#include "spool.h"
+#include "breaker.h"
 #include <string.h>
 #include <ctype.h>
 
+/*
+ * crawlConfig_t: The optional settings given on the command line.
+ *
+ * Fields:
+ * - numThreads: Crawler threads to run (-j).
+ * - numConnections: Fetches to keep in flight from one thread (-a), or 0.
+ * - rate: Requests per second to any one host (-r), or 0 for no limit.
+ * - burst: Requests that may go to one host back to back (-b).
+ * - minDelay: Minimum seconds between requests to one host (-d).
+ * - seenMode: How to remember the URLs seen (-s exact or -s bloom).
+ * - seenExpected: The number of URLs to size the seen set for (-n).
+ * - seenFPRate: The false-positive rate of a Bloom seen set (-f).
+ * - maxInMemory: Frontier pages to hold in memory before spilling to disk (-m), or 0.
+ * - order: The order to crawl pages in (-o lifo, -o depth or -o inlinks).
+ * - maxPages: The most pages to save (-l), or 0 for no limit.
+ * - checkpointEvery: Seconds between checkpoints (-c), or 0 for none;
+ *   only a crawl that takes them records pages' validators.
+ * - maxDistance: Bits by which a page's fingerprint may differ from a saved
+ *   page's for it to be skipped as a near-duplicate (-D), or -1 to keep all.
+ * - internalPrefix: The prefix of the URLs within the crawl (-p), normalized.
+ * - statsEvery: Seconds between lines written to .stats (-S), or 0 for none.
+ * - report: Whether to print the crawl's throughput, latency and the state
+ *   of its structures when it finishes (--report, or -S).
+ * - logLevel: How much of the crawl's progress to print (-v).
+ * - resume: Whether to carry on from the last checkpoint (--resume).
+ * - packed: Whether to save pages in packed segments (--packed).
+ * - compress: Whether to compress the HTML of pages saved (--compress).
+ * - recrawl: Whether to refresh the pages already saved (--recrawl).
+ * - partitions: Processes to split the crawl between (--partitions).
+ * - limits: Deadlines for each fetch (--connect-timeout, --first-byte-timeout
+ *   and --timeout), the attempts it may make (--tries) and the backoff
+ *   between them (--backoff).
+ * - breakerFailures: Fetches from a host failing in a row that stop the
+ *   crawl contacting it for a while (--breaker), or 0 never to stop.
+ * - partition: The partition of the URLs this process crawls, from 0;
+ *   set for each process rather than on the command line.
+ */
+typedef struct
+{
+    int numThreads;
+    int numConnections;
+    double rate;
+    int burst;
+    double minDelay;
+    seenmode_t seenMode;
+    size_t seenExpected;
+    double seenFPRate;
+    int maxInMemory;
+    frontierorder_t order;
+    int maxPages;
+    int checkpointEvery;
+    int maxDistance;
+    char* internalPrefix;
+    double statsEvery;
+    bool report;
+    loglevel_t logLevel;
+    bool resume;
+    bool packed;
+    bool compress;
+    bool recrawl;
+    int partitions;
+    int partition;
+    fetchlimits_t limits;
+    int breakerFailures;
+} crawlConfig_t;
+
+/*
+ * timing_t: The histograms of crawlState_t's timings: the phases of each
+ * fetch (see fetchtimes_t), the whole fetch, and the time taken to scan
+ * a page for links and to save it.
+ */
+typedef enum
+{
+    TIME_WAIT,
+    TIME_DNS,
+    TIME_CONNECT,
+    TIME_FIRST_BYTE,
+    TIME_DOWNLOAD,
+    TIME_FETCH,
+    TIME_PARSE,
+    TIME_SAVE,
+    NUM_TIMINGS
+} timing_t;
+
+static const char* const TIMING_NAMES[NUM_TIMINGS] = {
+    "wait", "dns", "connect", "firstByte", "download", "fetch", "parse", "save"
+};
+
+/*
+ * crawlState_t: The state shared by all crawler threads.
+ *
+ * Fields:
+ * - pagesToCrawl: The frontier of pages yet to be fetched.
+ * - pagesSeen: Every URL ever added to the frontier, as a compact set.
+ * - fetch: Keep-alive connections, politeness scheduler, DNS cache and
+ *   circuit breaker shared by the threads, and the limits on each fetch.
+ * - limits: The limits fetch points to.
+ * - seenLock: Guards pagesSeen.
+ * - docID: The docID to give the next page saved.  Each partition's
+ *   docIDs start at its number plus 1 and go up in steps of partitions.
+ * - docLock: Guards docID.
+ * - lastDocID: The last docID this process may give a page: with a page
+ *   limit, its partition's share of it (see pageLimit), else INT_MAX.
+ * - pageDirectory: Where pages are saved.
+ * - stateDirectory: Where this process keeps the files that are its own
+ *   (checkpoint, validators, duplicates, stats and frontier segments):
+ *   pageDirectory, or a directory in it for each partition.
+ * - pages: The pages saved there, as files or packed segments.
+ * - validators: The ETag and Last-Modified of each page saved there.
+ * - savedDocIDs: For a recrawl, the docID of each URL saved before; otherwise NULL.
+ * - maxDepth: The depth beyond which pages are not scanned.
+ * - checkpointEvery: Seconds between checkpoints, or 0 for none.
+ * - lastCheckpoint: When the last checkpoint was taken; atomic, as every
+ *   thread reads it after each page.
+ * - checkpointLock: Held by the thread taking a checkpoint.
+ * - fingerprints: SimHashes of the pages saved, or NULL if near-duplicates are kept.
+ * - duplicates: Where near-duplicates are noted, as "docID URL" lines.
+ * - dupLookups, dupSeconds, dupSkipped: Lookups in fingerprints, the time
+ *   they took, and the near-duplicates skipped.
+ * - dupLock: Guards the above, and is held from looking up a page's
+ *   fingerprint through to storing it.
+ * - internalPrefix: The prefix of the URLs within the crawl.
+ * - timings: Histograms of where the crawl's time went, one per timing_t.
+ * - fetches, failures, notModified: The fetches finished, those that
+ *   brought no page, and those answered "304 Not Modified".
+ * - hostDown: The failures that were never tried, their host's circuit
+ *   breaker being open.
+ * - pagesFetched, bytesFetched: The pages fetched with their HTML, and
+ *   the bytes of HTML.
+ * - pagesSaved: The pages saved by this run, new or, in a recrawl, changed.
+ * - urlsFound, urlsInternal, urlsAdded: The URLs found in pages, those
+ *   within the crawl, and those not seen before.
+ * - statsLock: Guards the above counters.
+ * - crawlStart: When the crawl began, on the monotonic clock.
+ * - stats: Where a line of stats is written every statsEvery seconds and
+ *   at the end, or NULL.
+ * - statsEvery: Seconds between lines of stats.
+ * - crawlDone, statsWake: Tell the thread writing stats to stop; crawlDone
+ *   is guarded by statsLock.
+ * - log: Where the crawl's progress is printed, by a thread of its own.
+ * - partition, partitions: The partition of the URLs this process crawls,
+ *   and how many there are; 0 and 1 unless the crawl is split.
+ * - spool: Where links are sent to and received from other partitions,
+ *   or NULL if the crawl is not split.
+ * - urlsForwarded, urlsReceived: The links sent to other partitions, and
+ *   those received from them that had not been seen; guarded by statsLock.
+ */
+typedef struct
+{
+    frontier_t* pagesToCrawl;
+    seenset_t* pagesSeen;
+    fetchopts_t fetch;
+    fetchlimits_t limits;
+    pthread_mutex_t seenLock;
+    int docID;
+    pthread_mutex_t docLock;
+    int lastDocID;
+    char* pageDirectory;
+    char* stateDirectory;
+    pagedir_t* pages;
+    validators_t* validators;
+    hashtable_t* savedDocIDs;
+    int maxDepth;
+    int checkpointEvery;
+    _Atomic time_t lastCheckpoint;
+    pthread_mutex_t checkpointLock;
+    simhash_t* fingerprints;
+    FILE* duplicates;
+    long dupLookups;
+    double dupSeconds;
+    long dupSkipped;
+    pthread_mutex_t dupLock;
+    const char* internalPrefix;
+    histogram_t* timings[NUM_TIMINGS];
+    long fetches;
+    long failures;
+    long notModified;
+    long hostDown;
+    long pagesFetched;
+    long bytesFetched;
+    long pagesSaved;
+    long urlsFound;
+    long urlsInternal;
+    long urlsAdded;
+    pthread_mutex_t statsLock;
+    double crawlStart;
+    FILE* stats;
+    double statsEvery;
+    bool crawlDone;
+    pthread_cond_t statsWake;
+    logger_t* log;
+    int partition;
+    int partitions;
+    spool_t* spool;
+    long urlsForwarded;
+    long urlsReceived;
+} crawlState_t;
+
+static const int MAX_THREADS = 64;
+static const int MAX_CONNECTIONS = 1000;
+#define MAX_PARTITIONS 64
+#define MAX_TRIES 20
+static const double DNS_TTL = 300;          // seconds to keep a host's address
+static const int DNS_RESOLVERS = 2;         // threads looking up hosts in the background
+static const char CHECKPOINT_HEADER[] = "tse-checkpoint 1";
+static const int RECRAWL_SLOTS = 65536;     // hashtable slots for the URLs saved before
+static const int DUP_MIN_WORDS = 32;        // pages with fewer words are never taken for near-duplicates
+static const int LOG_LINES = 8192;          // lines of progress that may wait to be printed
+static const long SPOOL_POLL = 10000000;    // nanoseconds between looks for links from other partitions
+#ifdef NOSLEEP
+static const double DEFAULT_RATE = 0;       // no limit, for tests against a local server
+#else
+static const double DEFAULT_RATE = 1;       // one request per second to each host
+#endif
+static const double CONNECT_TIMEOUT = 10;   // default seconds for a connection attempt
+static const double FIRST_BYTE_TIMEOUT = 30;    // default seconds from a request to its first byte
+static const double FETCH_TIMEOUT = 60;     // default seconds for a whole fetch
+static const int FETCH_TRIES = 3;           // default attempts at a fetch
+#ifdef NOSLEEP
+static const double DEFAULT_BACKOFF = 0;    // no backoff, for tests against a local server
+#else
+static const double DEFAULT_BACKOFF = 1;    // seconds before the second attempt
+#endif
+static const int BREAKER_FAILURES = 5;      // default failures in a row that trip a host's breaker
+static const double BREAKER_COOLDOWN = 30;  // seconds a tripped breaker first stays open
+
 /* Function declarations */
-void parseArgs(int argc, char* argv[], char** seedURL, char** pageDirectory, int* maxDepth);
-void crawl(char* seedURL, char* pageDirectory, int maxDepth);
-static void pageScan(webpage_t* page, bag_t* pagesToCrawl, hashtable_t* pagesSeen);
-char* strdup(char* str);
+void parseArgs(int argc, char* argv[], char** seedURL, char** pageDirectory, int* maxDepth, crawlConfig_t* config);
+bool crawl(char* seedURL, char* pageDirectory, int maxDepth, const crawlConfig_t* config);
+static bool crawlPartitions(char* seedURL, char* pageDirectory, int maxDepth, crawlConfig_t* config);
+static bool parseNumber(const char* arg, double min, double max, double* value);
+static void* crawlWorker(void* arg);
+static bool crawlAsync(crawlState_t* state, int numConnections);
+static int pageLimit(int maxPages, int partition, int partitions);
+static bool budgetSpent(crawlState_t* state);
+static int takeDocID(webpage_t* page, crawlState_t* state, int* original);
+static void pageFetched(webpage_t* page, crawlState_t* state, int savedDocID, const fetchvalidators_t* got);
+static void pageUnchanged(webpage_t* page, crawlState_t* state, int savedDocID, const fetchvalidators_t* got);
+static void pageScan(webpage_t* page, int depth, crawlState_t* state);
+static void prefetchHost(const char* url, crawlState_t* state);
+static void* spoolReceiver(void* arg);
+static void spoolLink(void* arg, int depth, const char* url);
+static bool checkpointDue(crawlState_t* state);
+static void checkpointTake(crawlState_t* state);
+static bool checkpointSave(crawlState_t* state);
+static bool checkpointLoad(crawlState_t* state);
+static void resumeSaved(crawlState_t* state, hashtable_t* savedURLs);
+static hashtable_t* recrawlLoad(crawlState_t* state);
+static int recrawlDocID(crawlState_t* state, const char* url);
+static bool sameValue(const char* a, const char* b);
+static void dupLoad(crawlState_t* state);
+static bool isInternal(const char* url, const char* prefix);
+static void fetchDone(crawlState_t* state, const webpage_t* page, int status, const fetchtimes_t* times);
+static void* statsReporter(void* arg);
+static void statsWrite(crawlState_t* state, bool final);
+static void reportStats(crawlState_t* state, double seconds, bool compress);
+static void reportCompression(crawlState_t* state);
+static double now(void);
 
 int main(int argc, char *argv[])
 {
     char* seedURL;
     char* pageDirectory;
     int maxDepth;
+    crawlConfig_t config;
 
     // Parsing arguments for crawler
-    parseArgs(argc, argv, &seedURL, &pageDirectory, &maxDepth);
+    parseArgs(argc, argv, &seedURL, &pageDirectory, &maxDepth, &config);
 
-    // Begin crawling with given parameters
-    crawl(seedURL, pageDirectory, maxDepth);
+    // Begin crawling with given parameters, in one process or several
+    bool ok = true;
+    if (config.partitions > 1)
+    {
+        ok = crawlPartitions(seedURL, pageDirectory, maxDepth, &config);
+    } else {
+        ok = crawl(seedURL, pageDirectory, maxDepth, &config);
+    }
 
     free(seedURL);
-    return 0;
+    free(config.internalPrefix);
+    return ok ? 0 : 1;
 }
 
 /*
  * parseArgs: Validates and extracts the required arguments from command line.
+ * for -j, ensure the number of threads is an integer in specified range
+ * for -a, ensure the number of connections is an integer in specified range,
+ *   and that -j was not also given
+ * for -r, -b and -d, ensure the politeness settings are non-negative numbers
+ *   (and the burst a positive integer)
+ * for -s, -n and -f, ensure a known seen-set mode, a positive size,
+ *   and a false-positive rate strictly between 0 and 1
+ * for -m, ensure the frontier limit is a non-negative integer
+ * for -o, ensure a known crawl order
+ * for -l, ensure the page limit is a non-negative integer
+ * for -c, ensure the checkpoint interval is a non-negative integer
+ * for -D, ensure the distance is an integer from 0 to SIMHASH_MAX_DISTANCE
+ * for -p, normalize the prefix and ensure it is an http:// URL
+ * for -S, ensure the stats interval is a non-negative number
+ * for -v, ensure a known log level
+ * for --recrawl, ensure that --resume was not also given
+ * for --partitions, ensure the number of processes is an integer in
+ *   specified range, and that --packed and --recrawl were not also given
+ * for --connect-timeout, --first-byte-timeout, --timeout and --backoff,
+ *   ensure a non-negative number of seconds
+ * for --tries, ensure a positive integer up to MAX_TRIES
+ * for --breaker, ensure a non-negative integer
  * for seedURL, normalize the URL and validate it is an internal URL
  * for pageDirectory, call pagedir_init()
  * for maxDepth, ensure it is an integer in specified range
  * if any trouble is found, print an error to stderr and exit non-zero.
  */
-void parseArgs(int argc, char* argv[], char** seedURL, char** pageDirectory, int* maxDepth)
+void parseArgs(int argc, char* argv[], char** seedURL, char** pageDirectory, int* maxDepth, crawlConfig_t* config)
 {
-    if (argc != 4)                                                      // Checking number of arguments
+    const char* usage = "Usage: ./crawler [-j threads | -a connections] [-r rate] [-b burst] [-d delay] "
+                        "[-s exact|bloom] [-n urls] [-f rate] [-m pages] [-o lifo|depth|inlinks] [-l pages] "
+                        "[-c seconds] [-D bits] [-p prefix] [-S seconds] [-v quiet|summary|verbose] [--report] [--resume] [--packed] [--compress] [--recrawl] [--partitions processes] "
+                        "[--connect-timeout seconds] [--first-byte-timeout seconds] [--timeout seconds] [--tries tries] "
+                        "[--backoff seconds] [--breaker failures] seedURL pageDirectory maxDepth\n";
+    const struct option longOptions[] = {
+        { "report", no_argument, NULL, 'E' },
+        { "resume", no_argument, NULL, 'R' },
+        { "packed", no_argument, NULL, 'P' },
+        { "compress", no_argument, NULL, 'Z' },
+        { "recrawl", no_argument, NULL, 'G' },
+        { "partitions", required_argument, NULL, 'K' },
+        { "connect-timeout", required_argument, NULL, 'C' },
+        { "first-byte-timeout", required_argument, NULL, 'F' },
+        { "timeout", required_argument, NULL, 'T' },
+        { "tries", required_argument, NULL, 'Y' },
+        { "backoff", required_argument, NULL, 'B' },
+        { "breaker", required_argument, NULL, 'H' },
+        { NULL, 0, NULL, 0 }
+    };
+    config->numThreads = 1;
+    config->numConnections = 0;
+    config->rate = DEFAULT_RATE;
+    config->burst = 1;
+    config->minDelay = 0;
+    config->seenMode = SEEN_EXACT;
+    config->seenExpected = 1000;
+    config->seenFPRate = 0.001;
+    config->maxInMemory = 100000;
+    config->order = FRONTIER_LIFO;
+    config->maxPages = 0;
+    config->checkpointEvery = 0;
+    config->maxDistance = -1;
+    config->internalPrefix = NULL;
+    config->statsEvery = 0;
+    config->report = false;
+    config->logLevel = LOG_VERBOSE;
+    config->resume = false;
+    config->packed = false;
+    config->compress = false;
+    config->recrawl = false;
+    config->partitions = 1;
+    config->partition = 0;
+    config->limits = (fetchlimits_t) { CONNECT_TIMEOUT, FIRST_BYTE_TIMEOUT, FETCH_TIMEOUT, FETCH_TRIES, DEFAULT_BACKOFF };
+    config->breakerFailures = BREAKER_FAILURES;
+
+    int opt;
+    double value;
+    while ((opt = getopt_long(argc, argv, "j:a:r:b:d:s:n:f:m:o:l:c:D:p:S:v:", longOptions, NULL)) != -1)   // Parse options ahead of the positional arguments
+    {
+        if (opt == 'j')
+        {
+            if (!parseNumber(optarg, 1, MAX_THREADS, &value) || value != (int) value)
+            {
+                printf("Number of threads should be between 1 and %d\n", MAX_THREADS);
+                exit(1);
+            }
+            config->numThreads = value;
+        } else if (opt == 'a') {
+            if (!parseNumber(optarg, 1, MAX_CONNECTIONS, &value) || value != (int) value)
+            {
+                printf("Number of connections should be between 1 and %d\n", MAX_CONNECTIONS);
+                exit(1);
+            }
+            config->numConnections = value;
+        } else if (opt == 'r') {
+            if (!parseNumber(optarg, 0, 1e6, &config->rate))
+            {
+                printf("Rate should be a non-negative number of requests per second (0 for no limit)\n");
+                exit(1);
+            }
+        } else if (opt == 'b') {
+            if (!parseNumber(optarg, 1, 1e6, &value) || value != (int) value)
+            {
+                printf("Burst should be a positive integer\n");
+                exit(1);
+            }
+            config->burst = value;
+        } else if (opt == 'd') {
+            if (!parseNumber(optarg, 0, 3600, &config->minDelay))
+            {
+                printf("Delay should be a non-negative number of seconds\n");
+                exit(1);
+            }
+        } else if (opt == 's') {
+            if (strcmp(optarg, "exact") == 0)
+            {
+                config->seenMode = SEEN_EXACT;
+            } else if (strcmp(optarg, "bloom") == 0) {
+                config->seenMode = SEEN_BLOOM;
+            } else {
+                printf("Seen-set mode should be exact or bloom\n");
+                exit(1);
+            }
+        } else if (opt == 'n') {
+            if (!parseNumber(optarg, 1, 1e12, &value) || value != (size_t) value)
+            {
+                printf("Expected number of URLs should be a positive integer\n");
+                exit(1);
+            }
+            config->seenExpected = value;
+        } else if (opt == 'f') {
+            if (!parseNumber(optarg, 0, 1, &config->seenFPRate) || config->seenFPRate == 0 || config->seenFPRate == 1)
+            {
+                printf("False-positive rate should be between 0 and 1\n");
+                exit(1);
+            }
+        } else if (opt == 'm') {
+            if (!parseNumber(optarg, 0, 1e9, &value) || value != (int) value)
+            {
+                printf("Frontier limit should be a non-negative integer (0 for no limit)\n");
+                exit(1);
+            }
+            config->maxInMemory = value;
+        } else if (opt == 'o') {
+            if (strcmp(optarg, "lifo") == 0)
+            {
+                config->order = FRONTIER_LIFO;
+            } else if (strcmp(optarg, "depth") == 0) {
+                config->order = FRONTIER_DEPTH;
+            } else if (strcmp(optarg, "inlinks") == 0) {
+                config->order = FRONTIER_SCORE;
+            } else {
+                printf("Crawl order should be lifo, depth or inlinks\n");
+                exit(1);
+            }
+        } else if (opt == 'l') {
+            if (!parseNumber(optarg, 0, 1e9, &value) || value != (int) value)
+            {
+                printf("Page limit should be a non-negative integer (0 for no limit)\n");
+                exit(1);
+            }
+            config->maxPages = value;
+        } else if (opt == 'c') {
+            if (!parseNumber(optarg, 0, 1e6, &value) || value != (int) value)
+            {
+                printf("Checkpoint interval should be a non-negative number of seconds (0 for none)\n");
+                exit(1);
+            }
+            config->checkpointEvery = value;
+        } else if (opt == 'D') {
+            if (!parseNumber(optarg, 0, SIMHASH_MAX_DISTANCE, &value) || value != (int) value)
+            {
+                printf("Near-duplicate distance should be an integer from 0 to %d bits\n", SIMHASH_MAX_DISTANCE);
+                exit(1);
+            }
+            config->maxDistance = value;
+        } else if (opt == 'p') {
+            free(config->internalPrefix);
+            config->internalPrefix = normalizeURL(optarg);
+            if (config->internalPrefix == NULL || strncmp(config->internalPrefix, "http://", strlen("http://")) != 0)
+            {
+                printf("Internal prefix should be an http:// URL\n");
+                exit(1);
+            }
+        } else if (opt == 'S') {
+            if (!parseNumber(optarg, 0, 1e6, &config->statsEvery))
+            {
+                printf("Stats interval should be a non-negative number of seconds (0 for none)\n");
+                exit(1);
+            }
+        } else if (opt == 'v') {
+            if (strcmp(optarg, "quiet") == 0)
+            {
+                config->logLevel = LOG_QUIET;
+            } else if (strcmp(optarg, "summary") == 0) {
+                config->logLevel = LOG_SUMMARY;
+            } else if (strcmp(optarg, "verbose") == 0) {
+                config->logLevel = LOG_VERBOSE;
+            } else {
+                printf("Log level should be quiet, summary or verbose\n");
+                exit(1);
+            }
+        } else if (opt == 'E') {
+            config->report = true;
+        } else if (opt == 'R') {
+            config->resume = true;
+        } else if (opt == 'P') {
+            config->packed = true;
+        } else if (opt == 'Z') {
+            config->compress = true;
+        } else if (opt == 'G') {
+            config->recrawl = true;
+        } else if (opt == 'K') {
+            if (!parseNumber(optarg, 1, MAX_PARTITIONS, &value) || value != (int) value)
+            {
+                printf("Number of partitions should be between 1 and %d\n", MAX_PARTITIONS);
+                exit(1);
+            }
+            config->partitions = value;
+        } else if (opt == 'C' || opt == 'F' || opt == 'T' || opt == 'B') {
+            double* seconds = (opt == 'C') ? &config->limits.connectTimeout
+                              : (opt == 'F') ? &config->limits.firstByteTimeout
+                              : (opt == 'T') ? &config->limits.totalTimeout : &config->limits.backoff;
+            if (!parseNumber(optarg, 0, 86400, seconds))
+            {
+                printf("Timeouts and backoff should be non-negative numbers of seconds (0 for none)\n");
+                exit(1);
+            }
+        } else if (opt == 'Y') {
+            if (!parseNumber(optarg, 1, MAX_TRIES, &value) || value != (int) value)
+            {
+                printf("Number of tries should be between 1 and %d\n", MAX_TRIES);
+                exit(1);
+            }
+            config->limits.maxTries = value;
+        } else if (opt == 'H') {
+            if (!parseNumber(optarg, 0, 1e6, &value) || value != (int) value)
+            {
+                printf("Breaker failures should be a non-negative integer (0 for no breaker)\n");
+                exit(1);
+            }
+            config->breakerFailures = value;
+        } else {
+            printf("%s", usage);
+            exit(1);
+        }
+    }
+    argc -= optind - 1;                                                 // Shift so argv[1..3] are the positional arguments
+    argv += optind - 1;
+
+    if (argc != 4 || (config->numThreads > 1 && config->numConnections > 0)
+        || (config->resume && config->recrawl)
+        || (config->partitions > 1 && (config->packed || config->recrawl)))   // Checking number of arguments
         {
-            printf("Usage: ./crawler seedURL pageDirectory maxDepth\n");
+            printf("%s", usage);
             exit(1);
         }
 
@@ -64,7 +620,11 @@ void parseArgs(int argc, char* argv[], char** seedURL, char** pageDirectory, int
             exit(1);
         }
 
-        if (!isInternalURL(normalizedURL))                              // Check if URL is internal
+        if (config->internalPrefix == NULL)                             // By default, crawl the CS50 test site
+        {
+            config->internalPrefix = strdup(INTERNAL_PREFIX);
+        }
+        if (!isInternal(normalizedURL, config->internalPrefix))         // Check if URL is internal
         {
             printf("Error: seedURL is not internal\n");
             free(normalizedURL);
@@ -99,126 +659,1323 @@ void parseArgs(int argc, char* argv[], char** seedURL, char** pageDirectory, int
         }
 }
 
+/*
+ * parseNumber: Converts an option's argument to a number.
+ * Returns true if the whole argument is a number between min and max.
+ */
+static bool parseNumber(const char* arg, double min, double max, double* value)
+{
+    char* end;
+    if (arg == NULL || *arg == '\0')
+    {
+        return false;
+    }
+    *value = strtod(arg, &end);
+    return *end == '\0' && *value >= min && *value <= max;
+}
+
 /*
  * crawl: Initiates the web crawling process up to the specified maxDepth.
  *
- * It maintains two data structures - a bag for pages to be crawled and a 
- * hashtable for pages already seen to avoid repetition.
+ * It maintains two data structures - a frontier of pages to be crawled and a 
+ * hashtable for pages already seen to avoid repetition - and shares them
+ * between config->numThreads threads, each of which runs crawlWorker; or, if
+ * config->numConnections is positive, drives them from this thread with crawlAsync.
+ * If the crawl is split, this process crawls only config->partition's
+ * URLs, and a thread running spoolReceiver exchanges links with the others.
+ * Returns false if the crawl could not be set up, or could not run.
  */
-void crawl(char* seedURL, char* pageDirectory, int maxDepth)
+bool crawl(char* seedURL, char* pageDirectory, int maxDepth, const crawlConfig_t* config)
 {
-    /* Hashtabe and Bag Initialization */
-    hashtable_t* pagesSeen = hashtable_new(100);
-    bag_t* pagesToCrawl = bag_new();
+    /* Hashtable and frontier initialization */
+    crawlState_t state;
+    pthread_t threads[MAX_THREADS];
+    bool ok = false;
+    state.partition = config->partition;
+    state.partitions = config->partitions;
+    state.stateDirectory = pageDirectory;
+    char partDirectory[strlen(pageDirectory) + 32];
+    if (state.partitions > 1)
+    {
+        sprintf(partDirectory, "%s/.part-%d", pageDirectory, state.partition);
+        if (mkdir(partDirectory, 0755) != 0 && errno != EEXIST)
+        {
+            fprintf(stderr, "Failed to create %s.\n", partDirectory);
+            return false;
+        }
+        state.stateDirectory = partDirectory;
+    }
+    state.pagesSeen = seenset_new(config->seenMode, config->seenExpected, config->seenFPRate);
+    state.pagesToCrawl = frontier_new(config->order, config->maxInMemory, state.stateDirectory);   // Spill to disk beyond maxInMemory
+    state.fetch.connections = connpool_new(config->numThreads);        // Each thread holds at most one connection at a time
+    state.fetch.politeness = politeness_new(config->rate, config->burst, config->minDelay);
+    state.fetch.dns = dnscache_new(DNS_TTL, DNS_RESOLVERS);
+    state.fetch.breaker = (config->breakerFailures > 0) ? breaker_new(config->breakerFailures, BREAKER_COOLDOWN) : NULL;
+    state.limits = config->limits;
+    state.fetch.limits = &state.limits;
+    state.docID = state.partition + 1;
+    state.lastDocID = pageLimit(config->maxPages, state.partition, state.partitions);
+    state.pageDirectory = pageDirectory;
+    state.maxDepth = maxDepth;
+    state.checkpointEvery = config->checkpointEvery;
+    atomic_init(&state.lastCheckpoint, time(NULL));
+    pthread_mutex_init(&state.seenLock, NULL);
+    pthread_mutex_init(&state.docLock, NULL);
+    pthread_mutex_init(&state.checkpointLock, NULL);
+    pthread_mutex_init(&state.dupLock, NULL);
+    pthread_mutex_init(&state.statsLock, NULL);
+    state.internalPrefix = config->internalPrefix;
+    for (int t = 0; t < NUM_TIMINGS; t++)
+    {
+        state.timings[t] = histogram_new();
+    }
+    state.fetches = 0;
+    state.failures = 0;
+    state.notModified = 0;
+    state.hostDown = 0;
+    state.pagesFetched = 0;
+    state.bytesFetched = 0;
+    state.pagesSaved = 0;
+    state.urlsFound = 0;
+    state.urlsInternal = 0;
+    state.urlsAdded = 0;
+    state.urlsForwarded = 0;
+    state.urlsReceived = 0;
+    state.spool = NULL;
+    state.stats = NULL;
+    state.statsEvery = config->statsEvery;
+    state.crawlDone = false;
+    pthread_cond_init(&state.statsWake, NULL);
+    state.log = logger_new(config->logLevel, stdout, LOG_LINES);
+    if (state.log == NULL)
+    {
+        fprintf(stderr, "Failed to start the log writer; progress will not be printed.\n");
+    }
+    state.fingerprints = NULL;
+    state.duplicates = NULL;
+    state.dupLookups = 0;
+    state.dupSeconds = 0;
+    state.dupSkipped = 0;
+    state.pages = NULL;
+    state.validators = NULL;
+    state.savedDocIDs = NULL;
+    if (state.pagesSeen == NULL)
+    {
+        fprintf(stderr, "Failed to allocate the seen set for %zu URLs.\n", config->seenExpected);
+        goto cleanup;
+    }
 
-    char* wpSeedURL = strdup(seedURL);                          // Duplicate seedURL for webpage creation
+    // Links in other partitions are sent to them from the first page scanned, even one saved before
+    if (state.partitions > 1)
+    {
+        char path[strlen(pageDirectory) + 32];
+        sprintf(path, "%s/.spool", pageDirectory);
+        state.spool = spool_open(path, state.partition, state.partitions);
+        if (state.spool == NULL)
+        {
+            fprintf(stderr, "Failed to open %s for partition %d.\n", path, state.partition);
+            goto cleanup;
+        }
+    }
 
-    /* seed page initializtion */
-    webpage_t* seedPage = webpage_new(wpSeedURL, 0, NULL);
-    if (!seedPage) 
+    // A resumed crawl or a recrawl carries on saving pages in whichever form the crawl began with
+    state.pages = (config->resume || config->recrawl) ? pagedir_open(pageDirectory) : NULL;
+    state.savedDocIDs = (config->recrawl && state.pages != NULL) ? recrawlLoad(&state) : NULL;
+    bool resumed = config->resume && state.pages != NULL && checkpointLoad(&state);
+    if (state.savedDocIDs == NULL && !resumed)
     {
-        fprintf(stderr, "Failed to initialize seedPage.\n");
-        return;
+        pagedir_close(state.pages);
+        state.pages = pagedir_create(pageDirectory, config->packed);
+        if (state.pages == NULL)
+        {
+            fprintf(stderr, "Failed to open %s for saving pages.\n", pageDirectory);
+            goto cleanup;
+        }
+        if (state.partitions == 1)
+        {
+            pagedir_setPartitions(pageDirectory, 1);        // docIDs are contiguous again
+        }
     }
-    
-    char* hashURL = strdup(seedURL);                           // Duplicate seedURL for hashtable insertion
 
-    if (!hashtable_insert(pagesSeen, hashURL, ""))             // Add seedURL to hashtable
+    // Validators are kept, for a later recrawl, alongside checkpoints; a recrawl keeps those it has
+    bool keepValidators = state.checkpointEvery > 0 || resumed || state.savedDocIDs != NULL;
+
+    // A recrawl cannot be resumed, so it takes no checkpoints, and the last crawl's no longer applies
+    if (state.savedDocIDs != NULL)
+    {
+        char path[strlen(state.stateDirectory) + 32];
+        sprintf(path, "%s/.checkpoint", state.stateDirectory);
+        unlink(path);
+        state.checkpointEvery = 0;
+    }
+    state.validators = keepValidators ? validators_open(state.stateDirectory, resumed || state.savedDocIDs != NULL) : NULL;
+    if (keepValidators && state.validators == NULL)
     {
-        free(hashURL);
+        fprintf(stderr, "Failed to open %s/.validators; pages' validators will not be recorded.\n", state.stateDirectory);
     }
 
-    bag_insert(pagesToCrawl, seedPage);                        // Add seed page to bag for crawling
+    // A split crawl holds its frontier open until every partition has run out of pages
+    pthread_t receiver;
+    bool receiving = false;
 
-    /* Begin crawling */
-    int docID = 1;                                          
-    webpage_t* curr_page;
-    while ((curr_page = bag_extract(pagesToCrawl)) != NULL)
+    // Only the partition the seedURL falls in starts from it; the others wait for links
+    if (!resumed && (state.spool == NULL || spool_partition(seedURL, state.partitions) == state.partition))
+    {
+        /* seed page initializtion */
+        webpage_t* seedPage = webpage_new(strdup(seedURL), 0, NULL);
+        if (!seedPage) 
+        {
+            fprintf(stderr, "Failed to initialize seedPage.\n");
+            goto cleanup;
+        }
+
+        seenset_insert(state.pagesSeen, seedURL);                     // Add seedURL to seen set
+        frontier_insert(state.pagesToCrawl, seedPage);                // Add seed page to frontier for crawling
+    }
+    pagedir_setCompressed(state.pages, config->compress);
+
+    // Near-duplicates are judged against every page saved, including those saved
+    // before; a recrawl meets its duplicates again, so only a resume keeps the list
+    if (config->maxDistance >= 0)
+    {
+        char path[strlen(state.stateDirectory) + 32];
+        sprintf(path, "%s/.duplicates", state.stateDirectory);
+        state.fingerprints = simhash_new(config->maxDistance);
+        state.duplicates = fopen(path, resumed ? "a" : "w");
+        if (state.fingerprints == NULL || state.duplicates == NULL)
+        {
+            fprintf(stderr, "Failed to set up near-duplicate detection; keeping all pages.\n");
+            simhash_delete(state.fingerprints);
+            state.fingerprints = NULL;
+        } else if (resumed || state.savedDocIDs != NULL) {
+            dupLoad(&state);
+        }
+    }
+
+    // Stats go to .stats, a JSON object per line, from a thread of their own
+    state.crawlStart = now();
+    pthread_t reporter;
+    bool reporting = false;
+    if (config->statsEvery > 0)
+    {
+        char path[strlen(state.stateDirectory) + 32];
+        sprintf(path, "%s/.stats", state.stateDirectory);
+        state.stats = fopen(path, resumed ? "a" : "w");
+        if (state.stats == NULL)
+        {
+            fprintf(stderr, "Failed to open %s; no stats will be written.\n", path);
+        } else {
+            reporting = pthread_create(&reporter, NULL, statsReporter, &state) == 0;
+        }
+    }
+
+    if (state.spool != NULL)
+    {
+        frontier_hold(state.pagesToCrawl);
+        receiving = pthread_create(&receiver, NULL, spoolReceiver, &state) == 0;
+        if (!receiving)
+        {
+            fprintf(stderr, "Failed to start the spool receiver; links from other partitions will not be crawled.\n");
+            frontier_release(state.pagesToCrawl);
+        }
+    }
+
+    /* Begin crawling; the main thread is the first worker */
+    int started = 1;
+    for (; config->numConnections == 0 && started < config->numThreads; started++)
+    {
+        if (pthread_create(&threads[started], NULL, crawlWorker, &state) != 0)
+        {
+            fprintf(stderr, "Failed to start crawler thread; continuing with %d.\n", started);
+            break;
+        }
+    }
+    if (config->numConnections > 0)
+    {
+        ok = crawlAsync(&state, config->numConnections);
+    } else {
+        crawlWorker(&state);
+        ok = true;
+    }
+    for (int i = 1; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    if (receiving)
+    {
+        pthread_join(receiver, NULL);   // it has already seen the crawl is over, or the workers would not be
+    }
+    if (reporting)
+    {
+        pthread_mutex_lock(&state.statsLock);
+        state.crawlDone = true;
+        pthread_cond_signal(&state.statsWake);
+        pthread_mutex_unlock(&state.statsLock);
+        pthread_join(reporter, NULL);
+    }
+    if (state.stats != NULL)
     {
-        if (webpage_fetch(curr_page))
+        statsWrite(&state, true);
+        fclose(state.stats);
+    }
+    if (config->report || state.statsEvery > 0)
+    {
+        reportStats(&state, now() - state.crawlStart, config->compress);
+    } else if (config->compress) {
+        reportCompression(&state);
+    }
+
+    /* A final checkpoint, with an empty frontier, records that the crawl is complete */
+    if (state.checkpointEvery > 0)
+    {
+        checkpointSave(&state);
+    }
+
+    /* Cleanup, in the reverse order of startup; the logger prints what is left in its ring */
+cleanup:
+    simhash_delete(state.fingerprints);
+    if (state.duplicates != NULL)
+    {
+        fclose(state.duplicates);
+    }
+    validators_close(state.validators);
+    hashtable_delete(state.savedDocIDs, free);
+    pagedir_close(state.pages);
+    spool_close(state.spool);
+    if (logger_dropped(state.log) > 0)
+    {
+        fprintf(stderr, "Log: %ld lines dropped because output could not keep up\n", logger_dropped(state.log));
+    }
+    logger_delete(state.log);
+    for (int t = 0; t < NUM_TIMINGS; t++)
+    {
+        histogram_delete(state.timings[t]);
+    }
+    pthread_cond_destroy(&state.statsWake);
+    pthread_mutex_destroy(&state.seenLock);
+    pthread_mutex_destroy(&state.docLock);
+    pthread_mutex_destroy(&state.checkpointLock);
+    pthread_mutex_destroy(&state.dupLock);
+    pthread_mutex_destroy(&state.statsLock);
+    breaker_delete(state.fetch.breaker);
+    dnscache_delete(state.fetch.dns);
+    politeness_delete(state.fetch.politeness);
+    connpool_delete(state.fetch.connections);
+    frontier_delete(state.pagesToCrawl);
+    seenset_delete(state.pagesSeen);
+    return ok;
+}
+
+/*
+ * crawlPartitions: Splits the crawl between config->partitions processes,
+ * forked from this one, each running crawl over its partition of the
+ * URLs and passing the others' links to them through pageDirectory/.spool.
+ * Each process's share of the politeness rate and delay is set so that,
+ * together, they keep to the limits given.  The page directory records
+ * the number of partitions, for the indexer to expect gaps in the docIDs.
+ * If a process fails, exiting with a non-zero status as when its crawl
+ * cannot be set up, or crashes, the others are stopped, to be carried on
+ * together with --resume.
+ * Returns true if every process finished.
+ */
+static bool crawlPartitions(char* seedURL, char* pageDirectory, int maxDepth, crawlConfig_t* config)
+{
+    char spoolDirectory[strlen(pageDirectory) + 32];
+    sprintf(spoolDirectory, "%s/.spool", pageDirectory);
+    if (!spool_prepare(spoolDirectory, config->partitions, !config->resume)
+        || !pagedir_setPartitions(pageDirectory, config->partitions))
+    {
+        fprintf(stderr, "Failed to set up %s for %d partitions.\n", pageDirectory, config->partitions);
+        return false;
+    }
+    if (config->rate > 0)
+    {
+        config->rate /= config->partitions;
+    }
+    config->minDelay *= config->partitions;
+
+    // Nothing buffered may be written twice, once by each child
+    fflush(stdout);
+    fflush(stderr);
+    pid_t children[MAX_PARTITIONS];
+    int started = 0;
+    for (; started < config->partitions; started++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
         {
-            printf("%d  Fetched: %s\n", webpage_getDepth(curr_page), webpage_getURL(curr_page));
+            config->partition = started;
+            bool crawled = crawl(seedURL, pageDirectory, maxDepth, config);
+            free(seedURL);
+            free(config->internalPrefix);
+            exit(crawled ? 0 : 1);
+        }
+        if (pid < 0)
+        {
+            break;
+        }
+        children[started] = pid;
+    }
 
-            pagedir_save(curr_page, pageDirectory, docID);
-            docID++;
+    bool ok = started == config->partitions;
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to start the crawler for partition %d; stopping the others.\n", started);
+    }
+    for (int i = 0; !ok && i < started; i++)
+    {
+        kill(children[i], SIGTERM);
+    }
+    for (int running = started; running > 0; running--)
+    {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0)
+        {
+            break;
+        }
+        for (int i = 0; i < started; i++)
+        {
+            if (children[i] == pid)
+            {
+                children[i] = 0;
+            }
+        }
+        if (ok && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+        {
+            fprintf(stderr, "A partition's crawler failed; stopping the others (carry on with --resume).\n");
+            ok = false;
+            for (int i = 0; i < started; i++)
+            {
+                if (children[i] != 0)
+                {
+                    kill(children[i], SIGTERM);
+                }
+            }
+        }
+    }
+    return ok;
+}
 
-            /* Scan page for URLs if not exceeded depth */
-            if (webpage_getDepth(curr_page) < maxDepth)
+/*
+ * crawlWorker: Crawls pages from the shared frontier until it is exhausted.
+ *
+ * Each page is fetched and passed to pageFetched, and only then reported
+ * done, so other threads keep waiting for the links it adds.
+ */
+static void* crawlWorker(void* arg)
+{
+    crawlState_t* state = arg;
+    webpage_t* curr_page;
+    while ((curr_page = frontier_extract(state->pagesToCrawl)) != NULL)
+    {
+        // Once the page limit is reached, the rest of the frontier is just emptied
+        int savedDocID = recrawlDocID(state, webpage_getURL(curr_page));
+        fetchvalidators_t got = { NULL, NULL };
+        int status = 0;
+        char* html = NULL;
+        if (!budgetSpent(state))
+        {
+            fetchtimes_t times;
+            html = fetch_conditional(webpage_getURL(curr_page), &state->fetch,
+                                     validators_get(state->validators, savedDocID), &got, &status, &times);
+            if (html != NULL)
             {
-                pageScan(curr_page, pagesToCrawl, pagesSeen);
+                /* Rebuild the page around its html; the URL moves to the new page */
+                webpage_t* fetched = webpage_new(strdup(webpage_getURL(curr_page)), webpage_getDepth(curr_page), html);
+                webpage_delete(curr_page);
+                curr_page = fetched;
             }
+            fetchDone(state, curr_page, status, &times);
+        }
+        if (html != NULL)
+        {
+            pageFetched(curr_page, state, savedDocID, &got);
+        } else if (status == 304 && savedDocID > 0) {
+            pageUnchanged(curr_page, state, savedDocID, &got);
         }
+        fetch_freeValidators(&got);
         webpage_delete(curr_page);
-    }
+        frontier_done(state->pagesToCrawl);
 
-    /* Cleanup */
-    free(hashURL);
-    hashtable_delete(pagesSeen, NULL);
-    bag_delete(pagesToCrawl, NULL);
+        if (checkpointDue(state))
+        {
+            checkpointTake(state);
+        }
+    }
+    return NULL;
 }
 
-
 /*
- * pageScan: Scans the given webpage for URLs.
+ * crawlAsync: Crawls pages from the frontier until it is exhausted,
+ * keeping up to numConnections fetches in flight through a fetch engine.
  *
- * For each URL, it normalizes the URL, checks if it's internal,
- * and if the URL hasn't been seen before, it adds it to the 
- * pages to be crawled.
+ * The engine is topped up from the frontier before waiting for each
+ * finished page, so new links join the in-flight set as soon as they
+ * are found.  When a checkpoint is due, the engine is left to empty
+ * first, so that every page not yet crawled is back in the frontier.
+ * With nothing in flight and nothing to submit, it waits for a page
+ * from another partition, if the crawl is split and not yet over.
+ * Returns false if the fetch engine could not be started.
  */
-static void pageScan(webpage_t* page, bag_t* pagesToCrawl, hashtable_t* pagesSeen)
+static bool crawlAsync(crawlState_t* state, int numConnections)
 {
-    int pos = 0;
-    char* nextURL;
-    int depth = webpage_getDepth(page);
+    fetchengine_t* engine = fetchengine_new(numConnections, &state->fetch);
+    if (engine == NULL)
+    {
+        fprintf(stderr, "Failed to initialize fetch engine.\n");
+        return false;
+    }
 
-    printf("%d  Scanning: %s\n", depth, webpage_getURL(page));
-    while ((nextURL = webpage_getNextURL(page, &pos)) != NULL)
+    webpage_t* curr_page;
+    while (true)
     {
-        printf("%d  Found: %s\n", depth, nextURL);
-        
-        /* Normalize and check if URL is internal */
-        char* normalizedURL = normalizeURL(nextURL);
-        if (normalizedURL != NULL && isInternalURL(normalizedURL))
+        // When a checkpoint is due, let the engine drain rather than topping it up
+        bool due = checkpointDue(state);
+        while (!due && fetchengine_hasRoom(engine) && (curr_page = frontier_tryExtract(state->pagesToCrawl)) != NULL)
         {
-            /* Insert in hashtable and bag */
-            char* hashURL = strdup(normalizedURL);
-            if (hashtable_insert(pagesSeen, hashURL, ""))
+            const fetchvalidators_t* have = validators_get(state->validators, recrawlDocID(state, webpage_getURL(curr_page)));
+            if (budgetSpent(state) || !fetchengine_submit(engine, curr_page, have))
             {
-                printf("%d  Added: %s\n", depth, normalizedURL);
-
-                char* wpURL = strdup(normalizedURL);
-                webpage_t* webpage = webpage_new(wpURL, depth + 1, NULL);
+                webpage_delete(curr_page);
+                frontier_done(state->pagesToCrawl);
+            }
+        }
 
-                if (webpage)
-                {
-                    bag_insert(pagesToCrawl, webpage);
-                } else {
-                    free(wpURL);
-                }
-            } else {
-                printf("%d  IgnDupl: %s\n", depth, normalizedURL);
+        fetchvalidators_t got;
+        int status;
+        fetchtimes_t times;
+        curr_page = fetchengine_next(engine, &status, &got, &times);
+        if (curr_page != NULL)
+        {
+            fetchDone(state, curr_page, status, &times);
+            int savedDocID = recrawlDocID(state, webpage_getURL(curr_page));
+            if (webpage_getHTML(curr_page) != NULL)
+            {
+                pageFetched(curr_page, state, savedDocID, &got);
+            } else if (status == 304 && savedDocID > 0) {
+                pageUnchanged(curr_page, state, savedDocID, &got);
             }
-            free(hashURL);
-        } else {
-            printf("%d  IgnExtrn: %s\n", depth, normalizedURL);
+            fetch_freeValidators(&got);
+            webpage_delete(curr_page);
+            frontier_done(state->pagesToCrawl);
+        } else if (due) {
+            checkpointTake(state);          // the engine is empty, so no page is in progress
+        } else if (!frontier_wait(state->pagesToCrawl)) {
+            break;                          // nothing in flight, nothing to submit, and no more to come
         }
-        free(nextURL);
-        free(normalizedURL);
     }
+
+    fetchengine_delete(engine);
+    return true;
 }
 
-/* 
- * strdup: Creates a duplicate of the given string. 
- * 
- * Allocates memory for the duplicate, and copies 
- * the string into it.
+/*
+ * pageLimit: Returns the last docID that partition may give a page, for
+ * the processes of a crawl to save no more than maxPages between them, or
+ * INT_MAX if maxPages is 0.  The limit is shared out evenly, the lowest
+ * partitions taking one more page each for any left over; a process whose
+ * partition runs out of pages does not pass its share on to the others.
  */
-char* strdup(char* str)
+static int pageLimit(int maxPages, int partition, int partitions)
 {
-    char* dup = malloc(strlen(str) + 1);
+    if (maxPages == 0)
+    {
+        return INT_MAX;
+    }
+    int share = maxPages / partitions + (partition < maxPages % partitions ? 1 : 0);
+    return partition + 1 + (share - 1) * partitions;
+}
 
-    if (dup != NULL)
-       strcpy(dup, str);
+/*
+ * budgetSpent: Returns true if a page limit is set and that many pages
+ * have been saved.
+ */
+static bool budgetSpent(crawlState_t* state)
+{
+    pthread_mutex_lock(&state->docLock);
+    bool spent = state->docID > state->lastDocID;
+    pthread_mutex_unlock(&state->docLock);
+    return spent;
+}
 
-    return dup;
-}
\ No newline at end of file
+/*
+ * takeDocID: Returns the next docID for a new page, or 0 if the page
+ * limit has been reached.  With near-duplicate detection on, a page with
+ * enough words is first looked up by its fingerprint: if it is within
+ * maxDistance bits of a page saved, the page gets no docID, *original is
+ * set to that page's docID, and the page is noted in .duplicates;
+ * otherwise its fingerprint is stored.  The lookup, the docID and the
+ * store happen under one lock, so of two copies fetched at once only one
+ * is kept.
+ */
+static int takeDocID(webpage_t* page, crawlState_t* state, int* original)
+{
+    *original = 0;
+    int numWords = 0;
+    uint64_t fingerprint = 0;
+    if (state->fingerprints != NULL)
+    {
+        fingerprint = simhash_fingerprint(webpage_getHTML(page), &numWords);
+    }
+    bool judged = numWords >= DUP_MIN_WORDS;
+    if (judged)
+    {
+        struct timespec start, end;
+        pthread_mutex_lock(&state->dupLock);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        *original = simhash_find(state->fingerprints, fingerprint);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        state->dupLookups++;
+        state->dupSeconds += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    }
+
+    int docID = 0;
+    if (*original > 0)
+    {
+        state->dupSkipped++;
+        fprintf(state->duplicates, "%d %s\n", *original, webpage_getURL(page));
+        fflush(state->duplicates);
+    } else {
+        pthread_mutex_lock(&state->docLock);
+        if (state->docID <= state->lastDocID)
+        {
+            docID = state->docID;
+            state->docID += state->partitions;
+        }
+        pthread_mutex_unlock(&state->docLock);
+        if (docID > 0 && judged)
+        {
+            simhash_insert(state->fingerprints, fingerprint, docID);
+        }
+    }
+
+    if (judged)
+    {
+        pthread_mutex_unlock(&state->dupLock);
+    }
+    return docID;
+}
+
+/*
+ * pageFetched: Saves a freshly fetched page, under savedDocID if it was
+ * saved before and otherwise the next docID, and records the validators
+ * it came with; if it is not at maxDepth, its links are added to the
+ * frontier.  A new page fetched after the page limit was reached by
+ * others is dropped; one that is a near-duplicate of a page saved is
+ * not saved, but still scanned.
+ */
+static void pageFetched(webpage_t* page, crawlState_t* state, int savedDocID, const fetchvalidators_t* got)
+{
+    int docID = savedDocID;
+    if (docID == 0)
+    {
+        int original;
+        docID = takeDocID(page, state, &original);
+        if (original > 0)
+        {
+            logger_printf(state->log, LOG_SUMMARY, "%d  Duplicate: %s (of %d)\n", webpage_getDepth(page), webpage_getURL(page), original);
+            if (webpage_getDepth(page) < state->maxDepth)
+            {
+                pageScan(page, webpage_getDepth(page), state);
+            }
+            return;
+        }
+        if (docID == 0)
+        {
+            return;
+        }
+    } else if (state->fingerprints != NULL) {
+        int numWords;
+        uint64_t fingerprint = simhash_fingerprint(webpage_getHTML(page), &numWords);
+        if (numWords >= DUP_MIN_WORDS)
+        {
+            pthread_mutex_lock(&state->dupLock);
+            simhash_insert(state->fingerprints, fingerprint, docID);
+            pthread_mutex_unlock(&state->dupLock);
+        }
+    }
+
+    logger_printf(state->log, LOG_SUMMARY, "%d  %s: %s\n", webpage_getDepth(page), (savedDocID > 0) ? "Changed" : "Fetched", webpage_getURL(page));
+
+    double start = now();
+    if (pagedir_put(state->pages, page, docID))
+    {
+        validators_put(state->validators, docID, got);
+        pthread_mutex_lock(&state->statsLock);
+        state->pagesSaved++;
+        pthread_mutex_unlock(&state->statsLock);
+    }
+    histogram_record(state->timings[TIME_SAVE], now() - start);
+
+    /* Scan page for URLs if not exceeded depth */
+    if (webpage_getDepth(page) < state->maxDepth)
+    {
+        pageScan(page, webpage_getDepth(page), state);
+    }
+}
+
+/*
+ * pageUnchanged: Handles a page the server says has not changed since it
+ * was saved under savedDocID: the saved copy stays as it is, and is loaded
+ * to be scanned for links, as at the depth it was found at this time, if
+ * that is not maxDepth.  Any validators the server sent replace those
+ * recorded; those it did not send are kept.
+ */
+static void pageUnchanged(webpage_t* page, crawlState_t* state, int savedDocID, const fetchvalidators_t* got)
+{
+    int depth = webpage_getDepth(page);
+    logger_printf(state->log, LOG_SUMMARY, "%d  Unchanged: %s\n", depth, webpage_getURL(page));
+
+    const fetchvalidators_t* had = validators_get(state->validators, savedDocID);
+    fetchvalidators_t now = {
+        (got->etag != NULL || had == NULL) ? got->etag : had->etag,
+        (got->lastModified != NULL || had == NULL) ? got->lastModified : had->lastModified
+    };
+    if (had == NULL || !sameValue(now.etag, had->etag) || !sameValue(now.lastModified, had->lastModified))
+    {
+        validators_put(state->validators, savedDocID, &now);
+    }
+
+    if (depth < state->maxDepth)
+    {
+        webpage_t* saved = pagedir_get(state->pages, savedDocID);
+        if (saved != NULL)
+        {
+            pageScan(saved, depth, state);
+        } else {
+            fprintf(stderr, "Failed to load the saved copy of %s\n", webpage_getURL(page));
+        }
+        webpage_delete(saved);
+    }
+}
+
+/*
+ * pageScan: Scans the given webpage, found at the given depth, for URLs.
+ *
+ * For each URL, it normalizes the URL, checks if it's internal,
+ * and if the URL hasn't been seen before, it adds it to the 
+ * pages to be crawled, logging each step at the verbose level; a URL
+ * in another partition's share of a split crawl is sent to it instead.  Each
+ * URL is resolved and normalized in a buffer on the stack, and copied
+ * only if it is added.  The time taken and the URLs found, internal
+ * and added are counted in the crawl's stats.
+ */
+static void pageScan(webpage_t* page, int depth, crawlState_t* state)
+{
+    int pos = 0;
+    char url[URL_MAX];
+    double start = now();
+    long found = 0, internal = 0, added = 0, forwarded = 0;
+
+    logger_printf(state->log, LOG_VERBOSE, "%d  Scanning: %s\n", depth, webpage_getURL(page));
+    while (url_nextLink(webpage_getHTML(page), &pos, webpage_getURL(page), url, sizeof(url)))
+    {
+        logger_printf(state->log, LOG_VERBOSE, "%d  Found: %s\n", depth, url);
+        found++;
+
+        /* Normalize, in place, and check if URL is internal */
+        if (url_normalize(url) && isInternal(url, state->internalPrefix))
+        {
+            /* Insert in seen set and frontier */
+            internal++;
+            pthread_mutex_lock(&state->seenLock);
+            bool isNew = seenset_insert(state->pagesSeen, url);
+            pthread_mutex_unlock(&state->seenLock);
+
+            int owner = (state->spool != NULL) ? spool_partition(url, state->partitions) : state->partition;
+            if (isNew && owner != state->partition)
+            {
+                // Another partition's to crawl; it is marked seen here too, so it is sent only once
+                added++;
+                forwarded++;
+                logger_printf(state->log, LOG_VERBOSE, "%d  Forward: %s (to %d)\n", depth, url, owner);
+                if (!spool_send(state->spool, owner, depth + 1, url))
+                {
+                    fprintf(stderr, "Failed to send %s to partition %d\n", url, owner);
+                }
+            } else if (isNew) {
+                added++;
+                logger_printf(state->log, LOG_VERBOSE, "%d  Added: %s\n", depth, url);
+
+                char* wpURL = strdup(url);
+                webpage_t* webpage = webpage_new(wpURL, depth + 1, NULL);
+
+                if (webpage)
+                {
+                    frontier_insert(state->pagesToCrawl, webpage);
+                    prefetchHost(url, state);
+                } else {
+                    free(wpURL);
+                }
+            } else {
+                logger_printf(state->log, LOG_VERBOSE, "%d  IgnDupl: %s\n", depth, url);
+                frontier_addScore(state->pagesToCrawl, url, 1);   // one more in-link, for -o inlinks
+            }
+        } else {
+            logger_printf(state->log, LOG_VERBOSE, "%d  IgnExtrn: %s\n", depth, url);
+        }
+    }
+
+    histogram_record(state->timings[TIME_PARSE], now() - start);
+    pthread_mutex_lock(&state->statsLock);
+    state->urlsFound += found;
+    state->urlsInternal += internal;
+    state->urlsAdded += added;
+    state->urlsForwarded += forwarded;
+    pthread_mutex_unlock(&state->statsLock);
+}
+
+/*
+ * prefetchHost: Starts looking up the host of a URL just added to the
+ * frontier, so its address is likely cached by the time it is fetched.
+ */
+static void prefetchHost(const char* url, crawlState_t* state)
+{
+    char host[256];
+    int port;
+    const char* path;
+    if (fetch_splitURL(url, host, sizeof(host), &port, &path))
+    {
+        dnscache_prefetch(state->fetch.dns, host);
+    }
+}
+
+/*
+ * spoolReceiver: Takes the links other partitions send to this one into
+ * the frontier, every SPOOL_POLL nanoseconds, and publishes whether this
+ * partition is idle.  Once every partition is idle with nothing left to
+ * read, the crawl is over: it releases its hold on the frontier, so the
+ * workers find it empty and stop.
+ */
+static void* spoolReceiver(void* arg)
+{
+    crawlState_t* state = arg;
+    bool wasIdle = false;
+    while (true)
+    {
+        // Nothing can make an idle partition busy but links read here, after the check
+        long received = spool_receive(state->spool, state, spoolLink);
+        bool idle = received == 0 && frontier_idle(state->pagesToCrawl);
+        if ((idle || wasIdle) && !spool_publish(state->spool, idle))
+        {
+            fprintf(stderr, "Failed to publish the state of partition %d\n", state->partition);
+        }
+        wasIdle = idle;
+        if (idle && spool_finished(state->spool))
+        {
+            break;
+        }
+        struct timespec nap = { 0, SPOOL_POLL };
+        nanosleep(&nap, NULL);
+    }
+    frontier_release(state->pagesToCrawl);
+    return NULL;
+}
+
+/*
+ * spoolLink: Adds a link another partition sent, found at the given depth,
+ * to the frontier, unless it has been seen.  The link goes into the seen
+ * set and the frontier under one hold of seenLock, so a checkpoint, which
+ * the receiver does not wait for, has it in both or in neither.
+ */
+static void spoolLink(void* arg, int depth, const char* url)
+{
+    crawlState_t* state = arg;
+    pthread_mutex_lock(&state->seenLock);
+    bool isNew = seenset_insert(state->pagesSeen, url);
+    webpage_t* webpage = NULL;
+    char* wpURL = isNew ? strdup(url) : NULL;
+    if (wpURL != NULL && (webpage = webpage_new(wpURL, depth, NULL)) != NULL)
+    {
+        frontier_insert(state->pagesToCrawl, webpage);
+    } else {
+        free(wpURL);
+    }
+    pthread_mutex_unlock(&state->seenLock);
+    if (!isNew)
+    {
+        return;
+    }
+
+    logger_printf(state->log, LOG_VERBOSE, "%d  Received: %s\n", depth - 1, url);
+    if (webpage != NULL)
+    {
+        prefetchHost(url, state);
+    }
+    pthread_mutex_lock(&state->statsLock);
+    state->urlsReceived++;
+    pthread_mutex_unlock(&state->statsLock);
+}
+
+/*
+ * checkpointDue: Returns true if checkpoints are enabled and the last
+ * one was taken at least checkpointEvery seconds ago.
+ */
+static bool checkpointDue(crawlState_t* state)
+{
+    return state->checkpointEvery > 0 && time(NULL) - atomic_load(&state->lastCheckpoint) >= state->checkpointEvery;
+}
+
+/*
+ * checkpointTake: Pauses the frontier until no page is in progress, saves
+ * a checkpoint, and lets the crawl carry on.  Only one thread takes each
+ * checkpoint; others that find it due meanwhile just carry on crawling.
+ * The caller must not hold a page from the frontier.
+ */
+static void checkpointTake(crawlState_t* state)
+{
+    if (pthread_mutex_trylock(&state->checkpointLock) != 0)
+    {
+        return;
+    }
+    if (checkpointDue(state))
+    {
+        frontier_pause(state->pagesToCrawl);
+        if (!checkpointSave(state))
+        {
+            fprintf(stderr, "Failed to write checkpoint in %s\n", state->stateDirectory);
+        }
+        atomic_store(&state->lastCheckpoint, time(NULL));
+        frontier_resume(state->pagesToCrawl);
+    }
+    pthread_mutex_unlock(&state->checkpointLock);
+}
+
+/*
+ * checkpointSave: Writes the next docID, the frontier and the seen set to
+ * pageDirectory/.checkpoint, by way of a temporary file renamed into place,
+ * so that a crash leaves either the old checkpoint or the new one.
+ *
+ * The file holds a header line, a "docID N" line, a "frontier" line, one
+ * "depth URL" line per waiting page, a "." line, and then the seen set
+ * as written by seenset_save.  The spool receiver keeps adding links while
+ * the crawl is paused, so seenLock is held from the frontier through the
+ * seen set, and a link is saved in both or neither.
+ * Returns true if successful.
+ */
+static bool checkpointSave(crawlState_t* state)
+{
+    char path[strlen(state->stateDirectory) + 32];
+    char tempPath[strlen(state->stateDirectory) + 32];
+    sprintf(path, "%s/.checkpoint", state->stateDirectory);
+    sprintf(tempPath, "%s/.checkpoint.tmp", state->stateDirectory);
+
+    FILE* fp = fopen(tempPath, "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&state->docLock);
+    fprintf(fp, "%s\ndocID %d\nfrontier\n", CHECKPOINT_HEADER, state->docID);
+    pthread_mutex_unlock(&state->docLock);
+    pthread_mutex_lock(&state->seenLock);
+    bool ok = frontier_save(state->pagesToCrawl, fp) >= 0;
+    fprintf(fp, ".\n");
+    ok = ok && seenset_save(state->pagesSeen, fp);
+    pthread_mutex_unlock(&state->seenLock);
+
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tempPath, path) != 0)
+    {
+        unlink(tempPath);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * checkpointLoad: Restores the frontier, seen set and next docID from
+ * pageDirectory/.checkpoint, then accounts for the pages saved since
+ * (see resumeSaved); pages of the checkpoint's frontier that were among
+ * them are not crawled again.
+ * Returns false, leaving the state as it was, if there is no usable
+ * checkpoint; the crawl then starts afresh from the seedURL.
+ */
+static bool checkpointLoad(crawlState_t* state)
+{
+    char path[strlen(state->stateDirectory) + 32];
+    sprintf(path, "%s/.checkpoint", state->stateDirectory);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "No checkpoint in %s; starting from seedURL\n", state->stateDirectory);
+        return false;
+    }
+
+    /* Header and docID, then the frontier's pages, held aside for now */
+    char* line = file_readLine(fp);
+    int docID;
+    bool ok = line != NULL && strcmp(line, CHECKPOINT_HEADER) == 0
+              && fscanf(fp, "docID %d\n", &docID) == 1 && docID >= 1;
+    free(line);
+    line = ok ? file_readLine(fp) : NULL;
+    ok = line != NULL && strcmp(line, "frontier") == 0;
+    free(line);
+
+    bag_t* pending = bag_new();
+    while (ok && (line = file_readLine(fp)) != NULL && strcmp(line, ".") != 0)
+    {
+        int depth, start;
+        webpage_t* page = NULL;
+        if (sscanf(line, "%d %n", &depth, &start) == 1)
+        {
+            page = webpage_new(strdup(line + start), depth, NULL);
+        }
+        if (page == NULL)
+        {
+            ok = false;
+        } else {
+            bag_insert(pending, page);
+        }
+        free(line);
+    }
+    ok = ok && line != NULL;
+    free(line);
+    seenset_t* seen = ok ? seenset_load(fp) : NULL;
+    fclose(fp);
+
+    if (seen == NULL)
+    {
+        fprintf(stderr, "Checkpoint in %s is damaged; starting from seedURL\n", state->stateDirectory);
+        bag_delete(pending, webpage_delete);
+        return false;
+    }
+    seenset_delete(state->pagesSeen);
+    state->pagesSeen = seen;
+    state->docID = docID;
+
+    /* Pages saved after the checkpoint are done; the rest are crawled again */
+    hashtable_t* savedURLs = hashtable_new(64);
+    resumeSaved(state, savedURLs);
+    webpage_t* page;
+    while ((page = bag_extract(pending)) != NULL)
+    {
+        if (hashtable_find(savedURLs, webpage_getURL(page)) == NULL)
+        {
+            frontier_insert(state->pagesToCrawl, page);
+        } else {
+            webpage_delete(page);
+        }
+    }
+    bag_delete(pending, NULL);
+    hashtable_delete(savedURLs, NULL);
+
+    fprintf(stderr, "Resuming from checkpoint in %s at docID %d\n", state->stateDirectory, state->docID);
+    return true;
+}
+
+/*
+ * resumeSaved: Accounts for the pages saved after the checkpoint, whose
+ * docIDs run up from the checkpoint's next docID.  Their URLs are first
+ * all marked seen (and noted in savedURLs), so that none is crawled again;
+ * then each page is loaded rather than fetched again, and scanned for
+ * links as if just fetched.  The next docID moves past them.
+ *
+ * Threads save pages slightly out of docID order, so a crash can leave a
+ * gap; every page after the first gap, up to the highest docID in the
+ * directory, is removed, to be fetched again, so that docIDs stay
+ * contiguous and none is given to a second page.  In a split crawl, all
+ * of this is of the docIDs of this process's partition alone.
+ */
+static void resumeSaved(crawlState_t* state, hashtable_t* savedURLs)
+{
+    int firstDocID = state->docID;
+    int step = state->partitions;
+    for (int pass = 1; pass <= 2; pass++)
+    {
+        for (int docID = firstDocID; pass == 1 || docID < state->docID; docID += step)
+        {
+            webpage_t* page = pagedir_get(state->pages, docID);
+            if (page == NULL)
+            {
+                break;
+            }
+
+            if (pass == 1)
+            {
+                seenset_insert(state->pagesSeen, webpage_getURL(page));
+                hashtable_insert(savedURLs, webpage_getURL(page), "");
+                state->docID = docID + step;
+            } else {
+                logger_printf(state->log, LOG_SUMMARY, "%d  Saved: %s\n", webpage_getDepth(page), webpage_getURL(page));
+                if (webpage_getDepth(page) < state->maxDepth)
+                {
+                    pageScan(page, webpage_getDepth(page), state);
+                }
+            }
+            webpage_delete(page);
+        }
+    }
+
+    int lastDocID = pagedir_lastDocID(state->pages);
+    for (int docID = state->docID; docID <= lastDocID; docID += step)
+    {
+        pagedir_remove(state->pages, docID);
+    }
+}
+
+/*
+ * recrawlLoad: Reads the URL of every page saved in the page directory,
+ * from docID 1 up to the first missing (or, if it was saved by a split
+ * crawl, the first run of missing as long as the number of partitions),
+ * and returns a hashtable giving the docID of each, so that a recrawl
+ * saves each page under the docID it had; new pages are numbered after
+ * them.
+ * Returns NULL if out of memory.
+ */
+static hashtable_t* recrawlLoad(crawlState_t* state)
+{
+    hashtable_t* savedDocIDs = hashtable_new(RECRAWL_SLOTS);
+    if (savedDocIDs == NULL)
+    {
+        return NULL;
+    }
+
+    int gap = pagedir_partitions(state->pageDirectory);
+    int last = 0, count = 0;
+    for (int docID = 1; docID <= last + gap; docID++)
+    {
+        char* url = pagedir_getURL(state->pages, docID);
+        if (url == NULL)
+        {
+            continue;
+        }
+        last = docID;
+        count++;
+        int* item = malloc(sizeof(int));
+        if (item != NULL)
+        {
+            *item = docID;
+            if (!hashtable_insert(savedDocIDs, url, item))
+            {
+                free(item);
+            }
+        }
+        free(url);
+    }
+    state->docID = last + 1;
+
+    fprintf(stderr, "Recrawling the %d pages saved in %s\n", count, state->pageDirectory);
+    return savedDocIDs;
+}
+
+/*
+ * recrawlDocID: Returns the docID under which the page at url was saved
+ * before this recrawl, or 0 if it was not (or this is not a recrawl).
+ */
+static int recrawlDocID(crawlState_t* state, const char* url)
+{
+    int* docID = (state->savedDocIDs != NULL) ? hashtable_find(state->savedDocIDs, url) : NULL;
+    return (docID != NULL) ? *docID : 0;
+}
+
+/*
+ * sameValue: Returns true if both header values are missing, or both are
+ * present and equal.
+ */
+static bool sameValue(const char* a, const char* b)
+{
+    return (a == NULL || b == NULL) ? a == b : strcmp(a, b) == 0;
+}
+
+/*
+ * dupLoad: Stores the fingerprint of every page saved before this run of
+ * the crawler, so that near-duplicates of them are found too; in a split
+ * crawl, only those of this process's partition.
+ */
+static void dupLoad(crawlState_t* state)
+{
+    for (int docID = state->partition + 1; docID < state->docID; docID += state->partitions)
+    {
+        webpage_t* page = pagedir_get(state->pages, docID);
+        if (page != NULL)
+        {
+            int numWords;
+            uint64_t fingerprint = simhash_fingerprint(webpage_getHTML(page), &numWords);
+            if (numWords >= DUP_MIN_WORDS)
+            {
+                simhash_insert(state->fingerprints, fingerprint, docID);
+            }
+            webpage_delete(page);
+        }
+    }
+}
+
+/*
+ * isInternal: Returns true if the normalized url begins with prefix,
+ * the crawl's internal prefix.
+ */
+static bool isInternal(const char* url, const char* prefix)
+{
+    return url != NULL && strncmp(url, prefix, strlen(prefix)) == 0;
+}
+
+/*
+ * fetchDone: Counts a finished fetch, which ended with the given HTTP
+ * status, and records where its time went; and, if the page came with
+ * its HTML, counts the page and its bytes.
+ */
+static void fetchDone(crawlState_t* state, const webpage_t* page, int status, const fetchtimes_t* times)
+{
+    const double phases[] = { times->wait, times->dns, times->connect, times->firstByte, times->download, times->total };
+    for (int t = TIME_WAIT; t <= TIME_FETCH; t++)
+    {
+        histogram_record(state->timings[t], phases[t]);        // phases that did not happen are negative, and ignored
+    }
+
+    pthread_mutex_lock(&state->statsLock);
+    state->fetches++;
+    if (webpage_getHTML(page) != NULL)
+    {
+        state->pagesFetched++;
+        state->bytesFetched += strlen(webpage_getHTML(page));
+    } else if (status == 304) {
+        state->notModified++;
+    } else {
+        state->failures++;
+        state->hostDown += (status == FETCH_HOST_DOWN) ? 1 : 0;
+    }
+    pthread_mutex_unlock(&state->statsLock);
+}
+
+/*
+ * statsReporter: Writes a line of stats every statsEvery seconds until
+ * the crawl is done.
+ */
+static void* statsReporter(void* arg)
+{
+    crawlState_t* state = arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);           // the clock pthread_cond_timedwait uses
+
+    pthread_mutex_lock(&state->statsLock);
+    while (!state->crawlDone)
+    {
+        double next = deadline.tv_nsec / 1e9 + state->statsEvery;
+        deadline.tv_sec += (time_t) next;
+        deadline.tv_nsec = (next - (time_t) next) * 1e9;
+        int waited = 0;
+        while (!state->crawlDone && waited != ETIMEDOUT)
+        {
+            waited = pthread_cond_timedwait(&state->statsWake, &state->statsLock, &deadline);
+        }
+        if (!state->crawlDone)
+        {
+            pthread_mutex_unlock(&state->statsLock);
+            statsWrite(state, false);
+            pthread_mutex_lock(&state->statsLock);
+        }
+    }
+    pthread_mutex_unlock(&state->statsLock);
+    return NULL;
+}
+
+/*
+ * statsWrite: Writes one line to the crawl's stats file: a JSON object
+ * with the seconds since the crawl began, whether it is the final line,
+ * the counters, the sizes of the frontier and seen set, the share of
+ * internal URLs found that had been seen before and of pages judged that
+ * were near-duplicates, the links passed between partitions, and a
+ * summary of each timing histogram.
+ */
+static void statsWrite(crawlState_t* state, bool final)
+{
+    pthread_mutex_lock(&state->statsLock);
+    long fetches = state->fetches, failures = state->failures, notModified = state->notModified;
+    long hostDown = state->hostDown;
+    long pages = state->pagesFetched, bytes = state->bytesFetched, saved = state->pagesSaved;
+    long found = state->urlsFound, internal = state->urlsInternal, added = state->urlsAdded;
+    long forwarded = state->urlsForwarded, received = state->urlsReceived;
+    pthread_mutex_unlock(&state->statsLock);
+
+    pthread_mutex_lock(&state->seenLock);
+    size_t seen = seenset_size(state->pagesSeen);
+    pthread_mutex_unlock(&state->seenLock);
+    pthread_mutex_lock(&state->dupLock);
+    long judged = state->dupLookups, skipped = state->dupSkipped;
+    pthread_mutex_unlock(&state->dupLock);
+
+    fprintf(state->stats, "{\"elapsed\":%.3f,\"final\":%s,\"fetches\":%ld,\"pages\":%ld,\"bytes\":%ld,"
+            "\"failures\":%ld,\"notModified\":%ld,\"saved\":%ld,\"frontier\":%ld,\"seen\":%zu,"
+            "\"urlsFound\":%ld,\"urlsInternal\":%ld,\"urlsAdded\":%ld,\"seenHitRate\":%.4f,"
+            "\"nearDupJudged\":%ld,\"nearDupSkipped\":%ld,\"nearDupRate\":%.4f,"
+            "\"urlsForwarded\":%ld,\"urlsReceived\":%ld,\"hostDown\":%ld,\"breakerTrips\":%ld",
+            now() - state->crawlStart, final ? "true" : "false", fetches, pages, bytes,
+            failures, notModified, saved, frontier_size(state->pagesToCrawl), seen,
+            found, internal, added, internal > 0 ? 1 - (double) added / internal : 0,
+            judged, skipped, judged > 0 ? (double) skipped / judged : 0, forwarded, received,
+            hostDown, breaker_trips(state->fetch.breaker));
+    for (int t = 0; t < NUM_TIMINGS; t++)
+    {
+        fprintf(state->stats, ",\"%s\":", TIMING_NAMES[t]);
+        histogram_print(state->timings[t], state->stats);
+    }
+    fprintf(state->stats, "}\n");
+    fflush(state->stats);
+}
+
+/*
+ * reportStats: Prints to stderr how many pages and bytes the crawl,
+ * which ran for the given seconds, fetched per second, and percentiles
+ * of the time each fetch took; then the size of the seen set, how well
+ * the pages saved compressed (if compress), the near-duplicates skipped,
+ * the circuit breaker's trips and the DNS cache's hits and misses.
+ */
+static void reportStats(crawlState_t* state, double seconds, bool compress)
+{
+    histogram_t* fetch = state->timings[TIME_FETCH];
+    fprintf(stderr, "Throughput: %ld pages, %ld bytes in %.2f s (%.1f pages/s, %.0f bytes/s)\n",
+            state->pagesFetched, state->bytesFetched, seconds,
+            seconds > 0 ? state->pagesFetched / seconds : 0, seconds > 0 ? state->bytesFetched / seconds : 0);
+    if (histogram_count(fetch) > 0)
+    {
+        fprintf(stderr, "Fetch latency: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+                histogram_percentile(fetch, 0.5) * 1e3, histogram_percentile(fetch, 0.9) * 1e3,
+                histogram_percentile(fetch, 0.99) * 1e3, histogram_max(fetch) * 1e3);
+    }
+
+    fprintf(stderr, "Seen set: %zu URLs in %zu bytes\n", seenset_size(state->pagesSeen), seenset_memory(state->pagesSeen));
+    if (compress)
+    {
+        reportCompression(state);
+    }
+    if (state->fingerprints != NULL)
+    {
+        fprintf(stderr, "Near-duplicates: %ld skipped; %zu fingerprints, %.2f us per lookup\n", state->dupSkipped,
+                simhash_size(state->fingerprints), state->dupLookups > 0 ? state->dupSeconds / state->dupLookups * 1e6 : 0);
+    }
+    if (state->fetch.breaker != NULL)
+    {
+        fprintf(stderr, "Breaker: tripped %ld times, %ld fetches not tried\n",
+                breaker_trips(state->fetch.breaker), state->hostDown);
+    }
+    long hits, misses;
+    dnscache_stats(state->fetch.dns, &hits, &misses);
+    fprintf(stderr, "DNS cache: %ld hits, %ld misses\n", hits, misses);
+}
+
+/*
+ * reportCompression: Prints to stderr how many pages the crawl saved,
+ * and how many bytes of HTML they held and took compressed.
+ */
+static void reportCompression(crawlState_t* state)
+{
+    pagedirstats_t stats;
+    pagedir_stats(state->pages, &stats);
+    fprintf(stderr, "Compression: %ld pages, %ld bytes of HTML stored in %ld (ratio %.2f)\n",
+            stats.pagesSaved, stats.savedBytes, stats.storedBytes,
+            stats.storedBytes > 0 ? (double) stats.savedBytes / stats.storedBytes : 0);
+}
+
+/*
+ * now: Returns the time in seconds on a monotonic clock.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -10,6 +10,25 @@ echo "====================================================="
 ./crawler http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-test abc # invalid maxDepth
 ./crawler http://cs50tse.cs.dartmouth.edu/tse/letters/index.html non_existent_directory 1 # non-existent directory
 ./crawler http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 2 # more than 3 arguments
+./crawler -j 0 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # invalid number of threads
+./crawler -j 2 -a 8 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # both threads and connections
+./crawler -r -1 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # negative rate
+./crawler -b 0 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # zero burst
+./crawler -s fuzzy http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # unknown seen-set mode
+./crawler -m -5 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # negative frontier limit
+./crawler -o random http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # unknown crawl order
+./crawler -l 1.5 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # non-integer page limit
+./crawler -c x http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # invalid checkpoint interval
+./crawler --resume --recrawl http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # both resume and recrawl
+./crawler -D 8 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # near-duplicate distance too large
+./crawler -p ftp://example.com/ http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # internal prefix not http
+./crawler -p http://localhost/ http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # seedURL outside the internal prefix
+./crawler -S -1 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # negative stats interval
+./crawler -v loud http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # unknown log level
+./crawler --partitions 0 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # invalid number of partitions
+./crawler --partitions 2 --packed http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # partitions with packed pages
+./crawler --tries 0 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # too few tries
+./crawler --timeout -1 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/ 1 # negative timeout
 
 # Valgrind testing
 echo "====================================================="
@@ -33,6 +52,92 @@ for depth in 0 1 2 10; do
     ./crawler http://cs50tse.cs.dartmouth.edu/tse/letters/index.html $dir $depth
 done
 
+echo "====================================================="
+echo "Testing letters with several threads and connections"
+echo "====================================================="
+mkdir -p data/letters-10-j4
+./crawler -j 4 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-j4 10
+diff <(head -qn1 data/letters-10/[0-9]* | sort) <(head -qn1 data/letters-10-j4/[0-9]* | sort) && echo "Same pages as single-threaded crawl"
+mkdir -p data/letters-10-a16
+./crawler -a 16 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-a16 10
+diff <(head -qn1 data/letters-10/[0-9]* | sort) <(head -qn1 data/letters-10-a16/[0-9]* | sort) && echo "Same pages as single-threaded crawl"
+
+# A local server answering with chunked HTTP/1.1 bodies, and one page in unframed HTTP/1.0
+python3 - 8642 <<'EOF' &
+import socketserver, sys
+pages = {
+    "/index.html": '<html><a href="chunked.html">chunked</a> <a href="old.html">old</a></html>',
+    "/chunked.html": '<html>a page sent in chunks <a href="index.html">home</a></html>',
+    "/old.html": '<html>a page from an HTTP/1.0 server</html>',
+}
+class Handler(socketserver.StreamRequestHandler):
+    def handle(self):
+        path = self.rfile.readline().split()[1].decode()
+        while self.rfile.readline() not in (b"\r\n", b""):
+            pass
+        body = pages.get(path, "").encode()
+        if path == "/old.html":
+            self.wfile.write(b"HTTP/1.0 200 OK\r\nContent-Type: text/html\r\n\r\n" + body)
+            return
+        out = b"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+        for i in range(0, len(body), 25):
+            out += b"%x\r\n" % len(body[i:i + 25]) + body[i:i + 25] + b"\r\n"
+        self.wfile.write(out + b"0\r\n\r\n")
+socketserver.TCPServer.allow_reuse_address = True
+socketserver.TCPServer(("127.0.0.1", int(sys.argv[1])), Handler).serve_forever()
+EOF
+server=$!
+sleep 1
+mkdir -p data/chunked data/chunked-a4
+./crawler -p http://localhost:8642/ http://localhost:8642/index.html data/chunked 1 > /dev/null
+./crawler -a 4 -p http://localhost:8642/ http://localhost:8642/index.html data/chunked-a4 1 > /dev/null
+kill $server
+diff <(cat data/chunked/[0-9]* | sort) <(cat data/chunked-a4/[0-9]* | sort) && echo "Same chunked and HTTP/1.0 pages with connections"
+mkdir -p data/letters-10-bloom
+./crawler -s bloom -n 100 -f 0.001 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-bloom 10
+diff <(head -qn1 data/letters-10/[0-9]* | sort) <(head -qn1 data/letters-10-bloom/[0-9]* | sort) && echo "Same pages with a Bloom seen set"
+mkdir -p data/letters-10-m2
+./crawler -j 2 -m 2 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-m2 10
+diff <(head -qn1 data/letters-10/[0-9]* | sort) <(head -qn1 data/letters-10-m2/[0-9]* | sort) && echo "Same pages with the frontier spilling to disk"
+ls -a data/letters-10-m2 | grep frontier || echo "No frontier segments left behind"
+mkdir -p data/letters-10-depth data/letters-10-l3
+./crawler -o depth -m 2 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-depth 10
+diff <(head -qn1 data/letters-10/[0-9]* | sort) <(head -qn1 data/letters-10-depth/[0-9]* | sort) && echo "Same pages crawling breadth-first"
+./crawler -o depth -l 3 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-l3 10
+ls data/letters-10-l3 | grep -c '^[0-9]' && sed -sn 2p data/letters-10-l3/[0-9]* | sort -u | tr '\n' ' ' && echo "<- depths of a 3-page breadth-first crawl"
+mkdir -p data/letters-10-packed
+./crawler --packed http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-packed 10
+ls data/letters-10-packed
+mkdir -p data/letters-10-compressed data/letters-10-packed-compressed
+./crawler --compress http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-compressed 10
+./crawler --packed --compress http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-packed-compressed 10
+ls -A data/letters-10 | grep -v '^[0-9]*$' && echo "<- all a crawl without -c or -S leaves beside its pages"
+mkdir -p data/letters-10-recrawl
+./crawler -c 60 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-recrawl 10 > /dev/null
+cp data/letters-10-recrawl/1 data/letters-10-recrawl/100
+./crawler -c 60 --resume http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-recrawl 10 | grep -c Fetched || echo "Resuming a finished crawl fetches nothing more"
+ls data/letters-10-recrawl/100 2> /dev/null || echo "Pages past a gap removed on resume"
+./crawler --recrawl http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-recrawl 10 | grep -c Unchanged && echo "<- pages unchanged on recrawl"
+diff <(head -qn1 data/letters-10/[0-9]* | sort) <(head -qn1 data/letters-10-recrawl/[0-9]* | sort) && echo "Same pages after recrawl"
+mkdir -p data/letters-10-dedup
+./crawler -D 3 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-dedup 10 > /dev/null
+diff <(head -qn1 data/letters-10/[0-9]* | sort) <(head -qn1 data/letters-10-dedup/[0-9]* | sort) && echo "Same pages with near-duplicate detection"
+mkdir -p data/letters-10-stats
+./crawler -S 0.01 http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-stats 10 > /dev/null
+tail -n 1 data/letters-10-stats/.stats
+mkdir -p data/letters-10-summary
+./crawler -v summary http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-summary 10
+mkdir -p data/letters-10-k3
+./crawler --partitions 3 -v quiet http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-k3 10
+diff <(head -qn1 data/letters-10/[0-9]* | sort) <(head -qn1 data/letters-10-k3/[0-9]* | sort) && echo "Same pages split between 3 processes"
+ls -a data/letters-10-k3 data/letters-10-k3/.spool
+mkdir -p data/letters-10-k3-l5
+./crawler --partitions 3 -l 5 -v quiet http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-k3-l5 10
+echo "Pages saved by 3 processes with -l 5: $(ls data/letters-10-k3-l5 | grep -c '^[0-9]')"
+mkdir -p data/letters-10-limits
+./crawler --connect-timeout 2 --first-byte-timeout 2 --timeout 5 --tries 2 --backoff 0.1 --breaker 2 -v quiet http://cs50tse.cs.dartmouth.edu/tse/letters/index.html data/letters-10-limits 10
+diff <(head -qn1 data/letters-10/[0-9]* | sort) <(head -qn1 data/letters-10-limits/[0-9]* | sort) && echo "Same pages with tight fetch limits"
+
 echo "====================================================="
 echo "Testing toscrape at different depths"
 echo "====================================================="
@@ -7,78 +7,337 @@
  *     - indexBuild: Builds the index by loading each webpage from a directory 
  *                   and processing words from each page.
  *     - indexPage: Processes each word in a webpage and updates the index.
+ *     - indexBuildParallel: Builds the same index with several threads,
+ *                   each indexing its own pages, and merges their indexes.
+ *     - indexBuildExternal: Builds the same index within a memory budget,
+ *                   writing sorted runs to disk and merging them.
+ *     - indexUpdate: Indexes only the pages added since the index was
+ *                   built, into a delta segment.
+ *     - indexCompact: Merges an index's delta segments into it, as
+ *                   streams, in the background once there are enough.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "../libcs50/webpage.h"
+#include "../libcs50/hashtable.h"
+#include "../libcs50/hash.h"
+#include "../libcs50/file.h"
 #include "../common/word.h"
 #include "pagedir.h"
 #include "index.h"
+#include "indexmap.h"
+
+/**************** local constants ****************/
+static const int INDEX_SLOTS = 1000;        // slots in the index saved
+static const int TERM_SLOTS = 20000;        // slots in each thread's dictionary of terms
+static const int CHUNK_DOCS = 64;           // docIDs a thread claims at a time
+static const int MAX_THREADS = 64;
+static const long MAX_BUDGET = 1L << 20;    // megabytes
+static const int MAX_RUN_SLOTS = 1 << 22;   // slots in a dictionary, however large the budget
+static const int NODE_BYTES = 32;           // roughly, a hashtable entry's own memory
+static const int MAX_FANIN = 64;            // run files merged at once
+static const int MAX_DELTAS = 8;            // delta segments an update leaves before compacting
+
+/**************** local types ****************/
+typedef struct posting
+{
+    int docID;
+    int count;
+} posting_t;
+
+/*
+ * term_t: A word as one thread has seen it: the page it first saw it on,
+ * its place among the words the thread has seen in the order first seen,
+ * and its postings, in increasing docID.
+ */
+typedef struct term
+{
+    char* word;
+    int slot;                   // its slot in the index saved
+    int firstDoc;
+    int order;
+    posting_t* postings;
+    int numPostings;
+    int maxPostings;
+} term_t;
+
+/*
+ * partial_t: The index built by one thread, from the pages it claimed.
+ */
+typedef struct partial
+{
+    struct build* build;        // what it shares with the other threads
+    bool ok;                    // false once out of memory
+    long bytes;                 // roughly, the memory it holds
+    hashtable_t* dict;          // word -> term_t
+    term_t** terms;             // in the order first seen
+    int numTerms;
+    int maxTerms;
+    int* docs;                  // the pages it found, in increasing docID
+    int numDocs;
+    int maxDocs;
+} partial_t;
+
+/*
+ * build_t: What the threads share while they build.  Each claims the
+ * next CHUNK_DOCS docIDs in turn, until claims reach stop.
+ */
+typedef struct build
+{
+    pagedir_t* pages;
+    int gap;                    // missing pages in a row that end them
+    int chunk;
+    pthread_mutex_t lock;       // guards next and stop
+    int next;
+    int stop;                   // a run of gap missing pages starts here, as far as yet found
+    partial_t* partials;
+    int numThreads;
+    int end;                    // after the threads finish, the first docID not indexed
+} build_t;
+
+/*
+ * merge_t: One thread's share of the merge: the slots from first up to
+ * last, and the lines it formats for them.
+ */
+typedef struct merge
+{
+    build_t* build;
+    int first;
+    int last;
+    char* text;
+    size_t length;
+    bool ok;
+} merge_t;
+
+/*
+ * entry_t: A word's entry in the index saved, merged from every thread's term.
+ */
+typedef struct entry
+{
+    char* word;
+    int slot;
+    int firstDoc;
+    int order;
+    posting_t* postings;
+    int numPostings;
+    bool owned;                 // whether postings were merged into a new array
+} entry_t;
+
+/*
+ * run_t: A run file being merged, and the record last read from it.
+ */
+typedef struct run
+{
+    FILE* fp;
+    bool live;                  // false once read to the end
+    int slot;
+    int firstDoc;
+    int order;
+    char* word;
+    int maxWord;
+    posting_t* postings;
+    int numPostings;
+    int maxPostings;
+} run_t;
 
 /* Function declarations */
-void indexBuild(const char* pageDirectory, const char* indexFilename);
+bool indexBuild(const char* pageDirectory, const char* indexFilename);
 void indexPage(index_t* index, webpage_t* webpage, int docID);
+bool indexUpdate(const char* pageDirectory, const char* indexFilename);
+bool indexCompact(const char* indexFilename);
+static int indexPages(pagedir_t* pages, index_t* index, int firstDoc, int gap);
+bool indexBuildParallel(const char* pageDirectory, const char* indexFilename, int numThreads);
+bool indexBuildExternal(const char* pageDirectory, const char* indexFilename, long budget);
+static void* buildThread(void* arg);
+static bool claimChunk(build_t* build, int* first);
+static bool partialInit(partial_t* partial, build_t* build, int slots);
+static bool partialPage(partial_t* partial, webpage_t* webpage, int docID);
+static bool partialAdd(partial_t* partial, char* word, int docID);
+static void partialFree(partial_t* partial);
+static int findEnd(build_t* build);
+static void* mergeThread(void* arg);
+static bool mergeTerms(term_t** terms, int numTerms, int end, entry_t* entry);
+static void writeEntries(FILE* fp, entry_t* entries, int numEntries);
+static bool writeRun(partial_t* partial, const char* indexFilename, int run);
+static bool writeRecord(FILE* fp, int slot, const char* word, int firstDoc, int order,
+                        const posting_t* postings, int numPostings);
+static bool readRun(run_t* run);
+static bool mergeRuns(const char* indexFilename, int numRuns);
+static bool mergeGroup(const char* indexFilename, int first, int numRuns, FILE* fp, bool final);
+static void removeRuns(const char* indexFilename, int first, int last);
+static void compactInBackground(const char* indexFilename, int numDeltas);
+static bool compactText(FILE* fp, indexmap_t** deltas, int numDeltas, const char* path);
+static bool mergeMaps(indexmap_t** maps, bool** skip, int numMaps, void* arg,
+                      void (*itemfunc)(void* arg, const char* key, void* item));
+static void addWord(void* arg, const char* key, void* item);
+static void setPosting(void* arg, const int key, const int count);
+static char* sidePath(const char* indexFilename, const char* format, int n);
+static int lockIndex(const char* indexFilename);
+static void unlockIndex(const char* indexFilename, int lock);
+static int countDeltas(const char* indexFilename);
+static int removeDeltas(const char* indexFilename);
+static int compareTerms(const void* a, const void* b);
+static int compareEntries(const void* a, const void* b);
+static int compareRunTerms(const void* a, const void* b);
+static int comparePostings(const void* a, const void* b);
+static int compareInts(const void* a, const void* b);
+static void reportStats(pagedir_t* pages);
 
-int main(int argc, char const *argv[])
+int main(int argc, char* argv[])
 {
-    if (argc != 3)
+    const char* usage = "Usage: ./indexer [-j threads] [-m megabytes] [--update] pageDirectory indexFilename\n"
+                        "       ./indexer --compact indexFilename\n";
+    const struct option longOptions[] = {
+        { "update", no_argument, NULL, 'U' },
+        { "compact", no_argument, NULL, 'K' },
+        { NULL, 0, NULL, 0 }
+    };
+    int numThreads = 1;
+    long budget = 0;
+    bool update = false;
+    bool compact = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:m:", longOptions, NULL)) != -1)
     {
-        printf("Usage: ./indexer pageDirectory indexFilename\n");
+        char* end;
+        if (opt == 'j')
+        {
+            long threads = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || threads < 1 || threads > MAX_THREADS)
+            {
+                printf("Number of threads should be between 1 and %d\n", MAX_THREADS);
+                return 1;
+            }
+            numThreads = (int) threads;
+        } else if (opt == 'm') {
+            budget = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || budget < 1 || budget > MAX_BUDGET)
+            {
+                printf("Memory budget should be between 1 and %ld megabytes\n", MAX_BUDGET);
+                return 1;
+            }
+        } else if (opt == 'U') {
+            update = true;
+        } else if (opt == 'K') {
+            compact = true;
+        } else {
+            printf("%s", usage);
+            return 1;
+        }
+    }
+    int arg = optind;
+    if ((update && compact) || argc - arg != (compact ? 1 : 2))
+    {
+        printf("%s", usage);
         return 1;
     }
 
-    const char* pageDirectory = argv[1];
-    const char* indexFilename = argv[2];
-
-    // Build index from the given page directory
-    indexBuild(pageDirectory, indexFilename);
+    // Merge the delta segments, index only what is new, or build the whole
+    // index from the given page directory, which replaces any delta segments
+    bool ok;
+    if (compact)
+    {
+        ok = indexCompact(argv[arg]);
+    } else if (update) {
+        ok = indexUpdate(argv[arg], argv[arg + 1]);
+    } else {
+        const char* pageDirectory = argv[arg];
+        const char* indexFilename = argv[arg + 1];
+        int lock = lockIndex(indexFilename);
+        if (lock < 0)
+        {
+            fprintf(stderr, "Unable to lock %s to build it\n", indexFilename);
+            return 1;
+        }
+        removeDeltas(indexFilename);
+        if (budget > 0 && numThreads > 1)
+        {
+            fprintf(stderr, "A memory budget is kept in one thread: ignoring -j %d\n", numThreads);
+        }
+        if (budget > 0)
+        {
+            ok = indexBuildExternal(pageDirectory, indexFilename, budget << 20);
+        } else if (numThreads > 1) {
+            ok = indexBuildParallel(pageDirectory, indexFilename, numThreads);
+        } else {
+            ok = indexBuild(pageDirectory, indexFilename);
+        }
+        unlockIndex(indexFilename, lock);
+    }
 
-    return 0;
+    return ok ? 0 : 1;
 }
 
 /*
  * indexBuild: Builds the index from crawled web pages located 
  * in a given directory and saves it to a file.
+ * Returns false if it could not be built.
  */
-void indexBuild(const char* pageDirectory, const char* indexFilename)
+bool indexBuild(const char* pageDirectory, const char* indexFilename)
 {
     // Initialize a new index
-    index_t* index = index_new(1000);
+    index_t* index = index_new(INDEX_SLOTS);
     if (index == NULL)
     {
-        return;
+        return false;
     }
 
-    for (int docID = 1; ; docID++)
+    // Open the pages, whether saved one per file or packed in segments
+    pagedir_t* pages = pagedir_open(pageDirectory);
+    if (pages == NULL)
     {
-        // Formulate the filename for each webpage
-        char filename[strlen(pageDirectory) + 20];
-        sprintf(filename, "%s/%d", pageDirectory, docID);
-        
-        // Open the webpage file
-        FILE* fp = fopen(filename, "r");
-
-        // Break out of loop if file doesn't exist
-        if (fp == NULL)
-        {
-            break;
-        }
-        
-        // Load the webpage and process its content
-        webpage_t* webpage = pagedir_load(fp);
-        fclose(fp);
-        if (webpage != NULL)
-        {
-            indexPage(index, webpage, docID);
-            webpage_delete(webpage);
-        }
+        index_delete(index);
+        return false;
     }
 
+    indexPages(pages, index, 1, pagedir_partitions(pageDirectory));
+    reportStats(pages);
+    pagedir_close(pages);
+
     // Save the completed index to a file and cleanup
     index_save(index, indexFilename);
     index_delete(index);
+    return true;
+}
+
+/*
+ * indexPages: Indexes each webpage from docID firstDoc on into the index.
+ * Returns the number of pages indexed.
+ *
+ * Pages are loaded in turn until one is missing; pages saved by a crawl
+ * split between processes may leave gaps, each shorter than the number
+ * of processes (gap), so only a run that long ends them.
+ */
+static int indexPages(pagedir_t* pages, index_t* index, int firstDoc, int gap)
+{
+    int indexed = 0;
+    int misses = 0;
+    for (int docID = firstDoc; misses < gap; docID++)
+    {
+        webpage_t* webpage = pagedir_get(pages, docID);
+        if (webpage == NULL)
+        {
+            misses++;
+            continue;
+        }
+        misses = 0;
+        indexPage(index, webpage, docID);
+        webpage_delete(webpage);
+        indexed++;
+    }
+    return indexed;
 }
 
 /*
@@ -117,4 +376,1384 @@ void indexPage(index_t* index, webpage_t* webpage, int docID)
         counters_add(ctrs, docID);
         free(word);
     }
-}
\ No newline at end of file
+}
+
+/*
+ * indexBuildParallel: Builds the same index as indexBuild, with
+ * numThreads threads, and saves it to a file.
+ *
+ * Each thread claims docIDs a chunk at a time and indexes their pages
+ * into its own partial index, which no other thread touches.  The
+ * partial indexes are then merged, each thread taking a share of the
+ * index's slots, into the lines index_save would write, in its order.
+ * Returns false if it could not be built.
+ */
+bool indexBuildParallel(const char* pageDirectory, const char* indexFilename, int numThreads)
+{
+    pagedir_t* pages = pagedir_open(pageDirectory);
+    if (pages == NULL)
+    {
+        return false;
+    }
+
+    build_t build;
+    build.pages = pages;
+    build.gap = pagedir_partitions(pageDirectory);
+    build.chunk = (build.gap > CHUNK_DOCS) ? build.gap : CHUNK_DOCS;
+    build.next = 1;
+    build.stop = INT_MAX;
+    build.numThreads = numThreads;
+    build.partials = calloc(numThreads, sizeof(partial_t));
+    merge_t* merges = calloc(numThreads, sizeof(merge_t));
+    bool ok = build.partials != NULL && merges != NULL;
+    pthread_mutex_init(&build.lock, NULL);
+    for (int t = 0; ok && t < numThreads; t++)
+    {
+        ok = partialInit(&build.partials[t], &build, TERM_SLOTS);
+    }
+
+    // Each thread indexes the pages it claims; any that cannot be started
+    // is run here instead
+    pthread_t threads[MAX_THREADS];
+    bool started[MAX_THREADS];
+    for (int t = 0; ok && t < numThreads; t++)
+    {
+        started[t] = pthread_create(&threads[t], NULL, buildThread, &build.partials[t]) == 0;
+    }
+    bool running = ok;
+    for (int t = 0; running && t < numThreads; t++)
+    {
+        if (started[t])
+        {
+            pthread_join(threads[t], NULL);
+        } else {
+            buildThread(&build.partials[t]);
+        }
+        ok = ok && build.partials[t].ok;
+    }
+    if (ok)
+    {
+        reportStats(pages);
+    }
+    pagedir_close(pages);
+
+    // Then each merges the words that fall in its share of the slots
+    build.end = ok ? findEnd(&build) : -1;
+    ok = build.end > 0;
+    for (int t = 0; ok && t < numThreads; t++)
+    {
+        merges[t].build = &build;
+        merges[t].first = t * INDEX_SLOTS / numThreads;
+        merges[t].last = (t + 1) * INDEX_SLOTS / numThreads;
+        started[t] = pthread_create(&threads[t], NULL, mergeThread, &merges[t]) == 0;
+    }
+    for (int t = 0; ok && t < numThreads; t++)
+    {
+        if (started[t])
+        {
+            pthread_join(threads[t], NULL);
+        } else {
+            mergeThread(&merges[t]);
+        }
+    }
+    for (int t = 0; ok && t < numThreads; t++)
+    {
+        ok = merges[t].ok;
+    }
+
+    // Save the merged lines, share by share, to the index file and cleanup
+    if (ok)
+    {
+        FILE* fp = fopen(indexFilename, "w");
+        for (int t = 0; fp != NULL && t < numThreads; t++)
+        {
+            ok = fwrite(merges[t].text, 1, merges[t].length, fp) == merges[t].length && ok;
+        }
+        ok = fp != NULL && fclose(fp) == 0 && ok;
+        if (!ok)
+        {
+            fprintf(stderr, "Unable to write %s\n", indexFilename);
+        }
+    } else {
+        fprintf(stderr, "Out of memory building the index\n");
+    }
+    for (int t = 0; t < numThreads; t++)
+    {
+        if (build.partials != NULL)
+        {
+            partialFree(&build.partials[t]);
+        }
+        if (merges != NULL)
+        {
+            free(merges[t].text);
+        }
+    }
+    pthread_mutex_destroy(&build.lock);
+    free(build.partials);
+    free(merges);
+    return ok;
+}
+
+/*
+ * indexBuildExternal: Builds the same index as indexBuild, holding
+ * roughly no more than budget bytes of it in memory, and saves it to a file.
+ *
+ * Pages are indexed in a single pass into a partial index, as a thread of
+ * indexBuildParallel does; whenever it outgrows the budget, its terms are
+ * written, in order of slot and word, to a run file beside the index file,
+ * and it starts afresh.  The runs are then merged a word at a time, and
+ * the index file written a slot at a time, in the order index_save would.
+ * Returns false if it could not be built.
+ */
+bool indexBuildExternal(const char* pageDirectory, const char* indexFilename, long budget)
+{
+    pagedir_t* pages = pagedir_open(pageDirectory);
+    if (pages == NULL)
+    {
+        return false;
+    }
+
+    // A dictionary large enough that a full budget of words is quick to search
+    long slots = budget / 1024;
+    slots = (slots < TERM_SLOTS) ? TERM_SLOTS : (slots > MAX_RUN_SLOTS) ? MAX_RUN_SLOTS : slots;
+    partial_t partial;
+    bool ok = partialInit(&partial, NULL, (int) slots);
+    int numRuns = 0;
+
+    // Load each webpage in turn until as many are missing in a row as indexBuild allows
+    int gap = pagedir_partitions(pageDirectory);
+    int misses = 0;
+    for (int docID = 1; ok && misses < gap; docID++)
+    {
+        webpage_t* webpage = pagedir_get(pages, docID);
+        if (webpage == NULL)
+        {
+            misses++;
+            continue;
+        }
+        misses = 0;
+        ok = partialPage(&partial, webpage, docID);
+        webpage_delete(webpage);
+
+        if (ok && partial.bytes >= budget)
+        {
+            ok = writeRun(&partial, indexFilename, numRuns++);
+            partialFree(&partial);
+            ok = partialInit(&partial, NULL, (int) slots) && ok;
+        }
+    }
+    if (ok && partial.numTerms > 0)
+    {
+        ok = writeRun(&partial, indexFilename, numRuns++);
+    }
+    partialFree(&partial);
+    if (ok)
+    {
+        reportStats(pages);
+    }
+    pagedir_close(pages);
+
+    // Merge the runs into the index file, then remove them
+    if (ok)
+    {
+        if (numRuns > 1)
+        {
+            fprintf(stderr, "Merging %d runs of at most %ld MB\n", numRuns, budget >> 20);
+        }
+        ok = mergeRuns(indexFilename, numRuns);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Unable to build the index: out of memory or disk\n");
+    }
+    removeRuns(indexFilename, 0, numRuns);
+    return ok;
+}
+
+/*
+ * indexUpdate: Indexes the pages of pageDirectory past the last docID in
+ * the index file and its delta segments into a new delta segment, rather
+ * than rebuilding the index.  Delta segments are written in the binary
+ * format, so the last docID is read from the header of the last of them,
+ * or failing that of the index file, without loading either.  Once an
+ * update leaves MAX_DELTAS delta segments, it starts compacting the index
+ * in the background, and returns without waiting.  Returns false if the
+ * index could not be updated.
+ */
+bool indexUpdate(const char* pageDirectory, const char* indexFilename)
+{
+    int lock = lockIndex(indexFilename);
+    if (lock < 0)
+    {
+        fprintf(stderr, "Unable to lock %s for update\n", indexFilename);
+        return false;
+    }
+
+    // Find the last docID indexed so far; each delta segment holds higher
+    // docIDs than those before it
+    int numDeltas = countDeltas(indexFilename);
+    char* lastPath = (numDeltas > 0) ? index_deltaPath(indexFilename, numDeltas) : NULL;
+    int last = index_fileLastDoc((numDeltas > 0) ? lastPath : indexFilename);
+    free(lastPath);
+    if (last < 0)
+    {
+        fprintf(stderr, "Unable to read the index %s to update\n", indexFilename);
+        unlockIndex(indexFilename, lock);
+        return false;
+    }
+
+    // Index the pages after it into the next delta segment, which appears whole
+    index_t* delta = index_new(INDEX_SLOTS);
+    pagedir_t* pages = pagedir_open(pageDirectory);
+    bool ok = delta != NULL && pages != NULL;
+    int added = 0;
+    if (ok)
+    {
+        added = indexPages(pages, delta, last + 1, pagedir_partitions(pageDirectory));
+        reportStats(pages);
+    }
+    if (pages != NULL)
+    {
+        pagedir_close(pages);
+    }
+    char* path = index_deltaPath(indexFilename, numDeltas + 1);
+    char* tempPath = sidePath(indexFilename, "%s.delta.tmp", 0);
+    if (!ok)
+    {
+        fprintf(stderr, "Unable to read the pages of %s\n", pageDirectory);
+    } else if (index_lastDoc(delta) > 0) {
+        ok = path != NULL && tempPath != NULL && index_saveBinary(delta, tempPath)
+             && rename(tempPath, path) == 0;
+        if (ok)
+        {
+            numDeltas++;
+            fprintf(stderr, "Indexed %d new pages, from docID %d, into %s\n", added, last + 1, path);
+        } else {
+            if (tempPath != NULL)
+            {
+                remove(tempPath);
+            }
+            fprintf(stderr, "Unable to write the next delta segment of %s\n", indexFilename);
+        }
+    } else {
+        fprintf(stderr, "No new pages to index after docID %d\n", last);
+    }
+    free(path);
+    free(tempPath);
+    if (delta != NULL)
+    {
+        index_delete(delta);
+    }
+    unlockIndex(indexFilename, lock);
+
+    // Merge the delta segments into the index once there are enough of them
+    if (ok && numDeltas >= MAX_DELTAS)
+    {
+        compactInBackground(indexFilename, numDeltas);
+    }
+    return ok;
+}
+
+/*
+ * indexCompact: Merges the delta segments of the index file into it, in
+ * the format it is in, and removes them, holding no more than a word of
+ * them at a time.  The delta segments, which are binary, are mapped, and
+ * merged with a binary index file, also mapped, word by word in sorted
+ * order, as runs are; a text index file is not sorted, so it is read a
+ * line at a time (see compactText).  The index file is replaced by a
+ * rename, and only then are the delta segments removed, the last first,
+ * so a querier starting meanwhile finds every page it would have before.
+ * Returns false if the index could not be compacted.
+ */
+bool indexCompact(const char* indexFilename)
+{
+    int lock = lockIndex(indexFilename);
+    if (lock < 0)
+    {
+        fprintf(stderr, "Unable to lock %s for compaction\n", indexFilename);
+        return false;
+    }
+    int numDeltas = countDeltas(indexFilename);
+    if (numDeltas == 0)
+    {
+        fprintf(stderr, "No delta segments of %s to compact\n", indexFilename);
+        unlockIndex(indexFilename, lock);
+        return true;
+    }
+
+    // Map the delta segments, and the index file into maps[0] if it is binary
+    indexmap_t** maps = calloc(numDeltas + 1, sizeof(indexmap_t*));
+    bool ok = maps != NULL;
+    for (int n = 1; ok && n <= numDeltas; n++)
+    {
+        char* path = index_deltaPath(indexFilename, n);
+        maps[n] = (path != NULL) ? indexmap_open(path) : NULL;
+        ok = maps[n] != NULL;
+        free(path);
+    }
+    FILE* fp = ok ? fopen(indexFilename, "r") : NULL;
+    int c = (fp != NULL) ? fgetc(fp) : EOF;
+    bool binary = c == '\0';
+    if (binary)
+    {
+        fclose(fp);
+        fp = NULL;
+        maps[0] = indexmap_open(indexFilename);
+    } else if (c != EOF) {
+        ungetc(c, fp);
+    }
+    ok = ok && (binary ? maps[0] != NULL : fp != NULL);
+
+    char* tempPath = sidePath(indexFilename, "%s.compact.tmp", 0);
+    if (!ok || tempPath == NULL)
+    {
+        fprintf(stderr, "Unable to read the index %s to compact\n", indexFilename);
+        ok = false;
+    } else {
+        if (binary)
+        {
+            indexwriter_t* writer = indexwriter_new(tempPath);
+            ok = writer != NULL && mergeMaps(maps, NULL, numDeltas + 1, writer, addWord);
+            ok = indexwriter_close(writer) && ok;
+        } else {
+            ok = compactText(fp, maps + 1, numDeltas, tempPath);
+        }
+        ok = ok && rename(tempPath, indexFilename) == 0;
+        if (ok)
+        {
+            removeDeltas(indexFilename);
+            fprintf(stderr, "Compacted %d delta segments into %s\n", numDeltas, indexFilename);
+        } else {
+            remove(tempPath);
+            fprintf(stderr, "Unable to compact %s\n", indexFilename);
+        }
+    }
+    free(tempPath);
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    for (int n = 0; maps != NULL && n <= numDeltas; n++)
+    {
+        indexmap_close(maps[n]);
+    }
+    free(maps);
+    unlockIndex(indexFilename, lock);
+    return ok;
+}
+
+/*
+ * compactInBackground: Runs indexCompact on the index file in a process
+ * of its own, which takes the lock itself once the update has released
+ * it.  The process is forked twice, in a session of its own, so it
+ * outlives the indexer and its terminal and no process is left to wait
+ * for it.  If no process can be made, the index is compacted here.
+ */
+static void compactInBackground(const char* indexFilename, int numDeltas)
+{
+    fprintf(stderr, "Compacting %d delta segments of %s in the background\n",
+            numDeltas, indexFilename);
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        setsid();
+        pid_t compactor = fork();
+        if (compactor <= 0)
+        {
+            _exit(indexCompact(indexFilename) ? 0 : 1);
+        }
+        _exit(0);
+    } else if (pid < 0) {
+        indexCompact(indexFilename);
+    } else {
+        waitpid(pid, NULL, 0);
+    }
+}
+
+/*
+ * compactText: Writes the text index at fp to path, with the counts of
+ * the mapped delta segments set over it.  Each line's word is found in
+ * each delta segment by binary search, and marked there as seen; the
+ * words of the delta segments left unseen are merged after the last line.
+ * Returns false if the index is not whole or any error.
+ */
+static bool compactText(FILE* fp, indexmap_t** deltas, int numDeltas, const char* path)
+{
+    FILE* out = fopen(path, "w");
+    bool** seen = calloc(numDeltas, sizeof(bool*));
+    bool ok = out != NULL && seen != NULL;
+    for (int n = 0; ok && n < numDeltas; n++)
+    {
+        seen[n] = calloc(indexmap_size(deltas[n]) + 1, sizeof(bool));
+        ok = seen[n] != NULL;
+    }
+
+    char* line;
+    while (ok && (line = file_readLine(fp)) != NULL)
+    {
+        // The word, then docID and count by turns
+        char* fields;
+        char* word = strtok_r(line, " \t\r", &fields);
+        counters_t* ctrs = (word != NULL) ? counters_new() : NULL;
+        char* docField;
+        while (ctrs != NULL && ok && (docField = strtok_r(NULL, " \t\r", &fields)) != NULL)
+        {
+            char* countField = strtok_r(NULL, " \t\r", &fields);
+            char* docEnd;
+            char* countEnd = NULL;
+            long docID = strtol(docField, &docEnd, 10);
+            long count = (countField != NULL) ? strtol(countField, &countEnd, 10) : -1;
+            ok = *docEnd == '\0' && countEnd != NULL && *countEnd == '\0'
+                 && docID >= 0 && docID <= INT_MAX && count >= 0 && count <= INT_MAX
+                 && counters_set(ctrs, (int) docID, (int) count);
+        }
+        for (int n = 0; ctrs != NULL && ok && n < numDeltas; n++)
+        {
+            int i = indexmap_find(deltas[n], word);
+            if (i >= 0)
+            {
+                ok = indexmap_iterate(deltas[n], i, ctrs, setPosting);
+                seen[n][i] = true;
+            }
+        }
+        if (ctrs != NULL)
+        {
+            if (ok)
+            {
+                index_print(out, word, ctrs);
+            }
+            counters_delete(ctrs);
+        } else if (word != NULL) {
+            ok = false;
+        }
+        free(line);
+    }
+    ok = ok && !ferror(fp) && mergeMaps(deltas, seen, numDeltas, out, index_print);
+
+    for (int n = 0; seen != NULL && n < numDeltas; n++)
+    {
+        free(seen[n]);
+    }
+    free(seen);
+    if (out != NULL)
+    {
+        ok = !ferror(out) && ok;
+        ok = (fclose(out) == 0) && ok;
+    }
+    return ok;
+}
+
+/*
+ * mergeMaps: Merges the words of the mapped indexes in strcmp order, as
+ * mergeGroup merges runs, calling itemfunc on each with a counters set of
+ * its documents.  The counts are set from each index in turn, so a later
+ * one's count of a document replaces an earlier one's.  Words marked in
+ * skip, if it is not NULL, are passed over.  Returns false if any index
+ * is corrupt or out of memory.
+ */
+static bool mergeMaps(indexmap_t** maps, bool** skip, int numMaps, void* arg,
+                      void (*itemfunc)(void* arg, const char* key, void* item))
+{
+    int* next = calloc(numMaps, sizeof(int));
+    bool ok = next != NULL;
+    while (ok)
+    {
+        // Find the least word left in any index
+        const char* least = NULL;
+        for (int m = 0; m < numMaps; m++)
+        {
+            while (skip != NULL && next[m] < indexmap_size(maps[m]) && skip[m][next[m]])
+            {
+                next[m]++;
+            }
+            const char* word = (next[m] < indexmap_size(maps[m])) ? indexmap_word(maps[m], next[m]) : NULL;
+            if (word != NULL && (least == NULL || strcmp(word, least) < 0))
+            {
+                least = word;
+            }
+        }
+        if (least == NULL)
+        {
+            break;
+        }
+
+        counters_t* ctrs = counters_new();
+        ok = ctrs != NULL;
+        for (int m = 0; ok && m < numMaps; m++)
+        {
+            const char* word = (next[m] < indexmap_size(maps[m])) ? indexmap_word(maps[m], next[m]) : NULL;
+            if (word != NULL && strcmp(word, least) == 0)
+            {
+                ok = indexmap_iterate(maps[m], next[m], ctrs, setPosting);
+                next[m]++;
+            }
+        }
+        if (ok)
+        {
+            itemfunc(arg, least, ctrs);
+        }
+        if (ctrs != NULL)
+        {
+            counters_delete(ctrs);
+        }
+    }
+
+    // A word that cannot be read ends an index early
+    for (int m = 0; ok && m < numMaps; m++)
+    {
+        ok = next[m] == indexmap_size(maps[m]);
+    }
+    free(next);
+    return ok;
+}
+
+/*
+ * addWord: Adds a merged word and its counters to an indexwriter, which
+ * reports any failure when closed.
+ */
+static void addWord(void* arg, const char* key, void* item)
+{
+    indexwriter_add(arg, key, item);
+}
+
+/*
+ * setPosting: Sets a document's count in a counters set.
+ */
+static void setPosting(void* arg, const int key, const int count)
+{
+    counters_set(arg, key, count);
+}
+
+/*
+ * buildThread: Indexes the pages of each chunk the thread claims into its
+ * partial index, until no more are to be claimed.
+ */
+static void* buildThread(void* arg)
+{
+    partial_t* partial = arg;
+    build_t* build = partial->build;
+    int first;
+    while (partial->ok && claimChunk(build, &first))
+    {
+        int misses = 0;
+        for (int docID = first; partial->ok && docID < first + build->chunk; docID++)
+        {
+            webpage_t* webpage = pagedir_get(build->pages, docID);
+            if (webpage == NULL)
+            {
+                // The pages end at or before a run of gap missing, so
+                // no docID past it need be claimed
+                if (++misses == build->gap)
+                {
+                    pthread_mutex_lock(&build->lock);
+                    if (docID - misses + 1 < build->stop)
+                    {
+                        build->stop = docID - misses + 1;
+                    }
+                    pthread_mutex_unlock(&build->lock);
+                    break;
+                }
+                continue;
+            }
+            misses = 0;
+            partial->ok = partialPage(partial, webpage, docID);
+            webpage_delete(webpage);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * claimChunk: Claims the next chunk of docIDs, setting *first to the
+ * first of them.  Returns false if there are none left to claim.
+ */
+static bool claimChunk(build_t* build, int* first)
+{
+    pthread_mutex_lock(&build->lock);
+    bool claimed = build->next < build->stop;
+    if (claimed)
+    {
+        *first = build->next;
+        build->next += build->chunk;
+    }
+    pthread_mutex_unlock(&build->lock);
+    return claimed;
+}
+
+/*
+ * partialInit: Sets up an empty partial index, with a dictionary of the
+ * given number of slots, for a thread of build (or NULL).  Returns false
+ * if out of memory.
+ */
+static bool partialInit(partial_t* partial, build_t* build, int slots)
+{
+    *partial = (partial_t) { build, true, 0, NULL, NULL, 0, 0, NULL, 0, 0 };
+    partial->dict = hashtable_new(slots);
+    partial->bytes = (long) slots * NODE_BYTES;
+    return partial->dict != NULL;
+}
+
+/*
+ * partialPage: Indexes each word of a webpage into a partial index, as
+ * indexPage does into the index.  Returns false if out of memory.
+ */
+static bool partialPage(partial_t* partial, webpage_t* webpage, int docID)
+{
+    if (partial->numDocs == partial->maxDocs)
+    {
+        int maxDocs = (partial->maxDocs > 0) ? 2 * partial->maxDocs : 64;
+        int* docs = realloc(partial->docs, maxDocs * sizeof(int));
+        if (docs == NULL)
+        {
+            return false;
+        }
+        partial->bytes += (maxDocs - partial->maxDocs) * sizeof(int);
+        partial->docs = docs;
+        partial->maxDocs = maxDocs;
+    }
+    partial->docs[partial->numDocs++] = docID;
+
+    int pos = 0;
+    char* word;
+    while ((word = webpage_getNextWord(webpage, &pos)) != NULL)
+    {
+        if (strlen(word) < 3)
+        {
+            free(word);
+            continue;
+        }
+        normalizeWord(word);
+        if (!partialAdd(partial, word, docID))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * partialAdd: Counts an occurrence of word on page docID, which is no
+ * lower than any page the partial index has seen.  The word is taken
+ * over by the partial index, or freed.  Returns false if out of memory.
+ */
+static bool partialAdd(partial_t* partial, char* word, int docID)
+{
+    term_t* term = hashtable_find(partial->dict, word);
+    if (term == NULL)
+    {
+        if (partial->numTerms == partial->maxTerms)
+        {
+            int maxTerms = (partial->maxTerms > 0) ? 2 * partial->maxTerms : 1024;
+            term_t** terms = realloc(partial->terms, maxTerms * sizeof(term_t*));
+            if (terms == NULL)
+            {
+                free(word);
+                return false;
+            }
+            partial->bytes += (maxTerms - partial->maxTerms) * sizeof(term_t*);
+            partial->terms = terms;
+            partial->maxTerms = maxTerms;
+        }
+        term = malloc(sizeof(term_t));
+        if (term == NULL)
+        {
+            free(word);
+            return false;
+        }
+        *term = (term_t) { word, (int) hash_jenkins(word, INDEX_SLOTS), docID, partial->numTerms, NULL, 0, 0 };
+        if (!hashtable_insert(partial->dict, word, term))
+        {
+            free(term);
+            free(word);
+            return false;
+        }
+        partial->terms[partial->numTerms++] = term;
+        partial->bytes += sizeof(term_t) + 2 * (strlen(word) + 1) + NODE_BYTES;
+    } else {
+        free(word);
+    }
+
+    // Pages come in increasing docID, so only the last posting can be this page's
+    if (term->numPostings > 0 && term->postings[term->numPostings - 1].docID == docID)
+    {
+        term->postings[term->numPostings - 1].count++;
+        return true;
+    }
+    if (term->numPostings == term->maxPostings)
+    {
+        int maxPostings = (term->maxPostings > 0) ? 2 * term->maxPostings : 4;
+        posting_t* postings = realloc(term->postings, maxPostings * sizeof(posting_t));
+        if (postings == NULL)
+        {
+            return false;
+        }
+        partial->bytes += (maxPostings - term->maxPostings) * sizeof(posting_t);
+        term->postings = postings;
+        term->maxPostings = maxPostings;
+    }
+    term->postings[term->numPostings++] = (posting_t) { docID, 1 };
+    return true;
+}
+
+/*
+ * partialFree: Frees all that a partial index holds.
+ */
+static void partialFree(partial_t* partial)
+{
+    for (int i = 0; i < partial->numTerms; i++)
+    {
+        free(partial->terms[i]->word);
+        free(partial->terms[i]->postings);
+        free(partial->terms[i]);
+    }
+    free(partial->terms);
+    free(partial->docs);
+    if (partial->dict != NULL)
+    {
+        hashtable_delete(partial->dict, NULL);
+    }
+}
+
+/*
+ * findEnd: Returns the first docID that indexBuild would not index: the
+ * page after the last one found before the first run of gap missing.
+ * Every docID before that run was claimed and read, though threads may
+ * have read past it.  Returns -1 if out of memory.
+ */
+static int findEnd(build_t* build)
+{
+    int numDocs = 0;
+    for (int t = 0; t < build->numThreads; t++)
+    {
+        numDocs += build->partials[t].numDocs;
+    }
+    int* docs = malloc((numDocs > 0 ? numDocs : 1) * sizeof(int));
+    if (docs == NULL)
+    {
+        return -1;
+    }
+    numDocs = 0;
+    for (int t = 0; t < build->numThreads; t++)
+    {
+        memcpy(docs + numDocs, build->partials[t].docs, build->partials[t].numDocs * sizeof(int));
+        numDocs += build->partials[t].numDocs;
+    }
+    qsort(docs, numDocs, sizeof(int), compareInts);
+
+    int last = 0;
+    for (int i = 0; i < numDocs && docs[i] - last <= build->gap; i++)
+    {
+        last = docs[i];
+    }
+    free(docs);
+    return last + 1;
+}
+
+/*
+ * mergeThread: Merges every thread's terms for the words that fall in
+ * this share of the slots, dropping pages from the end on, and formats
+ * their lines as index_save would: slot by slot, each slot's words from
+ * the last first seen, and each word's pages in increasing docID.
+ */
+static void* mergeThread(void* arg)
+{
+    merge_t* merge = arg;
+    build_t* build = merge->build;
+    merge->ok = false;
+
+    int numTerms = 0;
+    for (int t = 0; t < build->numThreads; t++)
+    {
+        partial_t* partial = &build->partials[t];
+        for (int i = 0; i < partial->numTerms; i++)
+        {
+            term_t* term = partial->terms[i];
+            numTerms += (term->slot >= merge->first && term->slot < merge->last && term->firstDoc < build->end);
+        }
+    }
+    term_t** terms = malloc((numTerms > 0 ? numTerms : 1) * sizeof(term_t*));
+    entry_t* entries = malloc((numTerms > 0 ? numTerms : 1) * sizeof(entry_t));
+    if (terms == NULL || entries == NULL)
+    {
+        free(terms);
+        free(entries);
+        return NULL;
+    }
+    numTerms = 0;
+    for (int t = 0; t < build->numThreads; t++)
+    {
+        partial_t* partial = &build->partials[t];
+        for (int i = 0; i < partial->numTerms; i++)
+        {
+            term_t* term = partial->terms[i];
+            if (term->slot >= merge->first && term->slot < merge->last && term->firstDoc < build->end)
+            {
+                terms[numTerms++] = term;
+            }
+        }
+    }
+
+    // Each word's terms come together, the one seen first leading
+    qsort(terms, numTerms, sizeof(term_t*), compareTerms);
+    int numEntries = 0;
+    bool ok = true;
+    for (int i = 0, j; ok && i < numTerms; i = j)
+    {
+        for (j = i + 1; j < numTerms && strcmp(terms[j]->word, terms[i]->word) == 0; j++)
+        {
+        }
+        ok = mergeTerms(terms + i, j - i, build->end, &entries[numEntries++]);
+    }
+
+    qsort(entries, numEntries, sizeof(entry_t), compareEntries);
+    FILE* fp = ok ? open_memstream(&merge->text, &merge->length) : NULL;
+    if (fp != NULL)
+    {
+        writeEntries(fp, entries, numEntries);
+        merge->ok = fclose(fp) == 0;
+    }
+
+    for (int i = 0; i < numEntries; i++)
+    {
+        if (entries[i].owned)
+        {
+            free(entries[i].postings);
+        }
+    }
+    free(entries);
+    free(terms);
+    return NULL;
+}
+
+/*
+ * mergeTerms: Merges the numTerms terms for one word, in the order the
+ * threads first saw it, into its entry, keeping the pages before end.
+ * Returns false if out of memory.
+ */
+static bool mergeTerms(term_t** terms, int numTerms, int end, entry_t* entry)
+{
+    *entry = (entry_t) { terms[0]->word, terms[0]->slot, terms[0]->firstDoc, terms[0]->order,
+                         terms[0]->postings, terms[0]->numPostings, false };
+    if (numTerms > 1)
+    {
+        // Threads claim chunks in turn, so their pages interleave
+        int numPostings = 0;
+        for (int i = 0; i < numTerms; i++)
+        {
+            numPostings += terms[i]->numPostings;
+        }
+        entry->postings = malloc(numPostings * sizeof(posting_t));
+        if (entry->postings == NULL)
+        {
+            entry->owned = false;
+            entry->numPostings = 0;
+            return false;
+        }
+        entry->owned = true;
+        entry->numPostings = 0;
+        for (int i = 0; i < numTerms; i++)
+        {
+            memcpy(entry->postings + entry->numPostings, terms[i]->postings,
+                   terms[i]->numPostings * sizeof(posting_t));
+            entry->numPostings += terms[i]->numPostings;
+        }
+        qsort(entry->postings, entry->numPostings, sizeof(posting_t), comparePostings);
+    }
+    while (entry->postings[entry->numPostings - 1].docID >= end)
+    {
+        entry->numPostings--;
+    }
+    return true;
+}
+
+/*
+ * writeEntries: Writes each entry's line to fp, as index_print does.
+ */
+static void writeEntries(FILE* fp, entry_t* entries, int numEntries)
+{
+    for (int i = 0; i < numEntries; i++)
+    {
+        fprintf(fp, "%s", entries[i].word);
+        for (int p = 0; p < entries[i].numPostings; p++)
+        {
+            fprintf(fp, " %d %d", entries[i].postings[p].docID, entries[i].postings[p].count);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+/*
+ * writeRun: Writes the terms of a partial index, in order of slot and
+ * word, to run file number run.  Each is a record of five native ints
+ * (slot, word length, first docID, place first seen and number of
+ * postings), the word, and its postings as pairs of ints.
+ * Returns false if the file could not be written.
+ */
+static bool writeRun(partial_t* partial, const char* indexFilename, int run)
+{
+    char* path = sidePath(indexFilename, "%s.run%d", run);
+    FILE* fp = (path != NULL) ? fopen(path, "wb") : NULL;
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Unable to write run file %s\n", (path != NULL) ? path : indexFilename);
+        free(path);
+        return false;
+    }
+    free(path);
+
+    qsort(partial->terms, partial->numTerms, sizeof(term_t*), compareRunTerms);
+    bool ok = true;
+    for (int i = 0; ok && i < partial->numTerms; i++)
+    {
+        term_t* term = partial->terms[i];
+        ok = writeRecord(fp, term->slot, term->word, term->firstDoc, term->order, term->postings, term->numPostings);
+    }
+    return (fclose(fp) == 0) && ok;
+}
+
+/*
+ * writeRecord: Writes one word's record to a run file, as writeRun
+ * describes.  Returns false if it could not be written.
+ */
+static bool writeRecord(FILE* fp, int slot, const char* word, int firstDoc, int order,
+                        const posting_t* postings, int numPostings)
+{
+    int length = strlen(word);
+    int header[5] = { slot, length, firstDoc, order, numPostings };
+    return fwrite(header, sizeof(int), 5, fp) == 5
+           && fwrite(word, 1, length, fp) == (size_t) length
+           && fwrite(postings, sizeof(posting_t), numPostings, fp) == (size_t) numPostings;
+}
+
+/*
+ * readRun: Reads the next record of a run file into the run, or marks it
+ * no longer live at the end of the file.  Returns false if the record
+ * could not be read whole, or if out of memory.
+ */
+static bool readRun(run_t* run)
+{
+    int header[5];
+    size_t got = fread(header, sizeof(int), 5, run->fp);
+    if (got == 0 && feof(run->fp))
+    {
+        run->live = false;
+        return true;
+    }
+    if (got != 5 || header[1] < 1 || header[4] < 1)
+    {
+        return false;
+    }
+    run->slot = header[0];
+    run->firstDoc = header[2];
+    run->order = header[3];
+
+    if (header[1] + 1 > run->maxWord)
+    {
+        char* word = realloc(run->word, header[1] + 1);
+        if (word == NULL)
+        {
+            return false;
+        }
+        run->word = word;
+        run->maxWord = header[1] + 1;
+    }
+    if (header[4] > run->maxPostings)
+    {
+        posting_t* postings = realloc(run->postings, header[4] * sizeof(posting_t));
+        if (postings == NULL)
+        {
+            return false;
+        }
+        run->postings = postings;
+        run->maxPostings = header[4];
+    }
+    run->numPostings = header[4];
+    run->word[header[1]] = '\0';
+    return fread(run->word, 1, header[1], run->fp) == (size_t) header[1]
+           && fread(run->postings, sizeof(posting_t), run->numPostings, run->fp) == (size_t) run->numPostings;
+}
+
+/*
+ * mergeRuns: Merges the numRuns run files into the index file, at most
+ * MAX_FANIN at a time, so that a build never holds more run files open
+ * than that.  While there are more, each MAX_FANIN runs in turn are merged
+ * into a new run file, numbered after the last, and removed; the runs left
+ * are merged into the index file.  Removes the runs it made, but leaves
+ * the numRuns given to the caller.  Returns false on any error.
+ */
+static bool mergeRuns(const char* indexFilename, int numRuns)
+{
+    int first = 0;                      // the runs still to merge are first to last - 1
+    int last = numRuns;
+    bool ok = true;
+    while (ok && last - first > MAX_FANIN)
+    {
+        int next = last;
+        for (int k = first; ok && k < last; k += MAX_FANIN)
+        {
+            int count = (last - k < MAX_FANIN) ? last - k : MAX_FANIN;
+            char* path = sidePath(indexFilename, "%s.run%d", next++);
+            FILE* fp = (path != NULL) ? fopen(path, "wb") : NULL;
+            ok = fp != NULL && mergeGroup(indexFilename, k, count, fp, false);
+            ok = (fp == NULL || fclose(fp) == 0) && ok;
+            free(path);
+            removeRuns(indexFilename, (k >= numRuns) ? k : numRuns, k + count);
+        }
+        if (!ok)
+        {
+            removeRuns(indexFilename, (first >= numRuns) ? first : numRuns, next);
+        }
+        first = last;
+        last = next;
+    }
+    if (!ok)
+    {
+        return false;
+    }
+
+    FILE* fp = fopen(indexFilename, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Unable to write %s\n", indexFilename);
+        ok = false;
+    } else {
+        ok = mergeGroup(indexFilename, first, last - first, fp, true);
+        ok = (fclose(fp) == 0) && ok;
+    }
+    removeRuns(indexFilename, (first >= numRuns) ? first : numRuns, last);
+    return ok;
+}
+
+/*
+ * mergeGroup: Merges the numRuns run files numbered from first, to fp.
+ * The runs cover increasing docIDs, so a word's postings are those of each
+ * run holding it, in turn, and it was first seen in the first of them.
+ * If final, fp is the index file: a slot's words are kept until the slot
+ * is complete, then written in the order index_save would.  Otherwise fp
+ * is a run file, and each word's record is written as soon as it is merged,
+ * in order of slot and word.  Returns false on any error.
+ */
+static bool mergeGroup(const char* indexFilename, int first, int numRuns, FILE* fp, bool final)
+{
+    run_t* runs = calloc((numRuns > 0) ? numRuns : 1, sizeof(run_t));
+    if (runs == NULL)
+    {
+        return false;
+    }
+    bool ok = true;
+    for (int k = 0; ok && k < numRuns; k++)
+    {
+        char* path = sidePath(indexFilename, "%s.run%d", first + k);
+        runs[k].fp = (path != NULL) ? fopen(path, "rb") : NULL;
+        runs[k].live = true;
+        free(path);
+        ok = runs[k].fp != NULL && readRun(&runs[k]);
+    }
+
+    entry_t* entries = NULL;
+    int numEntries = 0;
+    int maxEntries = 0;
+    int slot = -1;
+    while (ok)
+    {
+        // The least slot and word among the runs' records, in the first run holding it
+        int least = -1;
+        for (int k = 0; k < numRuns; k++)
+        {
+            if (runs[k].live && (least < 0 || runs[k].slot < runs[least].slot
+                                 || (runs[k].slot == runs[least].slot && strcmp(runs[k].word, runs[least].word) < 0)))
+            {
+                least = k;
+            }
+        }
+
+        // Write out each slot once all its words are in, or into a run each word as it is merged
+        if (least < 0 || runs[least].slot != slot || !final)
+        {
+            if (numEntries > 0 && final)
+            {
+                qsort(entries, numEntries, sizeof(entry_t), compareEntries);
+                writeEntries(fp, entries, numEntries);
+            }
+            for (int i = 0; ok && !final && i < numEntries; i++)
+            {
+                ok = writeRecord(fp, entries[i].slot, entries[i].word, entries[i].firstDoc, entries[i].order,
+                                 entries[i].postings, entries[i].numPostings);
+            }
+            for (int i = 0; i < numEntries; i++)
+            {
+                free(entries[i].word);
+                free(entries[i].postings);
+            }
+            numEntries = 0;
+            if (least < 0 || !ok)
+            {
+                break;
+            }
+            slot = runs[least].slot;
+        }
+
+        if (numEntries == maxEntries)
+        {
+            int max = (maxEntries > 0) ? 2 * maxEntries : 256;
+            entry_t* grown = realloc(entries, max * sizeof(entry_t));
+            if (grown == NULL)
+            {
+                ok = false;
+                break;
+            }
+            entries = grown;
+            maxEntries = max;
+        }
+        entry_t* entry = &entries[numEntries];
+        *entry = (entry_t) { strdup(runs[least].word), slot, runs[least].firstDoc, runs[least].order,
+                             NULL, 0, true };
+        ok = entry->word != NULL;
+        numEntries += ok;
+        for (int k = least; ok && k < numRuns; k++)
+        {
+            if (!runs[k].live || runs[k].slot != slot || strcmp(runs[k].word, entry->word) != 0)
+            {
+                continue;
+            }
+            posting_t* postings = realloc(entry->postings,
+                                          (entry->numPostings + runs[k].numPostings) * sizeof(posting_t));
+            ok = postings != NULL;
+            if (ok)
+            {
+                memcpy(postings + entry->numPostings, runs[k].postings, runs[k].numPostings * sizeof(posting_t));
+                entry->postings = postings;
+                entry->numPostings += runs[k].numPostings;
+                ok = readRun(&runs[k]);
+            }
+        }
+    }
+
+    for (int i = 0; i < numEntries; i++)
+    {
+        free(entries[i].word);
+        free(entries[i].postings);
+    }
+    free(entries);
+    for (int k = 0; k < numRuns; k++)
+    {
+        if (runs[k].fp != NULL)
+        {
+            fclose(runs[k].fp);
+        }
+        free(runs[k].word);
+        free(runs[k].postings);
+    }
+    free(runs);
+    return ok;
+}
+
+/*
+ * removeRuns: Removes the run files numbered from first to last - 1.
+ */
+static void removeRuns(const char* indexFilename, int first, int last)
+{
+    for (int run = first; run < last; run++)
+    {
+        char* path = sidePath(indexFilename, "%s.run%d", run);
+        if (path != NULL)
+        {
+            remove(path);
+            free(path);
+        }
+    }
+}
+
+/*
+ * sidePath: Returns the path of a file beside the index file, given by
+ * format from the index file's name and n, as a string the caller must
+ * free; or NULL if out of memory.
+ */
+static char* sidePath(const char* indexFilename, const char* format, int n)
+{
+    int length = snprintf(NULL, 0, format, indexFilename, n);
+    char* path = malloc(length + 1);
+    if (path != NULL)
+    {
+        sprintf(path, format, indexFilename, n);
+    }
+    return path;
+}
+
+/*
+ * lockIndex: Takes the lock beside the index file that updates and
+ * compactions of it hold, waiting for any under way.  Returns the lock
+ * file's descriptor, to be released by unlockIndex; or -1 on error.
+ *
+ * The holder removes the lock file as it releases it, so a lock taken on
+ * a file that has since been removed is no lock, and is taken afresh.
+ */
+static int lockIndex(const char* indexFilename)
+{
+    char* path = sidePath(indexFilename, "%s.lock", 0);
+    int fd = -1;
+    while (path != NULL)
+    {
+        fd = open(path, O_RDWR | O_CREAT, 0644);
+        struct flock lock = { .l_type = F_WRLCK, .l_whence = SEEK_SET, .l_start = 0, .l_len = 0 };
+        struct stat held;
+        struct stat named;
+        if (fd < 0 || fcntl(fd, F_SETLKW, &lock) != 0 || fstat(fd, &held) != 0)
+        {
+            break;
+        }
+        if (stat(path, &named) == 0 && named.st_dev == held.st_dev && named.st_ino == held.st_ino)
+        {
+            free(path);
+            return fd;
+        }
+        close(fd);
+        fd = -1;
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    free(path);
+    return -1;
+}
+
+/*
+ * unlockIndex: Removes the lock file beside the index file and releases
+ * the lock taken by lockIndex.
+ */
+static void unlockIndex(const char* indexFilename, int lock)
+{
+    char* path = sidePath(indexFilename, "%s.lock", 0);
+    if (path != NULL)
+    {
+        unlink(path);
+        free(path);
+    }
+    close(lock);
+}
+
+/*
+ * countDeltas: Returns the number of delta segments of the index file,
+ * counting from number 1 until one is missing.
+ */
+static int countDeltas(const char* indexFilename)
+{
+    int numDeltas = 0;
+    while (true)
+    {
+        char* path = index_deltaPath(indexFilename, numDeltas + 1);
+        bool exists = path != NULL && access(path, F_OK) == 0;
+        free(path);
+        if (!exists)
+        {
+            return numDeltas;
+        }
+        numDeltas++;
+    }
+}
+
+/*
+ * removeDeltas: Removes the delta segments of the index file, the last
+ * first, so a loader meanwhile still finds those before it.
+ * Returns the number removed.
+ */
+static int removeDeltas(const char* indexFilename)
+{
+    int numDeltas = countDeltas(indexFilename);
+    for (int n = numDeltas; n >= 1; n--)
+    {
+        char* path = index_deltaPath(indexFilename, n);
+        if (path != NULL)
+        {
+            remove(path);
+            free(path);
+        }
+    }
+    return numDeltas;
+}
+
+/*
+ * compareTerms: Orders terms by word, then by the page first seen on.
+ */
+static int compareTerms(const void* a, const void* b)
+{
+    const term_t* x = *(term_t* const*) a;
+    const term_t* y = *(term_t* const*) b;
+    int cmp = strcmp(x->word, y->word);
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+    return (x->firstDoc > y->firstDoc) - (x->firstDoc < y->firstDoc);
+}
+
+/*
+ * compareEntries: Orders entries by slot, then within a slot from the
+ * word last first seen, as a hashtable slot lists its keys.
+ */
+static int compareEntries(const void* a, const void* b)
+{
+    const entry_t* x = a;
+    const entry_t* y = b;
+    if (x->slot != y->slot)
+    {
+        return (x->slot > y->slot) - (x->slot < y->slot);
+    }
+    if (x->firstDoc != y->firstDoc)
+    {
+        return (x->firstDoc < y->firstDoc) - (x->firstDoc > y->firstDoc);
+    }
+    return (x->order < y->order) - (x->order > y->order);
+}
+
+/*
+ * compareRunTerms: Orders terms by slot in the index saved, then by word.
+ */
+static int compareRunTerms(const void* a, const void* b)
+{
+    const term_t* x = *(term_t* const*) a;
+    const term_t* y = *(term_t* const*) b;
+    if (x->slot != y->slot)
+    {
+        return (x->slot > y->slot) - (x->slot < y->slot);
+    }
+    return strcmp(x->word, y->word);
+}
+
+/*
+ * comparePostings: Orders postings by docID.
+ */
+static int comparePostings(const void* a, const void* b)
+{
+    const posting_t* x = a;
+    const posting_t* y = b;
+    return (x->docID > y->docID) - (x->docID < y->docID);
+}
+
+/*
+ * compareInts: Orders ints.
+ */
+static int compareInts(const void* a, const void* b)
+{
+    int x = *(const int*) a;
+    int y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * reportStats: Prints to stderr how fast the pages read were
+ * decompressed, if any were saved compressed.
+ */
+static void reportStats(pagedir_t* pages)
+{
+    pagedirstats_t stats;
+    pagedir_stats(pages, &stats);
+    if (stats.loadedBytes > 0 && stats.decodeSeconds > 0)
+    {
+        fprintf(stderr, "Decompressed %ld bytes of HTML at %.0f MB/s\n",
+                stats.loadedBytes, stats.loadedBytes / stats.decodeSeconds / 1e6);
+    }
+}
@@ -4,22 +4,31 @@
  * This file provides a way to test the functionality of the
  * index saving and loading functions. It loads an index from
  * a file, then saves it to another file, allowing for 
- * comparison between the two for testing purposes.
+ * comparison between the two for testing purposes.  The old index
+ * may be in either format; with -b the new one is saved in the binary
+ * format, so indextest also converts between the two.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../common/index.h"
 
 // Function prototypes
-void indextest(const char* oldIndexFilename, const char* newIndexFilename);
+void indextest(const char* oldIndexFilename, const char* newIndexFilename, bool binary);
 
 int main(int argc, char const *argv[])
 {
     // Ensure proper number of command line arguments
+    bool binary = argc == 4 && strcmp(argv[1], "-b") == 0;
+    if (binary)
+    {
+        argc--;
+        argv++;
+    }
     if (argc != 3)
     {
-        printf("Usage: /indextest oldIndexFilename newIndexFilename\n");
+        printf("Usage: /indextest [-b] oldIndexFilename newIndexFilename\n");
         return 1;
     }
 
@@ -28,16 +37,17 @@ int main(int argc, char const *argv[])
     const char* newIndexFilename = argv[2];
 
     // Load index from old file and save to new file
-    indextest(oldIndexFilename, newIndexFilename);
+    indextest(oldIndexFilename, newIndexFilename, binary);
 
     return 0;
 }
 
 /*
  * indextest: Loads an index from the given old file and
- * then saves it to the specified new file.
+ * then saves it to the specified new file, in the binary
+ * format if asked.
  */
-void indextest(const char* oldIndexFilename, const char* newIndexFilename)
+void indextest(const char* oldIndexFilename, const char* newIndexFilename, bool binary)
 {
     // Open the old index file for reading
     FILE* fp_oldIndex = fopen(oldIndexFilename, "r");
@@ -59,7 +69,17 @@ void indextest(const char* oldIndexFilename, const char* newIndexFilename)
     }
 
     // Save the index to the new file
-    index_save(index, newIndexFilename);
+    if (binary)
+    {
+        if (!index_saveBinary(index, newIndexFilename))
+        {
+            printf("Unable to write new index file\n");
+            index_delete(index);
+            exit(1);
+        }
+    } else {
+        index_save(index, newIndexFilename);
+    }
 
     // Cleanup
     index_delete(index);
@@ -18,6 +18,15 @@ echo "====================================================="
 ./indexer $CRAWLER_DIR/letters-1 $INDEXER_DIR/letters-1.index extra_arg     # more than 2 arguments
 ./indexer $CRAWLER_DIR/nonexistent $INDEXER_DIR/letters-1.index             # invalid pageDirectory (not a crawler directory)
 ./indexer $CRAWLER_DIR/letters-1 non_existent_path/index                    # invalid indexFile (non-existent path)
+./indexer -j 0 $CRAWLER_DIR/letters-1 $INDEXER_DIR/letters-1.index          # invalid number of threads
+./indexer -j 2 $CRAWLER_DIR/letters-1                                       # -j, missing indexFilename
+./indexer -m 0 $CRAWLER_DIR/letters-1 $INDEXER_DIR/letters-1.index          # invalid memory budget
+./indexer --update $CRAWLER_DIR/letters-1 non_existent_index                # --update, non-existent index
+./indexer --compact                                                         # --compact, missing indexFilename
+./indexer --update --compact $INDEXER_DIR/letters-1.index                    # --update and --compact together
+
+./indextest -b                                                              # indextest, missing filenames
+./indextest -b non_existent_file $INDEXER_DIR/letters-1.bin                 # indextest, non-existent old index
 
 # Testing read only
 chmod -w $INDEXER_DIR
@@ -51,6 +60,47 @@ for depth in 0 1 2 5 10; do
     ./indexer $crawler_dir $indexer_file
 done
 
+./indexer $CRAWLER_DIR/letters-10-packed $INDEXER_DIR/letters-10-packed.index
+diff <(sort $INDEXER_DIR/letters-10.index) <(sort $INDEXER_DIR/letters-10-packed.index) && echo "Same index from packed pages"
+for dir in letters-10-compressed letters-10-packed-compressed; do
+    ./indexer $CRAWLER_DIR/$dir $INDEXER_DIR/$dir.index
+    diff <(sort $INDEXER_DIR/letters-10.index) <(sort $INDEXER_DIR/$dir.index) && echo "Same index from $dir pages"
+done
+
+for threads in 2 4; do
+    ./indexer -j $threads $CRAWLER_DIR/letters-10 $INDEXER_DIR/letters-10-j$threads.index
+    cmp $INDEXER_DIR/letters-10.index $INDEXER_DIR/letters-10-j$threads.index && echo "Same index from $threads threads"
+done
+./indexer -m 1 $CRAWLER_DIR/letters-10 $INDEXER_DIR/letters-10-m1.index
+cmp $INDEXER_DIR/letters-10.index $INDEXER_DIR/letters-10-m1.index && echo "Same index within 1 MB"
+./indexer -j 2 -m 1 $CRAWLER_DIR/letters-10 $INDEXER_DIR/letters-10-j2m1.index
+cmp $INDEXER_DIR/letters-10.index $INDEXER_DIR/letters-10-j2m1.index && echo "Same index with -j and -m together"
+
+# Index letters-10 with its last pages held back, then update it once they are back
+rm -rf $INDEXER_DIR/letters-10-update && cp -r $CRAWLER_DIR/letters-10 $INDEXER_DIR/letters-10-update
+mkdir -p $INDEXER_DIR/held && mv $INDEXER_DIR/letters-10-update/[7-9] $INDEXER_DIR/held
+./indexer $INDEXER_DIR/letters-10-update $INDEXER_DIR/letters-10-update.index
+mv $INDEXER_DIR/held/* $INDEXER_DIR/letters-10-update && rmdir $INDEXER_DIR/held
+./indexer --update $INDEXER_DIR/letters-10-update $INDEXER_DIR/letters-10-update.index
+./indexer --update $INDEXER_DIR/letters-10-update $INDEXER_DIR/letters-10-update.index
+./indexer --compact $INDEXER_DIR/letters-10-update.index
+ls $INDEXER_DIR/letters-10-update.index.* 2>/dev/null || echo "No delta segments or lock left"
+~/cs50-dev/shared/tse/indexcmp $INDEXER_DIR/letters-10.index $INDEXER_DIR/letters-10-update.index
+
+# Add letters-10's pages one update at a time; the eighth update compacts in the background
+rm -rf $INDEXER_DIR/letters-10-pages && mkdir $INDEXER_DIR/letters-10-pages
+cp $CRAWLER_DIR/letters-10/.crawler $CRAWLER_DIR/letters-10/1 $INDEXER_DIR/letters-10-pages
+./indexer $INDEXER_DIR/letters-10-pages $INDEXER_DIR/letters-10-pages.index
+for page in 2 3 4 5 6 7 8 9; do
+    cp $CRAWLER_DIR/letters-10/$page $INDEXER_DIR/letters-10-pages
+    ./indexer --update $INDEXER_DIR/letters-10-pages $INDEXER_DIR/letters-10-pages.index
+done
+for wait in $(seq 30); do
+    [ -e $INDEXER_DIR/letters-10-pages.index.delta1 -o -e $INDEXER_DIR/letters-10-pages.index.lock ] && sleep 1
+done
+ls $INDEXER_DIR/letters-10-pages.index.* 2>/dev/null || echo "No delta segments or lock left"
+~/cs50-dev/shared/tse/indexcmp $INDEXER_DIR/letters-10.index $INDEXER_DIR/letters-10-pages.index
+
 echo "====================================================="
 echo "Testing toscrape at different depths"
 echo "====================================================="
@@ -68,6 +118,10 @@ for depth in 0 1 2; do
     indexer_file="$INDEXER_DIR/wikipedia-$depth.index"
     ./indexer $crawler_dir $indexer_file
 done
+./indexer -j 4 $CRAWLER_DIR/wikipedia-2 $INDEXER_DIR/wikipedia-2-j4.index
+cmp $INDEXER_DIR/wikipedia-2.index $INDEXER_DIR/wikipedia-2-j4.index && echo "Same index from 4 threads"
+./indexer -m 1 $CRAWLER_DIR/wikipedia-2 $INDEXER_DIR/wikipedia-2-m1.index
+cmp $INDEXER_DIR/wikipedia-2.index $INDEXER_DIR/wikipedia-2-m1.index && echo "Same index within 1 MB"
 
 echo "====================================================="
 echo "Testing indextest"
@@ -81,6 +135,18 @@ for depth in 0 1 2 5 10; do
     ~/cs50-dev/shared/tse/indexcmp $indexer_file $indextest_file
 done
 
+for depth in 0 1 2 5 10; do
+    indexer_file="$INDEXER_DIR/letters-$depth.index"
+    binary_file="$INDEXER_DIR/letters-$depth.bin"
+    indextest_file="$INDEXER_DIR/letters-$depth.frombin"
+
+    ./indextest -b $indexer_file $binary_file
+    ./indextest $binary_file $indextest_file
+    echo "Comparing $indexer_file and $indextest_file, through the binary format, with indexcmp"
+    ~/cs50-dev/shared/tse/indexcmp $indexer_file $indextest_file
+    ls -l $indexer_file $binary_file
+done
+
 for depth in 0 1 2 3; do
     indexer_file="$INDEXER_DIR/toscrape-$depth.index"
     indextest_file="$INDEXER_DIR/toscrape-$depth.indextest"
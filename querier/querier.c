@@ -8,6 +8,11 @@
  * logical AND and OR operations, ranks the results based on the number
  * of matches, and outputs the results to the user.
  * 
+ * An index in the binary format is mapped and queried in place, each
+ * word's postings decoded only when a query asks for the word; an index
+ * in the text format is loaded whole.  Either is served together with
+ * any delta segments that indexer --update has written beside it.
+ * 
  */
 
 #define _POSIX_C_SOURCE 200809L
@@ -21,6 +26,7 @@
 #include "word.h"
 #include "pagedir.h"
 #include "index.h"
+#include "indexmap.h"
 
 /*
  * two_sets_t: A structure to store two sets of counters.
@@ -59,12 +65,27 @@ typedef struct {
     int index;
 } doc_array_t;
 
+/*
+ * source_t: The index queried.
+ *
+ * Fields:
+ * - index: The index loaded from a text file, or NULL.
+ * - map: The index mapped from a binary file, or NULL.
+ * - delta: The index's delta segments, or NULL if there are none.
+ */
+typedef struct
+{
+    index_t* index;
+    indexmap_t* map;
+    index_t* delta;
+} source_t;
+
 bool validate_query(char** tokens, int numTokens);
 char* read_query();
-char* getURL(int docID, const char* pageDirectory);
+char* getURL(int docID, pagedir_t* pages);
 char** tokenize_query(char* query, int* numTokens);
 int compare_score(const void* score1, const void* score2);
-void process_query(char* query, index_t* index, const char* pageDirectory);
+void process_query(char* query, source_t* source, pagedir_t* pages);
 void print_query(void* arg, const int key, const int count);
 void free_tokens(char** tokens, int numTokens);
 void intersect_counters(void* arg, const int key, const int count);
@@ -76,6 +97,7 @@ doc_t* sort_result(counters_t* result, int* result_size);
 counters_t* counters_intersect(counters_t* ctrA, counters_t* ctrB);
 counters_t* counters_union(counters_t* ctrA, counters_t* ctrB);
 counters_t* counters_copy(counters_t *counters);
+counters_t* find_word(source_t* source, const char* word);
 
 int main(int argc, char const *argv[])
 {
@@ -104,25 +126,75 @@ int main(int argc, char const *argv[])
         return 1;
     }
 
-    index_t* index = index_load(fp);
+    // Load the delta segments before the index: a compaction replaces the
+    // index before removing them, so any found missing are in the index then
+    source_t source = { NULL, NULL, index_new(500) };
+    int numDeltas = index_loadDeltas(source.delta, indexFilename);
+    if (numDeltas <= 0 && source.delta != NULL)
+    {
+        index_delete(source.delta);
+        source.delta = NULL;
+    }
+
+    // Map a binary index where it lies; load any other
+    source.map = indexmap_open(indexFilename);
+    if (source.map == NULL)
+    {
+        source.index = index_load(fp);
+    }
     fclose(fp);
 
-    if (index == NULL)
+    if ((source.map == NULL && source.index == NULL) || numDeltas < 0)
     {
         printf("Failed to load index from %s\n", indexFilename);
+        indexmap_close(source.map);
+        if (source.index != NULL)
+        {
+            index_delete(source.index);
+        }
+        if (source.delta != NULL)
+        {
+            index_delete(source.delta);
+        }
         return 3;
     }
 
+    // Open the pages, to look up the URLs of the documents found
+    pagedir_t* pages = pagedir_open(pageDirectory);
+    if (pages == NULL)
+    {
+        printf("Failed to open pageDirectory %s\n", pageDirectory);
+        indexmap_close(source.map);
+        if (source.index != NULL)
+        {
+            index_delete(source.index);
+        }
+        if (source.delta != NULL)
+        {
+            index_delete(source.delta);
+        }
+        return 1;
+    }
+
     // Enter the main query processing loop
     char* query;
     while ((query = read_query()) != NULL)
     {
-        process_query(query, index, pageDirectory);
+        process_query(query, &source, pages);
         free(query);
     }
 
     // Cleanup
-    index_delete(index);
+    pagedir_close(pages);
+    indexmap_close(source.map);
+    if (source.index != NULL)
+    {
+        index_delete(source.index);
+    }
+    if (source.delta != NULL)
+    {
+        index_delete(source.delta);
+    }
     return 0;
 }
 
@@ -257,7 +329,7 @@ bool validate_query(char** tokens, int numTokens)
  * that match the query based on 'and'/'or' operators. The matching documents are then sorted
  * by score and printed.
  */
-void process_query(char* query, index_t* index, const char* pageDirectory)
+void process_query(char* query, source_t* source, pagedir_t* pages)
 {
     int numTokens;
     char** tokens = tokenize_query(query, &numTokens);                  // Tokenize the query
@@ -302,15 +374,16 @@ void process_query(char* query, index_t* index, const char* pageDirectory)
                 temp = NULL;
             }
         } else {
-            counters_t* word_counters = index_find(index, tokens[i]);
+            counters_t* word_counters = find_word(source, tokens[i]);
             if (word_counters != NULL)
             {
                 if (temp == NULL)
                 {
-                    temp = counters_copy(word_counters);
+                    temp = word_counters;
                 } else {
                     counters_t* new_temp = counters_intersect(temp, word_counters);
                     counters_delete(temp);
+                    counters_delete(word_counters);
                     temp = new_temp;
                 }
             }
@@ -364,7 +437,7 @@ void process_query(char* query, index_t* index, const char* pageDirectory)
         printf("Matches %d documents (ranked):\n", size);
         for (int i = 0; i < size; i++) 
         {
-            print_query((void*)pageDirectory, results[i].docID, results[i].score);
+            print_query(pages, results[i].docID, results[i].score);
         }
 
         free(results);
@@ -380,16 +453,16 @@ void process_query(char* query, index_t* index, const char* pageDirectory)
 /*
  * print_query: Prints the results of a query search, showing the score, document ID, and URL.
  *
- * The function takes in a page directory, document ID, and score as arguments.
- * It constructs the file path for the document, retrieves the URL from the file, and prints the results.
+ * The function takes in an open page directory, document ID, and score as arguments.
+ * It retrieves the URL of the document from the page directory, and prints the results.
  * The function ensures that valid results with scores greater than 0 are printed.
  */
 void print_query(void* arg, const int key, const int count) 
 {
     if (count > 0) 
     {
-        const char* pageDirectory = arg;
-        char* url = getURL(key, pageDirectory);
+        pagedir_t* pages = arg;
+        char* url = getURL(key, pages);
         if (url != NULL) 
         {
             printf("score\t%d doc\t%d: %s\n", count, key, url);
@@ -457,6 +530,37 @@ counters_t* counters_copy(counters_t *counters)
     return new_counters;
 }
 
+/*
+ * find_word: Finds a word's postings in the index queried.
+ *
+ * From a mapped index, the word's postings are decoded into a new counters set;
+ * from a loaded index, they are copied. Those in the delta segments are then set
+ * over them. The function returns the counters set, which the caller must delete,
+ * or NULL if the word is in neither.
+ */
+counters_t* find_word(source_t* source, const char* word)
+{
+    counters_t* counters;
+    if (source->map != NULL)
+    {
+        int i = indexmap_find(source->map, word);
+        counters = (i >= 0) ? indexmap_counters(source->map, i) : NULL;
+    } else {
+        counters = counters_copy(index_find(source->index, (char*) word));
+    }
+
+    counters_t* delta = (source->delta != NULL) ? index_find(source->delta, (char*) word) : NULL;
+    if (delta != NULL && counters == NULL)
+    {
+        counters = counters_new();
+    }
+    if (delta != NULL && counters != NULL)
+    {
+        counters_iterate(delta, counters, copy_counter);
+    }
+    return counters;
+}
+
 /*
  * intersect_counters: Helper function for counters_intersect, performs intersection on two counters.
  *
@@ -561,41 +665,19 @@ void sort_helper(void *arg, const int key, int count)
 }
 
 /*
- * getURL: Retrieves the URL of a document from its file in the page directory.
+ * getURL: Retrieves the URL of a document from the page directory.
  *
- * The function constructs the file path of the document using the page directory and document ID,
- * opens the file, reads the URL from the first line of the file, and returns the URL as a string.
+ * The function looks the document up by its ID, whether it is saved as a file of its own
+ * or packed in a segment, and returns its URL as a string the caller must free.
  * The function returns NULL on error and prints an error message.
  */
-char* getURL(int docID, const char* pageDirectory)
+char* getURL(int docID, pagedir_t* pages)
 {
-    char filePath[100];
-    sprintf(filePath, "%s/%d", pageDirectory, docID);
-
-    FILE* file = fopen(filePath, "r");
-    if (file == NULL) 
+    char* url = pagedir_getURL(pages, docID);
+    if (url == NULL) 
     {
-        fprintf(stderr, "Failed to open file %s\n", filePath);
-        return NULL;
+        fprintf(stderr, "Failed to read URL of document %d\n", docID);
     }
-
-    char* url = NULL;
-    size_t len = 0;
-    if (getline(&url, &len, file) == -1) 
-    {
-        fprintf(stderr, "Failed to read URL from file %s\n", filePath);
-        free(url);
-        fclose(file);
-        return NULL;
-    }
-
-    size_t url_len = strlen(url);
-    if (url_len > 0 && url[url_len - 1] == '\n') 
-    {
-        url[url_len - 1] = '\0';
-    }
-
-    fclose(file);
     return url;
 }
 
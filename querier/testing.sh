@@ -39,6 +39,25 @@ echo "====================================================="
 ./querier ../crawler/data/wikipedia-0 ../indexer/data/wikipedia-0.index < valid_query.txt
 ./querier ../crawler/data/wikipedia-1 ../indexer/data/wikipedia-1.index < valid_query.txt
 
+echo "====================================================="
+echo "Testing valid queries on a binary index, mapped in place..."
+echo "====================================================="
+../indexer/indextest -b ../indexer/data/letters-10.index ../indexer/data/letters-10.bin
+diff <(./querier ../crawler/data/letters-10 ../indexer/data/letters-10.index < valid_query.txt) \
+     <(./querier ../crawler/data/letters-10 ../indexer/data/letters-10.bin < valid_query.txt) && echo "Same results from the binary index"
+
+echo "====================================================="
+echo "Testing valid queries on a binary index with a delta segment..."
+echo "====================================================="
+rm -rf ../indexer/data/letters-10-delta && cp -r ../crawler/data/letters-10 ../indexer/data/letters-10-delta
+mkdir -p ../indexer/data/held && mv ../indexer/data/letters-10-delta/[7-9] ../indexer/data/held
+../indexer/indexer ../indexer/data/letters-10-delta ../indexer/data/letters-10-delta.index
+../indexer/indextest -b ../indexer/data/letters-10-delta.index ../indexer/data/letters-10-delta.bin
+mv ../indexer/data/held/* ../indexer/data/letters-10-delta && rmdir ../indexer/data/held
+../indexer/indexer --update ../indexer/data/letters-10-delta ../indexer/data/letters-10-delta.bin
+diff <(./querier ../crawler/data/letters-10 ../indexer/data/letters-10.index < valid_query.txt) \
+     <(./querier ../crawler/data/letters-10 ../indexer/data/letters-10-delta.bin < valid_query.txt) && echo "Same results from the index and its delta segment"
+
 echo "====================================================="
 echo "Testing invalid queries from invalid_query.txt..."
 echo "====================================================="